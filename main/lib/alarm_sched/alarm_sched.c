@@ -0,0 +1,568 @@
+#include "alarm_sched.h"
+#include "calendar.h"
+#include "tz.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "alarm_sched";
+
+// NVS configuration
+// Note: Use independent namespace "alarms", one blob per alarm so insert/cancel only touch one key
+#define NVS_NAMESPACE_ALARMS   "alarms"
+#define NVS_KEY_PREFIX         "a"
+
+#define ALARM_MAX_SLOTS        0xFFFF
+#define SLOT_FREE              -1
+
+// Persisted alarm record
+typedef struct {
+    alarm_id_t id;
+    alarm_spec_t spec;
+} alarm_record_t;
+
+// Scheduler slot (slot index is encoded in the alarm ID)
+typedef struct {
+    alarm_spec_t spec;
+    uint32_t next_fire;   // Seconds since 2000-01-01 UTC (RTC time base)
+    uint16_t gen;         // Incremented on reuse so stale IDs don't match
+    uint16_t next_free;   // Free list link (valid when heap_pos == SLOT_FREE)
+    int32_t heap_pos;     // Position in s_heap, SLOT_FREE if unused
+} alarm_slot_t;
+
+static ds3231_t *s_ds3231 = NULL;
+static gpio_num_t s_int_pin = GPIO_NUM_NC;
+static alarm_fire_cb_t s_fire_cb = NULL;
+static void *s_fire_ctx = NULL;
+static SemaphoreHandle_t s_lock = NULL;
+
+static alarm_slot_t *s_slots = NULL;   // Slot storage (grows on demand)
+static uint16_t *s_heap = NULL;        // Min-heap of slot indices keyed by next_fire
+static size_t s_capacity = 0;
+static size_t s_count = 0;             // Entries in heap
+static uint32_t s_free_head = ALARM_MAX_SLOTS;  // Head of free slot list
+
+static volatile bool s_irq_pending = false;
+static bool s_check_due = false;       // Process due alarms even without a hardware flag
+static bool s_reschedule = false;      // Fire times not yet computed from a valid RTC time
+static uint32_t s_armed[2] = {0, 0};   // Fire times programmed into alarm 1 / alarm 2 (0 = disabled)
+
+// Read RTC as seconds since 2000-01-01
+static bool alarm_read_now(uint32_t *now)
+{
+    ds3231_time_t t;
+    if (!ds3231_read_time(s_ds3231, &t) || !cal_ds3231_valid(&t)) {
+        return false;
+    }
+    *now = (uint32_t)(cal_epoch_from_ds3231(&t) - CAL_EPOCH_2000);
+    return true;
+}
+
+// Convert seconds since 2000-01-01 to DS3231 time
+static void alarm_to_rtc_time(uint32_t seconds, ds3231_time_t *t)
+{
+    cal_ds3231_from_epoch(CAL_EPOCH_2000 + seconds, t);  // Always in range: 2000 + 2^32 s < 2199
+}
+
+// Next fire time strictly after 'now' (recurring alarms, local wall time), or the fixed time (one-shot)
+static uint32_t alarm_next_fire(const alarm_spec_t *spec, uint32_t now)
+{
+    if (spec->weekdays == 0) {
+        return spec->at;
+    }
+    int64_t now_utc = CAL_EPOCH_2000 + now;
+    uint32_t tod = spec->hour * 3600UL + spec->minute * 60UL + spec->second;
+    uint32_t now_tod;
+    int32_t day = cal_split_epoch(tz_utc_to_local(now_utc), &now_tod);  // Local day
+    for (int32_t k = 0; k <= 7; k++) {
+        int32_t d = day + k;
+        if (!(spec->weekdays & (1 << cal_weekday(d)))) {
+            continue;
+        }
+        int64_t t = tz_local_to_utc((int64_t)d * CAL_SECONDS_PER_DAY + tod);
+        if (t > now_utc) {
+            return (uint32_t)(t - CAL_EPOCH_2000);
+        }
+    }
+    return UINT32_MAX;  // Unreachable with a non-empty mask
+}
+
+static inline alarm_id_t slot_to_id(uint32_t slot)
+{
+    return ((alarm_id_t)s_slots[slot].gen << 16) | (slot + 1);
+}
+
+// Heap helpers (ordered by next_fire, ties broken by slot index for determinism)
+static inline bool heap_less(size_t a, size_t b)
+{
+    const alarm_slot_t *sa = &s_slots[s_heap[a]];
+    const alarm_slot_t *sb = &s_slots[s_heap[b]];
+    return sa->next_fire < sb->next_fire ||
+           (sa->next_fire == sb->next_fire && s_heap[a] < s_heap[b]);
+}
+
+static inline void heap_swap(size_t a, size_t b)
+{
+    uint16_t tmp = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = tmp;
+    s_slots[s_heap[a]].heap_pos = (int32_t)a;
+    s_slots[s_heap[b]].heap_pos = (int32_t)b;
+}
+
+static void heap_sift_up(size_t i)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_less(i, parent)) {
+            break;
+        }
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void heap_sift_down(size_t i)
+{
+    for (;;) {
+        size_t left = 2 * i + 1;
+        size_t smallest = i;
+        if (left < s_count && heap_less(left, smallest)) {
+            smallest = left;
+        }
+        if (left + 1 < s_count && heap_less(left + 1, smallest)) {
+            smallest = left + 1;
+        }
+        if (smallest == i) {
+            break;
+        }
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void heap_push(uint32_t slot)
+{
+    s_heap[s_count] = (uint16_t)slot;
+    s_slots[slot].heap_pos = (int32_t)s_count;
+    s_count++;
+    heap_sift_up(s_count - 1);
+}
+
+static void heap_remove(size_t pos)
+{
+    s_count--;
+    if (pos != s_count) {
+        heap_swap(pos, s_count);
+        heap_sift_down(pos);
+        heap_sift_up(pos);
+    }
+}
+
+// Grow slot and heap arrays to hold at least 'needed' slots
+static bool alarm_reserve(size_t needed)
+{
+    if (needed <= s_capacity) {
+        return true;
+    }
+    if (needed > ALARM_MAX_SLOTS) {
+        return false;
+    }
+
+    size_t new_capacity = s_capacity ? s_capacity * 2 : 8;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > ALARM_MAX_SLOTS) {
+        new_capacity = ALARM_MAX_SLOTS;
+    }
+
+    alarm_slot_t *slots = realloc(s_slots, new_capacity * sizeof(alarm_slot_t));
+    if (!slots) {
+        return false;
+    }
+    s_slots = slots;
+    uint16_t *heap = realloc(s_heap, new_capacity * sizeof(uint16_t));
+    if (!heap) {
+        return false;
+    }
+    s_heap = heap;
+
+    // Chain new slots into the free list (lowest index first)
+    for (size_t i = new_capacity; i-- > s_capacity;) {
+        memset(&s_slots[i], 0, sizeof(alarm_slot_t));
+        s_slots[i].heap_pos = SLOT_FREE;
+        s_slots[i].next_free = (uint16_t)s_free_head;
+        s_free_head = (uint32_t)i;
+    }
+    s_capacity = new_capacity;
+    return true;
+}
+
+// Unlink a specific slot from the free list (only used when restoring persisted alarms)
+static void alarm_take_free_slot(uint32_t slot)
+{
+    uint32_t prev = ALARM_MAX_SLOTS;
+    for (uint32_t cur = s_free_head; cur != ALARM_MAX_SLOTS; cur = s_slots[cur].next_free) {
+        if (cur == slot) {
+            if (prev == ALARM_MAX_SLOTS) {
+                s_free_head = s_slots[cur].next_free;
+            } else {
+                s_slots[prev].next_free = s_slots[cur].next_free;
+            }
+            return;
+        }
+        prev = cur;
+    }
+}
+
+static void alarm_release_slot(uint32_t slot)
+{
+    s_slots[slot].heap_pos = SLOT_FREE;
+    s_slots[slot].gen++;
+    s_slots[slot].next_free = (uint16_t)s_free_head;
+    s_free_head = slot;
+}
+
+// NVS: persist one alarm
+static void alarm_persist(uint32_t slot)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_ALARMS, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    snprintf(key, sizeof(key), NVS_KEY_PREFIX "%04" PRIx32, slot);
+    alarm_record_t record = {
+        .id = slot_to_id(slot),
+        .spec = s_slots[slot].spec,
+    };
+    err = nvs_set_blob(nvs_handle, key, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error saving alarm %s: %s", key, esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+}
+
+// NVS: remove one alarm
+static void alarm_unpersist(uint32_t slot)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_ALARMS, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    snprintf(key, sizeof(key), NVS_KEY_PREFIX "%04" PRIx32, slot);
+    if (nvs_erase_key(nvs_handle, key) == ESP_OK) {
+        nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+}
+
+// NVS: restore all alarms
+static void alarm_load_all(uint32_t now)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_ALARMS, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;  // Namespace doesn't exist yet
+    }
+
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_NAMESPACE_ALARMS, NVS_TYPE_BLOB, &it);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+
+        alarm_record_t record;
+        size_t size = sizeof(record);
+        if (nvs_get_blob(nvs_handle, info.key, &record, &size) == ESP_OK && size == sizeof(record)) {
+            uint32_t slot = (record.id & 0xFFFF) - 1;
+            if ((record.id & 0xFFFF) != 0 && alarm_reserve(slot + 1) && s_slots[slot].heap_pos == SLOT_FREE) {
+                alarm_take_free_slot(slot);
+                s_slots[slot].spec = record.spec;
+                s_slots[slot].gen = (uint16_t)(record.id >> 16);
+                s_slots[slot].next_fire = alarm_next_fire(&record.spec, now);
+                heap_push(slot);
+            }
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    nvs_close(nvs_handle);
+}
+
+// Recompute every fire time from 'now' (lock held)
+static void alarm_reschedule_all(uint32_t now)
+{
+    for (size_t i = 0; i < s_count; i++) {
+        alarm_slot_t *slot = &s_slots[s_heap[i]];
+        slot->next_fire = alarm_next_fire(&slot->spec, now);
+    }
+    // Rebuild heap bottom-up
+    for (size_t i = s_count / 2; i-- > 0;) {
+        heap_sift_down(i);
+    }
+    s_armed[0] = s_armed[1] = 0;  // Force reprogramming
+    s_reschedule = false;
+}
+
+// Program the two nearest alarms into the DS3231
+static void alarm_arm_hardware(void)
+{
+    if (s_reschedule) {
+        return;  // Fire times are not known yet, armed at the first good RTC read
+    }
+    uint32_t want[2] = {0, 0};
+    if (s_count > 0) {
+        want[0] = s_slots[s_heap[0]].next_fire;
+    }
+    if (s_count > 1) {
+        // Second smallest is one of the root's children
+        size_t second = (s_count > 2 && heap_less(2, 1)) ? 2 : 1;
+        want[1] = s_slots[s_heap[second]].next_fire;
+    }
+
+    if (want[0] == s_armed[0] && want[1] == s_armed[1]) {
+        return;
+    }
+
+    ds3231_time_t t;
+    if (want[0] && want[0] != s_armed[0]) {
+        alarm_to_rtc_time(want[0], &t);
+        ds3231_set_alarm1(s_ds3231, &t);
+    }
+    if (want[1] && want[1] != s_armed[1]) {
+        // Alarm 2 has minute resolution: round down, the entry moves to alarm 1 before it is due
+        alarm_to_rtc_time(want[1], &t);
+        ds3231_set_alarm2(s_ds3231, &t);
+    }
+    ds3231_enable_alarm_interrupts(s_ds3231, want[0] != 0, want[1] != 0);
+    s_armed[0] = want[0];
+    s_armed[1] = want[1];
+    ESP_LOGD(TAG, "Armed alarm1=%" PRIu32 " alarm2=%" PRIu32, want[0], want[1]);
+}
+
+static void IRAM_ATTR alarm_isr_handler(void *arg)
+{
+    s_irq_pending = true;
+}
+
+esp_err_t alarm_sched_init(ds3231_t *ds3231, gpio_num_t int_pin, alarm_fire_cb_t cb, void *ctx)
+{
+    if (!ds3231) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_ds3231 = ds3231;
+    s_int_pin = int_pin;
+    s_fire_cb = cb;
+    s_fire_ctx = ctx;
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    uint32_t now = 0;
+    bool now_ok = alarm_read_now(&now);
+    if (!now_ok) {
+        ESP_LOGW(TAG, "Cannot read RTC time, alarms are rescheduled at the first good read");
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    alarm_load_all(now);
+    s_reschedule = !now_ok;
+    s_check_due = true;  // Fire one-shot alarms that expired while powered off
+    xSemaphoreGive(s_lock);
+
+    if (s_int_pin != GPIO_NUM_NC) {
+        // INT/SQW is open-drain, active low
+        gpio_config_t io_conf = {
+            .pin_bit_mask = 1ULL << s_int_pin,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_NEGEDGE,
+        };
+        ESP_ERROR_CHECK(gpio_config(&io_conf));
+        esp_err_t ret = gpio_install_isr_service(0);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {  // Already installed is fine
+            ESP_LOGE(TAG, "Failed to install GPIO ISR service: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        gpio_isr_handler_add(s_int_pin, alarm_isr_handler, NULL);
+        s_irq_pending = true;  // Flags may already be set
+    }
+
+    ESP_LOGI(TAG, "Alarm scheduler initialized: %d alarms, %s", (int)s_count,
+             s_int_pin != GPIO_NUM_NC ? "interrupt driven" : "polling status flags");
+    alarm_sched_service();
+    return ESP_OK;
+}
+
+esp_err_t alarm_sched_add(const alarm_spec_t *spec, alarm_id_t *id)
+{
+    if (!spec || !s_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (spec->weekdays & ~ALARM_EVERY_DAY || spec->hour > 23 || spec->minute > 59 || spec->second > 59) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t now = 0;
+    if (spec->weekdays != 0 && !alarm_read_now(&now)) {
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_free_head == ALARM_MAX_SLOTS && !alarm_reserve(s_capacity + 1)) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t slot = s_free_head;
+    s_free_head = s_slots[slot].next_free;
+    s_slots[slot].spec = *spec;
+    s_slots[slot].next_fire = alarm_next_fire(spec, now);
+    heap_push(slot);
+    alarm_id_t new_id = slot_to_id(slot);
+
+    alarm_persist(slot);
+    alarm_arm_hardware();
+    xSemaphoreGive(s_lock);
+
+    if (id) {
+        *id = new_id;
+    }
+    ESP_LOGI(TAG, "Alarm 0x%08" PRIx32 " added (action %d)", new_id, spec->action);
+    return ESP_OK;
+}
+
+esp_err_t alarm_sched_cancel(alarm_id_t id)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t slot = (id & 0xFFFF) - 1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if ((id & 0xFFFF) == 0 || slot >= s_capacity || s_slots[slot].heap_pos == SLOT_FREE ||
+        s_slots[slot].gen != (uint16_t)(id >> 16)) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    heap_remove((size_t)s_slots[slot].heap_pos);
+    alarm_release_slot(slot);
+    alarm_unpersist(slot);
+    alarm_arm_hardware();
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Alarm 0x%08" PRIx32 " cancelled", id);
+    return ESP_OK;
+}
+
+size_t alarm_sched_count(void)
+{
+    return s_count;
+}
+
+void alarm_sched_service(void)
+{
+    if (!s_lock) {
+        return;
+    }
+    if (s_int_pin != GPIO_NUM_NC && !s_irq_pending && !s_check_due) {
+        return;  // No interrupt: nothing to do, no I2C traffic
+    }
+    s_irq_pending = false;
+
+    uint8_t flags = 0;
+    if (!ds3231_get_alarm_flags(s_ds3231, &flags)) {
+        return;
+    }
+    if (flags == 0 && !s_check_due) {
+        return;
+    }
+    if (flags) {
+        ds3231_clear_alarm_flags(s_ds3231, flags);
+    }
+    s_check_due = false;
+
+    uint32_t now;
+    if (!alarm_read_now(&now)) {
+        s_check_due = true;  // Retry on next call
+        return;
+    }
+
+    // Fire times loaded without a valid RTC time are recomputed before anything is considered due
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_reschedule) {
+        alarm_reschedule_all(now);
+        ESP_LOGI(TAG, "Alarms rescheduled from the RTC time");
+    }
+    xSemaphoreGive(s_lock);
+
+    // Fire due alarms one at a time so the callback may add or cancel alarms
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_count == 0 || s_slots[s_heap[0]].next_fire > now) {
+            alarm_arm_hardware();
+            xSemaphoreGive(s_lock);
+            break;
+        }
+
+        uint32_t slot = s_heap[0];
+        alarm_id_t id = slot_to_id(slot);
+        alarm_spec_t spec = s_slots[slot].spec;
+        if (spec.weekdays != 0) {
+            // Recurring: move to next occurrence
+            s_slots[slot].next_fire = alarm_next_fire(&spec, now);
+            heap_sift_down(0);
+        } else {
+            heap_remove(0);
+            alarm_release_slot(slot);
+            alarm_unpersist(slot);
+        }
+        xSemaphoreGive(s_lock);
+
+        ESP_LOGI(TAG, "Alarm 0x%08" PRIx32 " fired (action %d)", id, spec.action);
+        if (s_fire_cb) {
+            s_fire_cb(id, &spec, s_fire_ctx);
+        }
+    }
+}
+
+void alarm_sched_time_changed(void)
+{
+    if (!s_lock) {
+        return;
+    }
+
+    uint32_t now;
+    bool now_ok = alarm_read_now(&now);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (now_ok) {
+        alarm_reschedule_all(now);
+    } else {
+        s_reschedule = true;  // Done by alarm_sched_service() at the first good read
+    }
+    s_check_due = true;
+    xSemaphoreGive(s_lock);
+
+    alarm_sched_service();
+}
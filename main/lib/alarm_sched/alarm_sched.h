@@ -0,0 +1,110 @@
+#ifndef ALARM_SCHED_H
+#define ALARM_SCHED_H
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "ds3231.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Weekday mask bits (same order as DS3231 day register: bit0 = Sunday)
+#define ALARM_SUNDAY     (1 << 0)
+#define ALARM_MONDAY     (1 << 1)
+#define ALARM_TUESDAY    (1 << 2)
+#define ALARM_WEDNESDAY  (1 << 3)
+#define ALARM_THURSDAY   (1 << 4)
+#define ALARM_FRIDAY     (1 << 5)
+#define ALARM_SATURDAY   (1 << 6)
+#define ALARM_WEEKDAYS   (ALARM_MONDAY | ALARM_TUESDAY | ALARM_WEDNESDAY | ALARM_THURSDAY | ALARM_FRIDAY)
+#define ALARM_EVERY_DAY  0x7F
+
+// Alarm identifier (0 is never a valid ID)
+typedef uint32_t alarm_id_t;
+#define ALARM_ID_INVALID 0
+
+// Alarm definition
+// weekdays == 0: one-shot alarm at 'at' (seconds since 2000-01-01 00:00:00 UTC, RTC time base)
+// weekdays != 0: recurring alarm at hour:minute:second local time (see tz.h) on every day in the mask
+typedef struct {
+    uint32_t at;          // One-shot fire time (ignored for recurring alarms)
+    uint8_t hour;         // 0-23 (recurring alarms)
+    uint8_t minute;       // 0-59 (recurring alarms)
+    uint8_t second;       // 0-59 (recurring alarms)
+    uint8_t weekdays;     // Weekday mask, 0 for one-shot
+    uint8_t action;       // Application-defined action code
+    uint8_t arg;          // Application-defined argument
+    uint8_t reserved[2];
+} alarm_spec_t;
+
+// Alarm fired callback (called from alarm_sched_service() context)
+typedef void (*alarm_fire_cb_t)(alarm_id_t id, const alarm_spec_t *spec, void *ctx);
+
+/**
+ * @brief Initialize alarm scheduler and load persisted alarms from NVS
+ *
+ * Must be called after nvs_flash_init() and ds3231_init(). Alarms are
+ * multiplexed onto the DS3231 hardware alarms: the nearest entry is
+ * programmed into alarm 1, the next one into alarm 2. If the RTC cannot be
+ * read, nothing is armed or fired until alarm_sched_service() gets a valid
+ * time and recomputes every fire time from it.
+ *
+ * @param ds3231 DS3231 device
+ * @param int_pin GPIO connected to DS3231 INT/SQW, or GPIO_NUM_NC to poll the status flags
+ * @param cb Callback invoked when an alarm fires
+ * @param ctx User context passed to the callback
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Failure
+ */
+esp_err_t alarm_sched_init(ds3231_t *ds3231, gpio_num_t int_pin, alarm_fire_cb_t cb, void *ctx);
+
+/**
+ * @brief Add an alarm (O(log n), persisted)
+ *
+ * @param spec Alarm definition
+ * @param id Output parameter for the new alarm ID (optional, can be NULL)
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid definition
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t alarm_sched_add(const alarm_spec_t *spec, alarm_id_t *id);
+
+/**
+ * @brief Cancel an alarm (O(log n), removed from NVS)
+ *
+ * @param id Alarm ID returned by alarm_sched_add()
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NOT_FOUND: No such alarm
+ */
+esp_err_t alarm_sched_cancel(alarm_id_t id);
+
+/**
+ * @brief Get number of scheduled alarms
+ */
+size_t alarm_sched_count(void);
+
+/**
+ * @brief Service fired alarms
+ *
+ * Cheap to call periodically: with an interrupt pin it returns immediately
+ * unless the pin fired, otherwise it reads the DS3231 status register once.
+ * Fires all due alarms, reschedules recurring ones and re-arms the hardware.
+ */
+void alarm_sched_service(void);
+
+/**
+ * @brief Recompute all fire times after the RTC time or the timezone was changed (e.g. NTP sync)
+ */
+void alarm_sched_time_changed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ALARM_SCHED_H
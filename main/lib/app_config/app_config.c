@@ -0,0 +1,279 @@
+#include "app_config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "app_config";
+
+// NVS configuration (keys of the former direct accesses in main.c, unchanged)
+#define NVS_NAMESPACE_TIME      "time_sync"
+#define NVS_KEY_LAST_SYNC       "last_sync"
+#define NVS_KEY_RTC_UTC         "rtc_utc"
+#define NVS_NAMESPACE_TZ        "tz_config"
+#define NVS_KEY_ZONE            "zone"
+#define NVS_NAMESPACE_FACE      "face_config"
+#define NVS_KEY_FACE            "face"
+
+// Dirty keys
+#define DIRTY_LAST_SYNC         (1 << 0)
+#define DIRTY_RTC_UTC           (1 << 1)
+#define DIRTY_ZONE              (1 << 2)
+#define DIRTY_FACE              (1 << 3)
+#define DIRTY_TIME_SYNC         (DIRTY_LAST_SYNC | DIRTY_RTC_UTC)
+
+typedef struct {
+    app_config_cb_t cb;
+    void *ctx;
+} app_config_subscriber_t;
+
+static app_config_t s_config;
+static SemaphoreHandle_t s_mutex = NULL;            // Guards s_config, s_dirty and the subscriber list
+static uint32_t s_dirty = 0;
+static int64_t s_dirty_us = 0;                      // Time of the last change not written back
+static app_config_subscriber_t s_subscribers[APP_CONFIG_MAX_SUBSCRIBERS];
+static size_t s_subscriber_count = 0;
+
+// Bump the generation and notify subscribers (called with s_mutex held, releases it)
+static void config_changed_unlock(uint32_t changed)
+{
+    s_config.generation++;
+    app_config_t snapshot = s_config;
+    app_config_subscriber_t subscribers[APP_CONFIG_MAX_SUBSCRIBERS];
+    size_t count = s_subscriber_count;
+    memcpy(subscribers, s_subscribers, sizeof(subscribers));
+    xSemaphoreGive(s_mutex);
+
+    for (size_t i = 0; i < count; i++) {
+        subscribers[i].cb(&snapshot, changed, subscribers[i].ctx);
+    }
+}
+
+esp_err_t app_config_init(void)
+{
+    if (s_mutex == NULL) {
+        s_mutex = xSemaphoreCreateMutex();
+        if (s_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    memset(&s_config, 0, sizeof(s_config));
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_TIME, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        int64_t last_sync = 0;
+        if (nvs_get_i64(nvs_handle, NVS_KEY_LAST_SYNC, &last_sync) == ESP_OK && last_sync > 0) {
+            s_config.last_sync = last_sync;
+        }
+        uint8_t rtc_utc = 0;
+        if (nvs_get_u8(nvs_handle, NVS_KEY_RTC_UTC, &rtc_utc) == ESP_OK) {
+            s_config.rtc_utc = rtc_utc != 0;
+        }
+        nvs_close(nvs_handle);
+    }
+    if (nvs_open(NVS_NAMESPACE_TZ, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        size_t len = sizeof(s_config.zone);
+        if (nvs_get_str(nvs_handle, NVS_KEY_ZONE, s_config.zone, &len) != ESP_OK) {
+            s_config.zone[0] = '\0';
+        }
+        nvs_close(nvs_handle);
+    }
+    if (nvs_open(NVS_NAMESPACE_FACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        size_t len = sizeof(s_config.face);
+        if (nvs_get_str(nvs_handle, NVS_KEY_FACE, s_config.face, &len) != ESP_OK) {
+            s_config.face[0] = '\0';
+        }
+        nvs_close(nvs_handle);
+    }
+    ESP_LOGI(TAG, "Loaded: last sync %lld, RTC %s, zone %s, face %s", (long long)s_config.last_sync,
+             s_config.rtc_utc ? "UTC" : "not migrated", s_config.zone[0] ? s_config.zone : "(default)",
+             s_config.face[0] ? s_config.face : "(default)");
+    return ESP_OK;
+}
+
+void app_config_get(app_config_t *config)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *config = s_config;
+    xSemaphoreGive(s_mutex);
+}
+
+uint32_t app_config_generation(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t generation = s_config.generation;
+    xSemaphoreGive(s_mutex);
+    return generation;
+}
+
+esp_err_t app_config_subscribe(app_config_cb_t cb, void *ctx)
+{
+    if (cb == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_subscriber_count < APP_CONFIG_MAX_SUBSCRIBERS) {
+        s_subscribers[s_subscriber_count].cb = cb;
+        s_subscribers[s_subscriber_count].ctx = ctx;
+        s_subscriber_count++;
+        ret = ESP_OK;
+    }
+    xSemaphoreGive(s_mutex);
+    return ret;
+}
+
+void app_config_set_last_sync(int64_t last_sync)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_config.last_sync == last_sync) {
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    s_config.last_sync = last_sync;
+    s_dirty |= DIRTY_LAST_SYNC;
+    s_dirty_us = esp_timer_get_time();
+    config_changed_unlock(APP_CONFIG_TIME_SYNC);
+}
+
+void app_config_set_rtc_utc(bool rtc_utc)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_config.rtc_utc == rtc_utc) {
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    s_config.rtc_utc = rtc_utc;
+    s_dirty |= DIRTY_RTC_UTC;
+    s_dirty_us = esp_timer_get_time();
+    config_changed_unlock(APP_CONFIG_TIME_SYNC);
+}
+
+esp_err_t app_config_set_zone(const char *zone)
+{
+    if (zone == NULL || zone[0] == '\0' || strlen(zone) >= sizeof(s_config.zone)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (strcmp(s_config.zone, zone) == 0) {
+        xSemaphoreGive(s_mutex);
+        return ESP_OK;
+    }
+    strcpy(s_config.zone, zone);
+    s_dirty |= DIRTY_ZONE;
+    s_dirty_us = esp_timer_get_time();
+    config_changed_unlock(APP_CONFIG_ZONE);
+    return ESP_OK;
+}
+
+esp_err_t app_config_set_face(const char *face)
+{
+    if (face == NULL || face[0] == '\0' || strlen(face) >= sizeof(s_config.face)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (strcmp(s_config.face, face) == 0) {
+        xSemaphoreGive(s_mutex);
+        return ESP_OK;
+    }
+    strcpy(s_config.face, face);
+    s_dirty |= DIRTY_FACE;
+    s_dirty_us = esp_timer_get_time();
+    config_changed_unlock(APP_CONFIG_FACE);
+    return ESP_OK;
+}
+
+void app_config_wifi_changed(uint8_t count)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_config.wifi_networks = count;
+    config_changed_unlock(APP_CONFIG_WIFI);
+}
+
+// Write the dirty keys of one namespace (single commit)
+static esp_err_t config_write(const char *ns, uint32_t dirty, const app_config_t *config)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(ns, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (dirty & DIRTY_LAST_SYNC) {
+        err = nvs_set_i64(nvs_handle, NVS_KEY_LAST_SYNC, config->last_sync);
+    }
+    if (err == ESP_OK && (dirty & DIRTY_RTC_UTC)) {
+        err = nvs_set_u8(nvs_handle, NVS_KEY_RTC_UTC, config->rtc_utc ? 1 : 0);
+    }
+    if (err == ESP_OK && (dirty & DIRTY_ZONE)) {
+        err = nvs_set_str(nvs_handle, NVS_KEY_ZONE, config->zone);
+    }
+    if (err == ESP_OK && (dirty & DIRTY_FACE)) {
+        err = nvs_set_str(nvs_handle, NVS_KEY_FACE, config->face);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+esp_err_t app_config_commit(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t dirty = s_dirty;
+    app_config_t config = s_config;
+    xSemaphoreGive(s_mutex);
+    if (dirty == 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (dirty & DIRTY_TIME_SYNC) {
+        err = config_write(NVS_NAMESPACE_TIME, dirty & DIRTY_TIME_SYNC, &config);
+    }
+    if (err == ESP_OK && (dirty & DIRTY_ZONE)) {
+        err = config_write(NVS_NAMESPACE_TZ, DIRTY_ZONE, &config);
+    }
+    if (err == ESP_OK && (dirty & DIRTY_FACE)) {
+        err = config_write(NVS_NAMESPACE_FACE, DIRTY_FACE, &config);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error saving configuration: %s", esp_err_to_name(err));
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_dirty_us = esp_timer_get_time();  // app_config_service() retries after the write-back delay
+        xSemaphoreGive(s_mutex);
+        return err;
+    }
+
+    // Keys changed again while writing stay dirty
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if ((dirty & DIRTY_LAST_SYNC) && s_config.last_sync == config.last_sync) {
+        s_dirty &= ~DIRTY_LAST_SYNC;
+    }
+    if ((dirty & DIRTY_RTC_UTC) && s_config.rtc_utc == config.rtc_utc) {
+        s_dirty &= ~DIRTY_RTC_UTC;
+    }
+    if ((dirty & DIRTY_ZONE) && strcmp(s_config.zone, config.zone) == 0) {
+        s_dirty &= ~DIRTY_ZONE;
+    }
+    if ((dirty & DIRTY_FACE) && strcmp(s_config.face, config.face) == 0) {
+        s_dirty &= ~DIRTY_FACE;
+    }
+    xSemaphoreGive(s_mutex);
+    ESP_LOGI(TAG, "Configuration saved (generation %" PRIu32 ")", config.generation);
+    return ESP_OK;
+}
+
+void app_config_service(void)
+{
+    if (s_dirty == 0) {
+        return;  // Unlocked peek: a change made right now is seen on the next call
+    }
+    if (esp_timer_get_time() - s_dirty_us >= APP_CONFIG_WRITEBACK_MS * 1000LL) {
+        app_config_commit();
+    }
+}
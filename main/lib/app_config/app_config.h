@@ -0,0 +1,138 @@
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In-RAM configuration cache
+//
+// The "time_sync", "tz_config" and "face_config" namespaces are read once at boot; reads are served from RAM
+// afterwards. Setters update the copy, bump the generation counter and notify subscribers.
+// Changed keys are written back together (one nvs_commit per namespace) by app_config_service()
+// once the settings have been quiet for APP_CONFIG_WRITEBACK_MS, or right away by
+// app_config_commit().
+//
+// WiFi credentials stay in the wifi_provisioning store (also loaded once at boot); it reports
+// changes here, so waiting for a new network needs no polling.
+
+#define APP_CONFIG_MAX_SUBSCRIBERS  4
+#define APP_CONFIG_WRITEBACK_MS     2000
+#define APP_CONFIG_ZONE_LEN         32      // TZ_NAME_MAX_LEN
+#define APP_CONFIG_FACE_LEN         16      // FACE_NAME_MAX_LEN
+
+// Changed sections (bit mask passed to subscribers)
+#define APP_CONFIG_TIME_SYNC    (1 << 0)
+#define APP_CONFIG_WIFI         (1 << 1)
+#define APP_CONFIG_ZONE         (1 << 2)
+#define APP_CONFIG_FACE         (1 << 3)
+
+typedef struct {
+    uint32_t generation;        // Incremented on every change
+    int64_t last_sync;          // UTC seconds of the last successful NTP sync (0 = never)
+    bool rtc_utc;               // DS3231 holds UTC (older firmware kept UTC+8)
+    uint8_t wifi_networks;      // Networks in the WiFi credential store
+    char zone[APP_CONFIG_ZONE_LEN];     // IANA timezone name (empty = TZ_DEFAULT_ZONE)
+    char face[APP_CONFIG_FACE_LEN];     // Clock face name (empty = FACE_DEFAULT)
+} app_config_t;
+
+// Called in the task that made the change, outside the cache lock: keep it short
+typedef void (*app_config_cb_t)(const app_config_t *config, uint32_t changed, void *ctx);
+
+/**
+ * @brief Load the configuration from NVS
+ *
+ * Must be called after nvs_flash_init() and before any other app_config function.
+ *
+ * @return
+ *    - ESP_OK: Success (missing keys keep their defaults)
+ *    - ESP_ERR_NO_MEM: Lock could not be created
+ */
+esp_err_t app_config_init(void);
+
+/**
+ * @brief Copy the current configuration
+ */
+void app_config_get(app_config_t *config);
+
+/**
+ * @brief Current generation (changes whenever any setting changes)
+ */
+uint32_t app_config_generation(void);
+
+/**
+ * @brief Register a change callback
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: cb is NULL
+ *    - ESP_ERR_NO_MEM: APP_CONFIG_MAX_SUBSCRIBERS reached
+ */
+esp_err_t app_config_subscribe(app_config_cb_t cb, void *ctx);
+
+/**
+ * @brief Set the last successful sync time (written back later)
+ */
+void app_config_set_last_sync(int64_t last_sync);
+
+/**
+ * @brief Set the RTC-holds-UTC flag (written back later)
+ */
+void app_config_set_rtc_utc(bool rtc_utc);
+
+/**
+ * @brief Set the timezone (written back later)
+ *
+ * The caller checks the name (tz_find_zone()); subscribers select it.
+ *
+ * @return
+ *    - ESP_OK: Success (also when unchanged)
+ *    - ESP_ERR_INVALID_ARG: NULL, empty or too long
+ */
+esp_err_t app_config_set_zone(const char *zone);
+
+/**
+ * @brief Set the clock face (written back later)
+ *
+ * The caller checks the name (face_find()); subscribers select it.
+ *
+ * @return
+ *    - ESP_OK: Success (also when unchanged)
+ *    - ESP_ERR_INVALID_ARG: NULL, empty or too long
+ */
+esp_err_t app_config_set_face(const char *face);
+
+/**
+ * @brief Report a change to the WiFi credential store (RAM only, the store persists itself)
+ *
+ * Subscribers are notified even if the count is unchanged (e.g. a password update).
+ *
+ * @param count Networks now stored
+ */
+void app_config_wifi_changed(uint8_t count);
+
+/**
+ * @brief Write all changed keys to NVS now (single commit)
+ *
+ * @return
+ *    - ESP_OK: Success, or nothing to write
+ *    - Others: NVS error (keys stay dirty and are retried)
+ */
+esp_err_t app_config_commit(void);
+
+/**
+ * @brief Write back changed keys once they have been quiet for APP_CONFIG_WRITEBACK_MS
+ *
+ * Call periodically (net task). Cheap when nothing is pending.
+ */
+void app_config_service(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_CONFIG_H
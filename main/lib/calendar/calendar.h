@@ -0,0 +1,228 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+// Header-only calendar arithmetic (proleptic Gregorian, no TZ, no libc time functions)
+// All functions are pure and side-effect free, so they can run on any task or in an ISR.
+// Day/epoch conversion uses the days_from_civil / civil_from_days algorithms by Howard Hinnant.
+
+#include "ds3231.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAL_SECONDS_PER_DAY     86400
+#define CAL_DAYS_1970_TO_2000   10957             // Days from 1970-01-01 to 2000-01-01
+#define CAL_EPOCH_2000          946684800LL       // Unix time of 2000-01-01 00:00:00
+
+// DS3231 representable range (century bit extends the 2-digit year to 2000-2199)
+#define CAL_DS3231_YEAR_MIN     2000
+#define CAL_DS3231_YEAR_MAX     2199
+
+// DS3231 register block layout (registers 0x00-0x06)
+#define CAL_DS3231_REG_COUNT    7
+#define CAL_DS3231_12H_BIT      0x40  // Hours register: 12-hour mode
+#define CAL_DS3231_PM_BIT       0x20  // Hours register: PM (12-hour mode only)
+#define CAL_DS3231_CENTURY_BIT  0x80  // Month register: century
+
+/**
+ * @brief Leap year test
+ */
+static inline bool cal_is_leap(int32_t y)
+{
+    return (y % 4 == 0) & ((y % 100 != 0) | (y % 400 == 0));
+}
+
+/**
+ * @brief Number of days in a month (m = 1-12)
+ */
+static inline uint32_t cal_days_in_month(int32_t y, uint32_t m)
+{
+    // 30/31 alternation folded into a bit mask, February patched for leap years
+    return m == 2 ? 28u + cal_is_leap(y) : 30u + ((0x15AAu >> m) & 1);
+}
+
+/**
+ * @brief Days since 1970-01-01 from a civil date
+ *
+ * @param y Year (any)
+ * @param m Month (1-12)
+ * @param d Day of month (1-31)
+ * @return Days since 1970-01-01 (negative before)
+ */
+static inline int32_t cal_days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = (uint32_t)(y - era * 400);                     // [0, 399]
+    const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1; // [0, 365]
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;          // [0, 146096]
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+/**
+ * @brief Civil date from days since 1970-01-01
+ *
+ * @param days Days since 1970-01-01
+ * @param y Output year
+ * @param m Output month (1-12)
+ * @param d Output day of month (1-31)
+ */
+static inline void cal_civil_from_days(int32_t days, int32_t *y, uint32_t *m, uint32_t *d)
+{
+    days += 719468;
+    const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(days - era * 146097);                        // [0, 146096]
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // [0, 399]
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);                // [0, 365]
+    const uint32_t mp = (5 * doy + 2) / 153;                                      // [0, 11]
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int32_t)yoe + era * 400 + (*m <= 2);
+}
+
+/**
+ * @brief Weekday from days since 1970-01-01
+ *
+ * @return 0=Sunday ... 6=Saturday (1970-01-01 was a Thursday)
+ */
+static inline uint32_t cal_weekday(int32_t days)
+{
+    int32_t w = (days + 4) % 7;
+    return (uint32_t)(w < 0 ? w + 7 : w);
+}
+
+/**
+ * @brief Unix time from civil date and time (no timezone applied)
+ */
+static inline int64_t cal_epoch_from_civil(int32_t y, uint32_t mon, uint32_t d,
+                                           uint32_t h, uint32_t min, uint32_t s)
+{
+    return (int64_t)cal_days_from_civil(y, mon, d) * CAL_SECONDS_PER_DAY +
+           (int64_t)(h * 3600 + min * 60 + s);
+}
+
+/**
+ * @brief Floor division of epoch seconds into days and second-of-day
+ */
+static inline int32_t cal_split_epoch(int64_t epoch, uint32_t *second_of_day)
+{
+    int64_t days = epoch / CAL_SECONDS_PER_DAY;
+    int64_t rem = epoch % CAL_SECONDS_PER_DAY;
+    if (rem < 0) {
+        rem += CAL_SECONDS_PER_DAY;
+        days--;
+    }
+    *second_of_day = (uint32_t)rem;
+    return (int32_t)days;
+}
+
+/**
+ * @brief BCD to binary
+ */
+static inline uint8_t cal_bcd_to_bin(uint8_t bcd)
+{
+    return (uint8_t)((bcd >> 4) * 10 + (bcd & 0x0F));
+}
+
+/**
+ * @brief Binary (0-99) to BCD
+ */
+static inline uint8_t cal_bin_to_bcd(uint8_t bin)
+{
+    return (uint8_t)(((bin / 10) << 4) | (bin % 10));
+}
+
+/**
+ * @brief Check that DS3231 time fields form a valid date and time
+ *
+ * Weekday is not checked; it is always derivable from the date.
+ */
+static inline bool cal_ds3231_valid(const ds3231_time_t *t)
+{
+    return t->year <= CAL_DS3231_YEAR_MAX - CAL_DS3231_YEAR_MIN &&
+           t->month >= 1 && t->month <= 12 &&
+           t->date >= 1 && t->date <= cal_days_in_month(2000 + t->year, t->month) &&
+           t->hours < 24 && t->minutes < 60 && t->seconds < 60;
+}
+
+/**
+ * @brief Unix time from DS3231 time fields (fields are taken as-is, no timezone applied)
+ */
+static inline int64_t cal_epoch_from_ds3231(const ds3231_time_t *t)
+{
+    return cal_epoch_from_civil(2000 + t->year, t->month, t->date, t->hours, t->minutes, t->seconds);
+}
+
+/**
+ * @brief DS3231 time fields from Unix time (including weekday, 1=Sunday)
+ *
+ * @return true if the time is within the DS3231 range (2000-2199)
+ */
+static inline bool cal_ds3231_from_epoch(int64_t epoch, ds3231_time_t *t)
+{
+    uint32_t sod;
+    int32_t days = cal_split_epoch(epoch, &sod);
+    int32_t y;
+    uint32_t m, d;
+    cal_civil_from_days(days, &y, &m, &d);
+    if (y < CAL_DS3231_YEAR_MIN || y > CAL_DS3231_YEAR_MAX) {
+        return false;
+    }
+    t->year = (uint8_t)(y - 2000);
+    t->month = (uint8_t)m;
+    t->date = (uint8_t)d;
+    t->day = (uint8_t)(cal_weekday(days) + 1);
+    t->hours = (uint8_t)(sod / 3600);
+    t->minutes = (uint8_t)(sod / 60 % 60);
+    t->seconds = (uint8_t)(sod % 60);
+    return true;
+}
+
+/**
+ * @brief Unpack DS3231 time registers 0x00-0x06
+ *
+ * Handles 12-hour mode and the century bit.
+ *
+ * @return true if the registers hold a valid date and time
+ */
+static inline bool cal_ds3231_unpack(const uint8_t regs[CAL_DS3231_REG_COUNT], ds3231_time_t *t)
+{
+    t->seconds = cal_bcd_to_bin(regs[0] & 0x7F);
+    t->minutes = cal_bcd_to_bin(regs[1] & 0x7F);
+    if (regs[2] & CAL_DS3231_12H_BIT) {
+        // 12-hour mode: 12 AM -> 0, 12 PM -> 12
+        uint8_t h12 = cal_bcd_to_bin(regs[2] & 0x1F);
+        t->hours = (uint8_t)(h12 % 12 + ((regs[2] & CAL_DS3231_PM_BIT) ? 12 : 0));
+    } else {
+        t->hours = cal_bcd_to_bin(regs[2] & 0x3F);
+    }
+    t->day = regs[3] & 0x07;
+    t->date = cal_bcd_to_bin(regs[4] & 0x3F);
+    t->month = cal_bcd_to_bin(regs[5] & 0x1F);
+    t->year = (uint8_t)(cal_bcd_to_bin(regs[6]) + ((regs[5] & CAL_DS3231_CENTURY_BIT) ? 100 : 0));
+    return cal_ds3231_valid(t);
+}
+
+/**
+ * @brief Pack DS3231 time registers 0x00-0x06 (24-hour mode, century bit for 2100-2199)
+ */
+static inline void cal_ds3231_pack(const ds3231_time_t *t, uint8_t regs[CAL_DS3231_REG_COUNT])
+{
+    uint8_t century = t->year >= 100;
+    regs[0] = cal_bin_to_bcd(t->seconds);
+    regs[1] = cal_bin_to_bcd(t->minutes);
+    regs[2] = cal_bin_to_bcd(t->hours);
+    regs[3] = t->day & 0x07;
+    regs[4] = cal_bin_to_bcd(t->date);
+    regs[5] = (uint8_t)(cal_bin_to_bcd(t->month) | (century ? CAL_DS3231_CENTURY_BIT : 0));
+    regs[6] = cal_bin_to_bcd((uint8_t)(t->year - (century ? 100 : 0)));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CALENDAR_H
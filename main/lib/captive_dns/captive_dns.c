@@ -0,0 +1,162 @@
+#include "captive_dns.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <errno.h>
+
+static const char *TAG = "captive_dns";
+
+#define DNS_PORT                53
+#define DNS_MAX_PACKET          512     // Plain UDP DNS without EDNS
+#define DNS_HEADER_SIZE         12
+#define DNS_ANSWER_SIZE         16      // Name pointer, type, class, TTL, length, IPv4 address
+#define DNS_RECV_TIMEOUT_MS     200     // Bounds how long captive_dns_stop() waits
+#define DNS_TASK_STACK_SIZE     3072    // Packet buffer lives on the stack
+
+// Header flags (RFC 1035, section 4.1.1)
+#define DNS_FLAG_QR             0x80    // Byte 2: response
+#define DNS_OPCODE_MASK         0x78    // Byte 2: opcode (0 = standard query)
+#define DNS_FLAG_AA             0x04    // Byte 2: authoritative answer
+#define DNS_FLAG_RD             0x01    // Byte 2: recursion desired (copied)
+
+#define DNS_TYPE_A              1
+#define DNS_TYPE_ANY            255
+#define DNS_CLASS_IN            1
+
+static TaskHandle_t s_task = NULL;
+static volatile bool s_stop = false;
+static uint32_t s_ip = 0;
+static int s_sock = -1;
+
+// Build the response to a query in place; returns its length, or 0 to ignore the packet
+static int dns_answer(uint8_t *buf, int len)
+{
+    if (len < DNS_HEADER_SIZE || (buf[2] & (DNS_FLAG_QR | DNS_OPCODE_MASK)) != 0 ||
+        buf[4] != 0 || buf[5] != 1) {
+        return 0;  // Not a standard query with exactly one question
+    }
+
+    // Skip the question name (labels only: queries do not use compression)
+    int pos = DNS_HEADER_SIZE;
+    while (pos < len && buf[pos] != 0) {
+        if (buf[pos] & 0xC0) {
+            return 0;
+        }
+        pos += buf[pos] + 1;
+    }
+    if (pos + 5 > len) {
+        return 0;
+    }
+    uint16_t qtype = (buf[pos + 1] << 8) | buf[pos + 2];
+    uint16_t qclass = (buf[pos + 3] << 8) | buf[pos + 4];
+    int end = pos + 5;  // Additional records (EDNS OPT) are dropped
+
+    buf[2] = DNS_FLAG_QR | DNS_FLAG_AA | (buf[2] & DNS_FLAG_RD);
+    buf[3] = 0;  // NOERROR
+    memset(&buf[6], 0, 6);  // ANCOUNT, NSCOUNT, ARCOUNT
+    if ((qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) && qclass == DNS_CLASS_IN) {
+        uint8_t *answer = &buf[end];
+        answer[0] = 0xC0;  // Pointer to the question name
+        answer[1] = DNS_HEADER_SIZE;
+        answer[2] = 0;
+        answer[3] = DNS_TYPE_A;
+        answer[4] = 0;
+        answer[5] = DNS_CLASS_IN;
+        answer[6] = 0;
+        answer[7] = 0;
+        answer[8] = (CAPTIVE_DNS_TTL_S >> 8) & 0xFF;
+        answer[9] = CAPTIVE_DNS_TTL_S & 0xFF;
+        answer[10] = 0;
+        answer[11] = 4;
+        memcpy(&answer[12], &s_ip, 4);  // Already in network byte order
+        buf[7] = 1;
+        end += DNS_ANSWER_SIZE;
+    }
+    return end;
+}
+
+// Responder task: one socket, one query at a time
+static void captive_dns_task(void *arg)
+{
+    uint8_t buf[DNS_MAX_PACKET + DNS_ANSWER_SIZE];
+    while (!s_stop) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(s_sock, buf, DNS_MAX_PACKET, 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGW(TAG, "recvfrom failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(DNS_RECV_TIMEOUT_MS));
+            }
+            continue;
+        }
+        int reply_len = dns_answer(buf, len);
+        if (reply_len > 0) {
+            sendto(s_sock, buf, reply_len, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+
+    close(s_sock);
+    s_sock = -1;
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t captive_dns_start(uint32_t ip)
+{
+    if (s_task != NULL) {
+        s_ip = ip;
+        return ESP_OK;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = DNS_RECV_TIMEOUT_MS * 1000,
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind port %d: errno %d", DNS_PORT, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    s_ip = ip;
+    s_sock = sock;
+    s_stop = false;
+    if (xTaskCreate(captive_dns_task, "captive_dns", DNS_TASK_STACK_SIZE, NULL,
+                    tskIDLE_PRIORITY + 2, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task");
+        close(sock);
+        s_sock = -1;
+        s_task = NULL;
+        return ESP_FAIL;
+    }
+    char ip_str[INET_ADDRSTRLEN];
+    struct in_addr in = {.s_addr = ip};
+    ESP_LOGI(TAG, "Answering DNS queries with %s", inet_ntop(AF_INET, &in, ip_str, sizeof(ip_str)));
+    return ESP_OK;
+}
+
+void captive_dns_stop(void)
+{
+    if (s_task == NULL) {
+        return;
+    }
+    s_stop = true;
+    while (s_task != NULL) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    ESP_LOGI(TAG, "Stopped");
+}
@@ -0,0 +1,41 @@
+#ifndef CAPTIVE_DNS_H
+#define CAPTIVE_DNS_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Captive-portal DNS responder for the provisioning SoftAP
+//
+// Answers every A query with the SoftAP address (other record types get an empty
+// NOERROR answer, so clients fall back to IPv4). Phones and laptops probe a known
+// URL after joining a network; resolving it to the clock and redirecting the probe
+// to the provisioning page makes the OS open the page on its own.
+
+#define CAPTIVE_DNS_TTL_S   60  // Short: clients re-resolve soon after the SoftAP goes away
+
+/**
+ * @brief Start answering DNS queries on UDP port 53
+ *
+ * @param ip Address returned for every query (network byte order, e.g. esp_netif_ip_info_t.ip.addr)
+ * @return
+ *    - ESP_OK: Success (or already running)
+ *    - ESP_FAIL: Socket or task creation failed
+ */
+esp_err_t captive_dns_start(uint32_t ip);
+
+/**
+ * @brief Stop the responder
+ *
+ * Blocks until the responder task has closed its socket (at most one receive timeout).
+ */
+void captive_dns_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPTIVE_DNS_H
@@ -0,0 +1,267 @@
+#include "dlog.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "dlog";
+
+// One recorded message (copied into the queue)
+typedef struct {
+    uint32_t timestamp;                 // esp_log_timestamp() when recorded
+    const char *tag;
+    const char *format;
+    uint8_t level;
+    uint8_t count;
+    uint8_t types[DLOG_MAX_ARGS];       // dlog_arg_type_t
+    uint64_t values[DLOG_MAX_ARGS];     // Raw bits; strings: offset into strings[]
+    char strings[DLOG_STRING_BYTES];
+} dlog_msg_t;
+
+static QueueHandle_t s_queue = NULL;
+static uint32_t s_queued = 0;
+static uint32_t s_dropped = 0;
+static uint32_t s_dropped_reported = 0;     // Only the dlog task reads and writes it
+static uint32_t s_max_depth = 0;
+
+// Format a message; length modifiers in the format are replaced, the argument type is known
+static void dlog_format(const dlog_msg_t *msg, char *out, size_t size)
+{
+    size_t len = 0;
+    int next = 0;
+    const char *p = msg->format;
+    while (*p != '\0' && len + 1 < size) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // "%" flags width precision, then our own length modifier and the conversion
+        char spec[24];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL && n < sizeof(spec) - 4) {
+            spec[n++] = *p++;
+        }
+        while (*p != '\0' && strchr("hlLqjzt", *p) != NULL) {
+            p++;
+        }
+        char conv = *p;
+        if (conv == '\0') {
+            break;
+        }
+        p++;
+
+        char *dst = out + len;
+        size_t room = size - len;
+        if (next >= msg->count) {
+            dst[0] = '?';
+            len++;
+            continue;
+        }
+        uint8_t type = msg->types[next];
+        uint64_t value = msg->values[next];
+        next++;
+
+        int written;
+        switch (conv) {
+            case 'd':
+            case 'i': {
+                long long v = type == DLOG_ARG_U64 ? (long long)value : (long long)(int32_t)(uint32_t)value;
+                memcpy(spec + n, "lld", 4);
+                written = snprintf(dst, room, spec, v);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o': {
+                unsigned long long v = type == DLOG_ARG_U64 ? value : (uint32_t)value;
+                spec[n] = 'l';
+                spec[n + 1] = 'l';
+                spec[n + 2] = conv;
+                spec[n + 3] = '\0';
+                written = snprintf(dst, room, spec, v);
+                break;
+            }
+            case 'c':
+                memcpy(spec + n, "c", 2);
+                written = snprintf(dst, room, spec, (int)(uint32_t)value);
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A': {
+                double v;
+                memcpy(&v, &value, sizeof(v));
+                spec[n] = conv;
+                spec[n + 1] = '\0';
+                written = snprintf(dst, room, spec, v);
+                break;
+            }
+            case 's':
+                memcpy(spec + n, "s", 2);
+                written = snprintf(dst, room, spec, type == DLOG_ARG_STR ? msg->strings + value : "?");
+                break;
+            case 'p':
+                written = snprintf(dst, room, "0x%08" PRIx32, (uint32_t)value);
+                break;
+            default:
+                written = snprintf(dst, room, "%%%c", conv);
+                break;
+        }
+        if (written < 0) {
+            break;
+        }
+        len += (size_t)written < room ? (size_t)written : room - 1;
+    }
+    out[len] = '\0';
+}
+
+// Print one message with the timestamp it was recorded at (same layout as ESP_LOGx)
+static void dlog_print(const dlog_msg_t *msg)
+{
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    static char text[DLOG_TEXT_MAX];    // Used by the dlog task, or by the caller before dlog_init()
+    dlog_format(msg, text, sizeof(text));
+    esp_log_write((esp_log_level_t)msg->level, msg->tag, "%c (%" PRIu32 ") %s: %s\n",
+                  letters[msg->level < sizeof(letters) ? msg->level : 0], msg->timestamp, msg->tag, text);
+}
+
+static void dlog_task(void *arg)
+{
+    dlog_msg_t msg;
+    while (1) {
+        xQueueReceive(s_queue, &msg, portMAX_DELAY);
+        uint32_t dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+        if (dropped != s_dropped_reported) {
+            ESP_LOGW(TAG, "%" PRIu32 " messages dropped (queue full)", dropped - s_dropped_reported);
+            s_dropped_reported = dropped;
+        }
+        dlog_print(&msg);
+    }
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, int count, const dlog_arg_t *args)
+{
+    dlog_msg_t msg;
+    msg.timestamp = esp_log_timestamp();
+    msg.tag = tag;
+    msg.format = format;
+    msg.level = (uint8_t)level;
+    msg.count = (uint8_t)(count < DLOG_MAX_ARGS ? count : DLOG_MAX_ARGS);
+
+    size_t used = 0;
+    for (int i = 0; i < msg.count; i++) {
+        msg.types[i] = args[i].type;
+        switch (args[i].type) {
+            case DLOG_ARG_U32:
+                msg.values[i] = args[i].u32;
+                break;
+            case DLOG_ARG_U64:
+                msg.values[i] = args[i].u64;
+                break;
+            case DLOG_ARG_F64:
+                memcpy(&msg.values[i], &args[i].f64, sizeof(double));
+                break;
+            case DLOG_ARG_PTR:
+                msg.values[i] = (uintptr_t)args[i].ptr;
+                break;
+            case DLOG_ARG_STR: {
+                // Copy what fits; an argument that gets no room at all prints as "?"
+                const char *str = args[i].str != NULL ? args[i].str : "(null)";
+                if (used + 1 >= sizeof(msg.strings)) {
+                    msg.types[i] = DLOG_ARG_U32;
+                    msg.values[i] = 0;
+                    break;
+                }
+                size_t copy = strnlen(str, sizeof(msg.strings) - used - 1);
+                memcpy(msg.strings + used, str, copy);
+                msg.strings[used + copy] = '\0';
+                msg.values[i] = used;
+                used += copy + 1;
+                break;
+            }
+        }
+    }
+
+    if (s_queue == NULL) {
+        dlog_print(&msg);
+        return;
+    }
+    __atomic_fetch_add(&s_queued, 1, __ATOMIC_RELAXED);
+    if (xQueueSend(s_queue, &msg, 0) != pdTRUE) {
+        __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint32_t depth = uxQueueMessagesWaiting(s_queue);
+    if (depth > s_max_depth) {
+        s_max_depth = depth;
+    }
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    stats->queued = __atomic_load_n(&s_queued, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&s_dropped, __ATOMIC_RELAXED);
+    stats->max_depth = s_max_depth;
+}
+
+#if DLOG_MEASURE
+// Time the same message through ESP_LOGI and DLOGI (the dlog task is idle-priority,
+// so the queued messages are printed after the measurement)
+static void dlog_measure(void)
+{
+    const int runs = 8;
+    long long diff = 123456;
+    long long hours = 720;
+    vTaskDelay(pdMS_TO_TICKS(100));  // Let boot messages drain from the UART FIFO
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < runs; i++) {
+        ESP_LOGI(TAG, "Last sync was %lld seconds ago (< %lld hours), skipping NTP sync", diff, hours);
+    }
+    int64_t direct_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < runs; i++) {
+        DLOGI(TAG, "Last sync was %lld seconds ago (< %lld hours), skipping NTP sync", diff, hours);
+    }
+    int64_t deferred_us = esp_timer_get_time() - start;
+
+    DLOGI(TAG, "Per call: ESP_LOGI %lld us, DLOGI %lld us",
+          (long long)(direct_us / runs), (long long)(deferred_us / runs));
+}
+#endif
+
+esp_err_t dlog_init(void)
+{
+    if (s_queue != NULL) {
+        return ESP_OK;
+    }
+    QueueHandle_t queue = xQueueCreate(DLOG_QUEUE_LEN, sizeof(dlog_msg_t));
+    if (queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_queue = queue;
+    if (xTaskCreate(dlog_task, "dlog", DLOG_TASK_STACK, NULL, DLOG_TASK_PRIORITY, NULL) != pdPASS) {
+        s_queue = NULL;
+        vQueueDelete(queue);
+        return ESP_ERR_NO_MEM;
+    }
+#if DLOG_MEASURE
+    dlog_measure();
+#endif
+    return ESP_OK;
+}
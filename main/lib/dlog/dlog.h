@@ -0,0 +1,145 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred logging
+//
+// DLOGE/W/I/D(TAG, fmt, ...) take the same arguments as ESP_LOGx, but only record the tag,
+// the format string pointer (its ID) and the raw arguments into a queue. The "dlog" task
+// (idle priority) formats and prints them later with the original timestamp, so call sites
+// on the per-second path neither format nor wait for the UART.
+//
+// - Up to DLOG_MAX_ARGS arguments: integers, floats/doubles, strings and pointers
+//   (classified at compile time; formats are still checked by the compiler); more is a compile error
+// - Strings are copied when the message is recorded (DLOG_STRING_BYTES per message, truncated)
+// - A full queue drops the message (never blocks); the count is printed with the next message
+// - Before dlog_init() and with DLOG_DEFERRED 0 messages are printed at once
+// - Field width/precision given as '*' is not supported; not for use in interrupts
+
+#define DLOG_DEFERRED       1       // 0 maps DLOGx to ESP_LOGx
+#define DLOG_QUEUE_LEN      16      // Messages waiting to be printed (about 120 bytes each)
+#define DLOG_MAX_ARGS       6
+#define DLOG_STRING_BYTES   48      // String arguments of one message, NUL terminated
+#define DLOG_TEXT_MAX       192     // Formatted message (longer ones are truncated)
+#define DLOG_TASK_STACK     3072
+#define DLOG_TASK_PRIORITY  0       // Runs when every other task waits (tskIDLE_PRIORITY)
+#define DLOG_MEASURE        0       // 1: time ESP_LOGI against DLOGI once in dlog_init() (not yet run on a device)
+
+typedef enum {
+    DLOG_ARG_U32,
+    DLOG_ARG_U64,
+    DLOG_ARG_F64,
+    DLOG_ARG_STR,
+    DLOG_ARG_PTR,
+} dlog_arg_type_t;
+
+typedef struct {
+    uint8_t type;               // dlog_arg_type_t
+    union {
+        uint32_t u32;
+        uint64_t u64;
+        double f64;
+        const char *str;
+        const void *ptr;
+    };
+} dlog_arg_t;
+
+typedef struct {
+    uint32_t queued;            // Messages recorded since boot
+    uint32_t dropped;           // Messages lost to a full queue
+    uint32_t max_depth;         // Largest queue depth seen
+} dlog_stats_t;
+
+/**
+ * @brief Create the queue and the formatting task
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NO_MEM: Queue or task could not be created
+ */
+esp_err_t dlog_init(void);
+
+/**
+ * @brief Record one message (use the DLOGx macros)
+ *
+ * @param level Log level
+ * @param tag Tag (must stay valid: the caller's static TAG)
+ * @param format Format string literal
+ * @param count Number of arguments
+ * @param args Arguments
+ */
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, int count, const dlog_arg_t *args);
+
+/**
+ * @brief Copy the queue statistics
+ */
+void dlog_get_stats(dlog_stats_t *stats);
+
+// Argument classification
+static inline dlog_arg_t dlog_arg_u32(uint32_t v) { dlog_arg_t a = {.type = DLOG_ARG_U32}; a.u32 = v; return a; }
+static inline dlog_arg_t dlog_arg_u64(uint64_t v) { dlog_arg_t a = {.type = DLOG_ARG_U64}; a.u64 = v; return a; }
+static inline dlog_arg_t dlog_arg_f64(double v) { dlog_arg_t a = {.type = DLOG_ARG_F64}; a.f64 = v; return a; }
+static inline dlog_arg_t dlog_arg_str(const char *v) { dlog_arg_t a = {.type = DLOG_ARG_STR}; a.str = v; return a; }
+static inline dlog_arg_t dlog_arg_ptr(const void *v) { dlog_arg_t a = {.type = DLOG_ARG_PTR}; a.ptr = v; return a; }
+static inline dlog_arg_t dlog_arg_long(long v) { return sizeof(long) > 4 ? dlog_arg_u64((uint64_t)v) : dlog_arg_u32((uint32_t)v); }
+static inline dlog_arg_t dlog_arg_ulong(unsigned long v) { return sizeof(long) > 4 ? dlog_arg_u64(v) : dlog_arg_u32((uint32_t)v); }
+
+#define DLOG_ARG(x) _Generic((x),                                       \
+    char *: dlog_arg_str, const char *: dlog_arg_str,                   \
+    float: dlog_arg_f64, double: dlog_arg_f64,                          \
+    long: dlog_arg_long, unsigned long: dlog_arg_ulong,                 \
+    long long: dlog_arg_u64, unsigned long long: dlog_arg_u64,          \
+    void *: dlog_arg_ptr, const void *: dlog_arg_ptr,                   \
+    default: dlog_arg_u32)(x)
+
+// Argument list (the format string is counted, so a message without arguments is handled)
+// 7 to 16 arguments count as 7, which DLOG_ARGS_7 turns into a compile error
+#define DLOG_COUNT(...)  DLOG_COUNT_(__VA_ARGS__, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_COUNT_(f, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, n, ...) n
+#define DLOG_CAT(a, b)   DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b)  a##b
+#define DLOG_ARGS_0(f)                          {{0}}
+#define DLOG_ARGS_1(f, a)                       {DLOG_ARG(a)}
+#define DLOG_ARGS_2(f, a, b)                    {DLOG_ARG(a), DLOG_ARG(b)}
+#define DLOG_ARGS_3(f, a, b, c)                 {DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c)}
+#define DLOG_ARGS_4(f, a, b, c, d)              {DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d)}
+#define DLOG_ARGS_5(f, a, b, c, d, e)           {DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e)}
+#define DLOG_ARGS_6(f, a, b, c, d, e, g)        {DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e), DLOG_ARG(g)}
+#define DLOG_ARGS_7(f, ...)                     \
+    {DLOG_ARG(sizeof(struct { _Static_assert(0, "DLOGx takes at most DLOG_MAX_ARGS (6) arguments"); int n; }))}
+#define DLOG_FIRST(f, ...) f
+
+// The dead printf() call keeps the compiler's format checking
+#define DLOG_LEVEL(level, tag, ...) do {                                                    \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                                   \
+            if (0) { printf(__VA_ARGS__); }                                                 \
+            const dlog_arg_t dlog_args_[] = DLOG_CAT(DLOG_ARGS_, DLOG_COUNT(__VA_ARGS__))(__VA_ARGS__); \
+            dlog_write((level), (tag), DLOG_FIRST(__VA_ARGS__, 0), DLOG_COUNT(__VA_ARGS__), dlog_args_); \
+        }                                                                                   \
+    } while (0)
+
+#if DLOG_DEFERRED
+#define DLOGE(tag, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, __VA_ARGS__)
+#define DLOGW(tag, ...) DLOG_LEVEL(ESP_LOG_WARN, tag, __VA_ARGS__)
+#define DLOGI(tag, ...) DLOG_LEVEL(ESP_LOG_INFO, tag, __VA_ARGS__)
+#define DLOGD(tag, ...) DLOG_LEVEL(ESP_LOG_DEBUG, tag, __VA_ARGS__)
+#else
+#define DLOGE(tag, ...) ESP_LOGE(tag, __VA_ARGS__)
+#define DLOGW(tag, ...) ESP_LOGW(tag, __VA_ARGS__)
+#define DLOGI(tag, ...) ESP_LOGI(tag, __VA_ARGS__)
+#define DLOGD(tag, ...) ESP_LOGD(tag, __VA_ARGS__)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DLOG_H
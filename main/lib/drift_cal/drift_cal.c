@@ -0,0 +1,261 @@
+#include "drift_cal.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <math.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "drift_cal";
+
+// NVS configuration
+// Note: Shares the "time_sync" namespace with main.c (last sync timestamp), using its own key
+#define NVS_NAMESPACE_TIME      "time_sync"
+#define NVS_KEY_DRIFT_HISTORY   "drift_hist"
+#define DRIFT_HISTORY_VERSION   2           // 2: per-sample resolution (version 1 samples are whole-second)
+
+// Sample acceptance
+#define DRIFT_CAL_MIN_INTERVAL_S        (6 * 3600)  // Shorter intervals are dominated by the offset resolution
+#define DRIFT_CAL_MAX_PPM               20.0f       // DS3231 is specified at ±2 ppm; larger values mean the RTC was reset
+#define DRIFT_CAL_MAX_SAMPLE_ERROR_PPM  1.0f        // Resolution over the interval; whole-second offsets need ~6 days
+#define DRIFT_CAL_MIN_SAMPLES           2           // Samples required before trimming or adapting the interval
+#define DRIFT_CAL_TRIM_MAX_UNCERTAINTY_PPM  1.0f    // Aging register is only written below this (1 LSB is ~0.1 ppm)
+#define DRIFT_CAL_V1_RESOLUTION_MS      1000        // Resolution assumed for samples of history version 1
+
+// Adaptive sync interval bounds
+#define DRIFT_CAL_MIN_SYNC_INTERVAL_S   (24 * 3600)         // 1 day
+#define DRIFT_CAL_MAX_SYNC_INTERVAL_S   (2160UL * 3600)     // 90 days
+
+// One (interval, offset) pair
+typedef struct {
+    uint32_t interval_s;  // Seconds since previous sync
+    int32_t offset_ms;    // RTC minus NTP, before correction
+    int8_t aging;         // Aging offset in effect during the interval
+    uint8_t reserved;
+    uint16_t resolution_ms;  // Offset measurement error bound (half-width)
+} drift_sample_t;
+
+// Persisted history (ring buffer)
+typedef struct {
+    uint8_t version;
+    uint8_t count;        // Valid samples (<= DRIFT_CAL_HISTORY_LEN)
+    uint8_t next;         // Next slot to write
+    int8_t aging;         // Aging offset last programmed by this module
+    uint8_t unverified;   // Set after a trim until the next sample confirms it
+    uint8_t reserved[3];
+    drift_sample_t samples[DRIFT_CAL_HISTORY_LEN];
+} drift_history_t;
+
+static drift_history_t s_history;
+static drift_cal_estimate_t s_estimate;
+
+// Recompute drift estimate from history
+static void drift_cal_update_estimate(void)
+{
+    memset(&s_estimate, 0, sizeof(s_estimate));
+    s_estimate.aging = s_history.aging;
+    s_estimate.samples = s_history.count;
+    if (s_history.count == 0) {
+        return;
+    }
+
+    // Interval-weighted mean of intrinsic drift (drift with aging offset 0)
+    // A positive aging offset slows the oscillator, so add it back to get the intrinsic value
+    float sum_w = 0.0f;
+    float sum_wp = 0.0f;
+    float sum_res = 0.0f;
+    for (int i = 0; i < s_history.count; i++) {
+        const drift_sample_t *s = &s_history.samples[i];
+        float w = (float)s->interval_s;
+        float ppm = (float)s->offset_ms * 1000.0f / w + s->aging * DS3231_AGING_PPM_PER_LSB;
+        sum_w += w;
+        sum_wp += w * ppm;
+        sum_res += (float)s->resolution_ms;
+    }
+    float mean = sum_wp / sum_w;
+
+    // Weighted standard deviation (stability between syncs)
+    float sum_wd2 = 0.0f;
+    for (int i = 0; i < s_history.count; i++) {
+        const drift_sample_t *s = &s_history.samples[i];
+        float w = (float)s->interval_s;
+        float d = (float)s->offset_ms * 1000.0f / w + s->aging * DS3231_AGING_PPM_PER_LSB - mean;
+        sum_wd2 += w * d * d;
+    }
+
+    s_estimate.ppm = mean;
+    s_estimate.residual_ppm = mean - s_history.aging * DS3231_AGING_PPM_PER_LSB;
+    // The weighted mean is the sum of offsets over the sum of intervals: its resolution error is bounded
+    // by the sum of the sample resolutions over the total time
+    s_estimate.uncertainty_ppm = sqrtf(sum_wd2 / sum_w) + sum_res * 1000.0f / sum_w;
+}
+
+// Save history to NVS
+static esp_err_t drift_cal_save(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_TIME, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, NVS_KEY_DRIFT_HISTORY, &s_history, sizeof(s_history));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error saving drift history: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t drift_cal_init(void)
+{
+    memset(&s_history, 0, sizeof(s_history));
+    s_history.version = DRIFT_HISTORY_VERSION;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_TIME, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK) {
+        drift_history_t loaded;
+        size_t size = sizeof(loaded);
+        err = nvs_get_blob(nvs_handle, NVS_KEY_DRIFT_HISTORY, &loaded, &size);
+        nvs_close(nvs_handle);
+
+        if (err == ESP_OK && size == sizeof(loaded) &&
+            (loaded.version == DRIFT_HISTORY_VERSION || loaded.version == 1) &&
+            loaded.count <= DRIFT_CAL_HISTORY_LEN && loaded.next < DRIFT_CAL_HISTORY_LEN) {
+            if (loaded.version == 1) {
+                // Same layout; version 1 offsets were measured with whole-second resolution
+                for (int i = 0; i < DRIFT_CAL_HISTORY_LEN; i++) {
+                    loaded.samples[i].reserved = 0;
+                    loaded.samples[i].resolution_ms = DRIFT_CAL_V1_RESOLUTION_MS;
+                }
+                loaded.version = DRIFT_HISTORY_VERSION;
+            }
+            s_history = loaded;
+        } else if (err == ESP_OK) {
+            ESP_LOGW(TAG, "Discarding incompatible drift history");
+        }
+    }
+
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGD(TAG, "Drift history not loaded: %s", esp_err_to_name(err));
+    }
+
+    drift_cal_update_estimate();
+    ESP_LOGI(TAG, "Drift history: %d samples, drift %.3f ppm, aging %d, residual %.3f ppm (±%.3f)",
+             s_estimate.samples, s_estimate.ppm, s_estimate.aging,
+             s_estimate.residual_ppm, s_estimate.uncertainty_ppm);
+    return ESP_OK;
+}
+
+esp_err_t drift_cal_record(ds3231_t *ds3231, uint32_t interval_s, int32_t offset_ms, uint32_t resolution_ms)
+{
+    if (interval_s < DRIFT_CAL_MIN_INTERVAL_S) {
+        ESP_LOGI(TAG, "Sync interval %" PRIu32 " s too short for drift measurement, ignoring", interval_s);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    float error_ppm = (float)resolution_ms * 1000.0f / (float)interval_s;
+    if (resolution_ms > UINT16_MAX || error_ppm > DRIFT_CAL_MAX_SAMPLE_ERROR_PPM) {
+        ESP_LOGI(TAG, "Offset resolution %" PRIu32 " ms over %" PRIu32 " s is ±%.2f ppm, too coarse, ignoring",
+                 resolution_ms, interval_s, error_ppm);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    float ppm = (float)offset_ms * 1000.0f / (float)interval_s;
+    if (fabsf(ppm) > DRIFT_CAL_MAX_PPM) {
+        ESP_LOGW(TAG, "Implausible drift %.1f ppm (offset %" PRId32 " ms over %" PRIu32 " s), ignoring",
+                 ppm, offset_ms, interval_s);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The DS3231 holds the aging offset that was in effect during the interval
+    int8_t aging = s_history.aging;
+    if (ds3231 && !ds3231_get_aging_offset(ds3231, &aging)) {
+        ESP_LOGW(TAG, "Failed to read aging offset, assuming %d", s_history.aging);
+        aging = s_history.aging;
+    }
+
+    drift_sample_t *sample = &s_history.samples[s_history.next];
+    sample->interval_s = interval_s;
+    sample->offset_ms = offset_ms;
+    sample->aging = aging;
+    sample->reserved = 0;
+    sample->resolution_ms = (uint16_t)resolution_ms;
+    s_history.next = (s_history.next + 1) % DRIFT_CAL_HISTORY_LEN;
+    if (s_history.count < DRIFT_CAL_HISTORY_LEN) {
+        s_history.count++;
+    }
+    s_history.aging = aging;
+    s_history.unverified = 0;
+
+    drift_cal_update_estimate();
+    ESP_LOGI(TAG, "Measured offset %" PRId32 " ±%" PRIu32 " ms over %" PRIu32 " s (%.3f ±%.3f ppm, aging %d)",
+             offset_ms, resolution_ms, interval_s, ppm, error_ppm, aging);
+
+    // Trim aging register once the estimate is backed by enough samples and known to within a few LSB
+    if (s_estimate.samples >= DRIFT_CAL_MIN_SAMPLES && s_estimate.uncertainty_ppm >= DRIFT_CAL_TRIM_MAX_UNCERTAINTY_PPM) {
+        ESP_LOGI(TAG, "Drift %.3f ±%.3f ppm not certain enough to trim (< %.1f ppm needed)",
+                 s_estimate.ppm, s_estimate.uncertainty_ppm, DRIFT_CAL_TRIM_MAX_UNCERTAINTY_PPM);
+    } else if (s_estimate.samples >= DRIFT_CAL_MIN_SAMPLES && ds3231) {
+        float target_f = roundf(s_estimate.ppm / DS3231_AGING_PPM_PER_LSB);
+        if (target_f > 127.0f) target_f = 127.0f;
+        if (target_f < -128.0f) target_f = -128.0f;
+        int8_t target = (int8_t)target_f;
+
+        if (target != aging) {
+            if (ds3231_set_aging_offset(ds3231, target)) {
+                ESP_LOGI(TAG, "Aging offset trimmed: %d -> %d (drift %.3f ppm)", aging, target, s_estimate.ppm);
+                s_history.aging = target;
+                s_history.unverified = 1;
+                drift_cal_update_estimate();
+            } else {
+                ESP_LOGE(TAG, "Failed to write aging offset");
+            }
+        }
+    }
+
+    return drift_cal_save();
+}
+
+bool drift_cal_get_estimate(drift_cal_estimate_t *estimate)
+{
+    if (!estimate) {
+        return false;
+    }
+    *estimate = s_estimate;
+    return s_estimate.samples > 0;
+}
+
+uint32_t drift_cal_get_sync_interval_s(uint32_t default_s)
+{
+    if (s_estimate.samples < DRIFT_CAL_MIN_SAMPLES) {
+        return default_s;
+    }
+
+    // Worst-case drift rate with the current trim: t = error / rate
+    float bound_ppm = fabsf(s_estimate.residual_ppm) + s_estimate.uncertainty_ppm;
+    float interval_f = (float)DRIFT_CAL_MAX_SYNC_INTERVAL_S;
+    if (bound_ppm > 0.0f) {
+        interval_f = DRIFT_CAL_TARGET_ERROR_MS * 1000.0f / bound_ppm;
+    }
+
+    uint32_t interval_s;
+    if (interval_f >= (float)DRIFT_CAL_MAX_SYNC_INTERVAL_S) {
+        interval_s = DRIFT_CAL_MAX_SYNC_INTERVAL_S;
+    } else if (interval_f <= (float)DRIFT_CAL_MIN_SYNC_INTERVAL_S) {
+        interval_s = DRIFT_CAL_MIN_SYNC_INTERVAL_S;
+    } else {
+        interval_s = (uint32_t)interval_f;
+    }
+
+    // A fresh trim has not been verified yet: don't stretch beyond the default
+    if (s_history.unverified && interval_s > default_s) {
+        interval_s = default_s;
+    }
+    return interval_s;
+}
@@ -0,0 +1,82 @@
+#ifndef DRIFT_CAL_H
+#define DRIFT_CAL_H
+
+#include "esp_err.h"
+#include "ds3231.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of (interval, offset) pairs kept in NVS
+#define DRIFT_CAL_HISTORY_LEN   8
+
+// Maximum RTC error we are willing to accumulate between two syncs
+#define DRIFT_CAL_TARGET_ERROR_MS  1000
+
+// Drift estimate computed from the sync history
+typedef struct {
+    float ppm;              // Intrinsic oscillator drift with aging offset 0 (positive = RTC runs fast)
+    float residual_ppm;     // Expected drift with the current aging offset applied
+    float uncertainty_ppm;  // Spread of the history plus the samples' offset resolution
+    int8_t aging;           // Aging offset currently programmed into the DS3231
+    uint8_t samples;        // Number of usable samples in the history
+} drift_cal_estimate_t;
+
+/**
+ * @brief Load drift history from NVS
+ *
+ * Must be called after nvs_flash_init(). Missing history is not an error.
+ *
+ * @return
+ *    - ESP_OK: Success (history may be empty)
+ *    - Others: Failure reading NVS
+ */
+esp_err_t drift_cal_init(void);
+
+/**
+ * @brief Record the RTC offset measured at an NTP sync, before the RTC is corrected
+ *
+ * Appends the sample to the history, re-estimates the drift and, once enough
+ * samples are available and the estimate's uncertainty is below 1 ppm, trims
+ * the DS3231 aging offset register.
+ *
+ * @param ds3231 DS3231 device (aging register is read and written)
+ * @param interval_s Seconds elapsed since the previous sync (NTP time base)
+ * @param offset_ms RTC time minus NTP time, in milliseconds
+ * @param resolution_ms Error bound of offset_ms (500 for a whole-second RTC read,
+ *                      the time service uncertainty for a sub-second one)
+ * @return
+ *    - ESP_OK: Sample recorded
+ *    - ESP_ERR_INVALID_ARG: Sample rejected (interval too short, resolution too coarse
+ *      for the interval, or implausible drift)
+ *    - Others: Failure
+ */
+esp_err_t drift_cal_record(ds3231_t *ds3231, uint32_t interval_s, int32_t offset_ms, uint32_t resolution_ms);
+
+/**
+ * @brief Get the current drift estimate
+ *
+ * @param estimate Output parameter
+ * @return true if at least one usable sample exists, false otherwise
+ */
+bool drift_cal_get_estimate(drift_cal_estimate_t *estimate);
+
+/**
+ * @brief Get the adaptive NTP sync interval
+ *
+ * The interval is chosen so that the expected RTC error stays below
+ * DRIFT_CAL_TARGET_ERROR_MS given the measured stability.
+ *
+ * @param default_s Interval to use while there is not enough history
+ * @return Sync interval in seconds
+ */
+uint32_t drift_cal_get_sync_interval_s(uint32_t default_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DRIFT_CAL_H
@@ -31,9 +31,24 @@
 
 // Control register bit definitions
 #define DS3231_EOSC_BIT       7  // Enable Oscillator bit
+#define DS3231_CONV_BIT       5  // Convert Temperature bit (forces TCXO update)
+#define DS3231_INTCN_BIT      2  // Interrupt Control bit (1 = alarms drive INT/SQW pin)
+#define DS3231_A2IE_BIT       1  // Alarm 2 Interrupt Enable bit
+#define DS3231_A1IE_BIT       0  // Alarm 1 Interrupt Enable bit
 
 // Status register bit definitions
 #define DS3231_OSF_BIT        7  // Oscillator Stop Flag bit
+#define DS3231_BSY_BIT        2  // Busy bit (TCXO conversion in progress)
+#define DS3231_A2F_BIT        1  // Alarm 2 Flag bit
+#define DS3231_A1F_BIT        0  // Alarm 1 Flag bit
+
+// Alarm flag masks (as returned by ds3231_get_alarm_flags)
+#define DS3231_ALARM1_FLAG    (1 << DS3231_A1F_BIT)
+#define DS3231_ALARM2_FLAG    (1 << DS3231_A2F_BIT)
+
+// Aging offset register: signed, roughly 0.1 ppm per LSB at 25°C
+// Positive values add load capacitance and slow the oscillator down
+#define DS3231_AGING_PPM_PER_LSB  0.1f
 
 // DS3231 time structure
 typedef struct {
@@ -43,22 +58,31 @@ typedef struct {
     uint8_t day;      // 1-7 (1=Sunday, 7=Saturday)
     uint8_t date;     // 1-31
     uint8_t month;    // 1-12
-    uint8_t year;     // 0-99 (represents 2000-2099)
+    uint8_t year;     // 0-199 (represents 2000-2199, century bit in month register)
 } ds3231_time_t;
 
 // DS3231 device structure
 typedef struct {
     i2c_master_bus_handle_t i2c_bus;
     i2c_master_dev_handle_t i2c_dev;
+    uint32_t i2c_errors;  // Failed I2C transactions since boot
 } ds3231_t;
 
 // Function declarations
 bool ds3231_init(ds3231_t *ds3231, i2c_master_bus_handle_t i2c_bus, uint8_t sda_pin, uint8_t scl_pin);
 bool ds3231_read_time(ds3231_t *ds3231, ds3231_time_t *time);
 bool ds3231_write_time(ds3231_t *ds3231, const ds3231_time_t *time);
+bool ds3231_read_seconds(ds3231_t *ds3231, uint8_t *seconds);  // Seconds register only (fast, for edge detection)
 bool ds3231_read_temperature(ds3231_t *ds3231, float *temperature);
 bool ds3231_enable_oscillator(ds3231_t *ds3231, bool enable);
 bool ds3231_is_oscillator_stopped(ds3231_t *ds3231, bool *stopped);
+bool ds3231_get_aging_offset(ds3231_t *ds3231, int8_t *offset);
+bool ds3231_set_aging_offset(ds3231_t *ds3231, int8_t offset);
+bool ds3231_set_alarm1(ds3231_t *ds3231, const ds3231_time_t *when);  // Matches date, hours, minutes, seconds
+bool ds3231_set_alarm2(ds3231_t *ds3231, const ds3231_time_t *when);  // Matches date, hours, minutes (fires at :00)
+bool ds3231_enable_alarm_interrupts(ds3231_t *ds3231, bool alarm1, bool alarm2);
+bool ds3231_get_alarm_flags(ds3231_t *ds3231, uint8_t *flags);
+bool ds3231_clear_alarm_flags(ds3231_t *ds3231, uint8_t flags);
 void ds3231_time_to_string(const ds3231_time_t *time, char *buffer, size_t buffer_size);
 
 // Helper functions
@@ -1,4 +1,8 @@
 #include "ds3231.h"
+#include "calendar.h"
+#include "trace.h"
+#include "dlog.h"
+#include "i2c_fault.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -8,6 +12,14 @@
 
 static const char *TAG = "ds3231";
 
+// Count failed I2C transactions
+static esp_err_t ds3231_i2c_result(ds3231_t *ds3231, esp_err_t ret) {
+    if (ret != ESP_OK) {
+        ds3231->i2c_errors++;
+    }
+    return ret;
+}
+
 // Write register
 static bool ds3231_write_register(ds3231_t *ds3231, uint8_t reg, uint8_t value) {
     if (!ds3231 || !ds3231->i2c_dev) {
@@ -15,7 +27,7 @@ static bool ds3231_write_register(ds3231_t *ds3231, uint8_t reg, uint8_t value)
     }
     
     uint8_t data[2] = {reg, value};
-    esp_err_t ret = i2c_master_transmit(ds3231->i2c_dev, data, 2, pdMS_TO_TICKS(100));
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, data, 2));
     return ret == ESP_OK;
 }
 
@@ -26,16 +38,21 @@ static bool ds3231_read_register(ds3231_t *ds3231, uint8_t reg, uint8_t *value)
     }
     
     // Write register address
-    esp_err_t ret = i2c_master_transmit(ds3231->i2c_dev, &reg, 1, pdMS_TO_TICKS(100));
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, &reg, 1));
     if (ret != ESP_OK) {
         return false;
     }
     
     // Read data
-    ret = i2c_master_receive(ds3231->i2c_dev, value, 1, pdMS_TO_TICKS(100));
+    ret = ds3231_i2c_result(ds3231, i2c_fault_receive(ds3231->i2c_dev, value, 1));
     return ret == ESP_OK;
 }
 
+// Restore the DS3231 after an I2C bus reset (registers are battery-backed, only check it answers)
+static bool ds3231_reinit(void *ctx) {
+    return ds3231_enable_oscillator((ds3231_t *)ctx, true);
+}
+
 // Initialize DS3231
 bool ds3231_init(ds3231_t *ds3231, i2c_master_bus_handle_t i2c_bus, uint8_t sda_pin, uint8_t scl_pin) {
     if (!ds3231 || !i2c_bus) {
@@ -58,11 +75,17 @@ bool ds3231_init(ds3231_t *ds3231, i2c_master_bus_handle_t i2c_bus, uint8_t sda_
     ds3231->i2c_bus = i2c_bus;
     
     // Enable oscillator
-    return ds3231_enable_oscillator(ds3231, true);
+    if (!ds3231_enable_oscillator(ds3231, true)) {
+        return false;
+    }
+    
+    // Bus resets caused by the DS3231 re-initialize it (a missing device is left unregistered)
+    i2c_fault_add_device(ds3231->i2c_dev, DS3231_I2C_ADDR, dev_cfg.scl_speed_hz, "ds3231", ds3231_reinit, ds3231);
+    return true;
 }
 
-// Read time
-bool ds3231_read_time(ds3231_t *ds3231, ds3231_time_t *time) {
+// Read the time registers
+static bool ds3231_read_time_regs(ds3231_t *ds3231, ds3231_time_t *time) {
     if (!ds3231 || !ds3231->i2c_dev || !time) {
         return false;
     }
@@ -71,31 +94,37 @@ bool ds3231_read_time(ds3231_t *ds3231, ds3231_time_t *time) {
     uint8_t data[7];
     
     // Write starting register address
-    esp_err_t ret = i2c_master_transmit(ds3231->i2c_dev, &reg, 1, pdMS_TO_TICKS(100));
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, &reg, 1));
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write register address: %s", esp_err_to_name(ret));
+        DLOGE(TAG, "Failed to write register address: %s", esp_err_to_name(ret));
         return false;
     }
     
     // Read 7 bytes of time data
-    ret = i2c_master_receive(ds3231->i2c_dev, data, 7, pdMS_TO_TICKS(100));
+    ret = ds3231_i2c_result(ds3231, i2c_fault_receive(ds3231->i2c_dev, data, 7));
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read time: %s", esp_err_to_name(ret));
+        DLOGE(TAG, "Failed to read time: %s", esp_err_to_name(ret));
         return false;
     }
     
-    // Parse time data
-    time->seconds = bcd_to_bin(data[0] & 0x7F);
-    time->minutes = bcd_to_bin(data[1] & 0x7F);
-    time->hours = bcd_to_bin(data[2] & 0x3F);
-    time->day = data[3] & 0x07;  // Day register directly stores 1-7, no BCD conversion needed
-    time->date = bcd_to_bin(data[4] & 0x3F);
-    time->month = bcd_to_bin(data[5] & 0x1F);
-    time->year = bcd_to_bin(data[6]);
+    // Parse time data (handles 12-hour mode and the century bit)
+    if (!cal_ds3231_unpack(data, time)) {
+        DLOGW(TAG, "RTC holds an invalid date/time: %04d-%02d-%02d %02d:%02d:%02d",
+             2000 + time->year, time->month, time->date,
+             time->hours, time->minutes, time->seconds);
+    }
     
     return true;
 }
 
+// Read time
+bool ds3231_read_time(ds3231_t *ds3231, ds3231_time_t *time) {
+    TRACE_BEGIN(TRACE_EV_DS3231_READ);
+    bool ok = ds3231_read_time_regs(ds3231, time);
+    TRACE_END(TRACE_EV_DS3231_READ, ok);
+    return ok;
+}
+
 // Write time
 bool ds3231_write_time(ds3231_t *ds3231, const ds3231_time_t *time) {
     if (!ds3231 || !ds3231->i2c_dev || !time) {
@@ -104,15 +133,9 @@ bool ds3231_write_time(ds3231_t *ds3231, const ds3231_time_t *time) {
     
     uint8_t data[8];
     data[0] = DS3231_SECONDS_REG;
-    data[1] = bin_to_bcd(time->seconds);
-    data[2] = bin_to_bcd(time->minutes);
-    data[3] = bin_to_bcd(time->hours);
-    data[4] = time->day & 0x07;  // Day register directly stores 1-7, ensure range is correct
-    data[5] = bin_to_bcd(time->date);
-    data[6] = bin_to_bcd(time->month);
-    data[7] = bin_to_bcd(time->year);
-    
-    esp_err_t ret = i2c_master_transmit(ds3231->i2c_dev, data, 8, pdMS_TO_TICKS(100));
+    cal_ds3231_pack(time, &data[1]);  // 24-hour mode, century bit for years >= 100
+    
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, data, 8));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write time: %s", esp_err_to_name(ret));
         return false;
@@ -120,6 +143,23 @@ bool ds3231_write_time(ds3231_t *ds3231, const ds3231_time_t *time) {
     return true;
 }
 
+// Read seconds register only (single repeated-start transaction, used for second edge detection)
+bool ds3231_read_seconds(ds3231_t *ds3231, uint8_t *seconds) {
+    if (!ds3231 || !ds3231->i2c_dev || !seconds) {
+        return false;
+    }
+    
+    uint8_t reg = DS3231_SECONDS_REG;
+    uint8_t value;
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit_receive(ds3231->i2c_dev, &reg, 1, &value, 1));
+    if (ret != ESP_OK) {
+        return false;
+    }
+    
+    *seconds = cal_bcd_to_bin(value & 0x7F);
+    return true;
+}
+
 // Read temperature
 bool ds3231_read_temperature(ds3231_t *ds3231, float *temperature) {
     if (!ds3231 || !ds3231->i2c_dev || !temperature) {
@@ -179,6 +219,146 @@ bool ds3231_is_oscillator_stopped(ds3231_t *ds3231, bool *stopped) {
     return true;
 }
 
+// Read aging offset register (two's complement)
+bool ds3231_get_aging_offset(ds3231_t *ds3231, int8_t *offset) {
+    if (!ds3231 || !ds3231->i2c_dev || !offset) {
+        return false;
+    }
+    
+    uint8_t value;
+    if (!ds3231_read_register(ds3231, DS3231_AGING_REG, &value)) {
+        return false;
+    }
+    
+    *offset = (int8_t)value;
+    return true;
+}
+
+// Write aging offset register and force a TCXO conversion so it takes effect immediately
+// (otherwise the new value is only applied at the next automatic conversion, up to 64 s later)
+bool ds3231_set_aging_offset(ds3231_t *ds3231, int8_t offset) {
+    if (!ds3231 || !ds3231->i2c_dev) {
+        return false;
+    }
+    
+    if (!ds3231_write_register(ds3231, DS3231_AGING_REG, (uint8_t)offset)) {
+        ESP_LOGE(TAG, "Failed to write aging offset");
+        return false;
+    }
+    
+    // Only start a conversion if none is in progress (BSY clear)
+    uint8_t status_reg;
+    if (!ds3231_read_register(ds3231, DS3231_STATUS_REG, &status_reg)) {
+        return false;
+    }
+    if (status_reg & (1 << DS3231_BSY_BIT)) {
+        return true;  // Busy conversion will pick up the new value
+    }
+    
+    uint8_t control_reg;
+    if (!ds3231_read_register(ds3231, DS3231_CONTROL_REG, &control_reg)) {
+        return false;
+    }
+    return ds3231_write_register(ds3231, DS3231_CONTROL_REG, control_reg | (1 << DS3231_CONV_BIT));
+}
+
+// Set alarm 1 (A1M1-A1M4 = 0, DY/DT = 0: alarm when date, hours, minutes and seconds match)
+bool ds3231_set_alarm1(ds3231_t *ds3231, const ds3231_time_t *when) {
+    if (!ds3231 || !ds3231->i2c_dev || !when) {
+        return false;
+    }
+    
+    uint8_t data[5];
+    data[0] = DS3231_ALARM1_SEC;
+    data[1] = bin_to_bcd(when->seconds);
+    data[2] = bin_to_bcd(when->minutes);
+    data[3] = bin_to_bcd(when->hours);
+    data[4] = bin_to_bcd(when->date);
+    
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, data, sizeof(data)));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write alarm 1: %s", esp_err_to_name(ret));
+        return false;
+    }
+    return true;
+}
+
+// Set alarm 2 (A2M2-A2M4 = 0, DY/DT = 0: alarm when date, hours and minutes match)
+bool ds3231_set_alarm2(ds3231_t *ds3231, const ds3231_time_t *when) {
+    if (!ds3231 || !ds3231->i2c_dev || !when) {
+        return false;
+    }
+    
+    uint8_t data[4];
+    data[0] = DS3231_ALARM2_MIN;
+    data[1] = bin_to_bcd(when->minutes);
+    data[2] = bin_to_bcd(when->hours);
+    data[3] = bin_to_bcd(when->date);
+    
+    esp_err_t ret = ds3231_i2c_result(ds3231, i2c_fault_transmit(ds3231->i2c_dev, data, sizeof(data)));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write alarm 2: %s", esp_err_to_name(ret));
+        return false;
+    }
+    return true;
+}
+
+// Enable/disable alarm interrupts (also selects interrupt mode on the INT/SQW pin)
+bool ds3231_enable_alarm_interrupts(ds3231_t *ds3231, bool alarm1, bool alarm2) {
+    if (!ds3231 || !ds3231->i2c_dev) {
+        return false;
+    }
+    
+    uint8_t control_reg;
+    if (!ds3231_read_register(ds3231, DS3231_CONTROL_REG, &control_reg)) {
+        return false;
+    }
+    
+    uint8_t new_reg = control_reg | (1 << DS3231_INTCN_BIT);
+    new_reg &= ~((1 << DS3231_A1IE_BIT) | (1 << DS3231_A2IE_BIT));
+    if (alarm1) {
+        new_reg |= (1 << DS3231_A1IE_BIT);
+    }
+    if (alarm2) {
+        new_reg |= (1 << DS3231_A2IE_BIT);
+    }
+    
+    if (new_reg == control_reg) {
+        return true;  // Nothing to change
+    }
+    return ds3231_write_register(ds3231, DS3231_CONTROL_REG, new_reg);
+}
+
+// Read alarm flags (DS3231_ALARM1_FLAG / DS3231_ALARM2_FLAG)
+bool ds3231_get_alarm_flags(ds3231_t *ds3231, uint8_t *flags) {
+    if (!ds3231 || !ds3231->i2c_dev || !flags) {
+        return false;
+    }
+    
+    uint8_t status_reg;
+    if (!ds3231_read_register(ds3231, DS3231_STATUS_REG, &status_reg)) {
+        return false;
+    }
+    
+    *flags = status_reg & (DS3231_ALARM1_FLAG | DS3231_ALARM2_FLAG);
+    return true;
+}
+
+// Clear alarm flags (releases the INT/SQW pin)
+bool ds3231_clear_alarm_flags(ds3231_t *ds3231, uint8_t flags) {
+    if (!ds3231 || !ds3231->i2c_dev) {
+        return false;
+    }
+    
+    uint8_t status_reg;
+    if (!ds3231_read_register(ds3231, DS3231_STATUS_REG, &status_reg)) {
+        return false;
+    }
+    
+    status_reg &= ~(flags & (DS3231_ALARM1_FLAG | DS3231_ALARM2_FLAG));
+    return ds3231_write_register(ds3231, DS3231_STATUS_REG, status_reg);
+}
+
 // Convert time to string
 void ds3231_time_to_string(const ds3231_time_t *time, char *buffer, size_t buffer_size) {
     if (!time || !buffer || buffer_size < 20) {
@@ -188,7 +368,7 @@ void ds3231_time_to_string(const ds3231_time_t *time, char *buffer, size_t buffe
     const char* day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
     
     snprintf(buffer, buffer_size, "%s %04d-%02d-%02d %02d:%02d:%02d",
-             day_names[time->day - 1],
+             day_names[cal_weekday(cal_days_from_civil(2000 + time->year, time->month, time->date))],
              2000 + time->year,
              time->month,
              time->date,
@@ -199,10 +379,10 @@ void ds3231_time_to_string(const ds3231_time_t *time, char *buffer, size_t buffe
 
 // BCD to binary
 uint8_t bcd_to_bin(uint8_t bcd) {
-    return ((bcd >> 4) * 10) + (bcd & 0x0F);
+    return cal_bcd_to_bin(bcd);
 }
 
 // Binary to BCD
 uint8_t bin_to_bcd(uint8_t bin) {
-    return ((bin / 10) << 4) | (bin % 10);
+    return cal_bin_to_bcd(bin);
 }
@@ -0,0 +1,82 @@
+#include "face.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "face";
+
+static const face_t *volatile s_face = NULL;  // Read by the render task
+
+const face_t *face_find(const char *name)
+{
+    for (size_t i = 0; i < face_count; i++) {
+        if (strcmp(face_faces[i].name, name) == 0) {
+            return &face_faces[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t face_init(const char *name)
+{
+    if (!name || name[0] == '\0') {
+        name = FACE_DEFAULT;
+    }
+    const face_t *face = face_find(name);
+    if (!face) {
+        ESP_LOGW(TAG, "Face '%s' is not compiled in, using %s", name, FACE_DEFAULT);
+        face = face_find(FACE_DEFAULT);
+    }
+    s_face = face ? face : &face_faces[0];
+    ESP_LOGI(TAG, "Face: %s (%u faces compiled in)", s_face->name, (unsigned)face_count);
+    return ESP_OK;
+}
+
+esp_err_t face_set(const char *name)
+{
+    const face_t *face = name ? face_find(name) : NULL;
+    if (!face) {
+        ESP_LOGE(TAG, "Unknown face: %s", name ? name : "(null)");
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_face = face;
+    ESP_LOGI(TAG, "Face: %s", face->name);
+    return ESP_OK;
+}
+
+const face_t *face_get(void)
+{
+    const face_t *face = s_face;
+    return face ? face : &face_faces[0];
+}
+
+bool face_show(ssd1306_t *ssd1306, const face_t *face, const char *const text[FACE_FIELD_COUNT],
+               int8_t offset_x, int8_t offset_y)
+{
+    if (!ssd1306 || !face || !text) {
+        return false;
+    }
+
+    // The compiler checked every element at the edges of this range
+    if (offset_x < -face->shift_x) offset_x = -face->shift_x;
+    if (offset_x > face->shift_x) offset_x = face->shift_x;
+    if (offset_y < -face->shift_y) offset_y = -face->shift_y;
+    if (offset_y > face->shift_y) offset_y = face->shift_y;
+
+    ssd1306_clear(ssd1306);
+    for (uint8_t i = 0; i < face->count; i++) {
+        const face_element_t *element = &face->elements[i];
+        const char *str = text[element->field];
+        if (!str) {
+            continue;
+        }
+        int16_t x = element->x;
+        if (element->align != FACE_ALIGN_LEFT) {
+            size_t len = strnlen(str, element->chars);
+            int16_t width = len ? (int16_t)(len * element->advance - element->spacing) : 0;
+            x -= element->align == FACE_ALIGN_RIGHT ? width : width / 2;
+        }
+        ssd1306_draw_string(ssd1306, (uint8_t)(x + offset_x), (uint8_t)(element->y + offset_y),
+                            str, element->size);
+    }
+    return ssd1306_refresh(ssd1306);
+}
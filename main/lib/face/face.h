@@ -0,0 +1,110 @@
+#ifndef FACE_H
+#define FACE_H
+
+#include "esp_err.h"
+#include "ssd1306.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Clock faces (generated into face_table.c by tools/face_compile.py from faces.json)
+//
+// A face is a list of text elements. The compiler resolves alignment, font spacing and the
+// burn-in shift range at build time and rejects layouts that would leave the screen or
+// overlap, so face_show() only adds the shift to constant coordinates.
+
+#define FACE_DEFAULT        "classic"   // Face used when none is stored (the former fixed layout)
+#define FACE_NAME_MAX_LEN   16
+
+// Text shown by an element
+typedef enum {
+    FACE_FIELD_TIME,        // hh:mm (colon blinking)
+    FACE_FIELD_DATE,        // YYYY-MM-DD
+    FACE_FIELD_WEEKDAY,     // Mon, Tue, ...
+    FACE_FIELD_TEMP,        // Temperature, e.g. 23.5c
+    FACE_FIELD_COUNT,
+} face_field_t;
+
+typedef enum {
+    FACE_ALIGN_LEFT,        // x is the left edge
+    FACE_ALIGN_RIGHT,       // x is one past the right edge
+    FACE_ALIGN_CENTER,      // x is the centre
+} face_align_t;
+
+typedef struct {
+    uint8_t field;          // face_field_t
+    uint8_t align;          // face_align_t
+    uint8_t x;              // Anchor at zero shift
+    uint8_t y;              // Top edge at zero shift
+    uint8_t size;           // Font scale (ssd1306_draw_string)
+    uint8_t advance;        // Character width plus spacing at this scale
+    uint8_t spacing;        // Spacing between characters at this scale
+    uint8_t chars;          // Longest text the layout was checked for
+} face_element_t;
+
+typedef struct {
+    const char *name;
+    const face_element_t *elements;
+    uint8_t count;
+    uint8_t shift_x;        // Burn-in shift range: -shift_x to +shift_x stays on screen
+    uint8_t shift_y;
+} face_t;
+
+extern const face_t face_faces[];
+extern const size_t face_count;
+
+/**
+ * @brief Select the stored face at boot
+ *
+ * Falls back to FACE_DEFAULT if no face is stored or the stored face is not compiled in.
+ *
+ * @param name Face name from app_config (NULL or empty: FACE_DEFAULT)
+ * @return
+ *    - ESP_OK: Success
+ */
+esp_err_t face_init(const char *name);
+
+/**
+ * @brief Find a compiled face by name
+ *
+ * @return Face, or NULL if it is not listed in faces.json
+ */
+const face_t *face_find(const char *name);
+
+/**
+ * @brief Select a face, shown from the next frame (the choice is stored by app_config_set_face())
+ *
+ * @param name Face name (must be listed in faces.json)
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NOT_FOUND: Face not compiled in
+ */
+esp_err_t face_set(const char *name);
+
+/**
+ * @brief Get the selected face
+ */
+const face_t *face_get(void);
+
+/**
+ * @brief Draw a face and refresh the display
+ *
+ * @param ssd1306 SSD1306 device structure pointer
+ * @param face Face to draw
+ * @param text Text per face_field_t (NULL: element not drawn), at most the element's chars long
+ * @param offset_x X-axis pixel offset (burn-in prevention, limited to the face's shift range)
+ * @param offset_y Y-axis pixel offset
+ * @return true on success, false on failure
+ */
+bool face_show(ssd1306_t *ssd1306, const face_t *face, const char *const text[FACE_FIELD_COUNT],
+               int8_t offset_x, int8_t offset_y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FACE_H
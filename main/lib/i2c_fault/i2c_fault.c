@@ -0,0 +1,256 @@
+#include "i2c_fault.h"
+#include "dlog.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "i2c_fault";
+
+#define I2C_FAULT_LOG_INTERVAL_US   1000000     // At most one recovery line per second
+
+typedef struct {
+    i2c_master_dev_handle_t dev;
+    uint16_t address;
+    uint32_t scl_hz;
+    const char *name;
+    i2c_fault_reinit_t reinit;
+    void *ctx;
+    uint8_t nacks;              // Consecutive NACKs
+    int64_t last_reinit_us;     // 0 = never
+} i2c_fault_device_t;
+
+static i2c_master_bus_handle_t s_bus = NULL;
+static gpio_num_t s_sda_pin = GPIO_NUM_NC;
+static gpio_num_t s_scl_pin = GPIO_NUM_NC;
+static SemaphoreHandle_t s_mutex = NULL;
+static i2c_fault_device_t s_devices[I2C_FAULT_DEVICES_MAX];
+static uint8_t s_device_count = 0;
+static bool s_recovering = false;       // Faults during a re-init are counted, not recovered
+static int64_t s_last_log_us = 0;
+static i2c_fault_stats_t s_stats;
+
+static const char *const s_kind_names[I2C_FAULT_KIND_COUNT] = {
+    [I2C_FAULT_NACK] = "nack",
+    [I2C_FAULT_TIMEOUT] = "timeout",
+    [I2C_FAULT_STUCK] = "stuck",
+    [I2C_FAULT_OTHER] = "other",
+};
+
+const char *i2c_fault_kind_name(i2c_fault_kind_t kind)
+{
+    return kind < I2C_FAULT_KIND_COUNT ? s_kind_names[kind] : "?";
+}
+
+esp_err_t i2c_fault_init(i2c_master_bus_handle_t bus, gpio_num_t sda_pin, gpio_num_t scl_pin)
+{
+    if (bus == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_mutex == NULL) {
+        s_mutex = xSemaphoreCreateRecursiveMutex();
+        if (s_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_bus = bus;
+    s_sda_pin = sda_pin;
+    s_scl_pin = scl_pin;
+    return ESP_OK;
+}
+
+esp_err_t i2c_fault_add_device(i2c_master_dev_handle_t dev, uint16_t address, uint32_t scl_hz,
+                               const char *name, i2c_fault_reinit_t reinit, void *ctx)
+{
+    i2c_fault_device_t *device = NULL;
+    for (uint8_t i = 0; i < s_device_count; i++) {
+        if (s_devices[i].ctx == ctx) {
+            device = &s_devices[i];
+            break;
+        }
+    }
+    if (device == NULL) {
+        if (s_device_count >= I2C_FAULT_DEVICES_MAX) {
+            return ESP_ERR_NO_MEM;
+        }
+        device = &s_devices[s_device_count++];
+    }
+    memset(device, 0, sizeof(*device));
+    device->dev = dev;
+    device->address = address;
+    device->scl_hz = scl_hz > 0 ? scl_hz : I2C_FAULT_SCL_HZ_DEFAULT;
+    device->name = name;
+    device->reinit = reinit;
+    device->ctx = ctx;
+    return ESP_OK;
+}
+
+int i2c_fault_timeout_ms(size_t bytes, uint32_t scl_hz)
+{
+    // 9 clocks per byte (8 bits and ACK), start and stop conditions
+    uint64_t bits = (uint64_t)bytes * 9 + 2;
+    uint32_t hz = scl_hz > 0 ? scl_hz : I2C_FAULT_SCL_HZ_DEFAULT;
+    return (int)((bits * 2 * 1000 + hz - 1) / hz) + I2C_FAULT_TIMEOUT_MARGIN_MS;
+}
+
+bool i2c_fault_bus_stuck(void)
+{
+    if (s_sda_pin == GPIO_NUM_NC || s_scl_pin == GPIO_NUM_NC) {
+        return false;
+    }
+    // A line released between samples is not stuck (a slave finishing a clock stretch)
+    for (int i = 0; i < I2C_FAULT_LINE_SAMPLES; i++) {
+        if (gpio_get_level(s_sda_pin) && gpio_get_level(s_scl_pin)) {
+            return false;
+        }
+        esp_rom_delay_us(10);
+    }
+    return true;
+}
+
+void i2c_fault_get_stats(i2c_fault_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+static i2c_fault_device_t *i2c_fault_find(i2c_master_dev_handle_t dev)
+{
+    for (uint8_t i = 0; i < s_device_count; i++) {
+        if (s_devices[i].dev == dev) {
+            return &s_devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Take the bus and return the timeout of a transfer of this many bytes
+static int i2c_fault_begin(i2c_master_dev_handle_t dev, size_t bytes)
+{
+    if (s_mutex != NULL) {
+        xSemaphoreTakeRecursive(s_mutex, portMAX_DELAY);
+    }
+    i2c_fault_device_t *device = i2c_fault_find(dev);
+    return i2c_fault_timeout_ms(bytes, device != NULL ? device->scl_hz : I2C_FAULT_SCL_HZ_DEFAULT);
+}
+
+// Driver errors other than timeouts and bad arguments are acknowledge errors
+static i2c_fault_kind_t i2c_fault_classify(esp_err_t ret)
+{
+    if (ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_NO_MEM) {
+        return I2C_FAULT_OTHER;
+    }
+    if (i2c_fault_bus_stuck()) {
+        return I2C_FAULT_STUCK;
+    }
+    return ret == ESP_ERR_TIMEOUT ? I2C_FAULT_TIMEOUT : I2C_FAULT_NACK;
+}
+
+// Reset the bus (9 SCL clocks, controller reset, STOP), then re-initialize the device
+static void i2c_fault_recover(i2c_fault_device_t *device, i2c_fault_kind_t kind, esp_err_t ret)
+{
+    int64_t start_us = esp_timer_get_time();
+    s_recovering = true;
+
+    // On the ESP32-C3 the controller generates the 9 clocks itself (I2C_SCL_RST_SLV)
+    esp_err_t reset_ret = i2c_master_bus_reset(s_bus);
+    s_stats.bus_resets++;
+    if (device != NULL) {
+        // START, address, STOP: the STOP also ends any transfer a slave still thinks is open
+        i2c_master_probe(s_bus, device->address, I2C_FAULT_TIMEOUT_MARGIN_MS);
+    }
+
+    const char *outcome = "bus released";
+    if (reset_ret != ESP_OK || i2c_fault_bus_stuck()) {
+        s_stats.bus_reset_failed++;
+        outcome = "bus still held low";
+    } else if (device != NULL && device->reinit != NULL &&
+               (device->last_reinit_us == 0 ||
+                start_us - device->last_reinit_us >= I2C_FAULT_REINIT_INTERVAL_MS * 1000LL)) {
+        device->last_reinit_us = start_us;
+        s_stats.reinits++;
+        if (device->reinit(device->ctx)) {
+            outcome = "device re-initialized";
+        } else {
+            s_stats.reinit_failed++;
+            outcome = "device re-init failed";
+        }
+    }
+    if (device != NULL) {
+        device->nacks = 0;
+    }
+    s_recovering = false;
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t elapsed_us = (uint32_t)(now_us - start_us);
+    if (elapsed_us > s_stats.recover_max_us) {
+        s_stats.recover_max_us = elapsed_us;
+    }
+    if (s_last_log_us == 0 || now_us - s_last_log_us >= I2C_FAULT_LOG_INTERVAL_US) {
+        s_last_log_us = now_us;
+        DLOGW(TAG, "%s: %s (%s), bus reset, %s in %" PRIu32 " us",
+              device != NULL ? device->name : "device", s_kind_names[kind], esp_err_to_name(ret),
+              outcome, elapsed_us);
+    }
+}
+
+// Count and handle the result of a transaction, then release the bus
+static esp_err_t i2c_fault_end(i2c_master_dev_handle_t dev, esp_err_t ret)
+{
+    if (s_mutex == NULL) {
+        return ret;  // Not initialized: plain driver calls
+    }
+    i2c_fault_device_t *device = i2c_fault_find(dev);
+    if (ret == ESP_OK) {
+        if (device != NULL) {
+            device->nacks = 0;
+        }
+    } else {
+        i2c_fault_kind_t kind = i2c_fault_classify(ret);
+        s_stats.faults[kind]++;
+
+        // A single NACK is left to the caller (a device busy for a moment), repeated ones reset the bus
+        bool reset = kind == I2C_FAULT_TIMEOUT || kind == I2C_FAULT_STUCK;
+        if (kind == I2C_FAULT_NACK && device != NULL) {
+            device->nacks++;
+            reset = device->nacks >= I2C_FAULT_NACK_RESET;
+        }
+        if (reset && !s_recovering) {
+            i2c_fault_recover(device, kind, ret);
+        }
+    }
+    xSemaphoreGiveRecursive(s_mutex);
+    return ret;
+}
+
+esp_err_t i2c_fault_transmit(i2c_master_dev_handle_t dev, const uint8_t *data, size_t len)
+{
+    int timeout_ms = i2c_fault_begin(dev, len + 1);
+    return i2c_fault_end(dev, i2c_master_transmit(dev, data, len, timeout_ms));
+}
+
+esp_err_t i2c_fault_receive(i2c_master_dev_handle_t dev, uint8_t *data, size_t len)
+{
+    int timeout_ms = i2c_fault_begin(dev, len + 1);
+    return i2c_fault_end(dev, i2c_master_receive(dev, data, len, timeout_ms));
+}
+
+esp_err_t i2c_fault_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *tx, size_t tx_len,
+                                     uint8_t *rx, size_t rx_len)
+{
+    int timeout_ms = i2c_fault_begin(dev, tx_len + rx_len + 2);
+    return i2c_fault_end(dev, i2c_master_transmit_receive(dev, tx, tx_len, rx, rx_len, timeout_ms));
+}
+
+esp_err_t i2c_fault_multi_buffer_transmit(i2c_master_dev_handle_t dev,
+                                          i2c_master_transmit_multi_buffer_info_t *segments, size_t count)
+{
+    size_t bytes = 1;
+    for (size_t i = 0; i < count; i++) {
+        bytes += segments[i].buffer_size;
+    }
+    int timeout_ms = i2c_fault_begin(dev, bytes);
+    return i2c_fault_end(dev, i2c_master_multi_buffer_transmit(dev, segments, count, timeout_ms));
+}
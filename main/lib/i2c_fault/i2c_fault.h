@@ -0,0 +1,144 @@
+#ifndef I2C_FAULT_H
+#define I2C_FAULT_H
+
+#include "esp_err.h"
+#include "driver/i2c_master.h"
+#include "driver/gpio.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// I2C fault handling for the shared bus
+//
+// The DS3231 and SSD1306 drivers send every transaction through i2c_fault_transmit() and
+// friends instead of calling the I2C master driver directly:
+//
+// - The timeout follows the transfer size: twice the time on the wire at the device's SCL
+//   rate plus I2C_FAULT_TIMEOUT_MARGIN_MS, so a 2-byte command gives up after a few ms and
+//   a full frame after about 190 ms
+// - A failed transaction is classified: NACK, timeout, or a stuck bus (SDA or SCL still
+//   held low after the transaction ended, sampled on the pins)
+// - Timeouts, stuck lines and repeated NACKs reset the bus: the controller clocks SCL
+//   9 times to release a slave holding SDA and resets its state machine, then a probe of
+//   the device address puts a STOP on the bus
+// - The affected device is re-initialized afterwards (its registered callback), at most
+//   once per I2C_FAULT_REINIT_INTERVAL_MS
+// - The failed transaction is not repeated: a register read split over two transactions
+//   cannot be, the caller retries if that is safe
+//
+// Transactions and recovery are serialized by a recursive mutex, so a reset never runs
+// under another task's transfer and a re-init callback can use the same functions.
+
+#define I2C_FAULT_TIMEOUT_MARGIN_MS   5       // Added to twice the transfer time
+#define I2C_FAULT_SCL_HZ_DEFAULT      100000  // Devices not registered (yet)
+#define I2C_FAULT_NACK_RESET          2       // Consecutive NACKs of a device before the bus is reset
+#define I2C_FAULT_REINIT_INTERVAL_MS  1000    // Minimum time between re-inits of one device
+#define I2C_FAULT_DEVICES_MAX         4
+#define I2C_FAULT_LINE_SAMPLES        8       // Pin samples 10 us apart, all low = stuck
+
+// Fault kinds
+typedef enum {
+    I2C_FAULT_NACK,         // Address or data not acknowledged
+    I2C_FAULT_TIMEOUT,      // Transaction did not end in time
+    I2C_FAULT_STUCK,        // SDA or SCL held low after the transaction
+    I2C_FAULT_OTHER,        // Any other driver error (no recovery)
+    I2C_FAULT_KIND_COUNT,
+} i2c_fault_kind_t;
+
+// Re-initialize a device after a bus reset (runs with the bus mutex held)
+typedef bool (*i2c_fault_reinit_t)(void *ctx);
+
+typedef struct {
+    uint32_t faults[I2C_FAULT_KIND_COUNT];  // Failed transactions by kind
+    uint32_t bus_resets;                    // 9 clocks, controller reset and STOP
+    uint32_t bus_reset_failed;              // Lines still held low after a reset
+    uint32_t reinits;                       // Device re-inits after a reset
+    uint32_t reinit_failed;
+    uint32_t recover_max_us;                // Longest reset and re-init
+} i2c_fault_stats_t;
+
+/**
+ * @brief Take over fault handling for a bus
+ *
+ * @param bus Bus created with i2c_new_master_bus()
+ * @param sda_pin SDA pin of the bus (sampled for stuck detection)
+ * @param scl_pin SCL pin of the bus
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: No bus
+ *    - ESP_ERR_NO_MEM: Mutex could not be created
+ */
+esp_err_t i2c_fault_init(i2c_master_bus_handle_t bus, gpio_num_t sda_pin, gpio_num_t scl_pin);
+
+/**
+ * @brief Register a device for size-based timeouts and re-init after a bus reset
+ *
+ * Registering the same ctx again replaces its entry (a driver retrying another address).
+ *
+ * @param dev Device handle
+ * @param address 7-bit address (probed to end a reset with a STOP)
+ * @param scl_hz SCL rate of the device
+ * @param name Name for logs (must stay valid)
+ * @param reinit Called after a bus reset caused by this device (NULL: none)
+ * @param ctx Passed to reinit, identifies the entry
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NO_MEM: I2C_FAULT_DEVICES_MAX devices registered
+ */
+esp_err_t i2c_fault_add_device(i2c_master_dev_handle_t dev, uint16_t address, uint32_t scl_hz,
+                               const char *name, i2c_fault_reinit_t reinit, void *ctx);
+
+/**
+ * @brief Timeout of a transfer in ms (twice the time on the wire plus the margin)
+ *
+ * @param bytes Bytes sent and received, address bytes included
+ * @param scl_hz SCL rate
+ */
+int i2c_fault_timeout_ms(size_t bytes, uint32_t scl_hz);
+
+/**
+ * @brief i2c_master_transmit() with a size-based timeout and fault handling
+ */
+esp_err_t i2c_fault_transmit(i2c_master_dev_handle_t dev, const uint8_t *data, size_t len);
+
+/**
+ * @brief i2c_master_receive() with a size-based timeout and fault handling
+ */
+esp_err_t i2c_fault_receive(i2c_master_dev_handle_t dev, uint8_t *data, size_t len);
+
+/**
+ * @brief i2c_master_transmit_receive() with a size-based timeout and fault handling
+ */
+esp_err_t i2c_fault_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *tx, size_t tx_len,
+                                     uint8_t *rx, size_t rx_len);
+
+/**
+ * @brief i2c_master_multi_buffer_transmit() with a size-based timeout and fault handling
+ */
+esp_err_t i2c_fault_multi_buffer_transmit(i2c_master_dev_handle_t dev,
+                                          i2c_master_transmit_multi_buffer_info_t *segments, size_t count);
+
+/**
+ * @brief Whether SDA or SCL is held low right now (bus idle expected)
+ */
+bool i2c_fault_bus_stuck(void);
+
+/**
+ * @brief Name of a fault kind ("nack", "timeout", "stuck", "other")
+ */
+const char *i2c_fault_kind_name(i2c_fault_kind_t kind);
+
+/**
+ * @brief Copy the fault statistics
+ */
+void i2c_fault_get_stats(i2c_fault_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // I2C_FAULT_H
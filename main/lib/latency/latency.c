@@ -0,0 +1,111 @@
+#include "latency.h"
+#include "trace.h"
+#include "dlog.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "latency";
+
+// Only the render task writes the window; s_report is copied out by the status server
+static latency_hist_t s_latency;
+static latency_hist_t s_jitter;
+static uint32_t s_detect_max_us = 0;
+static uint32_t s_queue_max_us = 0;
+static uint32_t s_draw_max_us = 0;
+static uint32_t s_transfer_max_us = 0;
+static uint32_t s_frames = 0;
+static int64_t s_window_start_us = 0;
+static int64_t s_last_end_us = 0;
+static latency_report_t s_report;
+
+static void latency_summarize(const latency_hist_t *hist, latency_summary_t *summary)
+{
+    summary->count = hist->count;
+    summary->p50_us = latency_hist_percentile(hist, 50);
+    summary->p99_us = latency_hist_percentile(hist, 99);
+    summary->max_us = hist->max_us;
+}
+
+static void latency_stage(uint32_t *max_us, int64_t from_us, int64_t to_us)
+{
+    if (from_us == 0 || to_us < from_us) {
+        return;
+    }
+    uint32_t us = (uint32_t)(to_us - from_us);
+    if (us > *max_us) {
+        *max_us = us;
+    }
+}
+
+// Publish the window, log it and start a new one
+static void latency_window_end(int64_t now_us)
+{
+    latency_report_t report = {
+        .window_s = (uint32_t)((now_us - s_window_start_us + 500000) / 1000000),
+        .frames = s_frames,
+        .detect_max_us = s_detect_max_us,
+        .queue_max_us = s_queue_max_us,
+        .draw_max_us = s_draw_max_us,
+        .transfer_max_us = s_transfer_max_us,
+    };
+    latency_summarize(&s_latency, &report.latency);
+    latency_summarize(&s_jitter, &report.jitter);
+    s_report = report;
+
+    // DLOG_MAX_ARGS per line: the jitter median is only in /status
+    DLOGI(TAG, "%" PRIu32 " frames: rollover to pixels p50 %.1f p99 %.1f max %.1f ms, jitter p99 %.1f max %.1f ms",
+          report.frames,
+          report.latency.p50_us / 1000.0, report.latency.p99_us / 1000.0, report.latency.max_us / 1000.0,
+          report.jitter.p99_us / 1000.0, report.jitter.max_us / 1000.0);
+    DLOGI(TAG, "Stage max: detect %.1f, queue %.1f, draw %.1f, transfer %.1f ms",
+          report.detect_max_us / 1000.0, report.queue_max_us / 1000.0,
+          report.draw_max_us / 1000.0, report.transfer_max_us / 1000.0);
+
+    memset(&s_latency, 0, sizeof(s_latency));
+    memset(&s_jitter, 0, sizeof(s_jitter));
+    s_detect_max_us = 0;
+    s_queue_max_us = 0;
+    s_draw_max_us = 0;
+    s_transfer_max_us = 0;
+    s_frames = 0;
+    s_window_start_us = now_us;
+}
+
+void latency_frame_done(const latency_stamps_t *stamps)
+{
+    // The transfer must belong to this render
+    if (stamps->transfer_end_us == 0 || stamps->transfer_start_us < stamps->render_us) {
+        return;
+    }
+    int64_t end_us = stamps->transfer_end_us;
+    if (s_window_start_us == 0) {
+        s_window_start_us = end_us;
+    }
+    s_frames++;
+
+    uint32_t interval_us = 0;
+    if (s_last_end_us != 0) {
+        int64_t interval = end_us - s_last_end_us;
+        interval_us = (uint32_t)interval;
+        latency_hist_add(&s_jitter, (uint32_t)(interval > 1000000 ? interval - 1000000 : 1000000 - interval));
+    }
+    s_last_end_us = end_us;
+
+    if (stamps->rollover_us != 0 && end_us > stamps->rollover_us) {
+        latency_hist_add(&s_latency, (uint32_t)(end_us - stamps->rollover_us));
+        TRACE_COMPLETE(TRACE_EV_FRAME, stamps->rollover_us, interval_us);
+    }
+    latency_stage(&s_detect_max_us, stamps->rollover_us, stamps->tick_us);
+    latency_stage(&s_queue_max_us, stamps->tick_us, stamps->render_us);
+    latency_stage(&s_draw_max_us, stamps->render_us, stamps->transfer_start_us);
+    latency_stage(&s_transfer_max_us, stamps->transfer_start_us, end_us);
+
+    if (end_us - s_window_start_us >= LATENCY_WINDOW_S * 1000000LL) {
+        latency_window_end(end_us);
+    }
+}
+
+void latency_get_report(latency_report_t *report)
+{
+    *report = s_report;
+}
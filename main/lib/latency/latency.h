@@ -0,0 +1,79 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "latency_hist.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Display latency and jitter measurement
+//
+// Every frame carries esp_timer stamps: the DS3231 second rollover (from the time service),
+// the moment the rtc task noticed it, the render task taking the frame, and the start and end
+// of the SSD1306 transfer. The render task hands them to latency_frame_done(), which keeps
+// two histograms over a window of LATENCY_WINDOW_S:
+//
+// - latency: rollover to pixels (transfer end minus rollover), only while the time service
+//   is locked (the rollover is unknown otherwise)
+// - jitter: |interval between two transfer ends - 1 s|
+//
+// At the end of each window p50/p99/max of both and the largest time spent in each stage are
+// logged and kept for /status, and the histograms start over. Buckets are exact below 32 us,
+// then 16 per power of two (at most 1/16 too high, the reported value is the bucket's upper
+// end, capped at the maximum seen; see latency_hist.h). With TRACE_ENABLED every frame is
+// also traced as a "frame" span from the rollover to the transfer end (arg0 = frame
+// interval), and tools/latency_report.py computes the same numbers from a trace dump on the
+// host.
+
+#define LATENCY_ENABLED     1       // 0 compiles the measurement out
+#define LATENCY_WINDOW_S    60      // Report interval (histograms restart)
+
+// Stamps of one frame (esp_timer microseconds)
+typedef struct {
+    int64_t rollover_us;            // DS3231 second rollover, 0 = unknown (time service not locked)
+    int64_t tick_us;                // rtc task noticed the new second
+    int64_t render_us;              // render task took the frame
+    int64_t transfer_start_us;      // SSD1306 transfer start
+    int64_t transfer_end_us;        // SSD1306 transfer end, 0 = transfer failed
+} latency_stamps_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} latency_summary_t;
+
+// Result of the last complete window
+typedef struct {
+    uint32_t window_s;              // 0 = no window completed yet
+    uint32_t frames;                // Frames displayed in the window
+    latency_summary_t latency;      // Rollover to pixels
+    latency_summary_t jitter;       // Frame interval error
+    uint32_t detect_max_us;         // Rollover to tick
+    uint32_t queue_max_us;          // Tick to render start
+    uint32_t draw_max_us;           // Render start to transfer start
+    uint32_t transfer_max_us;       // Transfer start to end
+} latency_report_t;
+
+/**
+ * @brief Record one displayed frame (render task)
+ *
+ * Frames whose transfer did not happen in this render (display missing, transfer failed)
+ * are left out.
+ */
+void latency_frame_done(const latency_stamps_t *stamps);
+
+/**
+ * @brief Copy the result of the last complete window
+ */
+void latency_get_report(latency_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_H
@@ -0,0 +1,56 @@
+#include "latency_hist.h"
+
+uint32_t latency_hist_bucket(uint32_t value_us)
+{
+    if (value_us >= (1u << LATENCY_MAX_BITS)) {
+        value_us = (1u << LATENCY_MAX_BITS) - 1;
+    }
+    if (value_us < LATENCY_LINEAR) {
+        return value_us;
+    }
+    uint32_t bits = 31 - __builtin_clz(value_us);  // 5 and up
+    return LATENCY_LINEAR + (bits - 5) * LATENCY_SUB_BUCKETS + ((value_us >> (bits - 4)) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+uint32_t latency_hist_bucket_upper(uint32_t bucket)
+{
+    if (bucket < LATENCY_LINEAR) {
+        return bucket;
+    }
+    uint32_t bits = 5 + (bucket - LATENCY_LINEAR) / LATENCY_SUB_BUCKETS;
+    uint32_t sub = (bucket - LATENCY_LINEAR) % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << (bits - 4)) - 1;
+}
+
+void latency_hist_add(latency_hist_t *hist, uint32_t value_us)
+{
+    uint32_t bucket = latency_hist_bucket(value_us);
+    if (hist->counts[bucket] < UINT16_MAX) {
+        hist->counts[bucket]++;
+    }
+    hist->count++;
+    if (value_us > hist->max_us) {
+        hist->max_us = value_us;
+    }
+}
+
+uint32_t latency_hist_percentile(const latency_hist_t *hist, uint32_t percent)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+    // Rank of the sample (1-based, rounded up)
+    uint32_t rank = (uint32_t)(((uint64_t)hist->count * percent + 99) / 100);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint32_t upper = latency_hist_bucket_upper(i);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
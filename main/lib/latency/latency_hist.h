@@ -0,0 +1,58 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log-linear histogram of microsecond values (no ESP-IDF dependencies, tested in test/host)
+//
+// Values below LATENCY_LINEAR have a bucket each, above that every power of two is split
+// into LATENCY_SUB_BUCKETS buckets, so a bucket's upper end is at most 1/16 above any value
+// in it. The layout is mirrored in tools/latency_report.py.
+
+#define LATENCY_LINEAR      32      // Values below are counted exactly
+#define LATENCY_SUB_BUCKETS 16      // Buckets per power of two above LATENCY_LINEAR
+#define LATENCY_MAX_BITS    22      // Larger values count as 2^22 - 1 us (4.2 s)
+#define LATENCY_BUCKETS     (LATENCY_LINEAR + (LATENCY_MAX_BITS - 5) * LATENCY_SUB_BUCKETS)
+
+typedef struct {
+    uint16_t counts[LATENCY_BUCKETS];   // Saturate at UINT16_MAX
+    uint32_t count;
+    uint32_t max_us;
+} latency_hist_t;
+
+/**
+ * @brief Bucket a value is counted in
+ */
+uint32_t latency_hist_bucket(uint32_t value_us);
+
+/**
+ * @brief Largest value counted in a bucket
+ */
+uint32_t latency_hist_bucket_upper(uint32_t bucket);
+
+/**
+ * @brief Add a value to a histogram
+ */
+void latency_hist_add(latency_hist_t *hist, uint32_t value_us);
+
+/**
+ * @brief Value below which a share of the samples falls (bucket upper end, capped at the maximum)
+ *
+ * The rank is 1-based and rounded up: the p-th percentile of n samples is the
+ * ceil(n * p / 100)-th smallest (at least the first).
+ *
+ * @param hist Histogram
+ * @param percent 0-100
+ * @return Microseconds, 0 for an empty histogram
+ */
+uint32_t latency_hist_percentile(const latency_hist_t *hist, uint32_t percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_HIST_H
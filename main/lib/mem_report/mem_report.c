@@ -0,0 +1,206 @@
+#include "mem_report.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+static const char *TAG = "mem_report";
+
+#define MEM_REPORT_WARN_SLOTS   12      // Tasks whose last stack warning is remembered
+
+static const uint32_t s_heap_caps[MEM_REPORT_HEAP_COUNT] = {
+    [MEM_REPORT_HEAP_INTERNAL] = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    [MEM_REPORT_HEAP_DMA] = MALLOC_CAP_DMA,
+    [MEM_REPORT_HEAP_EXEC] = MALLOC_CAP_EXEC,
+    [MEM_REPORT_HEAP_RTC] = MALLOC_CAP_RTCRAM,
+};
+
+static const char *const s_heap_names[MEM_REPORT_HEAP_COUNT] = {
+    [MEM_REPORT_HEAP_INTERNAL] = "internal",
+    [MEM_REPORT_HEAP_DMA] = "dma",
+    [MEM_REPORT_HEAP_EXEC] = "exec",
+    [MEM_REPORT_HEAP_RTC] = "rtc",
+};
+
+// Only one task checks the thresholds
+static bool s_checked = false;
+static int64_t s_last_check_us = 0;
+static uint32_t s_heap_warned = UINT32_MAX;     // Lowest value warned about so far
+static uint32_t s_block_warned = UINT32_MAX;
+static struct {
+    TaskHandle_t task;
+    uint32_t warned;
+} s_stack_warned[MEM_REPORT_WARN_SLOTS];
+
+const char *mem_report_heap_name(mem_report_heap_id_t heap)
+{
+    return heap < MEM_REPORT_HEAP_COUNT ? s_heap_names[heap] : "?";
+}
+
+static void mem_report_heap(mem_report_heap_id_t heap, mem_report_heap_t *out)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, s_heap_caps[heap]);
+    out->total = heap_caps_get_total_size(s_heap_caps[heap]);
+    out->free = info.total_free_bytes;
+    out->min_free = info.minimum_free_bytes;
+    out->largest_block = info.largest_free_block;
+}
+
+static int mem_report_task_order(const void *a, const void *b)
+{
+    UBaseType_t x = ((const TaskStatus_t *)a)->xTaskNumber;
+    UBaseType_t y = ((const TaskStatus_t *)b)->xTaskNumber;
+    return x < y ? -1 : x > y;
+}
+
+// Status of every task in creation order (free() the result), NULL when out of memory
+static TaskStatus_t *mem_report_tasks(UBaseType_t *count)
+{
+    // Room for tasks created between the two calls
+    UBaseType_t size = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *tasks = malloc(size * sizeof(TaskStatus_t));
+    *count = 0;
+    if (tasks == NULL) {
+        return NULL;
+    }
+    *count = uxTaskGetSystemState(tasks, size, NULL);
+    qsort(tasks, *count, sizeof(TaskStatus_t), mem_report_task_order);
+    return tasks;
+}
+
+esp_err_t mem_report_snapshot(mem_report_t *report, TaskStatus_t *status, size_t status_len)
+{
+    memset(report, 0, sizeof(*report));
+    for (int i = 0; i < MEM_REPORT_HEAP_COUNT; i++) {
+        mem_report_heap(i, &report->heap[i]);
+    }
+
+    // uxTaskGetSystemState() fills nothing when the buffer is too small
+    UBaseType_t count = uxTaskGetSystemState(status, (UBaseType_t)status_len, NULL);
+    if (count == 0) {
+        report->tasks_running = (uint8_t)uxTaskGetNumberOfTasks();
+        return ESP_ERR_INVALID_SIZE;
+    }
+    qsort(status, count, sizeof(TaskStatus_t), mem_report_task_order);
+    const TaskStatus_t *tasks = status;
+    report->tasks_running = count;
+    for (UBaseType_t i = 0; i < count && report->task_count < MEM_REPORT_TASKS_MAX; i++) {
+        mem_report_task_t *task = &report->tasks[report->task_count];
+        strncpy(task->name, tasks[i].pcTaskName, sizeof(task->name) - 1);
+        // Both HTTP servers run an "httpd" task
+        for (uint8_t j = 0; j < report->task_count; j++) {
+            if (strcmp(report->tasks[j].name, task->name) == 0) {
+                snprintf(task->name, sizeof(task->name), "%.9s#%u",
+                         tasks[i].pcTaskName, (unsigned)tasks[i].xTaskNumber);
+                break;
+            }
+        }
+        task->stack_free_min = tasks[i].usStackHighWaterMark;
+        report->task_count++;
+    }
+    return ESP_OK;
+}
+
+void mem_report_log(void)
+{
+    for (int i = 0; i < MEM_REPORT_HEAP_COUNT; i++) {
+        mem_report_heap_t heap;
+        mem_report_heap(i, &heap);
+        if (heap.total == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Heap %-8s total %6" PRIu32 ", free %6" PRIu32 ", min free %6" PRIu32 ", largest block %6" PRIu32,
+                 s_heap_names[i], heap.total, heap.free, heap.min_free, heap.largest_block);
+    }
+
+    UBaseType_t count;
+    TaskStatus_t *tasks = mem_report_tasks(&count);
+    if (tasks == NULL) {
+        ESP_LOGW(TAG, "No memory for the task list");
+        return;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "Task %-16s priority %2u, stack free min %5u bytes",
+                 tasks[i].pcTaskName, (unsigned)tasks[i].uxCurrentPriority,
+                 (unsigned)tasks[i].usStackHighWaterMark);
+    }
+    free(tasks);
+}
+
+// Warn about a task stack below the threshold, once per new low
+static void mem_report_check_stack(const TaskStatus_t *task)
+{
+    uint32_t free_min = task->usStackHighWaterMark;
+    if (free_min >= MEM_REPORT_STACK_WARN) {
+        return;
+    }
+    int slot = -1;
+    for (int i = 0; i < MEM_REPORT_WARN_SLOTS; i++) {
+        if (s_stack_warned[i].task == task->xHandle) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && s_stack_warned[i].task == NULL) {
+            slot = i;
+        }
+    }
+    if (slot >= 0) {
+        if (s_stack_warned[slot].task == task->xHandle && free_min >= s_stack_warned[slot].warned) {
+            return;
+        }
+        s_stack_warned[slot].task = task->xHandle;
+        s_stack_warned[slot].warned = free_min;
+    }
+    ESP_LOGW(TAG, "Task %s: only %" PRIu32 " bytes of stack were left (warning below %d)",
+             task->pcTaskName, free_min, MEM_REPORT_STACK_WARN);
+}
+
+void mem_report_service(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (s_checked && now_us - s_last_check_us < MEM_REPORT_INTERVAL_S * 1000000LL) {
+        return;
+    }
+    s_checked = true;
+    s_last_check_us = now_us;
+
+    mem_report_heap_t heap;
+    mem_report_heap(MEM_REPORT_HEAP_INTERNAL, &heap);
+    if (heap.min_free < MEM_REPORT_HEAP_WARN && heap.min_free < s_heap_warned) {
+        s_heap_warned = heap.min_free;
+        ESP_LOGW(TAG, "Internal heap went down to %" PRIu32 " bytes free (warning below %d)",
+                 heap.min_free, MEM_REPORT_HEAP_WARN);
+    }
+    if (heap.largest_block < MEM_REPORT_BLOCK_WARN && heap.largest_block < s_block_warned) {
+        s_block_warned = heap.largest_block;
+        ESP_LOGW(TAG, "Largest free internal block is %" PRIu32 " bytes, %" PRIu32 " free (warning below %d)",
+                 heap.largest_block, heap.free, MEM_REPORT_BLOCK_WARN);
+    }
+
+    UBaseType_t count;
+    TaskStatus_t *tasks = mem_report_tasks(&count);
+    if (tasks == NULL) {
+        return;  // Tried again at the next check
+    }
+    // Forget tasks that were deleted (ntp_sync is recreated for every sync)
+    for (int i = 0; i < MEM_REPORT_WARN_SLOTS; i++) {
+        bool running = false;
+        for (UBaseType_t j = 0; j < count && !running; j++) {
+            running = tasks[j].xHandle == s_stack_warned[i].task;
+        }
+        if (!running) {
+            s_stack_warned[i].task = NULL;
+        }
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        mem_report_check_stack(&tasks[i]);
+    }
+    free(tasks);
+}
@@ -0,0 +1,91 @@
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runtime memory accounting
+//
+// Heap by capability (total, free, minimum free since boot, largest free block) and the stack
+// high-water mark of every task, found with uxTaskGetSystemState() (needs
+// CONFIG_FREERTOS_USE_TRACE_FACILITY), so main, sys_evt, httpd and tasks added later are all
+// covered. mem_report_service() checks them every MEM_REPORT_INTERVAL_S from the net task and
+// warns when one falls below its threshold; a value is reported again only when it gets lower.
+//
+// The static footprint per component is reported at build time from the linker map
+// (tools/mem_report.py, run after each link).
+
+#define MEM_REPORT_INTERVAL_S   60
+#define MEM_REPORT_HEAP_WARN    (32 * 1024)     // Minimum free internal heap since boot
+#define MEM_REPORT_BLOCK_WARN   (8 * 1024)      // Largest free internal block
+#define MEM_REPORT_STACK_WARN   256             // Smallest free stack of any task (bytes)
+#define MEM_REPORT_TASKS_MAX    20              // Tasks in a snapshot
+#define MEM_REPORT_TASK_NAME    16
+
+// Heaps by capability
+typedef enum {
+    MEM_REPORT_HEAP_INTERNAL,   // MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT (DRAM)
+    MEM_REPORT_HEAP_DMA,        // MALLOC_CAP_DMA
+    MEM_REPORT_HEAP_EXEC,       // MALLOC_CAP_EXEC (IRAM, none while memory protection is on)
+    MEM_REPORT_HEAP_RTC,        // MALLOC_CAP_RTCRAM (RTC fast memory added to the heap)
+    MEM_REPORT_HEAP_COUNT,
+} mem_report_heap_id_t;
+
+typedef struct {
+    uint32_t total;
+    uint32_t free;
+    uint32_t min_free;              // Smallest free size since boot
+    uint32_t largest_block;
+} mem_report_heap_t;
+
+typedef struct {
+    char name[MEM_REPORT_TASK_NAME];    // Repeated names get a "#<task number>" suffix
+    uint32_t stack_free_min;            // High-water mark: smallest free stack seen, in bytes
+} mem_report_task_t;
+
+typedef struct {
+    mem_report_heap_t heap[MEM_REPORT_HEAP_COUNT];
+    mem_report_task_t tasks[MEM_REPORT_TASKS_MAX];
+    uint8_t task_count;
+    uint8_t tasks_running;          // More than task_count when the task list did not fit
+} mem_report_t;
+
+/**
+ * @brief Name of a heap ("internal", "dma", "exec", "rtc")
+ */
+const char *mem_report_heap_name(mem_report_heap_id_t heap);
+
+/**
+ * @brief Take a snapshot of the heaps and task stacks without allocating
+ *
+ * @param report Filled in (tasks are left out when they do not fit in status)
+ * @param status Work buffer for uxTaskGetSystemState(), e.g. a static TaskStatus_t[MEM_REPORT_TASKS_MAX]
+ * @param status_len Entries in status
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_SIZE: Heaps only, more tasks are running than status holds
+ */
+esp_err_t mem_report_snapshot(mem_report_t *report, TaskStatus_t *status, size_t status_len);
+
+/**
+ * @brief Log the heaps and the stack high-water mark of every task
+ */
+void mem_report_log(void);
+
+/**
+ * @brief Check the thresholds when due (call from one task periodically)
+ */
+void mem_report_service(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_REPORT_H
@@ -0,0 +1,524 @@
+#include "ntp_client.h"
+#include "ntp_proto.h"
+#include "ntp_dns.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+static const char *TAG = "ntp_client";
+
+#define NTP_DNS_TIMEOUT_MS      1000    // All lookups of a sync run at once; a failed refresh keeps the old address
+#define NTP_DNS_TTL_LITERAL     UINT32_MAX  // Servers given as IPv4 addresses never expire
+
+// NVS configuration
+// Note: Use independent namespace "ntp_cache", isolated from "time_sync"
+#define NVS_NAMESPACE_NTP       "ntp_cache"
+#define NVS_KEY_SERVERS         "servers"
+#define NTP_CACHE_VERSION       2
+
+#define US_PER_S                1000000LL
+
+// Cached server (persisted)
+typedef struct {
+    char name[NTP_CLIENT_NAME_MAX_LEN];
+    uint32_t addr;          // IPv4 address, network byte order (0 = not resolved)
+    uint32_t resolved_at;   // Unix time of the lookup (0 = resolved during the current sync)
+    uint32_t ttl_s;         // Lifetime of the address (record TTL)
+    uint32_t rtt_us;        // Smoothed round-trip delay (0 = no reply yet)
+} ntp_cache_entry_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    uint8_t reserved[2];
+    ntp_cache_entry_t entries[NTP_CLIENT_MAX_SERVERS];
+} ntp_cache_t;
+
+// Per-sync server state (snapshot of the cache plus the outstanding request)
+typedef struct {
+    uint32_t addr;
+    uint32_t rtt_us;
+    uint8_t nonce[NTP_NONCE_SIZE];  // Transmit timestamp of the outstanding request
+    int64_t t1_us;          // esp_timer time the request was sent
+    bool outstanding;
+    bool excluded;          // Kiss-o'-Death: no more requests during this sync
+} ntp_peer_t;
+
+static ntp_cache_t s_cache;
+static size_t s_server_count = 0;
+
+// Save cache to NVS
+static esp_err_t ntp_cache_save(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_NTP, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, NVS_KEY_SERVERS, &s_cache, sizeof(s_cache));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error saving server cache: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+// Resolve a server name to an IPv4 address (blocking DNS lookup, no TTL)
+static esp_err_t ntp_resolve(const char *name, uint32_t *addr)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(name, NULL, &hints, &res) != 0 || !res) {
+        ESP_LOGW(TAG, "Cannot resolve %s", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return ESP_OK;
+}
+
+// First IPv4 DNS server of the network (0 if there is none)
+static uint32_t ntp_dns_server(void)
+{
+    for (uint8_t i = 0; i < DNS_MAX_SERVERS; i++) {
+        const ip_addr_t *server = dns_getserver(i);
+        if (server && IP_IS_V4(server) && !ip_addr_isany(server)) {
+            return ip4_addr_get_u32(ip_2_ip4(server));
+        }
+    }
+    return 0;
+}
+
+// Look up the address and TTL of the selected servers; addrs[i] stays 0 if a lookup fails
+// All queries are sent at once and answered within NTP_DNS_TIMEOUT_MS. Without an IPv4 DNS
+// server, getaddrinfo() is used and its results are kept for NTP_CLIENT_DNS_MAX_TTL_S.
+static void ntp_lookup(const bool *selected, uint32_t *addrs, uint32_t *ttls)
+{
+    uint8_t pkt[NTP_DNS_PACKET_MAX];
+    uint16_t ids[NTP_CLIENT_MAX_SERVERS];
+    bool pending[NTP_CLIENT_MAX_SERVERS] = {0};
+    size_t waiting = 0;
+    struct sockaddr_in dns = {
+        .sin_family = AF_INET,
+        .sin_port = htons(NTP_DNS_PORT),
+    };
+    dns.sin_addr.s_addr = ntp_dns_server();
+    int sock = dns.sin_addr.s_addr != 0 ? socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP) : -1;
+
+    for (size_t i = 0; i < s_server_count; i++) {
+        addrs[i] = 0;
+        if (!selected[i]) {
+            continue;
+        }
+        const char *name = s_cache.entries[i].name;
+        uint32_t literal;
+        if (inet_pton(AF_INET, name, &literal) == 1) {
+            addrs[i] = literal;
+            ttls[i] = NTP_DNS_TTL_LITERAL;
+            continue;
+        }
+        if (sock < 0) {
+            if (ntp_resolve(name, &addrs[i]) == ESP_OK) {
+                ttls[i] = NTP_CLIENT_DNS_MAX_TTL_S;
+            }
+            continue;
+        }
+        esp_fill_random(&ids[i], sizeof(ids[i]));
+        size_t len = ntp_dns_query(pkt, ids[i], name);
+        if (len == 0) {
+            ESP_LOGW(TAG, "Cannot resolve %s: not a host name", name);
+            continue;
+        }
+        if (sendto(sock, pkt, len, 0, (struct sockaddr *)&dns, sizeof(dns)) != (int)len) {
+            ESP_LOGW(TAG, "DNS query for %s not sent: errno %d", name, errno);
+            continue;
+        }
+        pending[i] = true;
+        waiting++;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + NTP_DNS_TIMEOUT_MS * 1000LL;
+    while (waiting > 0) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            break;
+        }
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        struct timeval timeout = {
+            .tv_sec = remaining_us / US_PER_S,
+            .tv_usec = remaining_us % US_PER_S,
+        };
+        if (select(sock + 1, &fds, NULL, NULL, &timeout) <= 0) {
+            break;
+        }
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&from, &from_len);
+        if (len <= 0 || from.sin_addr.s_addr != dns.sin_addr.s_addr || from.sin_port != dns.sin_port) {
+            continue;
+        }
+        for (size_t i = 0; i < s_server_count; i++) {
+            if (!pending[i]) {
+                continue;
+            }
+            uint32_t addr, ttl_s;
+            ntp_dns_reply_t reply = ntp_dns_parse(pkt, (size_t)len, ids[i], s_cache.entries[i].name, &addr, &ttl_s);
+            if (reply == NTP_DNS_INVALID) {
+                continue;
+            }
+            pending[i] = false;
+            waiting--;
+            if (reply == NTP_DNS_OK) {
+                addrs[i] = addr;
+                ttls[i] = ttl_s < NTP_CLIENT_DNS_MAX_TTL_S ? ttl_s : NTP_CLIENT_DNS_MAX_TTL_S;
+            } else {
+                ESP_LOGW(TAG, "Cannot resolve %s: no IPv4 address", s_cache.entries[i].name);
+            }
+            break;
+        }
+    }
+    for (size_t i = 0; i < s_server_count; i++) {
+        if (pending[i]) {
+            ESP_LOGW(TAG, "Cannot resolve %s: no DNS reply", s_cache.entries[i].name);
+        }
+    }
+    if (sock >= 0) {
+        close(sock);
+    }
+}
+
+// Resolve servers during a sync (all of them, or only those without a cached address)
+// Returns true if at least one address was looked up
+static bool ntp_resolve_peers(ntp_peer_t *peers, bool all)
+{
+    bool selected[NTP_CLIENT_MAX_SERVERS];
+    bool looked_up = false;
+    for (size_t i = 0; i < s_server_count; i++) {
+        selected[i] = all || peers[i].addr == 0;
+        looked_up |= selected[i];
+    }
+    if (!looked_up) {
+        return false;
+    }
+
+    uint32_t addrs[NTP_CLIENT_MAX_SERVERS];
+    uint32_t ttls[NTP_CLIENT_MAX_SERVERS];
+    ntp_lookup(selected, addrs, ttls);
+    for (size_t i = 0; i < s_server_count; i++) {
+        if (addrs[i] == 0) {
+            continue;
+        }
+        peers[i].addr = addrs[i];
+        s_cache.entries[i].addr = addrs[i];
+        s_cache.entries[i].resolved_at = 0;  // Time-stamped once the sync knows the time
+        s_cache.entries[i].ttl_s = ttls[i];
+    }
+    return true;
+}
+
+// Re-resolve expired cache entries after a successful sync, while WiFi is still connected
+// (before the DS3231 write, which ends the bring-up); failed lookups are retried next sync
+static void ntp_refresh(int64_t offset_us)
+{
+    int64_t now_s = (esp_timer_get_time() + offset_us) / US_PER_S;
+    bool selected[NTP_CLIENT_MAX_SERVERS];
+    bool expired = false;
+    for (size_t i = 0; i < s_server_count; i++) {
+        ntp_cache_entry_t *entry = &s_cache.entries[i];
+        if (entry->addr != 0 && entry->resolved_at == 0) {
+            entry->resolved_at = (uint32_t)now_s;
+        }
+        selected[i] = now_s - (int64_t)entry->resolved_at >= (int64_t)entry->ttl_s;
+        expired |= selected[i];
+    }
+    if (!expired) {
+        return;
+    }
+
+    uint32_t addrs[NTP_CLIENT_MAX_SERVERS];
+    uint32_t ttls[NTP_CLIENT_MAX_SERVERS];
+    ntp_lookup(selected, addrs, ttls);
+    now_s = (esp_timer_get_time() + offset_us) / US_PER_S;
+    for (size_t i = 0; i < s_server_count; i++) {
+        ntp_cache_entry_t *entry = &s_cache.entries[i];
+        if (addrs[i] == 0) {
+            continue;
+        }
+        if (entry->addr != addrs[i]) {
+            char addr_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &addrs[i], addr_str, sizeof(addr_str));
+            ESP_LOGI(TAG, "%s moved to %s", entry->name, addr_str);
+        }
+        entry->addr = addrs[i];
+        entry->resolved_at = (uint32_t)now_s;
+        entry->ttl_s = ttls[i];
+    }
+}
+
+// Update a server's smoothed round-trip delay
+static void ntp_update_rtt(size_t idx, int64_t delay_us)
+{
+    s_cache.entries[idx].rtt_us = ntp_smooth_rtt(s_cache.entries[idx].rtt_us, delay_us);
+}
+
+// Send a request with a random nonce as transmit timestamp
+static esp_err_t ntp_send(int sock, ntp_peer_t *peer)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    esp_fill_random(peer->nonce, sizeof(peer->nonce));
+    ntp_request(pkt, peer->nonce);
+
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(NTP_PORT),
+    };
+    to.sin_addr.s_addr = peer->addr;
+
+    peer->t1_us = esp_timer_get_time();
+    if (sendto(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&to, sizeof(to)) != sizeof(pkt)) {
+        ESP_LOGW(TAG, "sendto failed: errno %d", errno);
+        return ESP_FAIL;
+    }
+    peer->outstanding = true;
+    return ESP_OK;
+}
+
+// Wait for the next valid reply to any outstanding request
+// Returns the server index, or -1 on timeout or when no request is outstanding
+static int ntp_receive(int sock, ntp_peer_t *peers, int64_t deadline_us, ntp_sample_t *sample)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    while (1) {
+        bool waiting = false;
+        for (size_t i = 0; i < s_server_count; i++) {
+            waiting |= peers[i].outstanding;
+        }
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (!waiting || remaining_us <= 0) {
+            return -1;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        struct timeval timeout = {
+            .tv_sec = remaining_us / US_PER_S,
+            .tv_usec = remaining_us % US_PER_S,
+        };
+        if (select(sock + 1, &fds, NULL, NULL, &timeout) <= 0) {
+            return -1;
+        }
+
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&from, &from_len);
+        int64_t t4 = esp_timer_get_time();
+        if (len < NTP_PACKET_SIZE) {
+            continue;
+        }
+
+        // Match the reply to its request: source address and echoed transmit timestamp
+        int idx = -1;
+        for (size_t i = 0; i < s_server_count; i++) {
+            if (peers[i].outstanding && peers[i].addr == from.sin_addr.s_addr &&
+                ntp_reply_matches(pkt, peers[i].nonce)) {
+                idx = (int)i;
+                break;
+            }
+        }
+        if (idx < 0) {
+            continue;  // Stale, duplicate or foreign reply
+        }
+        peers[idx].outstanding = false;
+
+        ntp_reply_t reply = ntp_parse(pkt, peers[idx].t1_us, t4, sample);
+        if (reply == NTP_REPLY_KOD) {
+            // Reference ID holds a 4-character code (RATE, DENY, ...)
+            ESP_LOGW(TAG, "Kiss-o'-Death from %s: %.4s", s_cache.entries[idx].name, (const char *)&pkt[NTP_REF_ID]);
+            peers[idx].excluded = true;
+            continue;
+        }
+        if (reply != NTP_REPLY_OK) {
+            ESP_LOGD(TAG, "%s reply from %s", reply == NTP_REPLY_UNSYNCHRONIZED ? "Unsynchronized" : "Invalid",
+                     s_cache.entries[idx].name);
+            continue;
+        }
+        ntp_update_rtt(idx, sample->delay_us);
+        return idx;
+    }
+}
+
+// Send one request to every usable server, smallest smoothed delay first; first valid reply wins
+static int ntp_race(int sock, ntp_peer_t *peers, ntp_sample_t *sample)
+{
+    uint32_t rtt_us[NTP_CLIENT_MAX_SERVERS];
+    uint8_t order[NTP_CLIENT_MAX_SERVERS];
+    for (size_t i = 0; i < s_server_count; i++) {
+        rtt_us[i] = peers[i].rtt_us;
+    }
+    ntp_race_order(rtt_us, s_server_count, order);
+
+    bool sent = false;
+    for (size_t k = 0; k < s_server_count; k++) {
+        ntp_peer_t *peer = &peers[order[k]];
+        if (peer->addr != 0 && !peer->excluded && ntp_send(sock, peer) == ESP_OK) {
+            sent = true;
+        }
+    }
+    if (!sent) {
+        return -1;
+    }
+    return ntp_receive(sock, peers, esp_timer_get_time() + NTP_RECV_TIMEOUT_MS * 1000LL, sample);
+}
+
+esp_err_t ntp_client_init(const char *const servers[], size_t count)
+{
+    if (!servers || count == 0 || count > NTP_CLIENT_MAX_SERVERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!servers[i] || strlen(servers[i]) >= NTP_CLIENT_NAME_MAX_LEN) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    ntp_cache_t loaded;
+    bool have_loaded = false;
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_NTP, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK) {
+        size_t size = sizeof(loaded);
+        err = nvs_get_blob(nvs_handle, NVS_KEY_SERVERS, &loaded, &size);
+        nvs_close(nvs_handle);
+        have_loaded = err == ESP_OK && size == sizeof(loaded) && loaded.version == NTP_CACHE_VERSION &&
+                      loaded.count <= NTP_CLIENT_MAX_SERVERS;
+        if (err == ESP_OK && !have_loaded) {
+            ESP_LOGW(TAG, "Discarding incompatible server cache");
+        }
+    }
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGD(TAG, "Server cache not loaded: %s", esp_err_to_name(err));
+    }
+
+    memset(&s_cache, 0, sizeof(s_cache));
+    s_cache.version = NTP_CACHE_VERSION;
+    s_cache.count = (uint8_t)count;
+    int cached = 0;
+    for (size_t i = 0; i < count; i++) {
+        ntp_cache_entry_t *entry = &s_cache.entries[i];
+        strcpy(entry->name, servers[i]);
+        for (size_t j = 0; have_loaded && j < loaded.count; j++) {
+            if (strncmp(loaded.entries[j].name, servers[i], NTP_CLIENT_NAME_MAX_LEN) == 0) {
+                *entry = loaded.entries[j];
+                cached += entry->addr != 0;
+                break;
+            }
+        }
+    }
+    s_server_count = count;
+
+    ESP_LOGI(TAG, "%d servers, %d cached addresses", (int)count, cached);
+    return ESP_OK;
+}
+
+esp_err_t ntp_client_sync(uint8_t samples, ntp_client_result_t *result)
+{
+    if (!result || samples == 0 || samples > NTP_CLIENT_MAX_SAMPLES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_server_count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(result, 0, sizeof(*result));
+
+    // Snapshot cached addresses and delays; only servers never resolved are looked up now
+    ntp_peer_t peers[NTP_CLIENT_MAX_SERVERS];
+    memset(peers, 0, sizeof(peers));
+    bool any_cached = false;
+    for (size_t i = 0; i < s_server_count; i++) {
+        peers[i].addr = s_cache.entries[i].addr;
+        peers[i].rtt_us = s_cache.entries[i].rtt_us;
+        any_cached |= peers[i].addr != 0;
+    }
+    ntp_resolve_peers(peers, false);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    ntp_sample_t sample;
+    int winner = ntp_race(sock, peers, &sample);
+    if (winner < 0 && any_cached) {
+        // Cached addresses may have gone stale: look everything up again and race once more
+        ESP_LOGW(TAG, "No reply from cached addresses, resolving again");
+        if (ntp_resolve_peers(peers, true)) {
+            winner = ntp_race(sock, peers, &sample);
+        }
+    }
+    if (winner < 0) {
+        close(sock);
+        ESP_LOGW(TAG, "No valid reply from any server");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ntp_filter_t filter;
+    ntp_filter_reset(&filter);
+    ntp_filter_add(&filter, &sample);
+    result->server = (uint8_t)winner;
+    result->first_reply_us = sample.t4_us;
+
+    // Rest of the burst from the winner; clock filter keeps the lowest-delay sample
+    for (uint8_t i = 1; i < samples && !peers[winner].excluded; i++) {
+        vTaskDelay(pdMS_TO_TICKS(NTP_SAMPLE_SPACING_MS));
+        if (ntp_send(sock, &peers[winner]) != ESP_OK) {
+            break;
+        }
+        int64_t deadline_us = esp_timer_get_time() + NTP_RECV_TIMEOUT_MS * 1000LL;
+        int idx;
+        do {
+            idx = ntp_receive(sock, peers, deadline_us, &sample);  // Late race replies only update delays
+        } while (idx >= 0 && idx != winner);
+        if (idx != winner) {
+            continue;
+        }
+
+        ESP_LOGD(TAG, "Sample %d: offset %lld us, delay %lld us", i,
+                 (long long)sample.offset_us, (long long)sample.delay_us);
+        ntp_filter_add(&filter, &sample);
+    }
+    close(sock);
+
+    result->samples = filter.count;
+    result->offset_us = filter.best.offset_us;
+    result->delay_us = filter.best.delay_us > UINT32_MAX ? UINT32_MAX : (uint32_t)filter.best.delay_us;
+    result->stratum = filter.best.stratum;
+
+    ESP_LOGI(TAG, "%s answered first: %d/%d samples, best delay %" PRIu32 " us (stratum %d)",
+             s_cache.entries[winner].name, result->samples, samples, result->delay_us, result->stratum);
+
+    // Time-stamp fresh lookups and refresh expired ones while still connected, persist delays
+    ntp_refresh(result->offset_us);
+    ntp_cache_save();
+    return ESP_OK;
+}
@@ -0,0 +1,91 @@
+#ifndef NTP_CLIENT_H
+#define NTP_CLIENT_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Multi-sample NTP client (RFC 5905 on-wire protocol, client mode)
+//
+// A sync races one request to every configured server and takes the first valid reply,
+// then sends the rest of the burst to that server and keeps the sample with the lowest
+// round-trip delay (NTP clock-filter rule: its offset has the smallest error bound).
+// Offsets are expressed against esp_timer, so the result can be used to act on an exact
+// UTC instant (e.g. writing the DS3231 on a second boundary) without touching system time.
+//
+// Resolved server addresses and smoothed round-trip delays are kept in NVS. Cached
+// addresses are used directly; addresses older than their DNS record's TTL are looked up
+// again at the end of a successful sync, while WiFi is still connected, so DNS is not on
+// the critical path.
+
+#define NTP_CLIENT_MAX_SERVERS      4
+#define NTP_CLIENT_NAME_MAX_LEN     32
+#define NTP_CLIENT_MAX_SAMPLES      8
+#define NTP_CLIENT_DNS_MAX_TTL_S    (24 * 3600)  // Longest cache lifetime (also for getaddrinfo() results, which have no TTL)
+
+// Best sample of a sync
+typedef struct {
+    int64_t offset_us;          // UTC minus esp_timer, in microseconds
+    uint32_t delay_us;          // Round-trip delay of the selected sample (error bound is delay / 2)
+    uint8_t samples;            // Valid replies from the selected server
+    uint8_t stratum;            // Server stratum
+    uint8_t server;             // Index of the server that answered first
+    int64_t first_reply_us;     // esp_timer time of the first valid reply
+} ntp_client_result_t;
+
+/**
+ * @brief Set the server list and load cached addresses from NVS
+ *
+ * Must be called after nvs_flash_init(). Cache entries are matched by name,
+ * so changing the server list drops the entries of removed servers.
+ *
+ * @param servers Host names or IPv4 addresses (strings must stay valid)
+ * @param count Number of servers (1 to NTP_CLIENT_MAX_SERVERS)
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid parameter
+ */
+esp_err_t ntp_client_init(const char *const servers[], size_t count);
+
+/**
+ * @brief Sync against the configured servers
+ *
+ * Blocking: about one round trip for the race plus (samples - 1) * sample
+ * spacing for the burst, at most one receive timeout per lost reply.
+ * Servers without a cached address are resolved first; if no cached
+ * address answers, all servers are resolved again and raced once more.
+ * After a valid reply, expired addresses are looked up again (one DNS
+ * round trip, at most 1 s) before the function returns.
+ *
+ * @param samples Number of samples from the selected server (1 to NTP_CLIENT_MAX_SAMPLES)
+ * @param result Output parameter
+ * @return
+ *    - ESP_OK: At least one valid reply
+ *    - ESP_ERR_INVALID_ARG: Invalid parameter
+ *    - ESP_ERR_INVALID_STATE: Not initialized
+ *    - ESP_ERR_TIMEOUT: No valid reply
+ *    - ESP_FAIL: Socket error
+ */
+esp_err_t ntp_client_sync(uint8_t samples, ntp_client_result_t *result);
+
+/**
+ * @brief Convert an esp_timer timestamp to UTC using a sync result
+ *
+ * @param result Sync result
+ * @param timer_us esp_timer time, in microseconds
+ * @return Microseconds since 1970-01-01 00:00:00 UTC
+ */
+static inline int64_t ntp_client_utc_us(const ntp_client_result_t *result, int64_t timer_us)
+{
+    return timer_us + result->offset_us;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NTP_CLIENT_H
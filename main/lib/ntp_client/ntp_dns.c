@@ -0,0 +1,165 @@
+#include "ntp_dns.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Header flags (RFC 1035, section 4.1.1)
+#define NTP_DNS_FLAG_QR         0x80    // Byte 2: response
+#define NTP_DNS_OPCODE_MASK     0x78    // Byte 2: opcode (0 = standard query)
+#define NTP_DNS_FLAG_RD         0x01    // Byte 2: recursion desired
+#define NTP_DNS_RCODE_MASK      0x0F    // Byte 3: response code (0 = no error)
+
+#define NTP_DNS_TYPE_A          1
+#define NTP_DNS_TYPE_CNAME      5
+#define NTP_DNS_CLASS_IN        1
+#define NTP_DNS_LABEL_MAX       63
+#define NTP_DNS_RECORD_FIXED    10      // Type, class, TTL, data length after the owner name
+
+static uint16_t ntp_dns_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t ntp_dns_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Length of the next label of a host name (up to the dot or the end)
+static size_t ntp_dns_label_len(const char *label)
+{
+    const char *dot = strchr(label, '.');
+    return dot ? (size_t)(dot - label) : strlen(label);
+}
+
+size_t ntp_dns_query(uint8_t *pkt, uint16_t id, const char *name)
+{
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > NTP_DNS_NAME_MAX) {
+        return 0;
+    }
+    memset(pkt, 0, NTP_DNS_HEADER_SIZE);
+    pkt[0] = id >> 8;
+    pkt[1] = id & 0xFF;
+    pkt[2] = NTP_DNS_FLAG_RD;
+    pkt[5] = 1;     // QDCOUNT
+
+    size_t pos = NTP_DNS_HEADER_SIZE;
+    const char *label = name;
+    while (1) {
+        size_t len = ntp_dns_label_len(label);
+        if (len == 0 || len > NTP_DNS_LABEL_MAX) {
+            return 0;
+        }
+        pkt[pos++] = (uint8_t)len;
+        memcpy(&pkt[pos], label, len);
+        pos += len;
+        if (label[len] == '\0') {
+            break;
+        }
+        label += len + 1;
+    }
+    pkt[pos++] = 0;
+    pkt[pos++] = 0;
+    pkt[pos++] = NTP_DNS_TYPE_A;
+    pkt[pos++] = 0;
+    pkt[pos++] = NTP_DNS_CLASS_IN;
+    return pos;
+}
+
+// Position after the question if it asks for name's A record, 0 otherwise
+// (labels only: the question is the first name in the packet, so it has no pointers)
+static size_t ntp_dns_match_question(const uint8_t *pkt, size_t len, const char *name)
+{
+    size_t pos = NTP_DNS_HEADER_SIZE;
+    const char *label = name;
+    while (1) {
+        size_t label_len = ntp_dns_label_len(label);
+        if (pos + 1 + label_len > len || pkt[pos] != label_len) {
+            return 0;
+        }
+        for (size_t i = 0; i < label_len; i++) {
+            if (tolower(pkt[pos + 1 + i]) != tolower((unsigned char)label[i])) {
+                return 0;
+            }
+        }
+        pos += 1 + label_len;
+        if (label[label_len] == '\0') {
+            break;
+        }
+        label += label_len + 1;
+    }
+    if (pos + 5 > len || pkt[pos] != 0 || ntp_dns_u16(&pkt[pos + 1]) != NTP_DNS_TYPE_A ||
+        ntp_dns_u16(&pkt[pos + 3]) != NTP_DNS_CLASS_IN) {
+        return 0;
+    }
+    return pos + 5;
+}
+
+// Position after a record owner name (labels, ending in a root label or a pointer), 0 if malformed
+static size_t ntp_dns_skip_name(const uint8_t *pkt, size_t len, size_t pos)
+{
+    while (pos < len) {
+        uint8_t label_len = pkt[pos];
+        if ((label_len & 0xC0) == 0xC0) {
+            return pos + 2 <= len ? pos + 2 : 0;
+        }
+        if (label_len & 0xC0) {
+            return 0;   // Reserved label types
+        }
+        if (label_len == 0) {
+            return pos + 1;
+        }
+        pos += 1 + label_len;
+    }
+    return 0;
+}
+
+ntp_dns_reply_t ntp_dns_parse(const uint8_t *pkt, size_t len, uint16_t id, const char *name,
+                              uint32_t *addr, uint32_t *ttl_s)
+{
+    if (len < NTP_DNS_HEADER_SIZE || ntp_dns_u16(&pkt[0]) != id || !(pkt[2] & NTP_DNS_FLAG_QR) ||
+        (pkt[2] & NTP_DNS_OPCODE_MASK) != 0 || ntp_dns_u16(&pkt[4]) != 1) {
+        return NTP_DNS_INVALID;
+    }
+    size_t pos = ntp_dns_match_question(pkt, len, name);
+    if (pos == 0) {
+        return NTP_DNS_INVALID;
+    }
+    if ((pkt[3] & NTP_DNS_RCODE_MASK) != 0) {
+        return NTP_DNS_NO_ADDRESS;
+    }
+
+    uint32_t ttl_min = UINT32_MAX;
+    uint16_t answers = ntp_dns_u16(&pkt[6]);
+    for (uint16_t i = 0; i < answers; i++) {
+        pos = ntp_dns_skip_name(pkt, len, pos);
+        if (pos == 0 || pos + NTP_DNS_RECORD_FIXED > len) {
+            return NTP_DNS_INVALID;
+        }
+        uint16_t type = ntp_dns_u16(&pkt[pos]);
+        uint16_t class = ntp_dns_u16(&pkt[pos + 2]);
+        uint32_t ttl = ntp_dns_u32(&pkt[pos + 4]);
+        uint16_t data_len = ntp_dns_u16(&pkt[pos + 8]);
+        pos += NTP_DNS_RECORD_FIXED;
+        if (pos + data_len > len) {
+            return NTP_DNS_INVALID;
+        }
+        bool address = type == NTP_DNS_TYPE_A && data_len == 4;
+        if (class == NTP_DNS_CLASS_IN && (address || type == NTP_DNS_TYPE_CNAME)) {
+            if (ttl & 0x80000000u) {
+                ttl = 0;
+            }
+            if (ttl < ttl_min) {
+                ttl_min = ttl;
+            }
+            if (address) {
+                memcpy(addr, &pkt[pos], 4);     // Stays in network byte order
+                *ttl_s = ttl_min;
+                return NTP_DNS_OK;
+            }
+        }
+        pos += data_len;
+    }
+    return NTP_DNS_NO_ADDRESS;
+}
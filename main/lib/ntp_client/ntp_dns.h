@@ -0,0 +1,56 @@
+#ifndef NTP_DNS_H
+#define NTP_DNS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// DNS A lookups for the server cache, without ESP-IDF dependencies (tested in test/host)
+//
+// getaddrinfo() does not report record TTLs, so ntp_client asks the network's DNS server
+// itself (RFC 1035, one question, recursion desired) and keeps each address for as long as
+// its record allows.
+
+#define NTP_DNS_PORT            53
+#define NTP_DNS_HEADER_SIZE     12
+#define NTP_DNS_NAME_MAX        253     // Text form without the trailing dot
+#define NTP_DNS_PACKET_MAX      512     // Plain UDP DNS without EDNS (queries fit as well)
+
+typedef enum {
+    NTP_DNS_OK,                 // IPv4 address found
+    NTP_DNS_INVALID,            // Malformed, or not the reply to this query (ignore it)
+    NTP_DNS_NO_ADDRESS,         // The server answered without an IPv4 address (NXDOMAIN, failure, no A record)
+} ntp_dns_reply_t;
+
+/**
+ * @brief Build an A query for a host name
+ *
+ * @param pkt Output buffer of NTP_DNS_PACKET_MAX bytes
+ * @param id Query ID (random, so replies cannot be guessed)
+ * @param name Host name, dot-separated labels of 1 to 63 characters
+ * @return Packet length, 0 if the name cannot be encoded
+ */
+size_t ntp_dns_query(uint8_t *pkt, uint16_t id, const char *name);
+
+/**
+ * @brief Read the IPv4 address of a reply to ntp_dns_query()
+ *
+ * The reply must carry the query's ID and question (names compare case-insensitively).
+ * The first A record is taken; its TTL is the smallest one of the records up to it, so
+ * a CNAME that expires earlier shortens it. TTLs with the top bit set count as 0
+ * (RFC 2181, section 8).
+ *
+ * @param addr IPv4 address, network byte order
+ * @param ttl_s Seconds the address may be cached
+ */
+ntp_dns_reply_t ntp_dns_parse(const uint8_t *pkt, size_t len, uint16_t id, const char *name,
+                              uint32_t *addr, uint32_t *ttl_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NTP_DNS_H
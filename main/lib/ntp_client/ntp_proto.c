@@ -0,0 +1,129 @@
+#include "ntp_proto.h"
+#include <string.h>
+
+#define US_PER_S                1000000LL
+
+static inline uint32_t ntp_get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void ntp_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+int64_t ntp_to_unix_us(const uint8_t p[8])
+{
+    uint32_t sec = ntp_get_u32(p);
+    uint32_t frac = ntp_get_u32(p + 4);
+    int64_t unix_s = (int64_t)sec - NTP_UNIX_EPOCH_OFFSET;
+    if (!(sec & 0x80000000u)) {
+        unix_s += 1LL << 32;
+    }
+    return unix_s * US_PER_S + (int64_t)(((uint64_t)frac * US_PER_S) >> 32);
+}
+
+void ntp_from_unix_us(int64_t unix_us, uint8_t p[8])
+{
+    int64_t unix_s = unix_us / US_PER_S;
+    int64_t us = unix_us % US_PER_S;
+    if (us < 0) {
+        unix_s--;
+        us += US_PER_S;
+    }
+    ntp_put_u32(p, (uint32_t)(unix_s + NTP_UNIX_EPOCH_OFFSET));  // Wraps into era 1 after 2036
+    // Round up so that converting back gives the same microsecond
+    ntp_put_u32(p + 4, (uint32_t)((((uint64_t)us << 32) + US_PER_S - 1) / US_PER_S));
+}
+
+void ntp_request(uint8_t pkt[NTP_PACKET_SIZE], const uint8_t nonce[NTP_NONCE_SIZE])
+{
+    memset(pkt, 0, NTP_PACKET_SIZE);
+    pkt[NTP_LI_VN_MODE] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+    memcpy(&pkt[NTP_TRANSMIT_TS], nonce, NTP_NONCE_SIZE);
+}
+
+bool ntp_reply_matches(const uint8_t pkt[NTP_PACKET_SIZE], const uint8_t nonce[NTP_NONCE_SIZE])
+{
+    return memcmp(&pkt[NTP_ORIGINATE_TS], nonce, NTP_NONCE_SIZE) == 0;
+}
+
+ntp_reply_t ntp_parse(const uint8_t pkt[NTP_PACKET_SIZE], int64_t t1_us, int64_t t4_us, ntp_sample_t *sample)
+{
+    uint8_t li = pkt[NTP_LI_VN_MODE] >> 6;
+    uint8_t mode = pkt[NTP_LI_VN_MODE] & 0x07;
+    if (mode != NTP_MODE_SERVER) {
+        return NTP_REPLY_INVALID;
+    }
+    if (pkt[NTP_STRATUM] == 0) {
+        return NTP_REPLY_KOD;
+    }
+    if (li == NTP_LI_UNSYNCHRONIZED || pkt[NTP_STRATUM] > NTP_MAX_STRATUM) {
+        return NTP_REPLY_UNSYNCHRONIZED;
+    }
+
+    int64_t t2 = ntp_to_unix_us(&pkt[NTP_RECEIVE_TS]);
+    int64_t t3 = ntp_to_unix_us(&pkt[NTP_TRANSMIT_TS]);
+    if (t3 < t2 || t3 < NTP_MIN_UNIX_S * US_PER_S) {
+        return NTP_REPLY_INVALID;
+    }
+
+    sample->offset_us = ((t2 - t1_us) + (t3 - t4_us)) / 2;
+    sample->delay_us = (t4_us - t1_us) - (t3 - t2);
+    if (sample->delay_us < 0) {
+        sample->delay_us = 0;  // Server processing time rounded above our measured round trip
+    }
+    sample->t4_us = t4_us;
+    sample->stratum = pkt[NTP_STRATUM];
+    return NTP_REPLY_OK;
+}
+
+uint32_t ntp_smooth_rtt(uint32_t rtt_us, int64_t delay_us)
+{
+    uint32_t delay = delay_us > UINT32_MAX ? UINT32_MAX : delay_us < 0 ? 0 : (uint32_t)delay_us;
+    if (rtt_us == 0) {
+        rtt_us = delay;
+    } else {
+        rtt_us = (uint32_t)((int64_t)rtt_us + ((int64_t)delay - rtt_us) / NTP_RTT_GAIN_DIV);
+    }
+    return rtt_us ? rtt_us : 1;  // 0 means "no reply yet"
+}
+
+void ntp_race_order(const uint32_t *rtt_us, size_t count, uint8_t *order)
+{
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (uint8_t)i;
+    }
+    // Insertion sort (unknown delay, 0, sorts last)
+    for (size_t i = 1; i < count; i++) {
+        uint8_t cur = order[i];
+        uint32_t key = rtt_us[cur] ? rtt_us[cur] : UINT32_MAX;
+        size_t j = i;
+        while (j > 0 && (rtt_us[order[j - 1]] ? rtt_us[order[j - 1]] : UINT32_MAX) > key) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = cur;
+    }
+}
+
+void ntp_filter_reset(ntp_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+}
+
+bool ntp_filter_add(ntp_filter_t *filter, const ntp_sample_t *sample)
+{
+    bool best = filter->count == 0 || sample->delay_us < filter->best.delay_us;
+    if (best) {
+        filter->best = *sample;
+    }
+    if (filter->count < UINT8_MAX) {
+        filter->count++;
+    }
+    return best;
+}
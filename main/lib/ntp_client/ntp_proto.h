@@ -0,0 +1,133 @@
+#ifndef NTP_PROTO_H
+#define NTP_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NTP packets, sample computation and clock filter of ntp_client (RFC 5905, client mode)
+//
+// No ESP-IDF dependencies: the same code is built on the host (test/host) and run against
+// the stand-in server of tools/ntp_bench.py. Times are microseconds of any monotonic local
+// clock (esp_timer on the device); server timestamps are converted to Unix microseconds.
+
+#define NTP_PORT                123
+#define NTP_PACKET_SIZE         48
+#define NTP_NONCE_SIZE          8
+#define NTP_RECV_TIMEOUT_MS     1000
+#define NTP_SAMPLE_SPACING_MS   250            // Between requests (public servers rate-limit tight bursts)
+#define NTP_RTT_GAIN_DIV        4              // Smoothed round-trip delay gain 1/4
+#define NTP_UNIX_EPOCH_OFFSET   2208988800LL   // 1900-01-01 to 1970-01-01, in seconds
+#define NTP_MIN_UNIX_S          1577836800LL   // 2020-01-01: replies claiming an earlier time are rejected
+
+// Packet layout (RFC 5905, figure 8)
+#define NTP_LI_VN_MODE          0
+#define NTP_STRATUM             1
+#define NTP_REF_ID              12
+#define NTP_ORIGINATE_TS        24
+#define NTP_RECEIVE_TS          32
+#define NTP_TRANSMIT_TS         40
+
+#define NTP_VERSION             4
+#define NTP_MODE_CLIENT         3
+#define NTP_MODE_SERVER         4
+#define NTP_LI_UNSYNCHRONIZED   3
+#define NTP_MAX_STRATUM         15
+
+// Reply check result
+typedef enum {
+    NTP_REPLY_OK,
+    NTP_REPLY_INVALID,          // Not a server reply, or implausible timestamps
+    NTP_REPLY_KOD,              // Kiss-o'-Death (stratum 0, code in the reference ID)
+    NTP_REPLY_UNSYNCHRONIZED,   // Server clock not synchronized
+} ntp_reply_t;
+
+typedef struct {
+    int64_t offset_us;          // Server UTC minus local clock
+    int64_t delay_us;           // Round-trip delay (error bound of the offset is delay / 2)
+    int64_t t4_us;              // Local time the reply was received
+    uint8_t stratum;
+} ntp_sample_t;
+
+// Clock filter: keeps the lowest-delay sample of a burst
+typedef struct {
+    ntp_sample_t best;
+    uint8_t count;              // Samples added
+} ntp_filter_t;
+
+/**
+ * @brief Build a client request carrying a nonce as transmit timestamp
+ *
+ * The reply must echo the nonce as originate timestamp (ntp_reply_matches()),
+ * which rejects late replies to earlier requests and blind spoofing.
+ */
+void ntp_request(uint8_t pkt[NTP_PACKET_SIZE], const uint8_t nonce[NTP_NONCE_SIZE]);
+
+/**
+ * @brief Check that a reply echoes the nonce of the request
+ */
+bool ntp_reply_matches(const uint8_t pkt[NTP_PACKET_SIZE], const uint8_t nonce[NTP_NONCE_SIZE]);
+
+/**
+ * @brief Check a reply and compute its sample
+ *
+ * T1/T4 are local times, T2/T3 server UTC:
+ * offset = ((T2 - T1) + (T3 - T4)) / 2, delay = (T4 - T1) - (T3 - T2)
+ *
+ * @param pkt Reply (NTP_PACKET_SIZE bytes)
+ * @param t1_us Local time the request was sent
+ * @param t4_us Local time the reply was received
+ * @param sample Filled in when NTP_REPLY_OK is returned
+ */
+ntp_reply_t ntp_parse(const uint8_t pkt[NTP_PACKET_SIZE], int64_t t1_us, int64_t t4_us, ntp_sample_t *sample);
+
+/**
+ * @brief NTP timestamp (seconds since 1900 + 32-bit fraction) to Unix microseconds
+ *
+ * Seconds values below 2^31 are taken to be in era 1 (after the 2036 rollover).
+ */
+int64_t ntp_to_unix_us(const uint8_t p[8]);
+
+/**
+ * @brief Unix microseconds to NTP timestamp
+ */
+void ntp_from_unix_us(int64_t unix_us, uint8_t p[8]);
+
+/**
+ * @brief Update a smoothed round-trip delay with a new sample
+ *
+ * @param rtt_us Smoothed delay (0 = no reply yet: the sample is taken as is)
+ * @return New smoothed delay, never 0
+ */
+uint32_t ntp_smooth_rtt(uint32_t rtt_us, int64_t delay_us);
+
+/**
+ * @brief Race order: server indices by smoothed delay, unknown delays (0) last
+ *
+ * @param rtt_us Smoothed delay per server
+ * @param count Number of servers (at most 255)
+ * @param order Output, count entries
+ */
+void ntp_race_order(const uint32_t *rtt_us, size_t count, uint8_t *order);
+
+/**
+ * @brief Start a new burst
+ */
+void ntp_filter_reset(ntp_filter_t *filter);
+
+/**
+ * @brief Add a sample to the burst
+ *
+ * @return true if the sample is the new best (lowest delay; the first sample always is)
+ */
+bool ntp_filter_add(ntp_filter_t *filter, const ntp_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NTP_PROTO_H
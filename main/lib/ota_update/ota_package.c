@@ -0,0 +1,127 @@
+#include "ota_package.h"
+#include <string.h>
+
+#define OTA_WINDOW_MASK     (OTA_WINDOW_SIZE - 1)
+#define OTA_BACKREF_BITS    (1 + OTA_WINDOW_BITS + OTA_LOOKAHEAD_BITS)
+#define OTA_VERSION_PART_MAX 1023
+
+void ota_decoder_init(ota_decoder_t *dec, uint32_t limit, ota_decoder_sink_t sink, void *ctx)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->limit = limit;
+    dec->sink = sink;
+    dec->ctx = ctx;
+}
+
+// Hand the bytes decoded since the last flush to the sink (one contiguous window segment)
+static void ota_decoder_flush(ota_decoder_t *dec)
+{
+    if (dec->pending == 0 || ota_decoder_failed(dec)) {
+        return;
+    }
+    dec->sink_error = dec->sink(dec->ctx, dec->window + dec->flushed, dec->pending);
+    dec->flushed = dec->head;
+    dec->pending = 0;
+}
+
+// Append one decoded byte; the window is flushed at its end and at its middle, so
+// bytes not handed to the sink are never overwritten
+static void ota_decoder_put(ota_decoder_t *dec, uint8_t byte)
+{
+    if (dec->written == dec->limit) {
+        dec->overflow = true;
+        return;
+    }
+    dec->window[dec->head] = byte;
+    dec->head = (dec->head + 1) & OTA_WINDOW_MASK;
+    dec->written++;
+    dec->pending++;
+    if (dec->head == 0 || dec->pending == OTA_FLUSH_SIZE) {
+        ota_decoder_flush(dec);
+    }
+}
+
+// Heatshrink bit stream (MSB first): 1 + 8-bit literal, or
+// 0 + (offset - 1) in OTA_WINDOW_BITS + (count - 1) in OTA_LOOKAHEAD_BITS
+void ota_decoder_feed(ota_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    while (!ota_decoder_failed(dec)) {
+        while (dec->bit_count <= 24 && pos < len) {
+            dec->bits |= (uint32_t)data[pos++] << (24 - dec->bit_count);
+            dec->bit_count += 8;
+        }
+        if (dec->bit_count == 0) {
+            return;
+        }
+        if (dec->bits & 0x80000000u) {
+            if (dec->bit_count < 9) {
+                return;
+            }
+            uint8_t literal = (uint8_t)(dec->bits >> 23);
+            dec->bits <<= 9;
+            dec->bit_count -= 9;
+            ota_decoder_put(dec, literal);
+        } else {
+            if (dec->bit_count < OTA_BACKREF_BITS) {
+                return;
+            }
+            uint32_t offset = ((dec->bits >> (31 - OTA_WINDOW_BITS)) & OTA_WINDOW_MASK) + 1;
+            uint32_t count = ((dec->bits >> (31 - OTA_WINDOW_BITS - OTA_LOOKAHEAD_BITS)) &
+                              ((1 << OTA_LOOKAHEAD_BITS) - 1)) + 1;
+            dec->bits <<= OTA_BACKREF_BITS;
+            dec->bit_count -= OTA_BACKREF_BITS;
+            while (count-- > 0 && !ota_decoder_failed(dec)) {
+                ota_decoder_put(dec, dec->window[(dec->head - offset) & OTA_WINDOW_MASK]);  // May overlap itself
+            }
+        }
+    }
+}
+
+void ota_decoder_finish(ota_decoder_t *dec)
+{
+    ota_decoder_flush(dec);
+}
+
+bool ota_version_parse(const char *version, size_t max_len, uint32_t *out)
+{
+    size_t len = strnlen(version, max_len);
+    size_t pos = 0;
+    uint32_t parts[3] = {0};
+    if (pos < len && version[pos] == 'v') {
+        pos++;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (pos == len || version[pos] < '0' || version[pos] > '9') {
+            return false;
+        }
+        while (pos < len && version[pos] >= '0' && version[pos] <= '9') {
+            parts[i] = parts[i] * 10 + (uint32_t)(version[pos++] - '0');
+            if (parts[i] > OTA_VERSION_PART_MAX) {
+                return false;
+            }
+        }
+        if (pos == len || version[pos] != '.') {
+            break;
+        }
+        pos++;
+    }
+    if (pos < len && version[pos] != '-' && version[pos] != '+') {
+        return false;
+    }
+    *out = parts[0] << 20 | parts[1] << 10 | parts[2];
+    return true;
+}
+
+bool ota_image_version(const uint8_t *image, size_t len, uint32_t *out)
+{
+    if (len < OTA_APP_DESC_MIN_SIZE) {
+        return false;
+    }
+    const uint8_t *desc = image + OTA_APP_DESC_OFFSET;
+    uint32_t magic = (uint32_t)desc[0] | (uint32_t)desc[1] << 8 | (uint32_t)desc[2] << 16 | (uint32_t)desc[3] << 24;
+    if (magic != OTA_APP_DESC_MAGIC) {
+        return false;
+    }
+    return ota_version_parse((const char *)image + OTA_APP_VERSION_OFFSET, OTA_APP_VERSION_LEN, out);
+}
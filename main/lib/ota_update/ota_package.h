@@ -0,0 +1,107 @@
+#ifndef OTA_PACKAGE_H
+#define OTA_PACKAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Update package pieces without ESP-IDF dependencies (tested in test/host): the streaming
+// heatshrink decoder and the application version check.
+//
+// The decoder's window is also the output buffer: decoded bytes are handed to a sink in
+// contiguous window segments of at most OTA_FLUSH_SIZE bytes (at the window's middle and
+// end), so bytes are never overwritten before the sink has seen them.
+
+#define OTA_WINDOW_BITS         11      // 2 KB window (heatshrink -w 11)
+#define OTA_LOOKAHEAD_BITS      4       // Matches up to 16 bytes (heatshrink -l 4)
+#define OTA_WINDOW_SIZE         (1 << OTA_WINDOW_BITS)
+#define OTA_FLUSH_SIZE          (OTA_WINDOW_SIZE / 2)
+
+// Application description in an ESP application image (esp_app_desc_t after the 24-byte
+// image header and the first 8-byte segment header)
+#define OTA_APP_DESC_OFFSET     32
+#define OTA_APP_DESC_MAGIC      0xABCD5432u
+#define OTA_APP_VERSION_OFFSET  (OTA_APP_DESC_OFFSET + 16)
+#define OTA_APP_VERSION_LEN     32
+#define OTA_APP_DESC_MIN_SIZE   (OTA_APP_VERSION_OFFSET + OTA_APP_VERSION_LEN)
+
+/**
+ * @brief Receives decoded bytes
+ *
+ * @return 0 to go on, anything else stops the decoder (kept in sink_error)
+ */
+typedef int (*ota_decoder_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t window[OTA_WINDOW_SIZE];    // Back-reference history and output buffer
+    uint32_t bits;                      // Input bits not decoded yet, MSB aligned
+    uint8_t bit_count;
+    uint16_t head;                      // Next write position in window
+    uint16_t flushed;                   // Start of the bytes not handed to the sink yet
+    uint16_t pending;                   // Bytes decoded since the last flush
+    uint32_t written;                   // Bytes produced
+    uint32_t limit;                     // Expected output size
+    bool overflow;                      // The stream decodes to more than limit
+    int sink_error;                     // First non-zero sink result
+    ota_decoder_sink_t sink;
+    void *ctx;
+} ota_decoder_t;
+
+/**
+ * @brief Start decoding a stream that should produce limit bytes
+ */
+void ota_decoder_init(ota_decoder_t *dec, uint32_t limit, ota_decoder_sink_t sink, void *ctx);
+
+/**
+ * @brief Decode a chunk of the heatshrink bit stream
+ *
+ * Chunks may have any size; tokens spanning chunks are completed by the next one. Does
+ * nothing once the decoder failed (overflow or sink error).
+ */
+void ota_decoder_feed(ota_decoder_t *dec, const uint8_t *data, size_t len);
+
+/**
+ * @brief Hand the remaining decoded bytes to the sink (end of stream)
+ *
+ * Trailing padding bits of the last byte are ignored. The stream is complete if the
+ * decoder did not fail and written == limit.
+ */
+void ota_decoder_finish(ota_decoder_t *dec);
+
+/**
+ * @brief Check whether decoding stopped (overflow or sink error)
+ */
+static inline bool ota_decoder_failed(const ota_decoder_t *dec)
+{
+    return dec->overflow || dec->sink_error != 0;
+}
+
+/**
+ * @brief Parse an application version "[v]major[.minor[.patch]]" (missing parts are 0)
+ *
+ * Anything after the numbers must start with '-' or '+' (pre-release or build suffix,
+ * ignored), so a git commit hash is not a version.
+ *
+ * @param version NUL-terminated within max_len bytes, or exactly max_len bytes long
+ * @param out Encoded as major << 20 | minor << 10 | patch (each part 0-1023)
+ * @return true if the version is valid
+ */
+bool ota_version_parse(const char *version, size_t max_len, uint32_t *out);
+
+/**
+ * @brief Read the version from the start of an ESP application image
+ *
+ * @param image First bytes of the image (at least OTA_APP_DESC_MIN_SIZE)
+ * @return true if the application description is present and its version is valid
+ */
+bool ota_image_version(const uint8_t *image, size_t len, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_PACKAGE_H
@@ -0,0 +1,341 @@
+#include "ota_update.h"
+#include "ota_package.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ecdsa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+static const char *TAG = "ota_update";
+
+#define OTA_RECV_RETRIES    5                       // Consecutive receive timeouts before giving up
+
+// Decoder and update state (allocated for one upload)
+typedef struct {
+    ota_decoder_t dec;                  // Its window is the flash write buffer
+    uint8_t recv[OTA_RECV_CHUNK];
+    uint32_t image_size;
+    uint8_t sha256[32];                 // Expected image hash
+    uint32_t running_version;           // ota_version_parse() of the running app
+    bool version_checked;               // Set by the first flash write
+    mbedtls_sha256_context sha;
+    esp_ota_handle_t handle;
+} ota_state_t;
+
+// Result of one upload
+typedef struct {
+    const char *status;                 // HTTP status on failure
+    const char *error;                  // NULL on success
+    uint32_t received;                  // Body bytes
+    uint32_t elapsed_ms;
+    uint32_t heap_min;                  // Lowest free heap seen during the upload
+} ota_result_t;
+
+static volatile bool s_busy = false;
+static bool s_confirmed = false;
+
+#if OTA_UPDATE_ENABLED
+// Decoder sink: hash and write one window segment. The first segment holds the application
+// description, whose version is checked before anything is written.
+static int ota_write(void *ctx, const uint8_t *data, size_t len)
+{
+    ota_state_t *st = ctx;
+    if (!st->version_checked) {
+        st->version_checked = true;
+        uint32_t version;
+        if (!ota_image_version(data, len, &version)) {
+            return ESP_ERR_INVALID_VERSION;
+        }
+        if (version < st->running_version) {
+            ESP_LOGW(TAG, "Image version %.*s is older than the running %s", OTA_APP_VERSION_LEN,
+                     (const char *)data + OTA_APP_VERSION_OFFSET, esp_app_get_description()->version);
+            return ESP_ERR_NOT_ALLOWED;
+        }
+    }
+    mbedtls_sha256_update(&st->sha, data, len);
+    return esp_ota_write(st->handle, data, len);
+}
+
+// Receive up to len body bytes, retrying on socket timeouts; returns <= 0 on failure
+static int ota_recv(httpd_req_t *req, uint8_t *buf, size_t len)
+{
+    for (int attempt = 0; attempt < OTA_RECV_RETRIES; attempt++) {
+        int n = httpd_req_recv(req, (char *)buf, len);
+        if (n != HTTPD_SOCK_ERR_TIMEOUT) {
+            return n;
+        }
+    }
+    return HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+// Check the header signature against the built-in public key (about 100 ms on the ESP32-C3)
+static bool ota_verify_signature(const uint8_t *header)
+{
+    uint8_t hash[32];
+    mbedtls_sha256(header, OTA_SIGNED_SIZE, hash, 0);
+
+    mbedtls_ecp_group group;
+    mbedtls_ecp_point key;
+    mbedtls_mpi r, s;
+    mbedtls_ecp_group_init(&group);
+    mbedtls_ecp_point_init(&key);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    int ret = mbedtls_ecp_group_load(&group, MBEDTLS_ECP_DP_SECP256R1);
+    if (ret == 0) {
+        ret = mbedtls_ecp_point_read_binary(&group, &key, ota_public_key, OTA_PUBLIC_KEY_SIZE);
+    }
+    if (ret == 0) {
+        ret = mbedtls_mpi_read_binary(&r, header + OTA_SIGNED_SIZE, OTA_SIGNATURE_SIZE / 2);
+    }
+    if (ret == 0) {
+        ret = mbedtls_mpi_read_binary(&s, header + OTA_SIGNED_SIZE + OTA_SIGNATURE_SIZE / 2, OTA_SIGNATURE_SIZE / 2);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ecdsa_verify(&group, hash, sizeof(hash), &key, &r, &s);
+    }
+    mbedtls_mpi_free(&s);
+    mbedtls_mpi_free(&r);
+    mbedtls_ecp_point_free(&key);
+    mbedtls_ecp_group_free(&group);
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Header signature rejected (-0x%04x)", (unsigned)-ret);
+    }
+    return ret == 0;
+}
+
+// Check the package header and prepare the state, returns an error message or NULL
+static const char *ota_parse_header(ota_state_t *st, const uint8_t *header, const esp_partition_t *partition)
+{
+    if (memcmp(header, OTA_MAGIC, 4) != 0) {
+        return "Not an update package";
+    }
+    if (header[4] != OTA_VERSION) {
+        return "Unsigned or old package format";
+    }
+    if (header[5] != OTA_WINDOW_BITS || header[6] != OTA_LOOKAHEAD_BITS) {
+        return "Unsupported compression parameters";
+    }
+    st->image_size = (uint32_t)header[8] | (uint32_t)header[9] << 8 |
+                     (uint32_t)header[10] << 16 | (uint32_t)header[11] << 24;
+    if (st->image_size == 0 || st->image_size > partition->size) {
+        return "Image does not fit the OTA partition";
+    }
+    memcpy(st->sha256, header + 12, sizeof(st->sha256));
+    ota_decoder_init(&st->dec, st->image_size, ota_write, st);
+    return NULL;
+}
+
+// Receive, decompress, write and verify one package
+static void ota_run(httpd_req_t *req, ota_state_t *st, ota_result_t *result)
+{
+    result->status = HTTPD_400;
+    const esp_app_desc_t *running = esp_app_get_description();
+    if (!ota_version_parse(running->version, sizeof(running->version), &st->running_version)) {
+        result->status = HTTPD_500;
+        result->error = "Running firmware has no version";  // PROJECT_VER in CMakeLists.txt
+        return;
+    }
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL) {
+        result->status = HTTPD_500;
+        result->error = "No OTA partition";
+        return;
+    }
+
+    // Header
+    uint8_t header[OTA_HEADER_SIZE];
+    size_t got = 0;
+    while (got < sizeof(header)) {
+        int n = ota_recv(req, header + got, sizeof(header) - got);
+        if (n <= 0) {
+            result->error = "Header not received";
+            return;
+        }
+        got += n;
+    }
+    result->received = got;
+    result->error = ota_parse_header(st, header, partition);
+    if (result->error != NULL) {
+        return;
+    }
+    // Nothing is written to flash before the header is authenticated
+    if (!ota_verify_signature(header)) {
+        result->status = "403 Forbidden";
+        result->error = "Bad signature";
+        return;
+    }
+    ESP_LOGI(TAG, "Receiving %" PRIu32 " byte image (%u bytes compressed) into %s",
+             st->image_size, (unsigned)(req->content_len - sizeof(header)), partition->label);
+
+    // Sequential writes erase sector by sector as the image arrives (no multi-second erase up front)
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &st->handle);
+    if (err != ESP_OK) {
+        result->status = HTTPD_500;
+        result->error = "esp_ota_begin failed";
+        return;
+    }
+    mbedtls_sha256_init(&st->sha);
+    mbedtls_sha256_starts(&st->sha, 0);
+
+    while (result->received < req->content_len && !ota_decoder_failed(&st->dec)) {
+        int n = ota_recv(req, st->recv, MIN(sizeof(st->recv), req->content_len - result->received));
+        if (n <= 0) {
+            result->error = "Upload interrupted";
+            break;
+        }
+        result->received += n;
+        ota_decoder_feed(&st->dec, st->recv, n);
+        result->heap_min = MIN(result->heap_min, esp_get_free_heap_size());
+    }
+    ota_decoder_finish(&st->dec);
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&st->sha, digest);
+    mbedtls_sha256_free(&st->sha);
+    if (result->error == NULL && st->dec.overflow) {
+        result->error = "Image larger than announced";
+    } else if (result->error == NULL && st->dec.sink_error == ESP_ERR_INVALID_VERSION) {
+        result->error = "Image has no valid version";
+    } else if (result->error == NULL && st->dec.sink_error == ESP_ERR_NOT_ALLOWED) {
+        result->status = "409 Conflict";
+        result->error = "Older than the running firmware";
+    } else if (result->error == NULL && st->dec.sink_error != ESP_OK) {
+        result->error = "Flash write failed";
+    }
+    if (result->error == NULL && st->dec.written != st->image_size) {
+        result->error = "Image shorter than announced";
+    }
+    if (result->error == NULL && memcmp(digest, st->sha256, sizeof(digest)) != 0) {
+        result->error = "SHA-256 mismatch";
+    }
+    if (result->error != NULL) {
+        esp_ota_abort(st->handle);
+        return;
+    }
+
+    // Image format and chip checks, then boot the new image once
+    err = esp_ota_end(st->handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(partition);
+    }
+    result->elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image rejected: %s", esp_err_to_name(err));
+        result->error = err == ESP_ERR_OTA_VALIDATE_FAILED ? "Invalid image" : "Cannot switch boot partition";
+    }
+}
+
+// Respond with an error document
+static esp_err_t ota_reply_error(httpd_req_t *req, const char *status, const char *error)
+{
+    char json[96];
+    snprintf(json, sizeof(json), "{\"ok\":false,\"error\":\"%s\"}", error);
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+static void ota_restart_cb(void *arg)
+{
+    esp_restart();
+}
+
+esp_err_t ota_update_post_handler(httpd_req_t *req)
+{
+    if (s_busy) {
+        return ota_reply_error(req, "409 Conflict", "Update already running");
+    }
+    if (req->content_len <= OTA_HEADER_SIZE) {
+        return ota_reply_error(req, HTTPD_400, "Empty package");
+    }
+    s_busy = true;
+
+    uint32_t heap_start = esp_get_free_heap_size();
+    ota_result_t result = {.heap_min = heap_start};
+    ota_state_t *st = calloc(1, sizeof(ota_state_t));
+    if (st == NULL) {
+        s_busy = false;
+        return ota_reply_error(req, HTTPD_500, "Out of memory");
+    }
+    ota_run(req, st, &result);
+    uint32_t image_size = st->image_size;
+    free(st);
+
+    if (result.error != NULL) {
+        ESP_LOGE(TAG, "Update failed after %" PRIu32 " bytes: %s", result.received, result.error);
+        s_busy = false;
+        return ota_reply_error(req, result.status, result.error);
+    }
+
+    // Throughput in KB/s of the compressed upload and of the image written to flash
+    uint32_t ms = MAX(result.elapsed_ms, 1);
+    uint32_t in_kb_s = (uint32_t)((uint64_t)result.received * 1000 / ms / 1024);
+    uint32_t out_kb_s = (uint32_t)((uint64_t)image_size * 1000 / ms / 1024);
+    uint32_t heap_peak = heap_start - result.heap_min;
+    ESP_LOGI(TAG, "Update written: %" PRIu32 " -> %" PRIu32 " bytes in %" PRIu32 " ms "
+             "(%" PRIu32 " KB/s in, %" PRIu32 " KB/s out), buffers %u bytes, heap peak %" PRIu32 " bytes",
+             result.received, image_size, ms, in_kb_s, out_kb_s, (unsigned)sizeof(ota_state_t), heap_peak);
+
+    char json[192];
+    snprintf(json, sizeof(json),
+             "{\"ok\":true,\"image\":%" PRIu32 ",\"received\":%" PRIu32 ",\"ms\":%" PRIu32 ","
+             "\"in_kb_s\":%" PRIu32 ",\"out_kb_s\":%" PRIu32 ",\"ram\":%u,\"heap_peak\":%" PRIu32 "}",
+             image_size, result.received, ms, in_kb_s, out_kb_s, (unsigned)sizeof(ota_state_t), heap_peak);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+
+    ESP_LOGI(TAG, "Restarting into the new image in %d ms", OTA_RESTART_DELAY_MS);
+    const esp_timer_create_args_t restart_args = {
+        .callback = ota_restart_cb,
+        .name = "ota_restart",
+    };
+    esp_timer_handle_t restart_timer;
+    if (esp_timer_create(&restart_args, &restart_timer) != ESP_OK ||
+        esp_timer_start_once(restart_timer, OTA_RESTART_DELAY_MS * 1000) != ESP_OK) {
+        esp_restart();
+    }
+    return ESP_OK;  // Stays busy until the restart
+}
+
+#endif // OTA_UPDATE_ENABLED
+
+esp_err_t ota_update_init(void)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    esp_ota_get_state_partition(running, &state);
+    s_confirmed = state != ESP_OTA_IMG_PENDING_VERIFY;
+    ESP_LOGI(TAG, "Running %s from %s at 0x%06" PRIx32 "%s", esp_app_get_description()->version,
+             running->label, running->address, s_confirmed ? "" : " (new update, not confirmed yet)");
+    return ESP_OK;
+}
+
+void ota_update_confirm(void)
+{
+    if (s_confirmed) {
+        return;
+    }
+    esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+    if (err == ESP_OK) {
+        s_confirmed = true;
+        ESP_LOGI(TAG, "Update confirmed, rollback cancelled");
+    } else {
+        ESP_LOGW(TAG, "Cannot confirm update: %s", esp_err_to_name(err));
+    }
+}
+
+bool ota_update_busy(void)
+{
+    return s_busy;
+}
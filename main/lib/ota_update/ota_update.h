@@ -0,0 +1,97 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "ota_package.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compressed firmware update over HTTP
+//
+// POST /ota with a package made by tools/ota_pack.py: a signed 108-byte header followed by
+// the application image compressed in heatshrink format. The header signature is checked
+// against ota_public_key before anything is written to flash. The body is then decompressed
+// while it is received and written straight to the inactive OTA partition; the only buffers
+// are the decompression window (which is also the flash write buffer) and one receive chunk.
+// The image is checked against the signed SHA-256 and by esp_ota_end() before the boot
+// partition is switched, so only images signed with the build's key can boot. Images whose
+// version (PROJECT_VER in CMakeLists.txt) is older than the running one are refused before
+// the first flash write (anti-downgrade: an old signed package stays signed). The device
+// restarts into the new image, which stays pending until ota_update_confirm() (the
+// bootloader rolls back if it resets before that).
+//
+// Header (little-endian):
+//   0  magic "PXFW"
+//   4  version (2)
+//   5  window bits, 6 lookahead bits (must match OTA_WINDOW_BITS / OTA_LOOKAHEAD_BITS in ota_package.h)
+//   7  reserved (0)
+//   8  image size in bytes (uint32)
+//  12  SHA-256 of the image (32 bytes)
+//  44  ECDSA P-256 signature of SHA-256(bytes 0-43): r and s, 32 bytes each, big-endian
+//
+// ota_public_key is generated at build time from the signing key (OTA_SIGNING_KEY in
+// main/CMakeLists.txt, created with tools/ota_pack.py keygen). Without a key the build sets
+// OTA_UPDATE_ENABLED 0: the upload path is left out and only the rollback confirmation remains.
+
+#ifndef OTA_UPDATE_ENABLED
+#define OTA_UPDATE_ENABLED      1       // Set to 0 by main/CMakeLists.txt when no signing key is found
+#endif
+
+#define OTA_MAGIC               "PXFW"
+#define OTA_VERSION             2
+#define OTA_SIGNED_SIZE         44      // Header bytes covered by the signature
+#define OTA_SIGNATURE_SIZE      64
+#define OTA_HEADER_SIZE         (OTA_SIGNED_SIZE + OTA_SIGNATURE_SIZE)
+#define OTA_PUBLIC_KEY_SIZE     65      // Uncompressed P-256 point (0x04, x, y)
+#define OTA_RECV_CHUNK          1024    // Receive buffer
+#define OTA_RESTART_DELAY_MS    1000    // Lets the response reach the client before the restart
+
+#if OTA_UPDATE_ENABLED
+// Update signing public key (generated into ota_pubkey.c by tools/ota_pack.py pubkey)
+extern const uint8_t ota_public_key[OTA_PUBLIC_KEY_SIZE];
+#endif
+
+/**
+ * @brief Log the running partition and whether it still waits for confirmation
+ *
+ * @return
+ *    - ESP_OK: Success
+ */
+esp_err_t ota_update_init(void);
+
+/**
+ * @brief Mark the running image as good (cancels the rollback of a fresh update)
+ *
+ * Call once the firmware has shown it works, including the path updates arrive on.
+ * No-op if the image is already confirmed.
+ */
+void ota_update_confirm(void);
+
+/**
+ * @brief Check whether an upload is in progress
+ */
+bool ota_update_busy(void);
+
+#if OTA_UPDATE_ENABLED
+/**
+ * @brief HTTP handler for POST /ota (the caller authorizes the request)
+ *
+ * Responds with JSON and restarts the device on success:
+ * {"ok":true,"image":<bytes>,"received":<bytes>,"ms":<upload time>,"in_kb_s":<compressed KB/s>,
+ *  "out_kb_s":<image KB/s>,"ram":<buffer bytes>,"heap_peak":<largest heap drop>},
+ * otherwise {"ok":false,"error":"..."} with status 400, 403 (bad signature), 409 (update running
+ * or older version) or 500.
+ */
+esp_err_t ota_update_post_handler(httpd_req_t *req);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_UPDATE_H
@@ -1,5 +1,9 @@
 #include "ssd1306.h"
+#include "trace.h"
+#include "dlog.h"
+#include "i2c_fault.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <string.h>
@@ -43,6 +47,14 @@ static const uint8_t font_5x7[][5] = {
     {0x1C, 0x22, 0x22, 0x22, 0x04},
 };
 
+// Count failed I2C transactions (each retry counts)
+static esp_err_t ssd1306_i2c_result(ssd1306_t *ssd1306, esp_err_t ret) {
+    if (ret != ESP_OK) {
+        ssd1306->i2c_errors++;
+    }
+    return ret;
+}
+
 // Send command to SSD1306
 static bool ssd1306_write_cmd(ssd1306_t *ssd1306, uint8_t cmd) {
     if (!ssd1306 || !ssd1306->i2c_dev) {
@@ -50,86 +62,39 @@ static bool ssd1306_write_cmd(ssd1306_t *ssd1306, uint8_t cmd) {
     }
     
     uint8_t data[2] = {SSD1306_CMD_MODE, cmd};
-    esp_err_t ret = i2c_master_transmit(ssd1306->i2c_dev, data, 2, pdMS_TO_TICKS(500));
+    esp_err_t ret = ssd1306_i2c_result(ssd1306, i2c_fault_transmit(ssd1306->i2c_dev, data, 2));
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write command 0x%02X: %s", cmd, esp_err_to_name(ret));
+        DLOGE(TAG, "Failed to write command 0x%02X: %s", cmd, esp_err_to_name(ret));
     }
     return ret == ESP_OK;
 }
 
 // Send data to SSD1306
+// The control byte and the data go out as two segments of one transaction, so the data
+// is sent in place (no copy into a packet buffer). The timeout follows the length
+// (about 190 ms for a full frame at 100kHz); a failure is handled by the i2c_fault layer.
 static bool ssd1306_write_data(ssd1306_t *ssd1306, const uint8_t *data, size_t len) {
     if (!ssd1306 || !ssd1306->i2c_dev || !data) {
         return false;
     }
     
-    // Use static buffer to avoid malloc
-    // Send at most 128 bytes (one page width) + 1 control byte each time
-    static uint8_t packet[129];  // Maximum 128 bytes data + 1 control byte
-    
-    size_t offset = 0;
-    while (offset < len) {
-        size_t chunk_size = (len - offset > 128) ? 128 : (len - offset);
-        
-        // Prepare packet: first byte is data mode flag
-        packet[0] = SSD1306_DATA_MODE;
-        memcpy(packet + 1, data + offset, chunk_size);
-        
-        // Increase timeout to 1000ms and add retry mechanism
-        esp_err_t ret = ESP_FAIL;
-        for (int retry = 0; retry < 3; retry++) {
-            ret = i2c_master_transmit(ssd1306->i2c_dev, packet, chunk_size + 1, pdMS_TO_TICKS(1000));
-            if (ret == ESP_OK) {
-                break;
-            }
-            if (retry < 2) {
-                vTaskDelay(pdMS_TO_TICKS(10));  // Wait before retry
-            }
-        }
-        
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write data chunk at offset %d after 3 retries: %s", offset, esp_err_to_name(ret));
-            return false;
-        }
-        
-        offset += chunk_size;
-        
-        // Small delay to ensure I2C bus stability
-        vTaskDelay(pdMS_TO_TICKS(2));
-    }
-    
-    return true;
-}
-
-// Initialize SSD1306
-bool ssd1306_init(ssd1306_t *ssd1306, i2c_master_bus_handle_t i2c_bus, uint8_t i2c_addr) {
-    if (!ssd1306 || !i2c_bus) {
-        return false;
-    }
-    
-    // Create I2C device
-    // Note: Use 100kHz to match DS3231 and avoid I2C bus conflicts
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = i2c_addr,
-        .scl_speed_hz = 100000,  // 100kHz, consistent with DS3231
+    static uint8_t control = SSD1306_DATA_MODE;  // Never written, the driver only reads it
+    i2c_master_transmit_multi_buffer_info_t segments[2] = {
+        {.write_buffer = &control, .buffer_size = 1},
+        {.write_buffer = (uint8_t *)data, .buffer_size = len},
     };
     
-    esp_err_t ret = i2c_master_bus_add_device(i2c_bus, &dev_cfg, &ssd1306->i2c_dev);
+    esp_err_t ret = ssd1306_i2c_result(ssd1306, i2c_fault_multi_buffer_transmit(ssd1306->i2c_dev, segments, 2));
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to add I2C device: %s", esp_err_to_name(ret));
+        DLOGE(TAG, "Failed to write %u data bytes: %s", (unsigned)len, esp_err_to_name(ret));
         return false;
     }
     
-    ssd1306->i2c_bus = i2c_bus;
-    ssd1306->i2c_addr = i2c_addr;
-    
-    // Initialize display buffer
-    memset(ssd1306->buffer, 0, sizeof(ssd1306->buffer));
-    
-    // Send initialization command sequence
-    vTaskDelay(pdMS_TO_TICKS(100));  // Wait for hardware to stabilize, increase delay
-    
+    return true;
+}
+
+// Send the initialization command sequence (contrast and inversion as last set)
+static bool ssd1306_configure(ssd1306_t *ssd1306) {
     // Turn off display
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_DISPLAY_OFF)) {
         ESP_LOGE(TAG, "Failed to send DISPLAY_OFF command");
@@ -172,7 +137,7 @@ bool ssd1306_init(ssd1306_t *ssd1306, i2c_master_bus_handle_t i2c_bus, uint8_t i
     
     // Set contrast
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_SET_CONTRAST)) return false;
-    if (!ssd1306_write_cmd(ssd1306, 0xCF)) return false;  // Contrast value
+    if (!ssd1306_write_cmd(ssd1306, ssd1306->contrast)) return false;  // Contrast value (0xCF at init)
     
     // Set precharge period
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_SET_PRECHARGE)) return false;
@@ -185,23 +150,69 @@ bool ssd1306_init(ssd1306_t *ssd1306, i2c_master_bus_handle_t i2c_bus, uint8_t i
     // Display all pixels resume (important: avoid snow screen)
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_DISPLAY_ALL_ON_RESUME)) return false;
     
-    // Normal display (non-inverted)
-    if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_NORMAL_DISPLAY)) return false;
+    // Normal display (non-inverted unless set since)
+    if (!ssd1306_write_cmd(ssd1306, ssd1306->inverse ? SSD1306_CMD_INVERSE_DISPLAY : SSD1306_CMD_NORMAL_DISPLAY)) return false;
     
     // Deactivate scrolling
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_DEACTIVATE_SCROLL)) return false;
     
-    // Clear screen (don't refresh yet, wait until initialization completes)
-    ssd1306_clear(ssd1306);
-    
     // Turn on display
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_DISPLAY_ON)) {
         ESP_LOGE(TAG, "Failed to enable display");
         return false;
     }
     
+    return true;
+}
+
+// Restore the panel after an I2C bus reset (the next refresh resends the frame)
+static bool ssd1306_reinit(void *ctx) {
+    return ssd1306_configure((ssd1306_t *)ctx);
+}
+
+// Initialize SSD1306
+bool ssd1306_init(ssd1306_t *ssd1306, i2c_master_bus_handle_t i2c_bus, uint8_t i2c_addr) {
+    if (!ssd1306 || !i2c_bus) {
+        return false;
+    }
+    
+    // Create I2C device
+    // Note: Use 100kHz to match DS3231 and avoid I2C bus conflicts
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = i2c_addr,
+        .scl_speed_hz = 100000,  // 100kHz, consistent with DS3231
+    };
+    
+    esp_err_t ret = i2c_master_bus_add_device(i2c_bus, &dev_cfg, &ssd1306->i2c_dev);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add I2C device: %s", esp_err_to_name(ret));
+        return false;
+    }
+    
+    ssd1306->i2c_bus = i2c_bus;
+    ssd1306->i2c_addr = i2c_addr;
+    ssd1306->contrast = 0xCF;
+    ssd1306->inverse = false;
+    
+    // Initialize display buffer
+    memset(ssd1306->buffer, 0, sizeof(ssd1306->buffer));
+    
+    // Send initialization command sequence
+    vTaskDelay(pdMS_TO_TICKS(100));  // Wait for hardware to stabilize, increase delay
+    
+    // Clear screen (don't refresh yet, wait until initialization completes)
+    ssd1306_clear(ssd1306);
+    
+    if (!ssd1306_configure(ssd1306)) {
+        return false;
+    }
+    
     vTaskDelay(pdMS_TO_TICKS(50));  // Wait for display to stabilize
     
+    // Bus resets caused by the panel re-send the command sequence
+    i2c_fault_add_device(ssd1306->i2c_dev, i2c_addr, dev_cfg.scl_speed_hz, "ssd1306", ssd1306_reinit, ssd1306);
+    
     ESP_LOGI(TAG, "SSD1306 initialized successfully (I2C addr: 0x%02X)", i2c_addr);
     ESP_LOGI(TAG, "Note: First refresh will happen when time is displayed");
     return true;
@@ -215,46 +226,51 @@ void ssd1306_clear(ssd1306_t *ssd1306) {
     memset(ssd1306->buffer, 0, sizeof(ssd1306->buffer));
 }
 
-// Refresh display buffer to screen
-bool ssd1306_refresh(ssd1306_t *ssd1306) {
+// Transfer pages of the display buffer to the screen
+// Horizontal addressing: the pages are contiguous in the buffer and sent from it directly
+static bool ssd1306_transfer_pages(ssd1306_t *ssd1306, uint8_t first_page, uint8_t last_page) {
     if (!ssd1306 || !ssd1306->i2c_dev) {
         return false;
     }
     
-    // Set page address (0-7)
+    // Set page address
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_PAGE_ADDR)) return false;
-    if (!ssd1306_write_cmd(ssd1306, 0)) return false;      // Start page
-    if (!ssd1306_write_cmd(ssd1306, SSD1306_PAGES - 1)) return false;  // End page
+    if (!ssd1306_write_cmd(ssd1306, first_page)) return false;  // Start page
+    if (!ssd1306_write_cmd(ssd1306, last_page)) return false;   // End page
     
     // Set column address (0-127)
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_COLUMN_ADDR)) return false;
     if (!ssd1306_write_cmd(ssd1306, 0)) return false;      // Start column
     if (!ssd1306_write_cmd(ssd1306, SSD1306_WIDTH - 1)) return false;  // End column
     
-    // Send entire buffer (send at once, referenced from demo project)
-    // Use static buffer to avoid stack overflow
-    static uint8_t data_packet[1025];  // 1024 bytes data + 1 control byte
-    data_packet[0] = SSD1306_DATA_MODE;  // 0x40 data mode
-    memcpy(data_packet + 1, ssd1306->buffer, sizeof(ssd1306->buffer));
-    
-    // Send entire buffer at once
-    esp_err_t ret = ESP_FAIL;
-    for (int retry = 0; retry < 3; retry++) {
-        ret = i2c_master_transmit(ssd1306->i2c_dev, data_packet, sizeof(ssd1306->buffer) + 1, pdMS_TO_TICKS(2000));
-        if (ret == ESP_OK) {
-            break;
-        }
-        if (retry < 2) {
-            vTaskDelay(pdMS_TO_TICKS(20));  // Wait before retry
-        }
-    }
-    
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to refresh display after 3 retries: %s", esp_err_to_name(ret));
+    // Send the pages at once (referenced from demo project)
+    return ssd1306_write_data(ssd1306, ssd1306->buffer + first_page * SSD1306_WIDTH,
+                              (size_t)(last_page - first_page + 1) * SSD1306_WIDTH);
+}
+
+// Transfer pages, once more after a failure: by then the i2c_fault layer has classified
+// it and, for a timeout or stuck bus, reset the bus and re-initialized the panel
+static bool ssd1306_transfer_pages_retry(ssd1306_t *ssd1306, uint8_t first_page, uint8_t last_page) {
+    return ssd1306_transfer_pages(ssd1306, first_page, last_page) ||
+           ssd1306_transfer_pages(ssd1306, first_page, last_page);
+}
+
+// Refresh display buffer to screen
+bool ssd1306_refresh(ssd1306_t *ssd1306) {
+    return ssd1306_refresh_pages(ssd1306, 0, SSD1306_PAGES - 1);
+}
+
+// Refresh a range of pages to screen
+bool ssd1306_refresh_pages(ssd1306_t *ssd1306, uint8_t first_page, uint8_t last_page) {
+    if (!ssd1306 || first_page > last_page || last_page >= SSD1306_PAGES) {
         return false;
     }
-    
-    return true;
+    TRACE_BEGIN(TRACE_EV_SSD1306_REFRESH);
+    ssd1306->refresh_start_us = esp_timer_get_time();
+    bool ok = ssd1306_transfer_pages_retry(ssd1306, first_page, last_page);
+    ssd1306->refresh_end_us = ok ? esp_timer_get_time() : 0;
+    TRACE_END(TRACE_EV_SSD1306_REFRESH, ok);
+    return ok;
 }
 
 // Draw a character in buffer (supports scaling)
@@ -313,25 +329,6 @@ static void ssd1306_draw_char(ssd1306_t *ssd1306, uint8_t x, uint8_t y, char c,
     }
 }
 
-// Calculate string display width (pixels)
-static uint8_t ssd1306_get_string_width(const char *text, uint8_t size) {
-    if (!text) {
-        return 0;
-    }
-    
-    uint8_t char_width = 5 * size;
-    // For large fonts (size >= 4), use compact spacing (1 pixel) to avoid exceeding screen
-    uint8_t char_spacing = (size >= 4) ? 1 : (1 * size);
-    
-    size_t len = strlen(text);
-    if (len == 0) {
-        return 0;
-    }
-    
-    // Total width = sum of character widths + sum of character spacings
-    return len * char_width + (len - 1) * char_spacing;
-}
-
 // Display string
 bool ssd1306_draw_string(ssd1306_t *ssd1306, uint8_t x, uint8_t y, const char *text, uint8_t size) {
     if (!ssd1306 || !text) {
@@ -339,7 +336,7 @@ bool ssd1306_draw_string(ssd1306_t *ssd1306, uint8_t x, uint8_t y, const char *t
     }
     
     uint8_t char_width = 5 * size;
-    // For large fonts (size >= 4), use compact spacing (1 pixel) to avoid exceeding screen
+    // For large fonts (size >= 4), use compact spacing (1 pixel) to avoid exceeding screen (mirrored in tools/face_compile.py)
     uint8_t char_spacing = (size >= 4) ? 1 : (1 * size);
     uint8_t current_x = x;
     
@@ -382,85 +379,6 @@ bool ssd1306_show_time(ssd1306_t *ssd1306, const char *time_str) {
     return ssd1306_refresh(ssd1306);
 }
 
-// Display complete clock interface (time, date, temperature)
-// Layout referenced from demo project: top shows date/weekday/temperature, bottom shows time
-bool ssd1306_show_clock(ssd1306_t *ssd1306, const char *time_str, const char *date_str, const char *weekday_str, const char *temp_str, int8_t offset_x, int8_t offset_y) {
-    if (!ssd1306 || !time_str) {
-        return false;
-    }
-    
-    // Limit offset range to prevent exceeding screen
-    if (offset_x < -2) offset_x = -2;
-    if (offset_x > 2) offset_x = 2;
-    if (offset_y < -2) offset_y = -2;
-    if (offset_y > 2) offset_y = 2;
-    
-    // Clear buffer
-    ssd1306_clear(ssd1306);
-    
-    // Top area: display date, weekday and temperature
-    // Row 1: Date (left-aligned, size=2) + Temperature (right-aligned, size=1, top-right corner)
-    int16_t top_y = 1 + offset_y;  // Top Y coordinate, apply Y offset
-    if (top_y < 0) top_y = 0;
-    if (top_y >= SSD1306_HEIGHT) top_y = SSD1306_HEIGHT - 1;
-    uint8_t date_font_size = 2;  // Date font size: 2x
-    uint8_t temp_font_size = 1;   // Temperature font size: 1x (original size)
-    
-    if (date_str) {
-        // Date left-aligned, apply X offset
-        int16_t date_x = 2 + offset_x;
-        if (date_x < 0) date_x = 0;
-        if (date_x >= SSD1306_WIDTH) date_x = SSD1306_WIDTH - 1;
-        ssd1306_draw_string(ssd1306, (uint8_t)date_x, (uint8_t)top_y, date_str, date_font_size);
-    }
-    
-    if (temp_str) {
-        // Calculate temperature string width (for right alignment, using size=1)
-        uint8_t temp_width = ssd1306_get_string_width(temp_str, temp_font_size);
-        // Right-aligned, top-right corner of screen, leave 1 pixel margin, ensure not exceeding screen, apply X offset
-        int16_t temp_x = SSD1306_WIDTH - temp_width - 1 + offset_x;
-        if (temp_x < 0) temp_x = 0;
-        if (temp_x >= SSD1306_WIDTH) temp_x = SSD1306_WIDTH - 1;
-        // Temperature Y coordinate moved down 20 pixels, apply Y offset
-        int16_t temp_y = top_y + 20 + offset_y;
-        if (temp_y < 0) temp_y = 0;
-        if (temp_y >= SSD1306_HEIGHT) temp_y = SSD1306_HEIGHT - 1;
-        ssd1306_draw_string(ssd1306, (uint8_t)temp_x, (uint8_t)temp_y, temp_str, temp_font_size);
-    }
-    
-    // Row 2: Weekday (left-aligned), using 2x font
-    if (weekday_str) {
-        int16_t weekday_y = top_y + 7 * date_font_size + 2 + offset_y;  // Date row height + spacing, apply Y offset
-        if (weekday_y < 0) weekday_y = 0;
-        if (weekday_y >= SSD1306_HEIGHT) weekday_y = SSD1306_HEIGHT - 1;
-        int16_t weekday_x = 2 + offset_x;  // Apply X offset
-        if (weekday_x < 0) weekday_x = 0;
-        if (weekday_x >= SSD1306_WIDTH) weekday_x = SSD1306_WIDTH - 1;
-        ssd1306_draw_string(ssd1306, (uint8_t)weekday_x, (uint8_t)weekday_y, weekday_str, date_font_size);
-    }
-    
-    // Bottom area: display time (centered, large font)
-    // Use 4x size font, compact spacing (spacing is 1 pixel, not 4 pixels)
-    // Time string length: 5 characters (hh:mm, seconds not displayed)
-    // Character width: 5*4 = 20 pixels, spacing: 1 pixel (compact layout)
-    // Total width: 5*20 + 4*1 = 100 + 4 = 104 pixels
-    // Center X coordinate: (128 - 104) / 2 = 12
-    // Calculate time display Y coordinate: top area occupies about 32 pixels (date row 14 + spacing 2 + weekday row 14 + spacing 2)
-    // Time font height: 7*4 = 28 pixels, vertically centered in remaining 32 pixels: 32 + (32-28)/2 = 34
-    int16_t x = 12 + offset_x;  // Center display, apply X offset
-    if (x < 0) x = 0;
-    if (x >= SSD1306_WIDTH) x = SSD1306_WIDTH - 1;
-    int16_t y = 34 + offset_y;  // Adjust Y coordinate to avoid overlapping with top area, apply Y offset
-    if (y < 0) y = 0;
-    if (y >= SSD1306_HEIGHT) y = SSD1306_HEIGHT - 1;
-    
-    // Draw time string (using 4x size, draw_string will automatically use compact spacing)
-    ssd1306_draw_string(ssd1306, (uint8_t)x, (uint8_t)y, time_str, 4);
-    
-    // Refresh to screen
-    return ssd1306_refresh(ssd1306);
-}
-
 // Set display on/off
 bool ssd1306_set_display_on(ssd1306_t *ssd1306, bool on) {
     if (!ssd1306) {
@@ -474,8 +392,18 @@ bool ssd1306_set_contrast(ssd1306_t *ssd1306, uint8_t contrast) {
     if (!ssd1306) {
         return false;
     }
+    ssd1306->contrast = contrast;  // Restored by a re-init
     if (!ssd1306_write_cmd(ssd1306, SSD1306_CMD_SET_CONTRAST)) {
         return false;
     }
     return ssd1306_write_cmd(ssd1306, contrast);
 }
+
+// Set inverse display
+bool ssd1306_set_inverse(ssd1306_t *ssd1306, bool inverse) {
+    if (!ssd1306) {
+        return false;
+    }
+    ssd1306->inverse = inverse;  // Restored by a re-init
+    return ssd1306_write_cmd(ssd1306, inverse ? SSD1306_CMD_INVERSE_DISPLAY : SSD1306_CMD_NORMAL_DISPLAY);
+}
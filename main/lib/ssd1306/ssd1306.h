@@ -48,6 +48,11 @@ typedef struct {
     i2c_master_bus_handle_t i2c_bus;
     i2c_master_dev_handle_t i2c_dev;
     uint8_t i2c_addr;
+    uint32_t i2c_errors;  // Failed I2C transactions since boot (each retry counts)
+    uint8_t contrast;     // Last contrast set (restored after an I2C bus reset)
+    bool inverse;         // Last inversion set
+    int64_t refresh_start_us;  // esp_timer time of the last refresh start (latency measurement)
+    int64_t refresh_end_us;    // Its end, 0 if it failed
     uint8_t buffer[SSD1306_WIDTH * SSD1306_PAGES];  // Display buffer (128 * 8 = 1024 bytes)
 } ssd1306_t;
 
@@ -76,6 +81,16 @@ void ssd1306_clear(ssd1306_t *ssd1306);
  */
 bool ssd1306_refresh(ssd1306_t *ssd1306);
 
+/**
+ * @brief Refresh pages of the display buffer to screen (rows first_page*8 to last_page*8+7)
+ * 
+ * @param ssd1306 SSD1306 device structure pointer
+ * @param first_page First page (0-7)
+ * @param last_page Last page (first_page-7)
+ * @return true on success, false on failure
+ */
+bool ssd1306_refresh_pages(ssd1306_t *ssd1306, uint8_t first_page, uint8_t last_page);
+
 /**
  * @brief Display string (using built-in font)
  * 
@@ -97,20 +112,6 @@ bool ssd1306_draw_string(ssd1306_t *ssd1306, uint8_t x, uint8_t y, const char *t
  */
 bool ssd1306_show_time(ssd1306_t *ssd1306, const char *time_str);
 
-/**
- * @brief Display complete clock interface (time, date, temperature)
- * 
- * @param ssd1306 SSD1306 device structure pointer
- * @param time_str Time string (format: hh:mm:ss)
- * @param date_str Date string (format: YYYY-MM-DD)
- * @param weekday_str Weekday string (format: Mon/Tue etc.)
- * @param temp_str Temperature string (format: XX.X°C or XX.XC)
- * @param offset_x X-axis pixel offset (for burn-in prevention, range: -2 to +2)
- * @param offset_y Y-axis pixel offset (for burn-in prevention, range: -2 to +2)
- * @return true on success, false on failure
- */
-bool ssd1306_show_clock(ssd1306_t *ssd1306, const char *time_str, const char *date_str, const char *weekday_str, const char *temp_str, int8_t offset_x, int8_t offset_y);
-
 /**
  * @brief Set display on/off
  * 
@@ -129,4 +130,13 @@ bool ssd1306_set_display_on(ssd1306_t *ssd1306, bool on);
  */
 bool ssd1306_set_contrast(ssd1306_t *ssd1306, uint8_t contrast);
 
+/**
+ * @brief Set inverse display (pixels lit where buffer bits are 0)
+ * 
+ * @param ssd1306 SSD1306 device structure pointer
+ * @param inverse true for inverse display, false for normal display
+ * @return true on success, false on failure
+ */
+bool ssd1306_set_inverse(ssd1306_t *ssd1306, bool inverse);
+
 #endif // SSD1306_H
@@ -0,0 +1,304 @@
+#include "status_server.h"
+#include "ota_update.h"
+#include "trace.h"
+#include "dlog.h"
+#include "mem_report.h"
+#include "i2c_fault.h"
+#include "latency.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "status_server";
+
+#define STATUS_SERVER_CTRL_PORT 32769   // Not the provisioning server's (default 32768)
+#define STATUS_SERVER_STACK     6144    // Update signature check (software ECDSA) runs in the server task
+
+// NVS configuration
+// Note: Use independent namespace "status_auth", isolated from "time_sync"
+#define NVS_NAMESPACE_AUTH      "status_auth"
+#define NVS_KEY_TOKEN           "token"
+#define AUTH_SCHEME             "Bearer "
+
+static httpd_handle_t s_httpd_handle = NULL;
+static status_server_fill_cb_t s_fill_cb = NULL;
+static char s_json[STATUS_SERVER_JSON_MAX];     // Only the server task formats responses
+static size_t s_json_len = 0;
+static bool s_json_overflow = false;
+static mem_report_t s_mem;                      // Heaps and task stacks of one response
+static TaskStatus_t s_mem_tasks[MEM_REPORT_TASKS_MAX];  // Work buffer of the snapshot (no heap per request)
+static char s_token[STATUS_SERVER_TOKEN_LEN + 1];   // Empty until loaded
+
+// Append formatted text to the response buffer
+static void json_append(const char *fmt, ...)
+{
+    if (s_json_overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(s_json + s_json_len, sizeof(s_json) - s_json_len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= sizeof(s_json) - s_json_len) {
+        s_json_overflow = true;
+        return;
+    }
+    s_json_len += n;
+}
+
+// Format the status document into s_json
+static void status_format(const status_report_t *report)
+{
+    s_json_len = 0;
+    s_json_overflow = false;
+
+    json_append("{\"uptime_s\":%lld,", (long long)(esp_timer_get_time() / 1000000));
+
+    json_append("\"sync\":{\"state\":\"%s\",\"last_sync\":%lld,\"interval_s\":%" PRIu32 ",",
+                report->net_state ? report->net_state : "unknown",
+                (long long)report->last_sync, report->sync_interval_s);
+    json_append("\"last_outcome\":\"%s\",\"delay_us\":%" PRIu32 "},",
+                !report->has_outcome ? "none" : report->last_ok ? "ok" : "failed", report->last_delay_us);
+
+    json_append("\"rtc\":{\"offset_ms\":%" PRId32 ",", report->rtc_offset_ms);
+    if (report->has_drift) {
+        json_append("\"drift_ppm\":%.3f,\"residual_ppm\":%.3f,\"uncertainty_ppm\":%.3f,"
+                    "\"aging\":%d,\"samples\":%d},",
+                    report->drift_ppm, report->residual_ppm, report->uncertainty_ppm,
+                    report->aging, report->drift_samples);
+    } else {
+        json_append("\"drift_ppm\":null},");
+    }
+
+    json_append("\"i2c_errors\":{\"rtc\":%" PRIu32 ",\"display\":%" PRIu32 "},",
+                report->i2c_errors_rtc, report->i2c_errors_display);
+
+    // Faults by kind and what the recovery did
+    i2c_fault_stats_t i2c;
+    i2c_fault_get_stats(&i2c);
+    json_append("\"i2c_faults\":{");
+    for (int i = 0; i < I2C_FAULT_KIND_COUNT; i++) {
+        json_append("\"%s\":%" PRIu32 ",", i2c_fault_kind_name(i), i2c.faults[i]);
+    }
+    json_append("\"bus_resets\":%" PRIu32 ",\"reset_failed\":%" PRIu32 ",\"reinits\":%" PRIu32
+                ",\"reinit_failed\":%" PRIu32 ",\"recover_max_us\":%" PRIu32 "},",
+                i2c.bus_resets, i2c.bus_reset_failed, i2c.reinits, i2c.reinit_failed, i2c.recover_max_us);
+
+    // Heaps by capability (the ones that exist on this chip)
+    esp_err_t mem_err = mem_report_snapshot(&s_mem, s_mem_tasks, MEM_REPORT_TASKS_MAX);
+    if (mem_err != ESP_OK) {
+        ESP_LOGW(TAG, "Task list left out (%u tasks running): %s",
+                 (unsigned)s_mem.tasks_running, esp_err_to_name(mem_err));
+    }
+    json_append("\"heap\":{\"free\":%" PRIu32 ",\"min_free\":%" PRIu32 ",\"largest_block\":%u",
+                esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+                (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    for (int i = 0; i < MEM_REPORT_HEAP_COUNT; i++) {
+        const mem_report_heap_t *heap = &s_mem.heap[i];
+        if (heap->total != 0) {
+            json_append(",\"%s\":{\"total\":%" PRIu32 ",\"free\":%" PRIu32 ",\"min_free\":%" PRIu32
+                        ",\"largest_block\":%" PRIu32 "}",
+                        mem_report_heap_name(i), heap->total, heap->free, heap->min_free, heap->largest_block);
+        }
+    }
+    json_append("},");
+
+    // Stack high-water marks of every task: smallest free stack seen, in bytes (null if the list did not fit)
+    if (mem_err == ESP_OK) {
+        json_append("\"stack_free_min\":{");
+        for (uint8_t i = 0; i < s_mem.task_count; i++) {
+            json_append("%s\"%s\":%" PRIu32, i > 0 ? "," : "", s_mem.tasks[i].name, s_mem.tasks[i].stack_free_min);
+        }
+        json_append("},");
+    } else {
+        json_append("\"stack_free_min\":null,");
+    }
+
+    dlog_stats_t log;
+    dlog_get_stats(&log);
+    json_append("\"log\":{\"deferred\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"max_queue\":%" PRIu32 "},",
+                log.queued, log.dropped, log.max_depth);
+
+    json_append("\"frames\":{\"count\":%" PRIu32 ",\"error_max_us\":%" PRIu32 "},",
+                report->frames, report->frame_error_max_us);
+
+    // Rollover-to-pixels latency and frame jitter of the last complete window
+    latency_report_t latency;
+    latency_get_report(&latency);
+    json_append("\"latency\":{\"window_s\":%" PRIu32 ",\"frames\":%" PRIu32 ",", latency.window_s, latency.frames);
+    const latency_summary_t *summaries[] = {&latency.latency, &latency.jitter};
+    const char *const names[] = {"rollover_to_pixels", "jitter"};
+    for (int i = 0; i < 2; i++) {
+        json_append("\"%s\":{\"p50_us\":%" PRIu32 ",\"p99_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "},",
+                    names[i], summaries[i]->p50_us, summaries[i]->p99_us, summaries[i]->max_us);
+    }
+    json_append("\"stage_max_us\":{\"detect\":%" PRIu32 ",\"queue\":%" PRIu32 ",\"draw\":%" PRIu32
+                ",\"transfer\":%" PRIu32 "}}}",
+                latency.detect_max_us, latency.queue_max_us, latency.draw_max_us, latency.transfer_max_us);
+}
+
+// HTTP handler: status document
+static esp_err_t status_get_handler(httpd_req_t *req)
+{
+    status_report_t report = {0};
+    s_fill_cb(&report);
+    status_format(&report);
+    if (s_json_overflow) {
+        ESP_LOGE(TAG, "Status document exceeds %d bytes", STATUS_SERVER_JSON_MAX);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Status too large");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send(req, s_json, s_json_len);
+    return ESP_OK;
+}
+
+// Load the device token from NVS, creating it on first use
+static esp_err_t status_token_load(void)
+{
+    if (s_token[0] != '\0') {
+        return ESP_OK;
+    }
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_AUTH, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t len = sizeof(s_token);
+    err = nvs_get_str(nvs_handle, NVS_KEY_TOKEN, s_token, &len);
+    if (err != ESP_OK || strlen(s_token) != STATUS_SERVER_TOKEN_LEN) {
+        for (int i = 0; i < STATUS_SERVER_TOKEN_LEN / 8; i++) {
+            snprintf(s_token + i * 8, 9, "%08" PRIx32, esp_random());
+        }
+        err = nvs_set_str(nvs_handle, NVS_KEY_TOKEN, s_token);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        if (err != ESP_OK) {
+            s_token[0] = '\0';
+        }
+    }
+    nvs_close(nvs_handle);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Device token for /trace and /ota: %s", s_token);
+    }
+    return err;
+}
+
+// Check the Authorization header (constant-time compare), answer 401 if it does not match
+static bool status_authorized(httpd_req_t *req)
+{
+    char value[sizeof(AUTH_SCHEME) + STATUS_SERVER_TOKEN_LEN];
+    bool ok = false;
+    if (httpd_req_get_hdr_value_str(req, "Authorization", value, sizeof(value)) == ESP_OK &&
+        strncmp(value, AUTH_SCHEME, strlen(AUTH_SCHEME)) == 0 &&
+        strlen(value) == strlen(AUTH_SCHEME) + STATUS_SERVER_TOKEN_LEN) {
+        uint8_t diff = 0;
+        for (int i = 0; i < STATUS_SERVER_TOKEN_LEN; i++) {
+            diff |= (uint8_t)(value[strlen(AUTH_SCHEME) + i] ^ s_token[i]);
+        }
+        ok = diff == 0;
+    }
+    if (!ok) {
+        ESP_LOGW(TAG, "Unauthorized request for %s", req->uri);
+        httpd_resp_set_status(req, "401 Unauthorized");
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        httpd_resp_send(req, "Device token required", HTTPD_RESP_USE_STRLEN);
+    }
+    return ok;
+}
+
+// HTTP handler: event trace (device token required)
+static esp_err_t status_trace_handler(httpd_req_t *req)
+{
+    return status_authorized(req) ? trace_http_handler(req) : ESP_OK;
+}
+
+#if OTA_UPDATE_ENABLED
+// HTTP handler: firmware update (device token required; the socket is closed instead of
+// reading an unauthorized upload)
+static esp_err_t status_ota_handler(httpd_req_t *req)
+{
+    return status_authorized(req) ? ota_update_post_handler(req) : ESP_FAIL;
+}
+#endif
+
+esp_err_t status_server_start(status_server_fill_cb_t fill)
+{
+    if (fill == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_httpd_handle != NULL) {
+        return ESP_OK;  // Already started
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = STATUS_SERVER_PORT;
+    config.ctrl_port = STATUS_SERVER_CTRL_PORT;
+    config.stack_size = STATUS_SERVER_STACK;
+    config.max_uri_handlers = 3;
+    config.max_open_sockets = 2;
+    config.lru_purge_enable = true;
+
+    s_fill_cb = fill;
+    if (httpd_start(&s_httpd_handle, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server");
+        s_httpd_handle = NULL;
+        return ESP_FAIL;
+    }
+    httpd_uri_t status = {
+        .uri       = "/status",
+        .method    = HTTP_GET,
+        .handler   = status_get_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(s_httpd_handle, &status);
+
+    // Trace and updates only with a device token (fail closed)
+    esp_err_t err = status_token_load();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No device token (%s), /trace and /ota disabled", esp_err_to_name(err));
+        ESP_LOGI(TAG, "Status at http://<device IP>/status");
+        return ESP_OK;
+    }
+#if OTA_UPDATE_ENABLED
+    httpd_uri_t ota = {
+        .uri       = "/ota",
+        .method    = HTTP_POST,
+        .handler   = status_ota_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(s_httpd_handle, &ota);
+#endif
+    httpd_uri_t trace = {
+        .uri       = "/trace",
+        .method    = HTTP_GET,
+        .handler   = status_trace_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(s_httpd_handle, &trace);
+#if OTA_UPDATE_ENABLED
+    ESP_LOGI(TAG, "Status at http://<device IP>/status, event trace at /trace, updates to POST /ota (device token)");
+#else
+    ESP_LOGI(TAG, "Status at http://<device IP>/status, event trace at /trace (device token); built without /ota");
+#endif
+    return ESP_OK;
+}
+
+void status_server_stop(void)
+{
+    if (s_httpd_handle != NULL) {
+        httpd_stop(s_httpd_handle);
+        s_httpd_handle = NULL;
+        ESP_LOGI(TAG, "Stopped");
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef STATUS_SERVER_H
+#define STATUS_SERVER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runtime status over HTTP on the station interface
+//
+// GET /status returns one JSON object: uptime, sync state and last outcome, RTC drift,
+// I2C error counts and fault recovery, heap and task stack high-water marks, display frame timing
+// and rollover-to-pixels latency.
+// The response is formatted into a static buffer (no heap allocation per request).
+// The server is meant to run only while the radio is on for a sync.
+//
+// GET /trace and POST /ota need "Authorization: Bearer <device token>". The token is 128
+// random bits created on the first start (with the radio on, so esp_random() is a true RNG),
+// kept in NVS and printed on the serial console once per boot. Without a token the two
+// endpoints are not registered. Update packages must also carry a valid signature (ota_update).
+
+#define STATUS_SERVER_PORT      80
+#define STATUS_SERVER_JSON_MAX  1792    // Response buffer size
+#define STATUS_SERVER_TOKEN_LEN 32      // Device token, hex characters
+
+// Application state for one response (filled by the callback on each request)
+typedef struct {
+    const char *net_state;          // Bring-up state ("idle", "connecting", "syncing", ...)
+    int64_t last_sync;              // UTC seconds of the last successful sync (0 = never)
+    uint32_t sync_interval_s;       // Current sync interval
+    bool last_ok;                   // Outcome of the last finished bring-up
+    bool has_outcome;               // A bring-up finished since boot
+    uint32_t last_delay_us;         // Round-trip delay of the last sync (error bound is half)
+    int32_t rtc_offset_ms;          // RTC offset measured before the last sync
+    bool has_drift;                 // Drift fields are valid
+    float drift_ppm;                // Intrinsic RTC drift (positive = fast)
+    float residual_ppm;             // Expected drift with the current aging offset
+    float uncertainty_ppm;
+    int8_t aging;                   // DS3231 aging offset
+    uint8_t drift_samples;
+    uint32_t i2c_errors_rtc;        // Failed DS3231 transactions since boot
+    uint32_t i2c_errors_display;    // Failed SSD1306 transactions since boot
+    uint32_t frames;                // Display updates during this bring-up
+    uint32_t frame_error_max_us;    // Largest display interval error during this bring-up
+} status_report_t;
+
+// Called in the HTTP server task: values are read while the application keeps running
+typedef void (*status_server_fill_cb_t)(status_report_t *report);
+
+/**
+ * @brief Start the status server (no-op if running)
+ *
+ * @param fill Callback filling the application part of each response
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: fill is NULL
+ *    - ESP_FAIL: HTTP server could not be started
+ */
+esp_err_t status_server_start(status_server_fill_cb_t fill);
+
+/**
+ * @brief Stop the status server (no-op if not running)
+ */
+void status_server_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STATUS_SERVER_H
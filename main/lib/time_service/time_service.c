@@ -0,0 +1,369 @@
+#include "time_service.h"
+#include "calendar.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+static const char *TAG = "time_service";
+
+// Edge capture
+#define TS_GUARD_US             5000       // Polling starts this long before the predicted edge (plus uncertainty)
+#define TS_PREPARE_US           60000      // service() starts waiting for a due edge this long ahead
+#define TS_MAX_WINDOW_US        300000     // Wider windows fall back to the coarse search
+#define TS_MAX_MISSES           3          // Missed edges before falling back to the coarse search
+
+// Discipline loop
+#define TS_STEP_THRESHOLD_US    128000     // Larger phase errors are stepped, smaller ones slewed
+#define TS_MAX_SLEW_PPB         500000     // 500 ppm, same limit as adjtime()
+#define TS_MAX_FREQ_PPB         200000     // esp_timer runs off the main crystal (±10 ppm typical)
+#define TS_FREQ_GAIN_DIV        4          // Frequency correction gain 1/4
+#define TS_FREQ_UNC_INIT_PPB    50000      // Rate uncertainty before the first frequency estimate
+#define TS_FREQ_UNC_MIN_PPB     1000
+#define TS_INTERVAL_MIN_S       16
+#define TS_INTERVAL_MAX_S       256
+#define TS_GOOD_ERROR_US        250        // Error growth below this (plus edge uncertainty) doubles the interval
+
+#define PPB_DIV                 1000000000LL
+#define US_PER_S                1000000LL
+
+typedef enum {
+    TS_STATE_IDLE,    // Not initialized
+    TS_STATE_COARSE,  // Looking for any seconds change (one register read per service() call)
+    TS_STATE_FINE,    // Edge predicted, polling only around it
+} ts_state_t;
+
+// Wall clock model: wall(t) = anchor_wall + dt + dt * freq + min(dt, slew duration) * slew
+typedef struct {
+    int64_t anchor_us;        // esp_timer time of the last measured edge
+    int64_t anchor_wall_us;   // Model wall time at the anchor
+    int32_t freq_ppb;         // esp_timer rate correction
+    int32_t slew_ppb;         // Temporary rate offset removing the last phase error
+    int64_t slew_end_us;      // esp_timer time at which the slew is complete
+    uint32_t anchor_unc_us;   // Edge timestamp uncertainty at the anchor
+    uint32_t freq_unc_ppb;    // Uncertainty of freq_ppb
+} ts_model_t;
+
+static ds3231_t *s_ds3231 = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static ts_model_t s_model;
+static bool s_locked = false;
+static bool s_step_pending = false;
+static ts_state_t s_state = TS_STATE_IDLE;
+
+// Coarse search
+static bool s_coarse_valid = false;
+static uint8_t s_coarse_sec = 0;
+static int64_t s_coarse_before_us = 0;
+
+// Fine measurement schedule
+static int64_t s_target_us = 0;       // Predicted edge (esp_timer)
+static uint32_t s_window_us = 0;      // Half-width of the polling window
+static uint32_t s_interval_s = TS_INTERVAL_MIN_S;
+static uint8_t s_misses = 0;
+static uint32_t s_edge_error_us = 0;
+static uint32_t s_steps = 0;
+
+// Model wall time at esp_timer time t
+static int64_t ts_model_wall(const ts_model_t *m, int64_t t)
+{
+    int64_t dt = t - m->anchor_us;
+    int64_t slew_dt = m->slew_end_us - m->anchor_us;
+    if (slew_dt > dt) {
+        slew_dt = dt;
+    }
+    if (slew_dt < 0) {
+        slew_dt = 0;
+    }
+    return m->anchor_wall_us + dt + dt * m->freq_ppb / PPB_DIV + slew_dt * m->slew_ppb / PPB_DIV;
+}
+
+// Correction the slew still has to apply after esp_timer time t (signed)
+static int64_t ts_slew_remaining(const ts_model_t *m, int64_t t)
+{
+    int64_t start = t > m->anchor_us ? t : m->anchor_us;
+    if (start >= m->slew_end_us) {
+        return 0;
+    }
+    return (m->slew_end_us - start) * m->slew_ppb / PPB_DIV;
+}
+
+static uint32_t ts_model_uncertainty(const ts_model_t *m, int64_t t)
+{
+    int64_t dt = t > m->anchor_us ? t - m->anchor_us : 0;
+    int64_t unc = m->anchor_unc_us + llabs(ts_slew_remaining(m, t)) + dt * m->freq_unc_ppb / PPB_DIV;
+    return unc > UINT32_MAX ? UINT32_MAX : (uint32_t)unc;
+}
+
+// Poll the seconds register until it changes or the deadline passes
+// The edge lies between the sampling instant of the last unchanged read and the first changed read
+static bool ts_capture_edge(int64_t deadline_us, int64_t *edge_us, uint32_t *edge_unc_us, uint8_t *seconds)
+{
+    uint8_t first;
+    uint8_t sec;
+    int64_t prev_before = esp_timer_get_time();
+    if (!ds3231_read_seconds(s_ds3231, &first)) {
+        return false;
+    }
+
+    for (;;) {
+        int64_t before = esp_timer_get_time();
+        if (!ds3231_read_seconds(s_ds3231, &sec)) {
+            return false;
+        }
+        int64_t after = esp_timer_get_time();
+        if (sec != first) {
+            *edge_us = (prev_before + after) / 2;
+            *edge_unc_us = (uint32_t)((after - prev_before + 1) / 2);
+            *seconds = sec;
+            return true;
+        }
+        if (after >= deadline_us) {
+            return false;
+        }
+        prev_before = before;
+    }
+}
+
+// Full RTC read right after an edge: wall time of the edge
+static bool ts_read_edge_wall(uint8_t seconds, int64_t *wall_us)
+{
+    ds3231_time_t t;
+    if (!ds3231_read_time(s_ds3231, &t) || t.seconds != seconds || !cal_ds3231_valid(&t)) {
+        return false;
+    }
+    *wall_us = cal_epoch_from_ds3231(&t) * US_PER_S;
+    return true;
+}
+
+static void ts_enter_coarse(void)
+{
+    s_state = TS_STATE_COARSE;
+    s_coarse_valid = false;
+    s_misses = 0;
+}
+
+static void ts_schedule(int64_t target_us, uint32_t uncertainty_us)
+{
+    s_target_us = target_us;
+    s_window_us = uncertainty_us + TS_GUARD_US;
+    if (s_window_us > TS_MAX_WINDOW_US) {
+        ts_enter_coarse();
+    } else {
+        s_state = TS_STATE_FINE;
+    }
+}
+
+// Discipline loop: compare the model with a measured edge, then step or slew
+static void ts_apply_edge(int64_t edge_us, uint32_t edge_unc_us, int64_t rtc_wall_us)
+{
+    ts_model_t m;
+    taskENTER_CRITICAL(&s_lock);
+    m = s_model;
+    bool was_locked = s_locked;
+    taskEXIT_CRITICAL(&s_lock);
+
+    int64_t model_wall = ts_model_wall(&m, edge_us);
+    int64_t err = model_wall - rtc_wall_us;  // Positive: model ahead of the RTC
+    s_edge_error_us = llabs(err) > UINT32_MAX ? UINT32_MAX : (uint32_t)llabs(err);
+
+    if (!was_locked || s_step_pending || llabs(err) > TS_STEP_THRESHOLD_US) {
+        if (was_locked || s_step_pending) {
+            s_steps++;
+            ESP_LOGI(TAG, "Clock stepped by %lld us", (long long)-err);
+        } else {
+            m.freq_ppb = 0;
+            m.freq_unc_ppb = TS_FREQ_UNC_INIT_PPB;
+            ESP_LOGI(TAG, "Locked to RTC second edge (±%" PRIu32 " us)", edge_unc_us);
+        }
+        m.anchor_us = edge_us;
+        m.anchor_wall_us = rtc_wall_us;
+        m.slew_ppb = 0;
+        m.slew_end_us = edge_us;
+        m.anchor_unc_us = edge_unc_us;
+        s_interval_s = TS_INTERVAL_MIN_S;
+    } else {
+        // Part of the error the unfinished slew would still have removed; the rest came from the rate error
+        int64_t growth = err + ts_slew_remaining(&m, edge_us);
+        int64_t span = edge_us - m.anchor_us;
+        if (span > 0) {
+            int64_t rate_err_ppb = growth * PPB_DIV / span;
+            int64_t freq = m.freq_ppb - rate_err_ppb / TS_FREQ_GAIN_DIV;
+            if (freq > TS_MAX_FREQ_PPB) freq = TS_MAX_FREQ_PPB;
+            if (freq < -TS_MAX_FREQ_PPB) freq = -TS_MAX_FREQ_PPB;
+            m.freq_ppb = (int32_t)freq;
+
+            // Track the rate uncertainty from the observed error growth and the edge resolution
+            int64_t observed = llabs(rate_err_ppb) + 2LL * edge_unc_us * PPB_DIV / span;
+            int64_t unc = m.freq_unc_ppb + (2 * observed - (int64_t)m.freq_unc_ppb) / 4;
+            if (unc < TS_FREQ_UNC_MIN_PPB) unc = TS_FREQ_UNC_MIN_PPB;
+            if (unc > TS_FREQ_UNC_INIT_PPB) unc = TS_FREQ_UNC_INIT_PPB;
+            m.freq_unc_ppb = (uint32_t)unc;
+        }
+
+        bool good = llabs(growth) <= 2LL * edge_unc_us + TS_GOOD_ERROR_US;
+        if (good && s_interval_s < TS_INTERVAL_MAX_S) {
+            s_interval_s *= 2;
+        } else if (!good) {
+            s_interval_s = TS_INTERVAL_MIN_S;
+        }
+
+        // Re-anchor on the model (no discontinuity) and slew the measured error out
+        m.anchor_us = edge_us;
+        m.anchor_wall_us = model_wall;
+        m.slew_ppb = err > 0 ? -TS_MAX_SLEW_PPB : TS_MAX_SLEW_PPB;
+        m.slew_end_us = edge_us + llabs(err) * PPB_DIV / TS_MAX_SLEW_PPB;
+        m.anchor_unc_us = edge_unc_us;
+
+        ESP_LOGD(TAG, "Edge error %lld us (±%" PRIu32 "), freq %" PRId32 " ppb (±%" PRIu32 "), next in %" PRIu32 " s",
+                 (long long)err, edge_unc_us, m.freq_ppb, m.freq_unc_ppb, s_interval_s);
+    }
+    s_step_pending = false;
+
+    taskENTER_CRITICAL(&s_lock);
+    s_model = m;
+    s_locked = true;
+    taskEXIT_CRITICAL(&s_lock);
+
+    // Next edge in esp_timer units, widened by the rate uncertainty accumulated until then
+    int64_t interval_us = (int64_t)s_interval_s * US_PER_S;
+    uint32_t predicted_unc = edge_unc_us + (uint32_t)(interval_us * m.freq_unc_ppb / PPB_DIV);
+    ts_schedule(edge_us + interval_us - interval_us * m.freq_ppb / PPB_DIV, predicted_unc);
+}
+
+esp_err_t time_service_init(ds3231_t *ds3231)
+{
+    if (!ds3231 || !ds3231->i2c_dev) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_ds3231 = ds3231;
+    s_locked = false;
+    s_step_pending = false;
+    s_interval_s = TS_INTERVAL_MIN_S;
+    ts_enter_coarse();
+    return ESP_OK;
+}
+
+void time_service_service(void)
+{
+    if (s_state == TS_STATE_IDLE) {
+        return;
+    }
+
+    if (s_state == TS_STATE_COARSE) {
+        int64_t before = esp_timer_get_time();
+        uint8_t sec;
+        if (!ds3231_read_seconds(s_ds3231, &sec)) {
+            s_coarse_valid = false;
+            return;
+        }
+        if (s_coarse_valid && sec != s_coarse_sec) {
+            // Edge between the previous call and this one: predict the next one and measure it precisely
+            int64_t after = esp_timer_get_time();
+            ts_schedule((s_coarse_before_us + after) / 2 + US_PER_S, (uint32_t)((after - s_coarse_before_us) / 2));
+            s_misses = 0;
+            return;
+        }
+        s_coarse_sec = sec;
+        s_coarse_before_us = before;
+        s_coarse_valid = true;
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t start = s_target_us - s_window_us;
+    if (now < start - TS_PREPARE_US) {
+        return;
+    }
+    if (now > start) {
+        // Caller was late for this edge, use the next one
+        while (s_target_us - s_window_us < now) {
+            s_target_us += US_PER_S;
+        }
+        return;
+    }
+
+    // Sleep most of the way to the window, spin the rest
+    TickType_t ticks = (TickType_t)((start - now) / (portTICK_PERIOD_MS * 1000));
+    if (ticks > 1) {
+        vTaskDelay(ticks - 1);
+    }
+    while (esp_timer_get_time() < start) {
+    }
+
+    int64_t edge_us;
+    uint32_t edge_unc_us;
+    uint8_t sec;
+    int64_t rtc_wall_us;
+    if (ts_capture_edge(s_target_us + s_window_us, &edge_us, &edge_unc_us, &sec) &&
+        ts_read_edge_wall(sec, &rtc_wall_us)) {
+        s_misses = 0;
+        ts_apply_edge(edge_us, edge_unc_us, rtc_wall_us);
+        return;
+    }
+
+    if (++s_misses >= TS_MAX_MISSES) {
+        ESP_LOGW(TAG, "RTC second edge lost, searching again");
+        ts_enter_coarse();
+    } else {
+        ts_schedule(s_target_us + US_PER_S, s_window_us * 2);
+    }
+}
+
+void time_service_time_changed(void)
+{
+    if (s_state == TS_STATE_IDLE) {
+        return;
+    }
+    // Writing the DS3231 restarts its countdown chain: the edge phase is unknown until measured again
+    taskENTER_CRITICAL(&s_lock);
+    s_locked = false;
+    taskEXIT_CRITICAL(&s_lock);
+    s_step_pending = true;
+    ts_enter_coarse();
+}
+
+int64_t time_service_now_us(uint32_t *uncertainty_us)
+{
+    int64_t t = esp_timer_get_time();
+    ts_model_t m;
+    taskENTER_CRITICAL(&s_lock);
+    m = s_model;
+    bool locked = s_locked;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (!locked) {
+        if (uncertainty_us) {
+            *uncertainty_us = UINT32_MAX;
+        }
+        return 0;
+    }
+    if (uncertainty_us) {
+        *uncertainty_us = ts_model_uncertainty(&m, t);
+    }
+    return ts_model_wall(&m, t);
+}
+
+bool time_service_is_locked(void)
+{
+    return s_locked;
+}
+
+void time_service_get_status(time_service_status_t *status)
+{
+    if (!status) {
+        return;
+    }
+    uint32_t unc;
+    time_service_now_us(&unc);
+    taskENTER_CRITICAL(&s_lock);
+    status->locked = s_locked;
+    status->freq_ppb = s_model.freq_ppb;
+    taskEXIT_CRITICAL(&s_lock);
+    status->uncertainty_us = unc;
+    status->edge_error_us = s_edge_error_us;
+    status->interval_s = s_interval_s;
+    status->steps = s_steps;
+}
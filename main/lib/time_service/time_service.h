@@ -0,0 +1,83 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include "esp_err.h"
+#include "ds3231.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sub-second wall clock disciplined to the DS3231 second edges
+//
+// The DS3231 INT/SQW pin is used for alarms (INTCN set), so second edges are found by
+// polling the seconds register around the predicted edge and timestamped with esp_timer.
+// Between edges, wall time is interpolated from esp_timer with a learned rate correction;
+// phase errors are slewed out at a bounded rate instead of stepping the clock.
+
+// Time service status (for diagnostics)
+typedef struct {
+    bool locked;              // Wall time available
+    int32_t freq_ppb;         // esp_timer rate correction (positive: esp_timer runs slow against the RTC)
+    uint32_t uncertainty_us;  // Current uncertainty bound
+    uint32_t edge_error_us;   // Magnitude of the last measured phase error
+    uint32_t interval_s;      // Current edge measurement interval
+    uint32_t steps;           // Number of times the clock was stepped
+} time_service_status_t;
+
+/**
+ * @brief Initialize the time service
+ *
+ * Non-blocking: the service locks onto the RTC second edges over the
+ * next one to two seconds of time_service_service() calls.
+ *
+ * @param ds3231 DS3231 device (holds UTC)
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_INVALID_ARG: Invalid device
+ */
+esp_err_t time_service_init(ds3231_t *ds3231);
+
+/**
+ * @brief Run edge detection and the discipline loop
+ *
+ * Call frequently (every loop iteration, ~10 ms). Returns immediately
+ * unless an edge measurement is due; a measurement busy-polls the RTC for
+ * a few milliseconds around the predicted edge.
+ */
+void time_service_service(void);
+
+/**
+ * @brief Notify that the RTC time was written (resets the DS3231 second phase)
+ *
+ * The next measurement steps the clock instead of slewing.
+ */
+void time_service_time_changed(void);
+
+/**
+ * @brief Get current wall time
+ *
+ * @param uncertainty_us Output: bound on the error against the RTC, in microseconds (optional, can be NULL)
+ * @return Microseconds since 1970-01-01 00:00:00 UTC, or 0 if not locked yet
+ */
+int64_t time_service_now_us(uint32_t *uncertainty_us);
+
+/**
+ * @brief Check whether the service is locked to the RTC
+ */
+bool time_service_is_locked(void);
+
+/**
+ * @brief Get time service status
+ *
+ * @param status Output parameter
+ */
+void time_service_get_status(time_service_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIME_SERVICE_H
@@ -0,0 +1,140 @@
+#include "trace.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "trace";
+
+#define TRACE_MAGIC     "PXTR"
+#define TRACE_VERSION   1
+#define TRACE_OTHER     (TRACE_TASKS - 1)   // Slot shared by tasks that found no free one
+
+_Static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of two");
+_Static_assert(sizeof(trace_record_t) == 16, "trace_record_t layout is read by tools/trace_decode.py");
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t record_size;
+    uint8_t tasks;
+    uint8_t reserved;
+    uint32_t written;
+    uint32_t count;
+    int64_t now_us;
+} trace_dump_header_t;
+
+static trace_record_t s_ring[TRACE_RECORDS];
+static uint32_t s_next = 0;                         // Records claimed since boot (atomic)
+static volatile bool s_paused = false;              // Set while a dump is sent
+static TaskHandle_t s_task_handles[TRACE_TASKS];    // Claimed with compare-and-swap
+static char s_task_names[TRACE_TASKS][TRACE_TASK_NAME] = {[TRACE_OTHER] = "other"};
+
+// Task index of the caller; a task recreated under the same name (ntp_sync) keeps its slot
+static uint8_t trace_task_index(void)
+{
+    if (xPortInIsrContext()) {
+        return TRACE_TASK_ISR;
+    }
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < TRACE_OTHER; i++) {
+        if (s_task_handles[i] == task) {
+            return i;
+        }
+    }
+
+    const char *name = pcTaskGetName(task);
+    for (uint8_t i = 0; i < TRACE_OTHER; i++) {
+        TaskHandle_t expected = NULL;
+        if (s_task_handles[i] != NULL && strncmp(s_task_names[i], name, TRACE_TASK_NAME - 1) == 0) {
+            s_task_handles[i] = task;
+            return i;
+        }
+        if (__atomic_compare_exchange_n(&s_task_handles[i], &expected, task, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            strncpy(s_task_names[i], name, TRACE_TASK_NAME - 1);
+            return i;
+        }
+    }
+    return TRACE_OTHER;
+}
+
+// Claim the next slot and fill it; the phase is written last so the dump can skip
+// a record that was interrupted half-way (single core: compiler barriers are enough)
+static void trace_write(uint8_t event, uint8_t phase, uint32_t ts_us, uint32_t arg0, uint32_t arg1)
+{
+    if (s_paused) {
+        return;
+    }
+    uint32_t index = __atomic_fetch_add(&s_next, 1, __ATOMIC_RELAXED);
+    trace_record_t *record = &s_ring[index & (TRACE_RECORDS - 1)];
+    record->phase = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    record->ts_us = ts_us;
+    record->event = event;
+    record->task = trace_task_index();
+    record->reserved = 0;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    record->phase = phase;
+}
+
+void trace_record(uint8_t event, uint8_t phase, uint32_t arg0, uint32_t arg1)
+{
+    trace_write(event, phase, (uint32_t)esp_timer_get_time(), arg0, arg1);
+}
+
+void trace_complete(uint8_t event, int64_t start_us, uint32_t arg0)
+{
+    int64_t duration_us = esp_timer_get_time() - start_us;
+    trace_write(event, TRACE_PH_COMPLETE, (uint32_t)start_us, arg0, (uint32_t)duration_us);
+}
+
+esp_err_t trace_http_handler(httpd_req_t *req)
+{
+    s_paused = true;
+    vTaskDelay(1);  // Lets a lower-priority task finish the record it was writing
+
+    uint32_t written = __atomic_load_n(&s_next, __ATOMIC_RELAXED);
+    uint32_t count = written < TRACE_RECORDS ? written : TRACE_RECORDS;
+    trace_dump_header_t header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(trace_record_t),
+        .tasks = TRACE_TASKS,
+        .written = written,
+        .count = count,
+        .now_us = esp_timer_get_time(),
+    };
+
+    // Oldest record first: the ring is sent in up to two segments
+    uint32_t first = (written - count) & (TRACE_RECORDS - 1);
+    uint32_t first_len = count < TRACE_RECORDS - first ? count : TRACE_RECORDS - first;
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t ret = httpd_resp_send_chunk(req, (const char *)&header, sizeof(header));
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, (const char *)s_task_names, sizeof(s_task_names));
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, (const char *)&s_ring[first], first_len * sizeof(trace_record_t));
+    }
+    if (ret == ESP_OK && count > first_len) {
+        ret = httpd_resp_send_chunk(req, (const char *)s_ring, (count - first_len) * sizeof(trace_record_t));
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    s_paused = false;
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Dump not sent: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Dumped %" PRIu32 " records (%" PRIu32 " since boot)", count, written);
+    TRACE_INSTANT(TRACE_EV_DUMP, count, 0);
+    return ESP_OK;
+}
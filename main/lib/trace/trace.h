@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary event trace in a RAM ring buffer
+//
+// Probes write fixed 16-byte records (timestamp, event, phase, task, two arguments) without
+// locks: a slot is claimed with an atomic increment and the oldest records are overwritten.
+// GET /trace (trace_http_handler, registered behind the status server's device token) returns
+// the ring, oldest record first;
+// tools/trace_decode.py turns it into Chrome/Perfetto trace JSON.
+//
+// Timestamps are esp_timer microseconds (low 32 bits, wraps after 71 minutes) rather than CPU
+// cycles: the ESP32-C3 cycle count comes from a performance counter that is not specified to
+// run while the idle task waits for interrupts, so it cannot be relied on across idle periods.
+//
+// Dump (little-endian):
+//   0  magic "PXTR", 4 version (1), 5 record size, 6 task slots, 7 reserved
+//   8  records written since boot (uint32), 12 records in this dump (uint32)
+//  16  esp_timer time of the dump (int64)
+//  24  task names (TRACE_TASKS x TRACE_TASK_NAME bytes, NUL padded)
+//      records
+
+#define TRACE_ENABLED       1       // 0 compiles the probes out
+#define TRACE_RECORDS       512     // Ring size (power of two), 8 KB
+#define TRACE_TASKS         8       // Task name slots, the last one is "other" (slots ran out)
+#define TRACE_TASK_NAME     16
+#define TRACE_TASK_ISR      0xFF    // Task index of records written from an interrupt
+#define TRACE_LOOP_MIN_US   1000    // Net task passes shorter than this are not recorded
+
+// Events (keep in sync with EVENTS in tools/trace_decode.py)
+typedef enum {
+    TRACE_EV_LOOP = 1,          // X: net task pass, arg0 = net state
+    TRACE_EV_DISPLAY,           // B/E: displayTime (render and refresh)
+    TRACE_EV_SSD1306_REFRESH,   // B/E: frame buffer transfer, end arg0 = ok
+    TRACE_EV_DS3231_READ,       // B/E: time registers read, end arg0 = ok
+    TRACE_EV_WIFI_EVENT,        // i: arg0 = wifi_event_t, arg1 = disconnect reason
+    TRACE_EV_IP_EVENT,          // i: arg0 = ip_event_t
+    TRACE_EV_NTP_SYNC,          // B/E: NTP exchange in ntp_sync_task, end arg0 = esp_err_t
+    TRACE_EV_DUMP,              // i: tracing resumed after a dump, arg0 = records sent
+    TRACE_EV_FRAME,             // X: RTC second rollover to pixels, arg0 = frame interval in us
+} trace_event_t;
+
+// Record phases (Chrome trace "ph" values)
+#define TRACE_PH_BEGIN      'B'
+#define TRACE_PH_END        'E'
+#define TRACE_PH_INSTANT    'i'
+#define TRACE_PH_COMPLETE   'X'     // Timestamp is the start, arg1 is the duration in us
+
+typedef struct {
+    uint32_t ts_us;             // esp_timer time, low 32 bits
+    uint8_t event;              // trace_event_t
+    uint8_t phase;              // TRACE_PH_*, 0 while the record is being written
+    uint8_t task;               // Index into the task names, TRACE_TASK_ISR from interrupts
+    uint8_t reserved;
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_record_t;
+
+/**
+ * @brief Write one record (safe from any task and from interrupts)
+ */
+void trace_record(uint8_t event, uint8_t phase, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Write a complete event that started at start_us (esp_timer time)
+ */
+void trace_complete(uint8_t event, int64_t start_us, uint32_t arg0);
+
+/**
+ * @brief HTTP handler for GET /trace (register it on any server)
+ *
+ * Sends the dump described above. Tracing is paused while it is sent, so the dump is
+ * consistent and does not show its own transfer.
+ */
+esp_err_t trace_http_handler(httpd_req_t *req);
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(event)                  trace_record((event), TRACE_PH_BEGIN, 0, 0)
+#define TRACE_END(event, arg0)              trace_record((event), TRACE_PH_END, (uint32_t)(arg0), 0)
+#define TRACE_INSTANT(event, arg0, arg1)    trace_record((event), TRACE_PH_INSTANT, (uint32_t)(arg0), (uint32_t)(arg1))
+#define TRACE_COMPLETE(event, start_us, arg0) trace_complete((event), (start_us), (uint32_t)(arg0))
+#else
+#define TRACE_BEGIN(event)                  do { } while (0)
+#define TRACE_END(event, arg0)              do { (void)(arg0); } while (0)
+#define TRACE_INSTANT(event, arg0, arg1)    do { (void)(arg0); (void)(arg1); } while (0)
+#define TRACE_COMPLETE(event, start_us, arg0) do { (void)(start_us); (void)(arg0); } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
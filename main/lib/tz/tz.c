@@ -0,0 +1,140 @@
+#include "tz.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "tz";
+
+static const tz_zone_t *s_zone = NULL;
+static volatile uint16_t s_cache_idx = 0;  // Transitions at or before the last looked-up instant
+
+const tz_zone_t *tz_find_zone(const char *name)
+{
+    for (size_t i = 0; i < tz_zone_count; i++) {
+        if (strcmp(tz_zones[i].name, name) == 0) {
+            return &tz_zones[i];
+        }
+    }
+    return NULL;
+}
+
+static inline const tz_zone_t *tz_zone(void)
+{
+    const tz_zone_t *zone = s_zone;
+    return zone ? zone : &tz_zones[0];
+}
+
+// Number of transitions at or before 'utc' (upper bound search)
+static uint16_t tz_search(const tz_zone_t *zone, int64_t utc)
+{
+    uint16_t lo = 0;
+    uint16_t hi = zone->count;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t)((lo + hi) / 2);
+        if ((int64_t)zone->transitions[mid] <= utc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Index of the interval containing 'utc', using the cached interval when it still applies
+static uint16_t tz_index(const tz_zone_t *zone, int64_t utc)
+{
+    if (zone->count == 0) {
+        return 0;
+    }
+    uint16_t idx = s_cache_idx;
+    if (idx <= zone->count &&
+        (idx == 0 || (int64_t)zone->transitions[idx - 1] <= utc) &&
+        (idx == zone->count || utc < (int64_t)zone->transitions[idx])) {
+        return idx;
+    }
+    idx = tz_search(zone, utc);
+    s_cache_idx = idx;
+    return idx;
+}
+
+// Daylight time is in effect after an odd number of transitions if the first one enters it
+static inline bool tz_index_is_dst(const tz_zone_t *zone, uint16_t idx)
+{
+    if (zone->count == 0) {
+        return false;
+    }
+    return (idx & 1) ? zone->first_is_dst : !zone->first_is_dst;
+}
+
+static esp_err_t tz_select(const tz_zone_t *zone)
+{
+    s_zone = zone;
+    s_cache_idx = 0;
+    ESP_LOGI(TAG, "Timezone: %s (UTC%+.2f, DST %s, exact from %u)", zone->name, zone->std_offset / 3600.0,
+             zone->count ? "observed" : "none", zone->first_year);
+    return ESP_OK;
+}
+
+esp_err_t tz_init(const char *name)
+{
+    if (!name || name[0] == '\0') {
+        name = TZ_DEFAULT_ZONE;
+    }
+    const tz_zone_t *zone = tz_find_zone(name);
+    if (!zone) {
+        ESP_LOGW(TAG, "Zone '%s' is not compiled in, using %s", name, TZ_DEFAULT_ZONE);
+        zone = tz_find_zone(TZ_DEFAULT_ZONE);
+    }
+    return tz_select(zone ? zone : &tz_zones[0]);
+}
+
+esp_err_t tz_set_zone(const char *name)
+{
+    const tz_zone_t *zone = name ? tz_find_zone(name) : NULL;
+    if (!zone) {
+        ESP_LOGE(TAG, "Unknown zone: %s", name ? name : "(null)");
+        return ESP_ERR_NOT_FOUND;
+    }
+    return tz_select(zone);
+}
+
+const char *tz_get_zone(void)
+{
+    return tz_zone()->name;
+}
+
+int32_t tz_offset_at(int64_t utc)
+{
+    const tz_zone_t *zone = tz_zone();
+    return tz_index_is_dst(zone, tz_index(zone, utc)) ? zone->dst_offset : zone->std_offset;
+}
+
+bool tz_is_dst(int64_t utc)
+{
+    const tz_zone_t *zone = tz_zone();
+    return tz_index_is_dst(zone, tz_index(zone, utc));
+}
+
+int64_t tz_utc_to_local(int64_t utc)
+{
+    return utc + tz_offset_at(utc);
+}
+
+int64_t tz_local_to_utc(int64_t local)
+{
+    const tz_zone_t *zone = tz_zone();
+    int64_t as_std = local - zone->std_offset;
+    int64_t as_dst = local - zone->dst_offset;
+    bool std_ok = tz_offset_at(as_std) == zone->std_offset;
+    bool dst_ok = tz_offset_at(as_dst) == zone->dst_offset;
+
+    if (std_ok && dst_ok) {
+        return as_std < as_dst ? as_std : as_dst;  // Repeated hour: first occurrence
+    }
+    if (std_ok) {
+        return as_std;
+    }
+    if (dst_ok) {
+        return as_dst;
+    }
+    return as_std > as_dst ? as_std : as_dst;  // Skipped hour: after the transition
+}
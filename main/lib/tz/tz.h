@@ -0,0 +1,101 @@
+#ifndef TZ_H
+#define TZ_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Zone used when none is stored (matches the former fixed CST-8 setting)
+#define TZ_DEFAULT_ZONE     "Asia/Shanghai"
+#define TZ_NAME_MAX_LEN     32
+
+// Compiled zone (generated into tz_table.c by tools/tz_compile.py from tz_zones.txt)
+// Transitions alternate between standard and daylight time; transitions[0] enters
+// daylight time if first_is_dst is set. Zones without DST have no transitions.
+typedef struct {
+    const char *name;               // IANA zone name
+    const uint32_t *transitions;    // Transition instants (Unix time, ascending), may be shared between zones
+    uint16_t count;                 // Number of transitions
+    int32_t std_offset;             // Standard time offset east of UTC, in seconds
+    int32_t dst_offset;             // Daylight time offset east of UTC, in seconds
+    uint8_t first_is_dst;           // transitions[0] switches to daylight time
+    uint16_t first_year;            // Table matches tzdata from Jan 1 of this year (earlier: current rule)
+} tz_zone_t;
+
+extern const tz_zone_t tz_zones[];
+extern const size_t tz_zone_count;
+
+/**
+ * @brief Select the stored zone at boot
+ *
+ * Falls back to TZ_DEFAULT_ZONE if no zone is stored or the stored zone is not compiled in.
+ *
+ * @param name IANA zone name from app_config (NULL or empty: TZ_DEFAULT_ZONE)
+ * @return
+ *    - ESP_OK: Success
+ */
+esp_err_t tz_init(const char *name);
+
+/**
+ * @brief Find a compiled zone by name
+ *
+ * @return Zone, or NULL if it is not listed in tz_zones.txt
+ */
+const tz_zone_t *tz_find_zone(const char *name);
+
+/**
+ * @brief Select a zone (the choice is stored by app_config_set_zone())
+ *
+ * Alarm fire times depend on the zone: call alarm_sched_time_changed() afterwards.
+ *
+ * @param name IANA zone name (must be listed in tz_zones.txt)
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NOT_FOUND: Zone not compiled in
+ */
+esp_err_t tz_set_zone(const char *name);
+
+/**
+ * @brief Get the selected zone name
+ */
+const char *tz_get_zone(void);
+
+/**
+ * @brief UTC offset in effect at a UTC instant
+ *
+ * O(1) while the instant stays between the same two transitions (the usual
+ * case for a clock), binary search otherwise.
+ *
+ * @param utc Unix time
+ * @return Offset east of UTC, in seconds
+ */
+int32_t tz_offset_at(int64_t utc);
+
+/**
+ * @brief Check whether daylight time is in effect at a UTC instant
+ */
+bool tz_is_dst(int64_t utc);
+
+/**
+ * @brief Convert Unix time to local time (seconds since 1970-01-01 00:00 local)
+ */
+int64_t tz_utc_to_local(int64_t utc);
+
+/**
+ * @brief Convert local time to Unix time
+ *
+ * Local times skipped by a DST transition are moved forward by the DST shift;
+ * repeated local times resolve to the first occurrence.
+ */
+int64_t tz_local_to_utc(int64_t local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TZ_H
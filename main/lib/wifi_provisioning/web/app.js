@@ -0,0 +1,139 @@
+// Provisioning form: posts the credentials to /wifi and shows the result
+document.getElementById('wifiForm').addEventListener('submit', async function(e) {
+    e.preventDefault();
+    const ssid = document.getElementById('ssid').value;
+    const password = document.getElementById('password').value;
+    const statusDiv = document.getElementById('status');
+    const button = document.querySelector('#wifiForm button');
+    button.disabled = true;
+    button.textContent = 'Connecting...';
+    statusDiv.innerHTML = '';
+    try {
+        const formData = new URLSearchParams();
+        formData.append('ssid', ssid);
+        formData.append('password', password);
+        const response = await fetch('/wifi', {
+            method: 'POST',
+            headers: { 'Content-Type': 'application/x-www-form-urlencoded' },
+            body: formData
+        });
+        const text = await response.text();
+        let data;
+        try { data = JSON.parse(text); } catch (e) { data = {success: false, message: text}; }
+        if (data.success) {
+            statusDiv.className = 'status success';
+            statusDiv.innerHTML = 'Configuration successful! Device is connecting to WiFi, please wait...';
+            setTimeout(() => { statusDiv.innerHTML += '<br>If connection succeeds, the device will disconnect this hotspot.'; }, 2000);
+        } else {
+            statusDiv.className = 'status error';
+            statusDiv.innerHTML = 'Configuration failed: ' + (data.message || 'Unknown error');
+            button.disabled = false;
+            button.textContent = 'Connect';
+        }
+    } catch (error) {
+        statusDiv.className = 'status error';
+        statusDiv.innerHTML = 'Network error: ' + error.message;
+        button.disabled = false;
+        button.textContent = 'Connect';
+    }
+});
+
+// Nearby networks: /scan returns the device's cached scan list at once (a new scan runs in
+// the background when it is old). Rows are updated in place, so a tap is never lost to a redraw.
+const networkList = document.getElementById('networks');
+const scanState = document.getElementById('scanState');
+const networkRows = new Map();
+
+function pickNetwork(ssid, open) {
+    document.getElementById('ssid').value = ssid;
+    const password = document.getElementById('password');
+    password.value = '';
+    if (!open) {
+        password.focus();
+    }
+}
+
+function showNetworks(aps) {
+    const seen = new Set();
+    for (const [ssid, rssi, channel, auth] of aps) {
+        let row = networkRows.get(ssid);
+        if (!row) {
+            row = document.createElement('li');
+            row.appendChild(document.createElement('span'));
+            row.appendChild(document.createElement('small'));
+            row.firstChild.textContent = ssid;
+            networkRows.set(ssid, row);
+        }
+        row.onclick = () => pickNetwork(ssid, auth === 0);
+        row.lastChild.textContent = (auth === 0 ? 'open ' : '\u{1F512} ') + rssi + ' dBm, ch ' + channel;
+        networkList.appendChild(row);
+        seen.add(ssid);
+    }
+    for (const [ssid, row] of networkRows) {
+        if (!seen.has(ssid)) {
+            row.remove();
+            networkRows.delete(ssid);
+        }
+    }
+}
+
+async function pollNetworks() {
+    let delay = 15000;
+    try {
+        const response = await fetch('/scan');
+        const data = await response.json();
+        showNetworks(data.aps);
+        scanState.textContent = data.scanning ? 'scanning...' : (data.aps.length ? '' : 'none found');
+        if (data.scanning || !data.aps.length) {
+            delay = 3000;
+        }
+    } catch (error) {
+        scanState.textContent = '';
+    }
+    setTimeout(pollNetworks, delay);
+}
+
+pollNetworks();
+
+// Clock settings: /settings lists the compiled timezones and faces and takes the selection
+const zoneSelect = document.getElementById('zone');
+const faceSelect = document.getElementById('face');
+const settingsStatus = document.getElementById('settingsStatus');
+
+async function loadSettings() {
+    try {
+        const response = await fetch('/settings');
+        const data = await response.json();
+        for (const zone of data.zones) {
+            zoneSelect.add(new Option(zone.replace(/_/g, ' '), zone, false, zone === data.zone));
+        }
+        for (const face of data.faces) {
+            faceSelect.add(new Option(face, face, false, face === data.face));
+        }
+    } catch (error) {
+        settingsStatus.className = 'status error';
+        settingsStatus.textContent = 'Cannot load settings: ' + error.message;
+    }
+}
+
+document.getElementById('settingsForm').addEventListener('submit', async function(e) {
+    e.preventDefault();
+    const formData = new URLSearchParams();
+    formData.append('zone', zoneSelect.value);
+    formData.append('face', faceSelect.value);
+    try {
+        const response = await fetch('/settings', {
+            method: 'POST',
+            headers: { 'Content-Type': 'application/x-www-form-urlencoded' },
+            body: formData
+        });
+        const data = await response.json();
+        settingsStatus.className = 'status ' + (data.success ? 'success' : 'error');
+        settingsStatus.textContent = data.success ? 'Settings saved' : 'Saving failed: ' + data.message;
+    } catch (error) {
+        settingsStatus.className = 'status error';
+        settingsStatus.textContent = 'Network error: ' + error.message;
+    }
+});
+
+loadSettings();
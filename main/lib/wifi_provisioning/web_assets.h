@@ -0,0 +1,30 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Provisioning web page (generated into web_assets.c by tools/web_compile.py from web/)
+// Bodies are minified and gzip-compressed; the page is web_assets[0] at "/".
+typedef struct {
+    const char *uri;            // Request path; assets carry their content hash in the name
+    const char *type;           // Content-Type
+    const uint8_t *data;        // gzip-compressed body
+    size_t size;                // Compressed size, in bytes
+    const char *etag;           // Strong ETag (quoted content hash)
+    bool immutable;             // Hashed name: cacheable for a year, otherwise revalidated on each load
+} web_asset_t;
+
+extern const web_asset_t web_assets[];
+extern const size_t web_asset_count;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WEB_ASSETS_H
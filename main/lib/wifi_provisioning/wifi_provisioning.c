@@ -1,14 +1,27 @@
 #include "wifi_provisioning.h"
+#include "web_assets.h"
+#include "captive_dns.h"
+#include "wifi_scan.h"
+#include "app_config.h"
+#include "tz.h"
+#include "face.h"
+#include "dlog.h"
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_http_server.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
 #include <string.h>
+#include <time.h>
 #include <sys/param.h>
+#include <inttypes.h>
 #include <ctype.h>
 
 static const char *TAG = "wifi_prov";
@@ -17,8 +30,26 @@ static const char *TAG = "wifi_prov";
 // Note: Use independent namespace "wifi_config", isolated from other NVS namespaces in the project (such as "time_sync")
 // Therefore will not overwrite or affect NVS data from other modules
 #define NVS_NAMESPACE_WIFI     "wifi_config"
-#define NVS_KEY_SSID           "ssid"
+#define NVS_KEY_SSID           "ssid"       // Single network of older firmware (imported into the store)
 #define NVS_KEY_PASSWORD       "password"
+#define NVS_KEY_NETWORKS       "networks"
+#define NVS_KEY_FAST_CONNECT   "fast_conn"
+#define FAST_CONNECT_VERSION   1
+#define CRED_STORE_VERSION     1
+
+// Network selection
+#define CRED_FAILURE_PENALTY_DB  10                  // One recent failure ranks like 10 dB less signal
+#define CRED_MAX_FAILURES        10                  // Failure count saturates here
+#define CRED_ORDER_TTL_US        (60 * 1000000LL)    // Retries within this time reuse the scan order
+#define CRED_MIN_VALID_TIME      1577836800          // 2020-01-01: earlier system time is not set yet
+#define SELECT_SCAN_MIN_MS       60                  // Active dwell per channel of the selection scan
+#define SELECT_SCAN_MAX_MS       120
+
+// Fast reconnect
+// Reusing the last lease as a static address skips DHCP entirely, but is only safe on
+// networks where the router reserves the address for this device. Without it, lwIP
+// requests the previous address directly (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+#define FAST_CONNECT_STATIC_LEASE  0
 
 // SoftAP configuration
 #define SOFTAP_SSID            "PIX_Clock_Setup"
@@ -26,6 +57,15 @@ static const char *TAG = "wifi_prov";
 #define SOFTAP_CHANNEL         1
 #define SOFTAP_MAX_CONNECTIONS 4
 
+// Web assets: hashed names never change content, the page is revalidated with its ETag
+#define WEB_CACHE_IMMUTABLE    "public, max-age=31536000, immutable"
+#define WEB_CACHE_REVALIDATE   "no-cache"
+#define WEB_ETAG_MAX_LEN       128     // If-None-Match may list several ETags
+
+// Network list of the provisioning page (scanned in the background while the SoftAP runs)
+#define PORTAL_SCAN_REFRESH_MS 15000   // A /scan request rescans when the list is older than this
+#define PORTAL_SCAN_JSON_MAX   1024    // Weakest networks are left out beyond this
+
 // Global variables
 static httpd_handle_t s_httpd_handle = NULL;
 static wifi_prov_status_cb_t s_status_cb = NULL;
@@ -33,89 +73,119 @@ static esp_netif_t *s_ap_netif = NULL;
 static esp_netif_t *s_sta_netif = NULL;
 static bool s_wifi_connected = false;
 static char s_connected_ip[16] = {0};
+static char s_portal_url[32] = "http://192.168.4.1/";
+static bool s_softap_active = false;                // Station interface only scans for the page
+static char s_scan_json[PORTAL_SCAN_JSON_MAX];      // Only the httpd task formats the list
+
+// Last successful connection (persisted), used to skip the all-channel scan
+typedef struct {
+    uint8_t version;
+    uint8_t channel;        // Primary channel of the AP (0 = invalid)
+    uint8_t bssid[6];
+    char ssid[33];          // Network the record belongs to
+    uint8_t reserved[3];
+    uint32_t ip;            // Last DHCP lease (network byte order)
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_fast_connect_t;
+
+static wifi_fast_connect_t s_fast_connect;          // Record of the last successful connection
+static bool s_fast_connect_dirty = false;           // Record changed, saved when WiFi is stopped
+static bool s_fast_attempt = false;                 // Current connection uses the cached channel/BSSID
+static bool s_static_lease = false;                 // DHCP client stopped for the cached lease
+static volatile bool s_disconnect_handled = false;  // Fast-connect fallback already reconnected
+
+// Connect-time breakdown (esp_timer microseconds)
+static int64_t s_connect_start_us = 0;
+static int64_t s_assoc_us = 0;
+static int64_t s_fallback_us = 0;
+
+// Credential store (persisted as one blob)
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    uint8_t reserved[2];
+    wifi_network_t entries[WIFI_PROV_MAX_NETWORKS];
+} wifi_cred_store_t;
+
+// Connection candidate from the selection scan
+typedef struct {
+    uint8_t index;          // Store entry
+    uint8_t channel;        // Scanned channel (0 = not seen, connect with a full scan)
+    uint8_t bssid[6];
+} wifi_candidate_t;
+
+static wifi_cred_store_t s_creds;                   // RAM copy of the store
+static bool s_creds_dirty = false;                  // Connection results changed, saved when WiFi is stopped
+static SemaphoreHandle_t s_creds_mutex = NULL;      // Guards s_creds (main, httpd and event tasks)
+static wifi_candidate_t s_order[WIFI_PROV_MAX_NETWORKS];  // Connection order of the last selection scan
+static uint8_t s_order_count = 0;
+static uint8_t s_order_pos = 0;                     // Next candidate to try
+static int64_t s_order_time_us = 0;                 // Time of the selection scan (0 = no order)
+static int s_current = -1;                          // Store entry of the current connection attempt
+static bool s_selecting = false;                    // Station started for a selection scan
+static bool s_select_hinted = false;                // Selection scan restricted to known channels
+
+static void select_scan_start(void);
 
-// Provisioning web page HTML
-static const char* PROVISIONING_HTML = 
-"<!DOCTYPE html>"
-"<html>"
-"<head>"
-"<meta charset='UTF-8'>"
-"<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
-"<title>WiFi Provisioning</title>"
-"<style>"
-"body { font-family: Arial, sans-serif; margin: 20px; background: #f5f5f5; }"
-".container { max-width: 400px; margin: 50px auto; background: white; padding: 30px; border-radius: 10px; box-shadow: 0 2px 10px rgba(0,0,0,0.1); }"
-"h1 { color: #333; text-align: center; margin-bottom: 30px; }"
-"label { display: block; margin: 15px 0 5px; color: #555; font-weight: bold; }"
-"input { width: 100%; padding: 10px; border: 1px solid #ddd; border-radius: 5px; box-sizing: border-box; font-size: 14px; }"
-"button { width: 100%; padding: 12px; background: #007bff; color: white; border: none; border-radius: 5px; font-size: 16px; cursor: pointer; margin-top: 20px; }"
-"button:hover { background: #0056b3; }"
-"button:disabled { background: #ccc; cursor: not-allowed; }"
-".status { margin-top: 20px; padding: 10px; border-radius: 5px; text-align: center; }"
-".success { background: #d4edda; color: #155724; }"
-".error { background: #f8d7da; color: #721c24; }"
-"</style>"
-"</head>"
-"<body>"
-"<div class='container'>"
-"<h1>WiFi Provisioning</h1>"
-"<form id='wifiForm'>"
-"<label for='ssid'>WiFi Name (SSID):</label>"
-"<input type='text' id='ssid' name='ssid' required autocomplete='off'>"
-"<label for='password'>WiFi Password:</label>"
-"<input type='password' id='password' name='password' autocomplete='off'>"
-"<button type='submit'>Connect</button>"
-"</form>"
-"<div id='status'></div>"
-"</div>"
-"<script>"
-"document.getElementById('wifiForm').addEventListener('submit', async function(e) {"
-"e.preventDefault();"
-"const ssid = document.getElementById('ssid').value;"
-"const password = document.getElementById('password').value;"
-"const statusDiv = document.getElementById('status');"
-"const button = document.querySelector('button');"
-"button.disabled = true;"
-"button.textContent = 'Connecting...';"
-"statusDiv.innerHTML = '';"
-"try {"
-"const formData = new URLSearchParams();"
-"formData.append('ssid', ssid);"
-"formData.append('password', password);"
-"const response = await fetch('/wifi', {"
-"method: 'POST',"
-"headers: { 'Content-Type': 'application/x-www-form-urlencoded' },"
-"body: formData"
-"});"
-"const text = await response.text();"
-"let data;"
-"try { data = JSON.parse(text); } catch(e) { data = {success: false, message: text}; }"
-"if (data.success) {"
-"statusDiv.className = 'status success';"
-"statusDiv.innerHTML = 'Configuration successful! Device is connecting to WiFi, please wait...';"
-"setTimeout(() => { statusDiv.innerHTML += '<br>If connection succeeds, the device will disconnect this hotspot.'; }, 2000);"
-"} else {"
-"statusDiv.className = 'status error';"
-"statusDiv.innerHTML = 'Configuration failed: ' + (data.message || 'Unknown error');"
-"button.disabled = false;"
-"button.textContent = 'Connect';"
-"}"
-"} catch (error) {"
-"statusDiv.className = 'status error';"
-"statusDiv.innerHTML = 'Network error: ' + error.message;"
-"button.disabled = false;"
-"button.textContent = 'Connect';"
-"}"
-"});"
-"</script>"
-"</body>"
-"</html>";
-
-// HTTP handler: root path
-static esp_err_t root_get_handler(httpd_req_t *req)
-{
-    httpd_resp_set_type(req, "text/html; charset=utf-8");
-    httpd_resp_send(req, PROVISIONING_HTML, HTTPD_RESP_USE_STRLEN);
+// HTTP handler: compiled web assets (user_ctx is the web_asset_t)
+static esp_err_t asset_get_handler(httpd_req_t *req)
+{
+    const web_asset_t *asset = (const web_asset_t *)req->user_ctx;
+    
+    // Revalidation: the browser already has this version
+    char etag[WEB_ETAG_MAX_LEN];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", etag, sizeof(etag)) == ESP_OK &&
+        strstr(etag, asset->etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_set_hdr(req, "ETag", asset->etag);
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+    
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->immutable ? WEB_CACHE_IMMUTABLE : WEB_CACHE_REVALIDATE);
+    httpd_resp_send(req, (const char *)asset->data, asset->size);
+    return ESP_OK;
+}
+
+// HTTP handler: unknown paths (OS connectivity probes) redirect to the provisioning page
+static esp_err_t captive_redirect_handler(httpd_req_t *req, httpd_err_code_t error)
+{
+    ESP_LOGD(TAG, "Redirecting %s to the provisioning page", req->uri);
+    httpd_resp_set_status(req, "302 Found");
+    httpd_resp_set_hdr(req, "Location", s_portal_url);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+}
+
+// HTTP handler: cached network list as JSON, rescanned in the background when it gets old.
+// The ETag is the cache generation, so polling while nothing changed costs a 304.
+static esp_err_t scan_get_handler(httpd_req_t *req)
+{
+    wifi_scan_refresh(PORTAL_SCAN_REFRESH_MS);
+    
+    uint32_t generation;
+    size_t len = wifi_scan_json(s_scan_json, sizeof(s_scan_json), &generation);
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"s%" PRIu32 "\"", generation);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", WEB_CACHE_REVALIDATE);
+    
+    char if_none_match[WEB_ETAG_MAX_LEN];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+    
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, s_scan_json, len);
     return ESP_OK;
 }
 
@@ -179,7 +249,7 @@ static esp_err_t wifi_post_handler(httpd_req_t *req)
     }
     content[recv_len] = '\0';
     
-    ESP_LOGI(TAG, "Received WiFi config: %s", content);
+    DLOGI(TAG, "Received WiFi config (%d bytes)", recv_len);
     
     // Parse form data
     wifi_config_data_t config;
@@ -187,7 +257,7 @@ static esp_err_t wifi_post_handler(httpd_req_t *req)
     config.password[0] = '\0';
     
     if (!get_form_value(content, "ssid", config.ssid, sizeof(config.ssid))) {
-        ESP_LOGE(TAG, "SSID not found in form data");
+        DLOGE(TAG, "SSID not found in form data");
         httpd_resp_set_status(req, HTTPD_400);
         httpd_resp_send(req, "{\"success\":false,\"message\":\"SSID required\"}", HTTPD_RESP_USE_STRLEN);
         return ESP_FAIL;
@@ -195,8 +265,8 @@ static esp_err_t wifi_post_handler(httpd_req_t *req)
     
     get_form_value(content, "password", config.password, sizeof(config.password));
     
-    ESP_LOGI(TAG, "Saving WiFi config: SSID=%s, Password=%s", config.ssid, 
-             strlen(config.password) > 0 ? "***" : "(empty)");
+    DLOGI(TAG, "Saving WiFi config: SSID=%s, Password=%s", config.ssid, 
+         strlen(config.password) > 0 ? "***" : "(empty)");
     
     // Save configuration
     esp_err_t err = wifi_provisioning_save_config(&config);
@@ -205,16 +275,516 @@ static esp_err_t wifi_post_handler(httpd_req_t *req)
     httpd_resp_set_type(req, "application/json");
     if (err == ESP_OK) {
         httpd_resp_send(req, "{\"success\":true,\"message\":\"Config saved\"}", HTTPD_RESP_USE_STRLEN);
-        ESP_LOGI(TAG, "WiFi config saved successfully");
+        DLOGI(TAG, "WiFi config saved successfully");
     } else {
         httpd_resp_set_status(req, HTTPD_500);
         httpd_resp_send(req, "{\"success\":false,\"message\":\"Failed to save config\"}", HTTPD_RESP_USE_STRLEN);
-        ESP_LOGE(TAG, "Failed to save WiFi config: %s", esp_err_to_name(err));
+        DLOGE(TAG, "Failed to save WiFi config: %s", esp_err_to_name(err));
+    }
+    
+    return ESP_OK;
+}
+
+// HTTP handler: clock settings as JSON,
+// {"zone":"<selected>","zones":["<name>",...],"face":"<selected>","faces":["<name>",...]}
+// Streamed in chunks: the zone list comes from the compiled table, no response buffer
+static esp_err_t settings_get_handler(httpd_req_t *req)
+{
+    char chunk[TZ_NAME_MAX_LEN + 16];
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    snprintf(chunk, sizeof(chunk), "{\"zone\":\"%s\",\"zones\":[", tz_get_zone());
+    esp_err_t err = httpd_resp_send_chunk(req, chunk, HTTPD_RESP_USE_STRLEN);
+    for (size_t i = 0; i < tz_zone_count && err == ESP_OK; i++) {
+        snprintf(chunk, sizeof(chunk), "%s\"%s\"", i > 0 ? "," : "", tz_zones[i].name);
+        err = httpd_resp_send_chunk(req, chunk, HTTPD_RESP_USE_STRLEN);
+    }
+    if (err == ESP_OK) {
+        snprintf(chunk, sizeof(chunk), "],\"face\":\"%s\",\"faces\":[", face_get()->name);
+        err = httpd_resp_send_chunk(req, chunk, HTTPD_RESP_USE_STRLEN);
+    }
+    for (size_t i = 0; i < face_count && err == ESP_OK; i++) {
+        snprintf(chunk, sizeof(chunk), "%s\"%s\"", i > 0 ? "," : "", face_faces[i].name);
+        err = httpd_resp_send_chunk(req, chunk, HTTPD_RESP_USE_STRLEN);
+    }
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    }
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return err;
+}
+
+// HTTP handler: clock settings POST (zone=<IANA name>, face=<name>, either may be left out),
+// stored by app_config and applied by its subscriber
+static esp_err_t settings_post_handler(httpd_req_t *req)
+{
+    char content[128];
+    int recv_len = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (recv_len <= 0) {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
+    content[recv_len] = '\0';
+    
+    char zone[TZ_NAME_MAX_LEN];
+    char face[FACE_NAME_MAX_LEN];
+    bool has_zone = get_form_value(content, "zone", zone, sizeof(zone)) != NULL;
+    bool has_face = get_form_value(content, "face", face, sizeof(face)) != NULL;
+    httpd_resp_set_type(req, "application/json");
+    if ((has_zone && !tz_find_zone(zone)) || (has_face && !face_find(face)) || (!has_zone && !has_face)) {
+        httpd_resp_set_status(req, HTTPD_400);
+        httpd_resp_send(req, "{\"success\":false,\"message\":\"Unknown timezone or face\"}", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
     }
     
+    if (has_zone) {
+        app_config_set_zone(zone);
+        DLOGI(TAG, "Timezone set to %s", zone);
+    }
+    if (has_face) {
+        app_config_set_face(face);
+        DLOGI(TAG, "Face set to %s", face);
+    }
+    httpd_resp_send(req, "{\"success\":true,\"message\":\"Settings saved\"}", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
+// Reconnect with an all-channel scan after a failed fast connect (runs in the event task)
+static void fast_connect_fallback(void)
+{
+    ESP_LOGW(TAG, "Fast connect failed, falling back to full scan");
+    s_fast_attempt = false;
+    s_fallback_us = esp_timer_get_time();
+    s_fast_connect.channel = 0;  // Don't retry the stale record on the next start
+    s_fast_connect_dirty = true;
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+        wifi_config.sta.channel = 0;
+        wifi_config.sta.bssid_set = false;
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    }
+    if (s_static_lease) {
+        esp_netif_dhcpc_start(s_sta_netif);
+        s_static_lease = false;
+    }
+
+    s_disconnect_handled = true;
+    if (s_creds.count > 1) {
+        // Several stored networks (device may have moved): choose by scan instead of searching this one
+        s_select_hinted = true;
+        select_scan_start();
+        return;
+    }
+    esp_err_t ret = esp_wifi_connect();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect() failed: %s", esp_err_to_name(ret));
+    }
+}
+
+// Record the AP and lease of a successful connection and log the connect-time breakdown (runs in the event task)
+// Saving to NVS is deferred to wifi_provisioning_stop_softap() (event task stack is small)
+static void fast_connect_record(const esp_netif_ip_info_t *ip_info)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (s_connect_start_us) {
+        int64_t start_us = s_fallback_us ? s_fallback_us : s_connect_start_us;
+        ESP_LOGI(TAG, "Connect time: %s %lld ms, %s %lld ms, total %lld ms%s",
+                 s_fast_attempt ? "association (cached channel)" : "scan + association",
+                 (long long)((s_assoc_us ? s_assoc_us : now_us) - start_us) / 1000,
+                 s_static_lease ? "cached lease" : "DHCP",
+                 (long long)(s_assoc_us ? now_us - s_assoc_us : 0) / 1000,
+                 (long long)(now_us - s_connect_start_us) / 1000,
+                 s_fallback_us ? " (after fast connect fallback)" : "");
+        s_connect_start_us = 0;
+    }
+
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK) {
+        return;
+    }
+
+    wifi_fast_connect_t record = {0};
+    record.version = FAST_CONNECT_VERSION;
+    record.channel = ap_info.primary;
+    memcpy(record.bssid, ap_info.bssid, sizeof(record.bssid));
+    memcpy(record.ssid, wifi_config.sta.ssid, sizeof(record.ssid) - 1);
+    record.ip = ip_info->ip.addr;
+    record.netmask = ip_info->netmask.addr;
+    record.gw = ip_info->gw.addr;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        record.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    if (memcmp(&record, &s_fast_connect, sizeof(record)) != 0) {
+        s_fast_connect = record;
+        s_fast_connect_dirty = true;
+    }
+}
+
+// Load the last successful connection record
+static void fast_connect_load(void)
+{
+    memset(&s_fast_connect, 0, sizeof(s_fast_connect));
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_WIFI, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    wifi_fast_connect_t record;
+    size_t size = sizeof(record);
+    if (nvs_get_blob(nvs_handle, NVS_KEY_FAST_CONNECT, &record, &size) == ESP_OK &&
+        size == sizeof(record) && record.version == FAST_CONNECT_VERSION) {
+        record.ssid[sizeof(record.ssid) - 1] = '\0';
+        s_fast_connect = record;
+    }
+    nvs_close(nvs_handle);
+}
+
+// Save the connection record if it changed
+static void fast_connect_save(void)
+{
+    if (!s_fast_connect_dirty) {
+        return;
+    }
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_WIFI, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs_handle, NVS_KEY_FAST_CONNECT, &s_fast_connect, sizeof(s_fast_connect));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save fast connect record: %s", esp_err_to_name(err));
+        return;
+    }
+    s_fast_connect_dirty = false;
+}
+
+// Reset per-connection state before starting the Station
+static void sta_connect_begin(wifi_prov_status_cb_t status_cb)
+{
+    s_status_cb = status_cb;
+    s_wifi_connected = false;
+    s_connect_start_us = esp_timer_get_time();
+    s_assoc_us = 0;
+    s_fallback_us = 0;
+    s_disconnect_handled = false;
+    s_fast_attempt = false;
+    s_selecting = false;
+}
+
+// Station configuration for a network
+static void sta_config_init(wifi_config_t *wifi_config, const char *ssid, const char *password)
+{
+    // Note: threshold.authmode is set to WIFI_AUTH_OPEN to support all authentication modes
+    // This allows automatic adaptation to different authentication methods like WPA, WPA2, WPA3, etc.
+    memset(wifi_config, 0, sizeof(*wifi_config));
+    wifi_config->sta.threshold.authmode = WIFI_AUTH_OPEN;  // Support all authentication modes
+    wifi_config->sta.scan_method = WIFI_FAST_SCAN;  // Fast scan
+    wifi_config->sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;  // Sort by signal strength
+    
+    strncpy((char*)wifi_config->sta.ssid, ssid, sizeof(wifi_config->sta.ssid) - 1);
+    if (strlen(password) > 0) {
+        strncpy((char*)wifi_config->sta.password, password, sizeof(wifi_config->sta.password) - 1);
+    }
+}
+
+static void select_from_scan(void);
+
+// Configure the Station for the next candidate of the selection order (caller holds s_creds_mutex)
+static void select_apply_next(void)
+{
+    const wifi_candidate_t *candidate = &s_order[s_order_pos++];
+    const wifi_network_t *network = &s_creds.entries[candidate->index];
+    s_current = candidate->index;
+    
+    wifi_config_t wifi_config;
+    sta_config_init(&wifi_config, network->ssid, network->password);
+    if (candidate->channel) {
+        wifi_config.sta.channel = candidate->channel;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, candidate->bssid, sizeof(wifi_config.sta.bssid));
+    }
+    ESP_LOGI(TAG, "Connecting to '%s' (%s)", network->ssid,
+             candidate->channel ? "scanned channel and BSSID" : "not seen, full scan");
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+// Find a stored network by SSID (caller holds s_creds_mutex)
+static int creds_find(const char *ssid)
+{
+    for (int i = 0; i < s_creds.count; i++) {
+        if (strcmp(s_creds.entries[i].ssid, ssid) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Stored network with the most recent successful connection (caller holds s_creds_mutex)
+static int creds_most_recent(void)
+{
+    int best = s_creds.count > 0 ? 0 : -1;
+    for (int i = 1; i < s_creds.count; i++) {
+        if (s_creds.entries[i].last_success > s_creds.entries[best].last_success) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Timestamp for last_success: system time once it is set, otherwise one past the newest
+// entry so the ranking still prefers the latest success (caller holds s_creds_mutex)
+static uint32_t creds_now(void)
+{
+    time_t now = time(NULL);
+    if (now >= CRED_MIN_VALID_TIME) {
+        return (uint32_t)now;
+    }
+    uint32_t newest = 0;
+    for (int i = 0; i < s_creds.count; i++) {
+        newest = MAX(newest, s_creds.entries[i].last_success);
+    }
+    return newest + 1;
+}
+
+// Write the store to NVS (caller holds s_creds_mutex; not from the event task, its stack is too small)
+static esp_err_t creds_write(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_WIFI, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, NVS_KEY_NETWORKS, &s_creds, sizeof(s_creds));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    if (err == ESP_OK) {
+        s_creds_dirty = false;
+    }
+    return err;
+}
+
+// Load the credential store, importing the single network saved by older firmware
+static void creds_load(void)
+{
+    memset(&s_creds, 0, sizeof(s_creds));
+    s_creds.version = CRED_STORE_VERSION;
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_WIFI, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    
+    size_t size = sizeof(s_creds);
+    if (nvs_get_blob(nvs_handle, NVS_KEY_NETWORKS, &s_creds, &size) == ESP_OK &&
+        size == sizeof(s_creds) && s_creds.version == CRED_STORE_VERSION &&
+        s_creds.count <= WIFI_PROV_MAX_NETWORKS) {
+        for (int i = 0; i < s_creds.count; i++) {
+            s_creds.entries[i].ssid[sizeof(s_creds.entries[i].ssid) - 1] = '\0';
+            s_creds.entries[i].password[sizeof(s_creds.entries[i].password) - 1] = '\0';
+        }
+        nvs_close(nvs_handle);
+        ESP_LOGI(TAG, "Credential store: %d network(s)", s_creds.count);
+        return;
+    }
+    
+    memset(&s_creds, 0, sizeof(s_creds));
+    s_creds.version = CRED_STORE_VERSION;
+    wifi_network_t *network = &s_creds.entries[0];
+    size_t len = sizeof(network->ssid);
+    if (nvs_get_str(nvs_handle, NVS_KEY_SSID, network->ssid, &len) == ESP_OK) {
+        len = sizeof(network->password);
+        if (nvs_get_str(nvs_handle, NVS_KEY_PASSWORD, network->password, &len) != ESP_OK) {
+            network->password[0] = '\0';
+        }
+        s_creds.count = 1;
+        nvs_close(nvs_handle);
+    
+        if (creds_write() == ESP_OK && nvs_open(NVS_NAMESPACE_WIFI, NVS_READWRITE, &nvs_handle) == ESP_OK) {
+            nvs_erase_key(nvs_handle, NVS_KEY_SSID);
+            nvs_erase_key(nvs_handle, NVS_KEY_PASSWORD);
+            nvs_commit(nvs_handle);
+            nvs_close(nvs_handle);
+        }
+        ESP_LOGI(TAG, "Imported WiFi network '%s' into the credential store", network->ssid);
+        return;
+    }
+    nvs_close(nvs_handle);
+}
+
+// Save connection results if they changed
+static void creds_save(void)
+{
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    if (s_creds_dirty) {
+        esp_err_t err = creds_write();
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to save credential store: %s", esp_err_to_name(err));
+        }
+    }
+    xSemaphoreGive(s_creds_mutex);
+}
+
+// Record the result of a connection attempt to the current network (runs in the event task)
+static void creds_record_result(bool success)
+{
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    if (s_current >= 0 && s_current < s_creds.count) {
+        wifi_network_t *network = &s_creds.entries[s_current];
+        if (success) {
+            wifi_ap_record_t ap_info;
+            if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+                network->rssi = ap_info.rssi;
+                network->channel = ap_info.primary;
+            }
+            network->failures = 0;
+            network->last_success = creds_now();
+            s_order_time_us = 0;  // Next bring-up ranks again
+        } else if (network->failures < CRED_MAX_FAILURES) {
+            network->failures++;
+        }
+        s_creds_dirty = true;
+    }
+    xSemaphoreGive(s_creds_mutex);
+}
+
+// Connection preference: visible networks by signal minus a penalty per recent failure,
+// then networks not seen by fewer failures (caller holds s_creds_mutex)
+static int creds_score(int index, const int8_t *seen_rssi)
+{
+    const wifi_network_t *network = &s_creds.entries[index];
+    if (seen_rssi[index] != INT8_MIN) {
+        return seen_rssi[index] - network->failures * CRED_FAILURE_PENALTY_DB;
+    }
+    return -1000 - network->failures;
+}
+
+// Start the selection scan: only the channels the stored networks were last seen on,
+// unless none is known (a few hundred ms instead of all 13 channels)
+static void select_scan_start(void)
+{
+    wifi_scan_config_t scan_config = {
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time = {
+            .active = {
+                .min = SELECT_SCAN_MIN_MS,
+                .max = SELECT_SCAN_MAX_MS,
+            }
+        }
+    };
+    
+    uint16_t channels = 0;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    if (s_select_hinted) {
+        for (int i = 0; i < s_creds.count; i++) {
+            uint8_t channel = s_creds.entries[i].channel;
+            if (channel >= 1 && channel <= 14) {
+                channels |= 1 << channel;  // Bit n = channel n
+            }
+        }
+    }
+    xSemaphoreGive(s_creds_mutex);
+    s_select_hinted = channels != 0;
+    scan_config.channel_bitmap.ghz_2_channels = channels;  // 0 = all channels
+    
+    ESP_LOGI(TAG, "Scanning for stored networks (%s)", s_select_hinted ? "known channels" : "all channels");
+    s_selecting = true;
+    esp_err_t ret = esp_wifi_scan_start(&scan_config, false);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Selection scan failed: %s", esp_err_to_name(ret));
+        s_select_hinted = false;
+        select_from_scan();  // Ranks without results: networks are tried with full scans
+    }
+}
+
+// Build the connection order from the selection scan and connect to the first candidate (runs in the event task)
+static void select_from_scan(void)
+{
+    int8_t seen_rssi[WIFI_PROV_MAX_NETWORKS];
+    uint8_t seen_channel[WIFI_PROV_MAX_NETWORKS] = {0};
+    uint8_t seen_bssid[WIFI_PROV_MAX_NETWORKS][6];
+    memset(seen_rssi, INT8_MIN, sizeof(seen_rssi));
+    bool any_seen = false;
+    
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    wifi_ap_record_t ap;
+    while (esp_wifi_scan_get_ap_record(&ap) == ESP_OK) {
+        for (int i = 0; i < s_creds.count; i++) {
+            if (strcmp((const char *)ap.ssid, s_creds.entries[i].ssid) == 0 && ap.rssi > seen_rssi[i]) {
+                seen_rssi[i] = ap.rssi;
+                seen_channel[i] = ap.primary;
+                memcpy(seen_bssid[i], ap.bssid, sizeof(seen_bssid[i]));
+                any_seen = true;
+            }
+        }
+    }
+    esp_wifi_clear_ap_list();
+    
+    if (!any_seen && s_select_hinted) {
+        xSemaphoreGive(s_creds_mutex);
+        ESP_LOGI(TAG, "No stored network on its known channel, scanning all channels");
+        s_select_hinted = false;
+        select_scan_start();
+        return;
+    }
+    
+    // Order: insertion sort by score, most recent success first on ties
+    s_order_count = 0;
+    for (int i = 0; i < s_creds.count; i++) {
+        if (seen_rssi[i] != INT8_MIN) {
+            s_creds.entries[i].rssi = seen_rssi[i];
+            s_creds.entries[i].channel = seen_channel[i];
+            s_creds_dirty = true;
+        }
+        wifi_candidate_t candidate = {.index = (uint8_t)i, .channel = seen_channel[i]};
+        if (candidate.channel) {
+            memcpy(candidate.bssid, seen_bssid[i], sizeof(candidate.bssid));
+        }
+        int score = creds_score(i, seen_rssi);
+        int pos = s_order_count;
+        while (pos > 0) {
+            int prev = s_order[pos - 1].index;
+            int prev_score = creds_score(prev, seen_rssi);
+            if (prev_score > score || (prev_score == score &&
+                s_creds.entries[prev].last_success >= s_creds.entries[i].last_success)) {
+                break;
+            }
+            s_order[pos] = s_order[pos - 1];
+            pos--;
+        }
+        s_order[pos] = candidate;
+        s_order_count++;
+    }
+    s_order_pos = 0;
+    s_order_time_us = esp_timer_get_time();
+    for (int i = 0; i < s_order_count; i++) {
+        ESP_LOGI(TAG, "  %d. %s (%d dBm, %d failures)%s", i + 1, s_creds.entries[s_order[i].index].ssid,
+                 seen_rssi[s_order[i].index] != INT8_MIN ? seen_rssi[s_order[i].index] : 0,
+                 s_creds.entries[s_order[i].index].failures, s_order[i].channel ? "" : " not seen");
+    }
+    s_selecting = false;
+    select_apply_next();
+    xSemaphoreGive(s_creds_mutex);
+    
+    esp_err_t ret = esp_wifi_connect();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect() failed: %s", esp_err_to_name(ret));
+    }
+}
+
 // WiFi event handler (internal to provisioning module)
 static void wifi_prov_event_handler(void* arg, esp_event_base_t event_base,
                               int32_t event_id, void* event_data)
@@ -243,18 +813,40 @@ static void wifi_prov_event_handler(void* arg, esp_event_base_t event_base,
                 break;
             case WIFI_EVENT_STA_START:
                 ESP_LOGI(TAG, "WiFi Station started");
-                // Delay briefly to ensure WiFi driver is fully initialized
-                vTaskDelay(pdMS_TO_TICKS(100));
+                if (s_softap_active) {
+                    wifi_scan_start();  // APSTA: fill the page's network list, never connect
+                    break;
+                }
+                if (s_selecting) {
+                    select_scan_start();  // Connects when the scan is done
+                    break;
+                }
+                // The driver accepts connect requests once STA_START is posted (no delay in the event task)
                 esp_err_t ret = esp_wifi_connect();
                 if (ret != ESP_OK) {
                     ESP_LOGW(TAG, "esp_wifi_connect() failed: %s", esp_err_to_name(ret));
                 }
                 break;
+            case WIFI_EVENT_SCAN_DONE:
+                if (s_selecting) {
+                    select_from_scan();
+                }
+                break;
+            case WIFI_EVENT_STA_CONNECTED:
+                s_assoc_us = esp_timer_get_time();
+                break;
             case WIFI_EVENT_STA_DISCONNECTED:
                 {
                     wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
                     ESP_LOGI(TAG, "WiFi Station disconnected, reason: %d", event->reason);
+                    bool was_connected = s_wifi_connected;
                     s_wifi_connected = false;
+                    if (s_fast_attempt && !s_assoc_us) {
+                        // Cached channel/BSSID did not work (AP moved or replaced): full scan right away
+                        fast_connect_fallback();
+                    } else if (!was_connected) {
+                        creds_record_result(false);
+                    }
                     if (s_status_cb) {
                         s_status_cb(false, NULL);
                     }
@@ -272,6 +864,8 @@ static void wifi_prov_event_handler(void* arg, esp_event_base_t event_base,
             ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
             snprintf(s_connected_ip, sizeof(s_connected_ip), IPSTR, IP2STR(&event->ip_info.ip));
             s_wifi_connected = true;
+            fast_connect_record(&event->ip_info);
+            creds_record_result(true);
             if (s_status_cb) {
                 s_status_cb(true, s_connected_ip);
             }
@@ -279,6 +873,15 @@ static void wifi_prov_event_handler(void* arg, esp_event_base_t event_base,
     }
 }
 
+// HTTP session opened: send small responses right away. Headers and body go out as
+// separate writes; with Nagle the body waits for the client's delayed ACK (~40 ms per request).
+static esp_err_t http_open_session(httpd_handle_t hd, int sockfd)
+{
+    int nodelay = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return ESP_OK;
+}
+
 // Initialize HTTP server
 static esp_err_t start_http_server(void)
 {
@@ -287,18 +890,21 @@ static esp_err_t start_http_server(void)
     }
     
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 2;
+    config.max_uri_handlers = web_asset_count + 4;
+    config.open_fn = http_open_session;
     
     ESP_LOGI(TAG, "Starting HTTP server on port: '%d'", config.server_port);
     if (httpd_start(&s_httpd_handle, &config) == ESP_OK) {
         // Register URI handlers
-        httpd_uri_t root = {
-            .uri       = "/",
-            .method    = HTTP_GET,
-            .handler   = root_get_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(s_httpd_handle, &root);
+        for (size_t i = 0; i < web_asset_count; i++) {
+            httpd_uri_t asset = {
+                .uri       = web_assets[i].uri,
+                .method    = HTTP_GET,
+                .handler   = asset_get_handler,
+                .user_ctx  = (void *)&web_assets[i]
+            };
+            httpd_register_uri_handler(s_httpd_handle, &asset);
+        }
         
         httpd_uri_t wifi = {
             .uri       = "/wifi",
@@ -308,6 +914,32 @@ static esp_err_t start_http_server(void)
         };
         httpd_register_uri_handler(s_httpd_handle, &wifi);
         
+        httpd_uri_t scan = {
+            .uri       = "/scan",
+            .method    = HTTP_GET,
+            .handler   = scan_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(s_httpd_handle, &scan);
+        
+        httpd_uri_t settings_get = {
+            .uri       = "/settings",
+            .method    = HTTP_GET,
+            .handler   = settings_get_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(s_httpd_handle, &settings_get);
+        
+        httpd_uri_t settings_post = {
+            .uri       = "/settings",
+            .method    = HTTP_POST,
+            .handler   = settings_post_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(s_httpd_handle, &settings_post);
+        
+        httpd_register_err_handler(s_httpd_handle, HTTPD_404_NOT_FOUND, captive_redirect_handler);
+        
         ESP_LOGI(TAG, "HTTP server started");
         return ESP_OK;
     }
@@ -359,6 +991,17 @@ esp_err_t wifi_provisioning_init(void)
                                                         NULL,
                                                         NULL));
     
+    // Background scan cache (its handler runs before the ones main.c registers later)
+    ESP_ERROR_CHECK(wifi_scan_init());
+    
+    // Load stored networks (served from RAM afterwards)
+    s_creds_mutex = xSemaphoreCreateMutex();
+    if (!s_creds_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+    creds_load();
+    app_config_wifi_changed(s_creds.count);
+    
     return ESP_OK;
 }
 
@@ -368,38 +1011,18 @@ esp_err_t wifi_provisioning_load_config(wifi_config_data_t *config)
         return ESP_ERR_INVALID_ARG;
     }
     
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE_WIFI, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGD(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return err;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    int index = creds_most_recent();
+    if (index >= 0) {
+        memcpy(config->ssid, s_creds.entries[index].ssid, sizeof(config->ssid));
+        memcpy(config->password, s_creds.entries[index].password, sizeof(config->password));
     }
+    xSemaphoreGive(s_creds_mutex);
     
-    // Read SSID
-    size_t required_size = sizeof(config->ssid);
-    err = nvs_get_str(nvs_handle, NVS_KEY_SSID, config->ssid, &required_size);
-    if (err != ESP_OK) {
-        nvs_close(nvs_handle);
-        ESP_LOGD(TAG, "SSID not found in NVS: %s", esp_err_to_name(err));
-        return err;
+    if (index < 0) {
+        ESP_LOGD(TAG, "No WiFi network stored");
+        return ESP_ERR_NOT_FOUND;
     }
-    
-    // Read password
-    required_size = sizeof(config->password);
-    err = nvs_get_str(nvs_handle, NVS_KEY_PASSWORD, config->password, &required_size);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        nvs_close(nvs_handle);
-        ESP_LOGE(TAG, "Failed to read password: %s", esp_err_to_name(err));
-        return err;
-    }
-    
-    // If password doesn't exist, set to empty string
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        config->password[0] = '\0';
-    }
-    
-    nvs_close(nvs_handle);
-    
     ESP_LOGI(TAG, "WiFi config loaded: SSID=%s, Password=%s", 
              config->ssid, strlen(config->password) > 0 ? "***" : "(empty)");
     
@@ -408,43 +1031,74 @@ esp_err_t wifi_provisioning_load_config(wifi_config_data_t *config)
 
 esp_err_t wifi_provisioning_save_config(const wifi_config_data_t *config)
 {
-    if (!config) {
+    if (!config || config->ssid[0] == '\0') {
         return ESP_ERR_INVALID_ARG;
     }
     
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE_WIFI, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return err;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    int index = creds_find(config->ssid);
+    if (index < 0) {
+        if (s_creds.count < WIFI_PROV_MAX_NETWORKS) {
+            index = s_creds.count++;
+        } else {
+            // Store full: replace the network with the oldest successful connection
+            index = 0;
+            for (int i = 1; i < s_creds.count; i++) {
+                if (s_creds.entries[i].last_success < s_creds.entries[index].last_success) {
+                    index = i;
+                }
+            }
+            ESP_LOGI(TAG, "Credential store full, replacing '%s'", s_creds.entries[index].ssid);
+        }
+        memset(&s_creds.entries[index], 0, sizeof(s_creds.entries[index]));
+        strncpy(s_creds.entries[index].ssid, config->ssid, sizeof(s_creds.entries[index].ssid) - 1);
     }
+    wifi_network_t *network = &s_creds.entries[index];
+    strncpy(network->password, config->password, sizeof(network->password) - 1);
+    network->password[sizeof(network->password) - 1] = '\0';
+    network->failures = 0;
+    s_order_time_us = 0;  // Store changed: rank again on the next connect
     
-    // Save SSID
-    err = nvs_set_str(nvs_handle, NVS_KEY_SSID, config->ssid);
-    if (err != ESP_OK) {
-        nvs_close(nvs_handle);
-        ESP_LOGE(TAG, "Failed to save SSID: %s", esp_err_to_name(err));
-        return err;
-    }
+    esp_err_t err = creds_write();
+    int count = s_creds.count;
+    xSemaphoreGive(s_creds_mutex);
     
-    // Save password
-    err = nvs_set_str(nvs_handle, NVS_KEY_PASSWORD, config->password);
     if (err != ESP_OK) {
-        nvs_close(nvs_handle);
-        ESP_LOGE(TAG, "Failed to save password: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to save WiFi config: %s", esp_err_to_name(err));
         return err;
     }
     
-    err = nvs_commit(nvs_handle);
-    nvs_close(nvs_handle);
+    ESP_LOGI(TAG, "WiFi config saved successfully (%d network(s) stored)", count);
+    app_config_wifi_changed((uint8_t)count);
+    return ESP_OK;
+}
+
+size_t wifi_provisioning_get_networks(wifi_network_t *networks, size_t max)
+{
+    if (!networks) {
+        return 0;
+    }
     
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
-        return err;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    size_t count = MIN((size_t)s_creds.count, max);
+    for (size_t i = 0; i < count; i++) {
+        networks[i] = s_creds.entries[i];
+        memset(networks[i].password, 0, sizeof(networks[i].password));
+    }
+    xSemaphoreGive(s_creds_mutex);
+    return count;
+}
+
+bool wifi_provisioning_is_known(const char *ssid)
+{
+    if (!ssid) {
+        return false;
     }
     
-    ESP_LOGI(TAG, "WiFi config saved successfully");
-    return ESP_OK;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    bool known = creds_find(ssid) >= 0;
+    xSemaphoreGive(s_creds_mutex);
+    return known;
 }
 
 esp_err_t wifi_provisioning_start_softap(wifi_prov_status_cb_t status_cb)
@@ -469,7 +1123,11 @@ esp_err_t wifi_provisioning_start_softap(wifi_prov_status_cb_t status_cb)
         wifi_config.ap.authmode = WIFI_AUTH_OPEN;
     }
     
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+    // APSTA: the station interface scans for the page's network list; scans return to the
+    // SoftAP channel between channels, so connected clients stay connected
+    s_softap_active = true;
+    s_selecting = false;
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
     
@@ -480,9 +1138,18 @@ esp_err_t wifi_provisioning_start_softap(wifi_prov_status_cb_t status_cb)
         return ret;
     }
     
+    // Captive portal: resolve every name to the SoftAP so the OS opens the page itself
+    esp_netif_ip_info_t ip_info;
+    if (esp_netif_get_ip_info(s_ap_netif, &ip_info) != ESP_OK ||
+        captive_dns_start(ip_info.ip.addr) != ESP_OK) {
+        ESP_LOGW(TAG, "Captive DNS not available, open %s manually", s_portal_url);
+    } else {
+        snprintf(s_portal_url, sizeof(s_portal_url), "http://" IPSTR "/", IP2STR(&ip_info.ip));
+    }
+    
     ESP_LOGI(TAG, "SoftAP started. Connect to '%s' with password '%s'", 
              SOFTAP_SSID, SOFTAP_PASSWORD);
-    ESP_LOGI(TAG, "Then open http://192.168.4.1 in your browser");
+    ESP_LOGI(TAG, "The setup page opens automatically, or open %s in your browser", s_portal_url);
     
     return ESP_OK;
 }
@@ -491,14 +1158,26 @@ esp_err_t wifi_provisioning_stop_softap(void)
 {
     ESP_LOGI(TAG, "Stopping SoftAP");
     
-    // Stop HTTP server
+    // Stop HTTP server and captive DNS
     stop_http_server();
+    captive_dns_stop();
+    s_softap_active = false;
     
     // Stop WiFi
     esp_err_t ret = esp_wifi_stop();
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to stop WiFi: %s", esp_err_to_name(ret));
     }
+    s_fast_attempt = false;
+    if (s_static_lease) {
+        esp_netif_dhcpc_start(s_sta_netif);  // Leave the interface in DHCP mode for the next start
+        s_static_lease = false;
+    }
+    
+    // Persist the AP and lease of the last connection for the next fast connect
+    fast_connect_save();
+    s_selecting = false;
+    creds_save();
     
     return ESP_OK;
 }
@@ -509,28 +1188,45 @@ esp_err_t wifi_provisioning_start_sta(const wifi_config_data_t *config, wifi_pro
         return ESP_ERR_INVALID_ARG;
     }
     
-    s_status_cb = status_cb;
-    s_wifi_connected = false;
+    sta_connect_begin(status_cb);
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    s_current = creds_find(config->ssid);  // Connection results are recorded for stored networks
+    xSemaphoreGive(s_creds_mutex);
     
     ESP_LOGI(TAG, "Starting WiFi Station: SSID=%s", config->ssid);
     
     // Configure Station
-    // Note: threshold.authmode is set to WIFI_AUTH_OPEN to support all authentication modes
-    // This allows automatic adaptation to different authentication methods like WPA, WPA2, WPA3, etc.
-    wifi_config_t wifi_config = {
-        .sta = {
-            .threshold.authmode = WIFI_AUTH_OPEN,  // Support all authentication modes
-            .scan_method = WIFI_FAST_SCAN,  // Fast scan
-            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,  // Sort by signal strength
-        },
-    };
+    wifi_config_t wifi_config;
+    sta_config_init(&wifi_config, config->ssid, config->password);
     
-    strncpy((char*)wifi_config.sta.ssid, config->ssid, sizeof(wifi_config.sta.ssid) - 1);
-    wifi_config.sta.ssid[sizeof(wifi_config.sta.ssid) - 1] = '\0';
-    
-    if (strlen(config->password) > 0) {
-        strncpy((char*)wifi_config.sta.password, config->password, sizeof(wifi_config.sta.password) - 1);
-        wifi_config.sta.password[sizeof(wifi_config.sta.password) - 1] = '\0';
+    // Fast connect: associate directly on the cached channel and BSSID of the same network
+    if (s_fast_connect.version == 0) {
+        fast_connect_load();
+    }
+    s_fast_attempt = s_fast_connect.channel != 0 && strcmp(s_fast_connect.ssid, config->ssid) == 0;
+    if (s_fast_attempt) {
+        wifi_config.sta.channel = s_fast_connect.channel;
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_fast_connect.bssid, sizeof(wifi_config.sta.bssid));
+        ESP_LOGI(TAG, "Fast connect: channel %d, BSSID " MACSTR,
+                 s_fast_connect.channel, MAC2STR(s_fast_connect.bssid));
+        
+#if FAST_CONNECT_STATIC_LEASE
+        if (s_fast_connect.ip != 0 && esp_netif_dhcpc_stop(s_sta_netif) == ESP_OK) {
+            esp_netif_ip_info_t ip_info = {0};
+            ip_info.ip.addr = s_fast_connect.ip;
+            ip_info.netmask.addr = s_fast_connect.netmask;
+            ip_info.gw.addr = s_fast_connect.gw;
+            esp_netif_set_ip_info(s_sta_netif, &ip_info);
+            if (s_fast_connect.dns != 0) {
+                esp_netif_dns_info_t dns = {0};
+                dns.ip.type = ESP_IPADDR_TYPE_V4;
+                dns.ip.u_addr.ip4.addr = s_fast_connect.dns;
+                esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+            }
+            s_static_lease = true;
+        }
+#endif
     }
     
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
@@ -540,15 +1236,65 @@ esp_err_t wifi_provisioning_start_sta(const wifi_config_data_t *config, wifi_pro
     return ESP_OK;
 }
 
+esp_err_t wifi_provisioning_connect(wifi_prov_status_cb_t status_cb)
+{
+    if (s_fast_connect.version == 0) {
+        fast_connect_load();
+    }
+    
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    if (s_creds.count == 0) {
+        xSemaphoreGive(s_creds_mutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    // One network, or the last one connected to has a usable fast connect record: connect directly
+    int recent = creds_most_recent();
+    if (s_creds.count == 1 || (s_fast_connect.channel != 0 && s_creds.entries[recent].failures == 0 &&
+                               strcmp(s_fast_connect.ssid, s_creds.entries[recent].ssid) == 0)) {
+        wifi_config_data_t config;
+        memcpy(config.ssid, s_creds.entries[recent].ssid, sizeof(config.ssid));
+        memcpy(config.password, s_creds.entries[recent].password, sizeof(config.password));
+        xSemaphoreGive(s_creds_mutex);
+        return wifi_provisioning_start_sta(&config, status_cb);
+    }
+    
+    // Retry shortly after a selection scan: next network in its order, otherwise scan when started
+    sta_connect_begin(status_cb);
+    bool reuse = s_order_time_us != 0 && s_order_pos < s_order_count &&
+                 esp_timer_get_time() - s_order_time_us < CRED_ORDER_TTL_US;
+    if (reuse) {
+        select_apply_next();
+    } else {
+        s_selecting = true;
+        s_select_hinted = true;
+    }
+    xSemaphoreGive(s_creds_mutex);
+    
+    ESP_LOGI(TAG, "Starting WiFi Station (%s)", reuse ? "next network of the last scan" : "selecting from stored networks");
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    
+    return ESP_OK;
+}
+
+bool wifi_provisioning_disconnect_handled(void)
+{
+    bool handled = s_disconnect_handled;
+    s_disconnect_handled = false;
+    return handled;
+}
+
 bool wifi_provisioning_has_config(void)
 {
-    wifi_config_data_t config;
-    esp_err_t ret = wifi_provisioning_load_config(&config);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "WiFi config found: SSID=%s", config.ssid);
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    int count = s_creds.count;
+    xSemaphoreGive(s_creds_mutex);
+    if (count > 0) {
+        ESP_LOGI(TAG, "WiFi config found: %d network(s) stored", count);
         return true;
     } else {
-        ESP_LOGI(TAG, "No WiFi config found: %s", esp_err_to_name(ret));
+        ESP_LOGI(TAG, "No WiFi config found");
         return false;
     }
 }
@@ -567,6 +1313,16 @@ esp_err_t wifi_provisioning_clear_config(void)
     if (err == ESP_OK) {
         err = nvs_commit(nvs_handle);
     }
+    memset(&s_fast_connect, 0, sizeof(s_fast_connect));  // Also erased: fast connect record
+    s_fast_connect_dirty = false;
+    xSemaphoreTake(s_creds_mutex, portMAX_DELAY);
+    memset(&s_creds, 0, sizeof(s_creds));  // And the credential store
+    s_creds.version = CRED_STORE_VERSION;
+    s_creds_dirty = false;
+    s_order_time_us = 0;
+    s_current = -1;
+    xSemaphoreGive(s_creds_mutex);
+    app_config_wifi_changed(0);
     
     nvs_close(nvs_handle);
     return err;
@@ -3,17 +3,33 @@
 
 #include "esp_err.h"
 #include "esp_wifi.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define WIFI_PROV_MAX_NETWORKS  5   // Networks kept in the credential store
+
 // WiFi configuration structure
 typedef struct {
     char ssid[33];      // WiFi SSID (max 32 characters + null terminator)
     char password[65];  // WiFi password (max 64 characters + null terminator)
 } wifi_config_data_t;
 
+// Stored network (credential store entry)
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t channel;        // Channel the AP was last seen on (0 = unknown), used as scan hint
+    int8_t rssi;            // Signal strength when last seen, in dBm (0 = never seen)
+    uint8_t failures;       // Consecutive failed connection attempts
+    uint8_t reserved;
+    uint32_t last_success;  // UTC seconds of the last successful connection (0 = never)
+} wifi_network_t;
+
 // Provisioning status callback function type
 typedef void (*wifi_prov_status_cb_t)(bool connected, const char* ip);
 
@@ -27,18 +43,21 @@ typedef void (*wifi_prov_status_cb_t)(bool connected, const char* ip);
 esp_err_t wifi_provisioning_init(void);
 
 /**
- * @brief Load WiFi configuration from NVS
+ * @brief Load the most recently successful stored network
  * 
  * @param config Output parameter, stores the loaded configuration
  * @return 
  *    - ESP_OK: Successfully loaded configuration
- *    - ESP_ERR_NOT_FOUND: Configuration not found
+ *    - ESP_ERR_NOT_FOUND: No network stored
  *    - Others: Failed to load
  */
 esp_err_t wifi_provisioning_load_config(wifi_config_data_t *config);
 
 /**
- * @brief Save WiFi configuration to NVS
+ * @brief Add a network to the credential store (or update its password) and save to NVS
+ * 
+ * Resets the failure count of the network. When the store is full, the
+ * network with the oldest successful connection is replaced.
  * 
  * @param config Configuration to save
  * @return 
@@ -47,6 +66,24 @@ esp_err_t wifi_provisioning_load_config(wifi_config_data_t *config);
  */
 esp_err_t wifi_provisioning_save_config(const wifi_config_data_t *config);
 
+/**
+ * @brief Copy the stored networks (passwords are not copied)
+ * 
+ * @param networks Output array
+ * @param max Size of the output array
+ * @return Number of networks copied
+ */
+size_t wifi_provisioning_get_networks(wifi_network_t *networks, size_t max);
+
+/**
+ * @brief Check whether an SSID is in the credential store
+ * 
+ * @param ssid Network name
+ * @return true if stored, false otherwise
+ */
+bool wifi_provisioning_is_known(const char *ssid);
+
+
 /**
  * @brief Start SoftAP provisioning mode
  * 
@@ -77,15 +114,49 @@ esp_err_t wifi_provisioning_stop_softap(void);
  */
 esp_err_t wifi_provisioning_start_sta(const wifi_config_data_t *config, wifi_prov_status_cb_t status_cb);
 
+/**
+ * @brief Start WiFi Station mode and connect to the best stored network
+ * 
+ * With one stored network, connects directly (on the cached channel and
+ * BSSID when available). With several, runs one scan restricted to the
+ * channels the networks were last seen on (all channels if none is known
+ * or none was found), ranks the visible networks by signal strength,
+ * failure count and last success, and connects to the best one on its
+ * scanned channel and BSSID. Further calls within a minute of the scan
+ * try the next network in that order without scanning again.
+ * 
+ * Failure is reported as WIFI_EVENT_STA_DISCONNECTED (reason NO_AP_FOUND
+ * when no stored network is visible).
+ * 
+ * @param status_cb Connection status callback function (optional, can be NULL)
+ * @return 
+ *    - ESP_OK: Successfully started connection
+ *    - ESP_ERR_NOT_FOUND: No network stored
+ *    - Others: Failure
+ */
+esp_err_t wifi_provisioning_connect(wifi_prov_status_cb_t status_cb);
+
+/**
+ * @brief Check whether the last Station disconnect was already handled
+ * 
+ * Station mode first associates on the channel and BSSID of the last
+ * successful connection. If that fails, the module reconnects with a full
+ * scan by itself; callers with their own retry logic should skip that
+ * disconnect. Reading the flag clears it.
+ * 
+ * @return true if the module already reconnected, false otherwise
+ */
+bool wifi_provisioning_disconnect_handled(void);
+
 /**
  * @brief Check if there is saved WiFi configuration
  * 
- * @return true if configuration exists, false otherwise
+ * @return true if at least one network is stored, false otherwise
  */
 bool wifi_provisioning_has_config(void);
 
 /**
- * @brief Clear saved WiFi configuration
+ * @brief Clear all stored networks and the fast connect record
  * 
  * @return 
  *    - ESP_OK: Success
@@ -0,0 +1,307 @@
+#include "wifi_scan.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "wifi_scan";
+
+static wifi_scan_entry_t s_entries[WIFI_SCAN_MAX_RESULTS];  // Sorted by RSSI, strongest first
+static size_t s_count = 0;
+static uint32_t s_generation = 0;
+static int64_t s_scanned_us = 0;                    // Completion of the last scan (0 = none yet)
+static volatile bool s_running = false;             // Scan started here, cleared by WIFI_EVENT_SCAN_DONE
+static SemaphoreHandle_t s_mutex = NULL;            // Guards the cache (event, main and httpd tasks)
+
+// Merge one scan result into the cache (caller holds s_mutex)
+static void cache_merge(const wifi_ap_record_t *ap, int64_t now_us)
+{
+    const char *ssid = (const char *)ap->ssid;
+    if (ssid[0] == '\0') {
+        return;  // Hidden network
+    }
+
+    wifi_scan_entry_t *entry = NULL;
+    for (size_t i = 0; i < s_count; i++) {
+        if (strcmp(s_entries[i].ssid, ssid) == 0) {
+            entry = &s_entries[i];
+            break;
+        }
+    }
+    if (entry != NULL && entry->seen_us == now_us && entry->rssi >= ap->rssi) {
+        return;  // Weaker access point of a network already seen in this scan
+    }
+    if (entry == NULL) {
+        if (s_count < WIFI_SCAN_MAX_RESULTS) {
+            entry = &s_entries[s_count++];
+        } else {
+            // Full: replace the weakest network if this one is stronger
+            size_t weakest = 0;
+            for (size_t i = 1; i < s_count; i++) {
+                if (s_entries[i].rssi < s_entries[weakest].rssi) {
+                    weakest = i;
+                }
+            }
+            if (s_entries[weakest].rssi >= ap->rssi) {
+                return;
+            }
+            entry = &s_entries[weakest];
+        }
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->ssid, ssid, sizeof(entry->ssid) - 1);
+    }
+    entry->rssi = ap->rssi;
+    entry->channel = ap->primary;
+    entry->authmode = (uint8_t)ap->authmode;
+    entry->seen_us = now_us;
+}
+
+// Drop networks not seen recently and restore the RSSI order (caller holds s_mutex)
+static void cache_age_and_sort(int64_t now_us)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < s_count; i++) {
+        if (now_us - s_entries[i].seen_us > WIFI_SCAN_MAX_AGE_MS * 1000LL) {
+            continue;
+        }
+        s_entries[kept++] = s_entries[i];
+    }
+    s_count = kept;
+
+    // Insertion sort: the cache is small and mostly sorted already
+    for (size_t i = 1; i < s_count; i++) {
+        wifi_scan_entry_t entry = s_entries[i];
+        size_t pos = i;
+        while (pos > 0 && s_entries[pos - 1].rssi < entry.rssi) {
+            s_entries[pos] = s_entries[pos - 1];
+            pos--;
+        }
+        s_entries[pos] = entry;
+    }
+}
+
+// Collect the results of our scan (runs in the event task, one record at a time)
+static void scan_collect(bool ok)
+{
+    int64_t now_us = esp_timer_get_time();
+    size_t found = 0;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (ok) {
+        wifi_ap_record_t ap;
+        while (esp_wifi_scan_get_ap_record(&ap) == ESP_OK) {
+            cache_merge(&ap, now_us);
+            found++;
+        }
+    }
+    esp_wifi_clear_ap_list();
+    cache_age_and_sort(now_us);
+    s_scanned_us = now_us;
+    s_running = false;
+    s_generation++;
+    size_t count = s_count;
+    xSemaphoreGive(s_mutex);
+
+    if (ok) {
+        ESP_LOGI(TAG, "Scan done: %u access points, %u networks cached", (unsigned)found, (unsigned)count);
+    } else {
+        ESP_LOGW(TAG, "Scan failed");
+    }
+}
+
+// WiFi event handler
+static void wifi_scan_event_handler(void *arg, esp_event_base_t event_base,
+                                    int32_t event_id, void *event_data)
+{
+    if (!s_running) {
+        return;  // Selection scans of wifi_provisioning are collected there
+    }
+    if (event_id == WIFI_EVENT_SCAN_DONE) {
+        wifi_event_sta_scan_done_t *event = (wifi_event_sta_scan_done_t *)event_data;
+        scan_collect(event->status == 0);
+    } else if (event_id == WIFI_EVENT_STA_STOP) {
+        // Stopping the station aborts the scan without a result
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_running = false;
+        s_generation++;
+        xSemaphoreGive(s_mutex);
+    }
+}
+
+esp_err_t wifi_scan_init(void)
+{
+    if (s_mutex != NULL) {
+        return ESP_OK;
+    }
+    s_mutex = xSemaphoreCreateMutex();
+    if (s_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // ANY_ID like the other WiFi handlers: handlers of one level run in registration order,
+    // so handlers registered later see the collected results on SCAN_DONE
+    return esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                               &wifi_scan_event_handler, NULL, NULL);
+}
+
+esp_err_t wifi_scan_start(void)
+{
+    wifi_scan_config_t scan_config = {
+        .show_hidden = false,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time = {
+            .active = {
+                .min = WIFI_SCAN_ACTIVE_MIN_MS,
+                .max = WIFI_SCAN_ACTIVE_MAX_MS,
+            }
+        },
+        .home_chan_dwell_time = WIFI_SCAN_HOME_DWELL_MS,
+    };
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_running) {
+        xSemaphoreGive(s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_running = true;  // Set first: SCAN_DONE may arrive before esp_wifi_scan_start() returns
+    esp_err_t ret = esp_wifi_scan_start(&scan_config, false);
+    if (ret != ESP_OK) {
+        s_running = false;
+    } else {
+        s_generation++;
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Scan not started: %s", esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "Scanning for WiFi networks...");
+    }
+    return ret;
+}
+
+bool wifi_scan_refresh(uint32_t max_age_ms)
+{
+    if (s_running) {
+        return true;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool fresh = s_scanned_us != 0 && esp_timer_get_time() - s_scanned_us < max_age_ms * 1000LL;
+    xSemaphoreGive(s_mutex);
+    if (fresh) {
+        return false;
+    }
+    esp_err_t ret = wifi_scan_start();
+    return ret == ESP_OK || ret == ESP_ERR_INVALID_STATE;
+}
+
+bool wifi_scan_running(void)
+{
+    return s_running;
+}
+
+size_t wifi_scan_count(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    size_t count = s_count;
+    xSemaphoreGive(s_mutex);
+    return count;
+}
+
+bool wifi_scan_get(size_t index, wifi_scan_entry_t *entry)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool ok = index < s_count;
+    if (ok) {
+        *entry = s_entries[index];
+    }
+    xSemaphoreGive(s_mutex);
+    return ok;
+}
+
+uint32_t wifi_scan_generation(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    uint32_t generation = s_generation;
+    xSemaphoreGive(s_mutex);
+    return generation;
+}
+
+// Write ssid as a JSON string, returns its length or 0 if it does not fit
+static size_t json_string(char *buf, size_t size, const char *ssid)
+{
+    size_t len = 0;
+    if (size < 2) {
+        return 0;
+    }
+    buf[len++] = '"';
+    for (const unsigned char *p = (const unsigned char *)ssid; *p; p++) {
+        char esc[7];
+        size_t n;
+        if (*p == '"' || *p == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)*p;
+            n = 2;
+        } else if (*p < 0x20) {
+            n = (size_t)snprintf(esc, sizeof(esc), "\\u%04x", *p);
+        } else {
+            esc[0] = (char)*p;
+            n = 1;
+        }
+        if (len + n + 1 >= size) {
+            return 0;
+        }
+        memcpy(buf + len, esc, n);
+        len += n;
+    }
+    if (len + 1 >= size) {
+        return 0;
+    }
+    buf[len++] = '"';
+    return len;
+}
+
+size_t wifi_scan_json(char *buf, size_t size, uint32_t *generation)
+{
+    static const char tail[] = "]}";
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int n = snprintf(buf, size, "{\"scanning\":%s,\"aps\":[", s_running ? "true" : "false");
+    if (n < 0 || (size_t)n + sizeof(tail) > size) {
+        xSemaphoreGive(s_mutex);
+        return 0;
+    }
+    size_t len = (size_t)n;
+    size_t limit = size - (sizeof(tail) - 1);  // Room kept for the closing brackets
+    for (size_t i = 0; i < s_count; i++) {
+        const wifi_scan_entry_t *entry = &s_entries[i];
+        size_t start = len;
+        if (len + 2 >= limit) {
+            break;
+        }
+        if (i > 0) {
+            buf[len++] = ',';
+        }
+        buf[len++] = '[';
+        size_t ssid_len = json_string(buf + len, limit - len, entry->ssid);
+        if (ssid_len == 0) {
+            len = start;
+            break;
+        }
+        len += ssid_len;
+        n = snprintf(buf + len, limit - len, ",%d,%u,%u]", entry->rssi, entry->channel, entry->authmode);
+        if (n < 0 || (size_t)n >= limit - len) {
+            len = start;
+            break;  // Sorted: only weaker networks are left out
+        }
+        len += (size_t)n;
+    }
+    memcpy(buf + len, tail, sizeof(tail));
+    len += sizeof(tail) - 1;
+    if (generation != NULL) {
+        *generation = s_generation;
+    }
+    xSemaphoreGive(s_mutex);
+    return len;
+}
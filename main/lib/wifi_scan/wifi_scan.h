@@ -0,0 +1,103 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Background WiFi scan with a result cache
+//
+// Scans are non-blocking (results are collected on WIFI_EVENT_SCAN_DONE) and return to the
+// home channel between channels, so a running SoftAP keeps serving its clients (APSTA mode).
+// Results are merged into a cache of networks: one entry per SSID (strongest access point),
+// sorted by RSSI, each with the time it was last seen. Networks not seen for
+// WIFI_SCAN_MAX_AGE_MS are dropped. Hidden networks are not cached (they cannot be picked).
+
+#define WIFI_SCAN_MAX_RESULTS   16      // Cached networks (the weakest is replaced when full)
+#define WIFI_SCAN_MAX_AGE_MS    60000   // Drop networks not seen for this long
+#define WIFI_SCAN_ACTIVE_MIN_MS 30      // Active dwell per channel
+#define WIFI_SCAN_ACTIVE_MAX_MS 120
+#define WIFI_SCAN_HOME_DWELL_MS 30      // Time on the home channel between scanned channels (SoftAP beacons)
+
+typedef struct {
+    char ssid[33];
+    int8_t rssi;            // dBm, strongest access point of the network
+    uint8_t channel;
+    uint8_t authmode;       // wifi_auth_mode_t (0 = open)
+    int64_t seen_us;        // esp_timer time of the last scan that saw it
+} wifi_scan_entry_t;
+
+/**
+ * @brief Initialize the scan cache and register for scan events
+ *
+ * Call after the default event loop has been created and before registering other
+ * WIFI_EVENT handlers that read the cache on WIFI_EVENT_SCAN_DONE.
+ *
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Failure
+ */
+esp_err_t wifi_scan_init(void);
+
+/**
+ * @brief Start an all-channel scan in the background (station interface must be started)
+ *
+ * @return
+ *    - ESP_OK: Scan started
+ *    - ESP_ERR_INVALID_STATE: A scan started here is still running
+ *    - Others: esp_wifi_scan_start() failed
+ */
+esp_err_t wifi_scan_start(void);
+
+/**
+ * @brief Start a scan unless one is running or the cache is newer than max_age_ms
+ *
+ * @return true if a scan is running afterwards
+ */
+bool wifi_scan_refresh(uint32_t max_age_ms);
+
+/**
+ * @brief Check whether a scan started with wifi_scan_start() is still running
+ */
+bool wifi_scan_running(void);
+
+/**
+ * @brief Number of cached networks
+ */
+size_t wifi_scan_count(void);
+
+/**
+ * @brief Copy a cached network (index 0 is the strongest)
+ *
+ * @return false if index is out of range
+ */
+bool wifi_scan_get(size_t index, wifi_scan_entry_t *entry);
+
+/**
+ * @brief Cache generation, incremented when a scan starts or ends (the cache only changes then)
+ */
+uint32_t wifi_scan_generation(void);
+
+/**
+ * @brief Format the cache as compact JSON
+ *
+ * {"scanning":true,"aps":[["ssid",rssi,channel,authmode],...]}, strongest first.
+ * Networks that do not fit into the buffer are left out (the weakest ones).
+ *
+ * @param buf Output buffer
+ * @param size Buffer size (at least 64 bytes)
+ * @param generation Optional: generation of the formatted cache
+ * @return Length of the document (without terminator), 0 if the buffer is too small
+ */
+size_t wifi_scan_json(char *buf, size_t size, uint32_t *generation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIFI_SCAN_H
@@ -3,6 +3,7 @@
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
 #ifndef CONFIG_LOG_MAXIMUM_LEVEL
 #define CONFIG_LOG_MAXIMUM_LEVEL 5
@@ -22,37 +23,96 @@
 #include "esp_netif.h"
 #include "esp_timer.h"
 #include "nvs_flash.h"
-#include "nvs.h"
-#include "lwip/apps/sntp.h"
 #include "ssd1306.h"
 #include "ds3231.h"
 #include "wifi_provisioning.h"
+#include "drift_cal.h"
+#include "alarm_sched.h"
+#include "calendar.h"
+#include "tz.h"
+#include "time_service.h"
+#include "ntp_client.h"
+#include "status_server.h"
+#include "app_config.h"
+#include "wifi_scan.h"
+#include "ota_update.h"
+#include "trace.h"
+#include "dlog.h"
+#include "mem_report.h"
+#include "i2c_fault.h"
+#include "latency.h"
+#include "face.h"
 #include <stdint.h>
+#include <inttypes.h>
 #include <time.h>
+#include <sys/time.h>
 
 // ESP32-C3 pin definitions
 // DS3231 and SSD1306 share I2C pins
 #define DS3231_SDA_PIN     GPIO_NUM_0
 #define DS3231_SCL_PIN     GPIO_NUM_1
 
+// DS3231 INT/SQW pin (not wired by default: alarm flags are polled once per second instead)
+#define DS3231_INT_PIN     GPIO_NUM_NC
+
 // SSD1306 I2C address (common is 0x3C, try 0x3D if it doesn't work)
 #define SSD1306_I2C_ADDR   SSD1306_I2C_ADDR_0  // 0x3C
 
 // WiFi configuration
 #define WIFI_MAX_RETRY      5
-#define WIFI_CONNECT_TIMEOUT_MS  15000  // WiFi connection timeout: 15 seconds
+#define WIFI_CONNECT_TIMEOUT_MS  15000  // Per attempt: association and DHCP
+#define WIFI_BACKOFF_MIN_MS      1000   // Radio off before the first retry, doubled per failed attempt
+#define WIFI_BACKOFF_MAX_MS      16000
+#define NET_RADIO_BUDGET_MS      120000 // Radio-on time per bring-up (connecting and NTP), then WiFi is stopped
 
-// NTP configuration (Beijing time, UTC+8)
+// NTP configuration
 #define NTP_SERVER1         "cn.pool.ntp.org"
 #define NTP_SERVER2         "time.windows.com"
 #define NTP_SERVER3         "pool.ntp.org"
-#define TIMEZONE_OFFSET     8  // Beijing time UTC+8
+#define NTP_SAMPLES         4       // Requests to the fastest server; the lowest-delay sample is used
+#define NTP_RETRY_INTERVAL_MS  5000  // Between sync attempts until the radio budget is spent
+#define NTP_SYNC_STACK_SIZE    4096  // ntp_sync_task (sockets, DNS)
+
+// Status server: GET /status (JSON) and POST /ota (firmware update) on the station interface
+// while the radio is on for a sync
+#define STATUS_SERVER_ENABLED  1
+
+// Tasks (app_main initializes the modules, starts them and returns)
+// render: draws each frame as it arrives and owns the SSD1306
+// rtc: second edges, DS3231 reads and writes, alarms; owns the DS3231 and sends one frame per second
+// net: WiFi, NTP, provisioning, settings write-back and memory checks
+// The I2C driver serializes the two devices on the shared bus.
+#define RENDER_TASK_PRIORITY    19      // Above lwIP (18), below the event loop (20) and WiFi (23)
+#define RENDER_TASK_STACK       3072
+#define RTC_TASK_PRIORITY       17
+#define RTC_TASK_STACK          4096
+#define RTC_TASK_POLL_MS        10      // Second edge check interval
+#define NET_TASK_PRIORITY       2
+#define NET_TASK_STACK          4096
+#define NET_TASK_POLL_MS        50      // Deadline check interval (events wake the task earlier)
+#define RTC_QUEUE_LEN           2       // NTP results to write (net -> rtc)
+#define NET_QUEUE_LEN           2       // DS3231 write outcomes (rtc -> net)
+
+// DS3231 write alignment
+#define RTC_WRITE_LATENCY_US    300     // I2C start to seconds byte ACK at 100 kHz (resets the countdown chain)
+#define RTC_WRITE_LEAD_US       50000   // Minimum time to prepare a write before the second boundary
+#define RTC_WRITE_MAX_LATE_US   2000    // Writes started later than this are redone on the next second
+#define RTC_WRITE_ATTEMPTS      3
+#define RTC_WRITE_SPIN_US       30000   // Busy-wait window before the boundary (rtc task polls every 10 ms)
 
-// NVS configuration
-// Note: Use independent namespace "time_sync", isolated from WiFi provisioning module's "wifi_config" namespace
-#define NVS_NAMESPACE        "time_sync"
-#define NVS_KEY_LAST_SYNC    "last_sync"
-#define SYNC_INTERVAL_HOURS  720  // Skip NTP sync if synced within 720 hours
+// Time settings (last sync, RTC UTC flag) live in app_config, NVS namespace "time_sync"
+#define LEGACY_RTC_OFFSET_S  (8 * 3600)   // Fixed CST-8 offset used by older firmware
+#define SYNC_INTERVAL_HOURS  720  // Default sync interval until drift_cal has enough history to adapt it
+
+// Alarm actions (alarm_spec_t.action)
+#define ALARM_ACTION_USER    0  // User alarm: blink display for ALARM_USER_BLINK_SECONDS (even)
+#define ALARM_ACTION_CHIME   1  // Chime: single display flash
+#define ALARM_ACTION_DIM     2  // Scheduled dimming: arg = contrast value
+#define ALARM_USER_BLINK_SECONDS  30
+
+// Display brightness (contrast) levels
+#define BRIGHTNESS_DAY       0xCF  // 100% brightness (original value)
+#define BRIGHTNESS_NIGHT     0x9B  // 75% brightness (0xCF * 0.75 ≈ 0x9B)
 
 static const char *TAG = "main";
 
@@ -61,13 +121,67 @@ static ssd1306_t ssd1306 = {0};  // Initialize to 0, ensure i2c_dev is NULL
 static ds3231_t ds3231;
 static i2c_master_bus_handle_t i2c_bus = NULL;
 static int s_retry_num = 0;
-static bool sntp_synced = false;
-static bool ntp_initialized = false;
+static TaskHandle_t s_net_task = NULL;   // Woken by WiFi/IP events, ntp_sync_task and the rtc task
+static TaskHandle_t s_rtc_task = NULL;   // Woken when an NTP result is queued
+static QueueHandle_t s_render_queue = NULL;  // Latest frame (length 1, overwritten)
+static QueueHandle_t s_rtc_queue = NULL;     // rtc_sync_request_t
+static QueueHandle_t s_net_queue = NULL;     // esp_err_t: outcome of a DS3231 write
+
+// Network bring-up state (advanced by net_service() in the net task, never blocks)
+typedef enum {
+    NET_IDLE,        // Radio off
+    NET_CONNECTING,  // Station started, waiting for an IP address
+    NET_BACKOFF,     // Attempt failed, radio off (or diagnostic scan) until the retry time
+    NET_SYNCING,     // Connected, NTP exchanges run in ntp_sync_task
+    NET_RTC_WRITE,   // NTP offset known, waiting for the second boundary to write the DS3231
+    NET_UPDATING,    // Bring-up done, radio kept on until a firmware upload ends
+} net_state_t;
+
+static const char *const s_net_state_names[] = {"idle", "connecting", "backoff", "syncing", "rtc_write",
+                                                "updating"};
+
+static net_state_t s_net_state = NET_IDLE;
+static TickType_t s_net_deadline = 0;         // End of the attempt, backoff or NTP retry wait
+static int64_t s_net_radio_start_us = 0;      // Start of the current radio-on period (0 = radio off)
+static int64_t s_net_radio_used_us = 0;       // Radio-on time of earlier periods in this bring-up
+static volatile bool s_net_got_ip = false;    // Set by IP_EVENT_STA_GOT_IP
+static volatile bool s_net_disconnected = false;  // Set by WIFI_EVENT_STA_DISCONNECTED
+static bool s_net_update_success = false;     // Outcome of the bring-up finished in NET_UPDATING
+
+// NTP exchange (ntp_sync_task)
+static volatile bool s_ntp_busy = false;      // ntp_sync_task running
+static bool s_ntp_launched = false;           // Result of the last ntp_sync_task not consumed yet
+static esp_err_t s_ntp_status = ESP_FAIL;
+static ntp_client_result_t s_ntp_result;
+
+// Aligned DS3231 write (rtc task)
+static ntp_client_result_t s_rtc_sync;        // NTP result being written
+static int64_t s_rtc_write_second = 0;        // Epoch second to write on its boundary
+static int s_rtc_write_attempt = 0;           // 0 = no write pending
+
+// Display tick jitter during bring-up (interval error against 1 s)
+static int64_t s_last_frame_us = 0;
+static int64_t s_frame_jitter_max_us = 0;
+static uint32_t s_frame_count = 0;
+
+// Last bring-up outcome (reported by the status server)
+static bool s_net_has_outcome = false;
+static bool s_net_last_ok = false;
+static uint32_t s_net_last_delay_us = 0;      // Round-trip delay of the last successful sync
+static int32_t s_rtc_offset_ms = 0;           // RTC offset measured before the last sync
+
+// Sync timing (esp_timer microseconds since boot, 0 = not reached)
+static int64_t s_got_ip_us = 0;       // IP address obtained
+static int64_t s_first_reply_us = 0;  // First valid NTP reply
 static bool s_in_provisioning_mode = false;
-static bool s_need_wifi_scan = false;  // Flag to indicate if WiFi scan is needed
+static volatile bool s_wifi_config_changed = false;  // Set by the app_config subscriber when a network is saved
+static volatile bool s_zone_changed = false;  // Set by the app_config subscriber, applied by the rtc task
+static volatile bool s_need_wifi_scan = false;  // Set by the event handler on "No AP found", scan runs in net_service
 static bool s_need_enter_provisioning = false;  // Flag to indicate if provisioning mode is needed
-static bool s_need_ntp_sync = false;  // Flag to indicate if NTP sync is needed (global variable for main loop)
+static bool s_need_ntp_sync = false;  // Flag to indicate if NTP sync is needed (checked at boot)
 static bool s_force_ntp_sync = false;  // Flag to indicate if forced NTP sync is needed (ignore 720-hour limit)
+static uint8_t s_target_brightness = BRIGHTNESS_DAY;  // Set at boot from the hour, then by dimming alarms
+static int s_alarm_flash_remaining = 0;  // Seconds of display inversion left (alarm indication)
 
 // Time structure
 typedef struct {
@@ -76,12 +190,42 @@ typedef struct {
     int second;
 } Time_t;
 
+static Time_t s_rtc_time = {15, 29, 15};  // Displayed time, advanced by the rtc task (default until read)
+
+// One second's frame (rtc task -> render task)
+typedef struct {
+    Time_t time;                // Displayed time (software timing while the DS3231 cannot be read)
+    ds3231_time_t local;        // Local date and time
+    bool local_valid;
+    float temperature;
+    bool temperature_valid;
+    uint8_t brightness;         // Contrast (scheduled dimming)
+    bool inverse;               // Alarm indication
+    int64_t rollover_us;        // esp_timer time of the DS3231 second rollover (0 = unknown)
+    int64_t tick_us;            // esp_timer time the rtc task noticed it
+} render_frame_t;
+
+// NTP result to write to the DS3231 (net task -> rtc task)
+typedef struct {
+    ntp_client_result_t ntp;
+} rtc_sync_request_t;
+
+// Read DS3231 (UTC) and convert to local time fields
+static bool read_local_time(ds3231_time_t *local)
+{
+    ds3231_time_t utc;
+    if (!ds3231_read_time(&ds3231, &utc) || !cal_ds3231_valid(&utc)) {
+        return false;
+    }
+    return cal_ds3231_from_epoch(tz_utc_to_local(cal_epoch_from_ds3231(&utc)), local);
+}
+
 // Read time from DS3231 and convert to Time structure
 bool readTimeFromDS3231(Time_t *time) {
     if (!time) return false;
     
     ds3231_time_t ds3231_time;
-    if (ds3231_read_time(&ds3231, &ds3231_time)) {
+    if (read_local_time(&ds3231_time)) {
         time->hour = ds3231_time.hours;
         time->minute = ds3231_time.minutes;
         time->second = ds3231_time.seconds;
@@ -94,9 +238,9 @@ bool readTimeFromDS3231(Time_t *time) {
 bool writeTimeToDS3231(const Time_t *time) {
     if (!time) return false;
     
-    // First read current complete time (including date)
+    // First read current complete local time (including date)
     ds3231_time_t ds3231_time;
-    if (!ds3231_read_time(&ds3231, &ds3231_time)) {
+    if (!read_local_time(&ds3231_time)) {
         return false;
     }
     
@@ -105,37 +249,56 @@ bool writeTimeToDS3231(const Time_t *time) {
     ds3231_time.minutes = time->minute;
     ds3231_time.seconds = time->second;
     
-    // Write to DS3231
-    return ds3231_write_time(&ds3231, &ds3231_time);
+    // Convert back to UTC and write to DS3231
+    ds3231_time_t utc;
+    if (!cal_ds3231_from_epoch(tz_local_to_utc(cal_epoch_from_ds3231(&ds3231_time)), &utc) ||
+        !ds3231_write_time(&ds3231, &utc)) {
+        return false;
+    }
+    time_service_time_changed();
+    return true;
 }
 
-// Display time to SSD1306 (with date, weekday and temperature)
-void displayTime(const Time_t *time) {
-    if (!time) return;
+// Collect the date, temperature and display settings for a frame (reads the DS3231: rtc task,
+// or app_main before the tasks start)
+static void rtc_fill_frame(const Time_t *time, render_frame_t *frame)
+{
+    frame->time = *time;
+    frame->local_valid = read_local_time(&frame->local);
+    frame->temperature_valid = frame->local_valid && ds3231_read_temperature(&ds3231, &frame->temperature);
+    frame->brightness = s_target_brightness;
+    frame->inverse = s_alarm_flash_remaining % 2 == 1;
+    frame->rollover_us = 0;
+    frame->tick_us = 0;
+}
+
+// Render a frame to SSD1306 (with date, weekday and temperature; render task)
+static void drawTime(const render_frame_t *frame) {
+    if (!frame) return;
+    const Time_t *time = &frame->time;
     
     // Only display if SSD1306 is initialized successfully
     if (ssd1306.i2c_dev == NULL) {
         return;
     }
     
-    // Automatically adjust brightness based on time period
-    // Night (18:00-23:59): 75% brightness (0xCF * 0.75 ≈ 0x9B)
-    // Daytime (06:00-17:59): 100% brightness (0xCF)
-    // Night (00:00-05:59): 75% brightness (0xCF * 0.75 ≈ 0x9B)
-    static uint8_t last_brightness = 0;
-    uint8_t target_brightness;
-    if (time->hour >= 18 || time->hour < 6) {
-        target_brightness = 0x9B;  // 75% brightness (0xCF * 0.75 ≈ 0x9B)
-    } else {
-        target_brightness = 0xCF;  // 100% brightness (original value)
+    // Alarm indication: inverted on odd seconds of the countdown, normal once it ends
+    static bool last_inverse = false;
+    if (frame->inverse != last_inverse) {
+        ssd1306_set_inverse(&ssd1306, frame->inverse);
+        last_inverse = frame->inverse;
     }
     
+    // Brightness follows scheduled dimming alarms (see seed_default_alarms)
+    static uint8_t last_brightness = 0;
+    uint8_t target_brightness = frame->brightness;
+    
     // Only update when brightness needs to change
     if (last_brightness != target_brightness) {
         ssd1306_set_contrast(&ssd1306, target_brightness);
         last_brightness = target_brightness;
-        ESP_LOGD(TAG, "Brightness adjusted to %d%% (%02X) for hour %02d", 
-                 time->hour >= 18 || time->hour < 6 ? 75 : 100, target_brightness, time->hour);
+        DLOGD(TAG, "Brightness adjusted to %02X at %02d:%02d", 
+             target_brightness, time->hour, time->minute);
     }
     
     // Pixel shift to prevent burn-in: slightly move display position every 5 minutes
@@ -168,9 +331,9 @@ void displayTime(const Time_t *time) {
         last_cycle = cycle;
     }
     
-    // Read complete DS3231 time (including date)
-    ds3231_time_t ds3231_time;
-    if (!ds3231_read_time(&ds3231, &ds3231_time)) {
+    // Complete DS3231 time (including date) as local time
+    const ds3231_time_t *ds3231_time = &frame->local;
+    if (!frame->local_valid) {
         // If read fails, only display time (colon blinking)
         char timeStr[6];
         if (time->second % 2 == 0) {
@@ -200,22 +363,79 @@ void displayTime(const Time_t *time) {
     // Format date string
     char dateStr[16];
     snprintf(dateStr, sizeof(dateStr), "%04d-%02d-%02d", 
-             2000 + ds3231_time.year, ds3231_time.month, ds3231_time.date);
+             2000 + ds3231_time->year, ds3231_time->month, ds3231_time->date);
     
-    // Format weekday string (DS3231 day: 1=Sunday, 2=Monday, ..., 7=Saturday)
+    // Format weekday string (derived from the date, so a stale day register can't show the wrong day)
     const char* weekdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
-    const char* weekdayStr = (ds3231_time.day >= 1 && ds3231_time.day <= 7) ? 
-                             weekdays[ds3231_time.day - 1] : "---";
+    const char* weekdayStr = weekdays[cal_weekday(cal_days_from_civil(2000 + ds3231_time->year,
+                                                                      ds3231_time->month, ds3231_time->date))];
     
-    // Read temperature
-    float temperature = 0.0f;
+    // Temperature (read by the rtc task with the time)
     char tempStr[12] = "---c";
-    if (ds3231_read_temperature(&ds3231, &temperature)) {
-        snprintf(tempStr, sizeof(tempStr), "%.1fc", temperature);
+    if (frame->temperature_valid) {
+        snprintf(tempStr, sizeof(tempStr), "%.1fc", frame->temperature);
+    }
+    
+    // Display the selected clock face (with pixel shift)
+    const char *const text[FACE_FIELD_COUNT] = {
+        [FACE_FIELD_TIME] = timeStr,
+        [FACE_FIELD_DATE] = dateStr,
+        [FACE_FIELD_WEEKDAY] = weekdayStr,
+        [FACE_FIELD_TEMP] = tempStr,
+    };
+    face_show(&ssd1306, face_get(), text, offset_x, offset_y);
+}
+
+// Display a frame on the SSD1306 (traced: rendering and frame transfer)
+void displayTime(const render_frame_t *frame) {
+    TRACE_BEGIN(TRACE_EV_DISPLAY);
+    drawTime(frame);
+    TRACE_END(TRACE_EV_DISPLAY, 0);
+}
+
+// Brightness for a given hour, used at boot before any dimming alarm has fired
+// Night (18:00-05:59): 75% brightness, daytime (06:00-17:59): 100% brightness
+static uint8_t brightness_for_hour(int hour)
+{
+    return (hour >= 18 || hour < 6) ? BRIGHTNESS_NIGHT : BRIGHTNESS_DAY;
+}
+
+// Alarm fired callback (runs in the rtc task via alarm_sched_service)
+static void alarm_fired_callback(alarm_id_t id, const alarm_spec_t *spec, void *ctx)
+{
+    switch (spec->action) {
+        case ALARM_ACTION_DIM:
+            s_target_brightness = spec->arg;
+            break;
+        case ALARM_ACTION_CHIME:
+            s_alarm_flash_remaining = 2;  // One inverted second
+            break;
+        case ALARM_ACTION_USER:
+        default:
+            s_alarm_flash_remaining = ALARM_USER_BLINK_SECONDS;
+            break;
+    }
+}
+
+// Create default scheduled dimming alarms on first boot (when no alarms are persisted)
+static void seed_default_alarms(void)
+{
+    if (alarm_sched_count() > 0) {
+        return;
     }
     
-    // Display complete clock interface (with pixel shift)
-    ssd1306_show_clock(&ssd1306, timeStr, dateStr, weekdayStr, tempStr, offset_x, offset_y);
+    ESP_LOGI(TAG, "No alarms found, creating default dimming schedule (18:00 dim, 06:00 bright)");
+    alarm_spec_t dim = {
+        .hour = 18, .minute = 0, .second = 0,
+        .weekdays = ALARM_EVERY_DAY,
+        .action = ALARM_ACTION_DIM,
+        .arg = BRIGHTNESS_NIGHT,
+    };
+    alarm_spec_t bright = dim;
+    bright.hour = 6;
+    bright.arg = BRIGHTNESS_DAY;
+    alarm_sched_add(&dim, NULL);
+    alarm_sched_add(&bright, NULL);
 }
 
 // Parse time string in format "hh:mm:ss"
@@ -235,48 +455,66 @@ bool parseTimeString(const char *str, Time_t *time) {
     return false;
 }
 
-// NVS: Save last sync timestamp
-static void save_last_sync_time(time_t sync_time)
+// Convert DS3231 time (UTC) to time_t, returns -1 on failure
+static time_t ds3231_time_to_epoch(const ds3231_time_t *ds3231_time)
 {
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return;
+    if (!cal_ds3231_valid(ds3231_time)) {
+        return -1;
     }
-    
-    err = nvs_set_i64(nvs_handle, NVS_KEY_LAST_SYNC, (int64_t)sync_time);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error saving last sync time: %s", esp_err_to_name(err));
-    } else {
-        nvs_commit(nvs_handle);
-        ESP_LOGI(TAG, "Last sync time saved to NVS: %lld", (long long)sync_time);
-    }
-    
-    nvs_close(nvs_handle);
+    return (time_t)cal_epoch_from_ds3231(ds3231_time);
 }
 
-// NVS: Read last sync timestamp
-static time_t get_last_sync_time(void)
+// One-time migration: older firmware kept UTC+8 local time in the DS3231, convert it to UTC
+static void migrate_rtc_to_utc(void)
 {
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGD(TAG, "NVS namespace not found or error opening: %s", esp_err_to_name(err));
-        return 0;
+    app_config_t config;
+    app_config_get(&config);
+    if (config.rtc_utc) {
+        return;
     }
     
-    int64_t last_sync = 0;
-    err = nvs_get_i64(nvs_handle, NVS_KEY_LAST_SYNC, &last_sync);
-    nvs_close(nvs_handle);
+    // Only devices that synced with older firmware hold local time; a fresh RTC is just wrong either way
+    bool legacy = config.last_sync > 0;
     
-    if (err != ESP_OK) {
-        ESP_LOGD(TAG, "Last sync time not found in NVS: %s", esp_err_to_name(err));
-        return 0;
+    ds3231_time_t rtc_time;
+    if (!ds3231_read_time(&ds3231, &rtc_time)) {
+        ESP_LOGW(TAG, "Cannot read DS3231 time, RTC UTC migration postponed");
+        return;
+    }
+    
+    if (legacy && cal_ds3231_valid(&rtc_time)) {
+        ds3231_time_t utc;
+        if (cal_ds3231_from_epoch(cal_epoch_from_ds3231(&rtc_time) - LEGACY_RTC_OFFSET_S, &utc) &&
+            ds3231_write_time(&ds3231, &utc)) {
+            ESP_LOGI(TAG, "DS3231 converted from UTC+8 to UTC: %04d-%02d-%02d %02d:%02d:%02d",
+                     2000 + utc.year, utc.month, utc.date, utc.hours, utc.minutes, utc.seconds);
+        } else {
+            ESP_LOGW(TAG, "Failed to convert DS3231 to UTC, RTC UTC migration postponed");
+            return;
+        }
     }
     
-    ESP_LOGI(TAG, "Last sync time from NVS: %lld", (long long)last_sync);
-    return (time_t)last_sync;
+    // Written through at once: converting the RTC a second time after a reset would put it 8 h off
+    app_config_set_rtc_utc(true);
+    esp_err_t err = app_config_commit();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error saving RTC UTC flag: %s", esp_err_to_name(err));
+    }
+}
+
+// Record the last sync timestamp (written back to NVS by app_config_service)
+static void save_last_sync_time(time_t sync_time)
+{
+    app_config_set_last_sync((int64_t)sync_time);
+    ESP_LOGI(TAG, "Last sync time recorded: %lld", (long long)sync_time);
+}
+
+// Last sync timestamp from the configuration cache (0 = never synced)
+static time_t get_last_sync_time(void)
+{
+    app_config_t config;
+    app_config_get(&config);
+    return (time_t)config.last_sync;
 }
 
 // Check if NTP sync is needed (returns false if synced within 720 hours)
@@ -287,7 +525,7 @@ static bool should_sync_ntp(void)
     static bool force_sync_logged = false;
     if (s_force_ntp_sync) {
         if (!force_sync_logged) {
-            ESP_LOGI(TAG, "Force NTP sync requested");
+            DLOGI(TAG, "Force NTP sync requested");
             force_sync_logged = true;
         }
         return true;
@@ -298,7 +536,7 @@ static bool should_sync_ntp(void)
     
     time_t last_sync = get_last_sync_time();
     if (last_sync == 0) {
-        ESP_LOGI(TAG, "No previous sync record found, will sync NTP");
+        DLOGI(TAG, "No previous sync record found, will sync NTP");
         return true;
     }
     
@@ -308,43 +546,67 @@ static bool should_sync_ntp(void)
         // System time unavailable, try to get time from DS3231
         ds3231_time_t ds3231_time;
         if (ds3231_read_time(&ds3231, &ds3231_time)) {
-            // Convert DS3231 time to time_t (simplified calculation, only for time difference judgment)
-            struct tm tm_time = {0};
-            tm_time.tm_sec = ds3231_time.seconds;
-            tm_time.tm_min = ds3231_time.minutes;
-            tm_time.tm_hour = ds3231_time.hours;
-            tm_time.tm_mday = ds3231_time.date;
-            tm_time.tm_mon = ds3231_time.month - 1;
-            tm_time.tm_year = 2000 + ds3231_time.year - 1900;
-            now = mktime(&tm_time);
+            now = ds3231_time_to_epoch(&ds3231_time);
             
             if (now > 0) {
-                ESP_LOGI(TAG, "Using DS3231 time to check sync interval");
+                DLOGI(TAG, "Using DS3231 time to check sync interval");
             } else {
-                ESP_LOGW(TAG, "Cannot get time from DS3231, will sync NTP");
+                DLOGW(TAG, "Cannot get time from DS3231, will sync NTP");
                 return true;
             }
         } else {
-            ESP_LOGW(TAG, "Cannot read DS3231 time, will sync NTP");
+            DLOGW(TAG, "Cannot read DS3231 time, will sync NTP");
             return true;
         }
     }
     
     // Calculate time difference (seconds)
+    // Interval adapts to the measured RTC stability (see drift_cal)
     time_t diff = now - last_sync;
-    time_t interval_seconds = SYNC_INTERVAL_HOURS * 3600;
+    time_t interval_seconds = drift_cal_get_sync_interval_s(SYNC_INTERVAL_HOURS * 3600);
     
     if (diff < 0 || diff >= interval_seconds) {
-        ESP_LOGI(TAG, "Last sync was %lld seconds ago (>= %d hours), will sync NTP", 
-                 (long long)diff, SYNC_INTERVAL_HOURS);
+        DLOGI(TAG, "Last sync was %lld seconds ago (>= %lld hours), will sync NTP", 
+             (long long)diff, (long long)interval_seconds / 3600);
         return true;
     }
     
-    ESP_LOGI(TAG, "Last sync was %lld seconds ago (< %d hours), skipping NTP sync", 
-             (long long)diff, SYNC_INTERVAL_HOURS);
+    DLOGI(TAG, "Last sync was %lld seconds ago (< %lld hours), skipping NTP sync", 
+         (long long)diff, (long long)interval_seconds / 3600);
     return false;
 }
 
+// Configuration change notification: a saved network ends provisioning, a new timezone is
+// handed to the rtc task, a new face is drawn from the next frame (runs in the caller's task)
+static void config_changed_cb(const app_config_t *config, uint32_t changed, void *ctx)
+{
+    if ((changed & APP_CONFIG_WIFI) && config->wifi_networks > 0) {
+        s_wifi_config_changed = true;
+        if (s_net_task) {
+            xTaskNotifyGive(s_net_task);
+        }
+    }
+    if (changed & APP_CONFIG_ZONE) {
+        s_zone_changed = true;
+        if (s_rtc_task) {
+            xTaskNotifyGive(s_rtc_task);
+        }
+    }
+    if (changed & APP_CONFIG_FACE) {
+        face_set(config->face);
+    }
+}
+
+// Select the timezone stored in app_config and recompute the local alarm times (rtc task)
+static void apply_zone_change(void)
+{
+    app_config_t config;
+    app_config_get(&config);
+    if (tz_set_zone(config.zone) == ESP_OK) {
+        alarm_sched_time_changed();
+    }
+}
+
 // WiFi connection status callback
 static void wifi_status_callback(bool connected, const char* ip)
 {
@@ -370,120 +632,85 @@ static void wifi_status_callback(bool connected, const char* ip)
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                               int32_t event_id, void* event_data)
 {
+    if (event_base == WIFI_EVENT) {
+        uint32_t reason = event_id == WIFI_EVENT_STA_DISCONNECTED ?
+                          ((wifi_event_sta_disconnected_t*) event_data)->reason : 0;
+        TRACE_INSTANT(TRACE_EV_WIFI_EVENT, event_id, reason);
+    } else {
+        TRACE_INSTANT(TRACE_EV_IP_EVENT, event_id, 0);
+    }
+    
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (wifi_provisioning_disconnect_handled()) {
+            return;  // Fast connect fallback: wifi_provisioning.c already reconnected with a full scan
+        }
         wifi_event_sta_disconnected_t* event = (wifi_event_sta_disconnected_t*) event_data;
         // Simplify log output to avoid stack overflow
         ESP_LOGW(TAG, "WiFi disconnected, reason: %d", event->reason);
         
-        // If "No AP found" error, mark need for scan (execute in main loop to avoid stack overflow)
+        // If "No AP found" error, mark need for scan (runs during the backoff, see net_service)
         if (event->reason == WIFI_REASON_NO_AP_FOUND && s_retry_num == 0) {
             s_need_wifi_scan = true;
         }
         
-        if (s_retry_num < WIFI_MAX_RETRY) {
-            // Note: Using vTaskDelay in event handler will block event loop
-            // But this is necessary because we need delayed retry
-            // Wait 15 seconds before retry connection
-            ESP_LOGI(TAG, "Waiting %d seconds before retry (%d/%d)...", 
-                     WIFI_CONNECT_TIMEOUT_MS / 1000, s_retry_num + 1, WIFI_MAX_RETRY);
-            vTaskDelay(pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS));
-            esp_err_t ret = esp_wifi_connect();
-            if (ret != ESP_OK) {
-                ESP_LOGW(TAG, "esp_wifi_connect() failed: %s", esp_err_to_name(ret));
-            }
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retry to connect (%d/%d)", s_retry_num, WIFI_MAX_RETRY);
-        } else {
-            ESP_LOGE(TAG, "Failed to connect after %d retries", WIFI_MAX_RETRY);
-            ESP_LOGI(TAG, "All connection attempts failed. Will enter provisioning mode.");
-            // Mark need to enter provisioning mode (handle in main loop to avoid complex operations in event handler)
-            s_need_enter_provisioning = true;
-            wifi_status_callback(false, NULL);
+        // Retry with backoff is scheduled by net_service() in the net task:
+        // waiting here would stall every other event on the default event loop
+        s_net_disconnected = true;
+        if (s_net_task) {
+            xTaskNotifyGive(s_net_task);
+        }
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
+        // wifi_scan has collected the results (its handler was registered first)
+        if (s_net_task) {
+            xTaskNotifyGive(s_net_task);
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         // Note: wifi_provisioning.c has already handled IP_EVENT_STA_GOT_IP and called callback
-        // Not repeated here to avoid duplicate logs
-        // Callback in wifi_provisioning.c is sufficient
+        // Only record the time and wake the net task (NTP sync is started from there)
+        s_got_ip_us = esp_timer_get_time();
+        s_net_got_ip = true;
+        if (s_net_task) {
+            xTaskNotifyGive(s_net_task);
+        }
     }
 }
 
-// Perform WiFi scan (independent function to avoid stack overflow)
-static void perform_wifi_scan(void)
+// Log diagnostic scan results from the scan cache (one entry at a time, no array on the stack)
+static void log_wifi_scan(void)
 {
-    ESP_LOGI(TAG, "Scanning for available WiFi networks...");
-    wifi_scan_config_t scan_config = {
-        .ssid = NULL,  // Scan all networks
-        .bssid = NULL,
-        .channel = 0,
-        .show_hidden = true,  // Include hidden SSID
-        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
-        .scan_time = {
-            .active = {
-                .min = 100,
-                .max = 300,
+    size_t count = wifi_scan_count();
+    ESP_LOGI(TAG, "Found %u WiFi networks:", (unsigned)count);
+    
+    if (count > 0) {
+        bool found_target = false;
+        wifi_scan_entry_t entry;
+        for (size_t i = 0; wifi_scan_get(i, &entry); i++) {
+            const char* match = "";
+            if (wifi_provisioning_is_known(entry.ssid)) {
+                match = " <-- STORED";
+                found_target = true;
             }
+            ESP_LOGI(TAG, "  [%u] SSID: %s, RSSI: %d dBm, Ch: %u, Auth: %u%s",
+                    (unsigned)(i + 1), entry.ssid, entry.rssi, entry.channel,
+                    entry.authmode, match);
         }
-    };
-    
-    esp_err_t ret = esp_wifi_scan_start(&scan_config, true);  // Blocking scan
-    if (ret == ESP_OK) {
-        uint16_t ap_count = 0;
-        esp_wifi_scan_get_ap_num(&ap_count);
-        ESP_LOGI(TAG, "Found %d WiFi networks:", ap_count);
         
-        if (ap_count > 0) {
-            // Reduce array size to avoid stack overflow (display at most 10)
-            wifi_ap_record_t ap_records[10];
-            uint16_t ap_records_count = ap_count > 10 ? 10 : ap_count;
-            esp_wifi_scan_get_ap_records(&ap_records_count, ap_records);
-            
-            // Read configured SSID
-            wifi_config_data_t wifi_config_data;
-            const char* target_ssid = NULL;
-            if (wifi_provisioning_load_config(&wifi_config_data) == ESP_OK) {
-                target_ssid = wifi_config_data.ssid;
-            }
-            
-            bool found_target = false;
-            for (int i = 0; i < ap_records_count; i++) {
-                const char* match = "";
-                if (target_ssid && strcmp((char*)ap_records[i].ssid, target_ssid) == 0) {
-                    match = " <-- TARGET";
-                    found_target = true;
-                }
-                ESP_LOGI(TAG, "  [%d] SSID: %s, RSSI: %d dBm, Auth: %d%s",
-                        i + 1, ap_records[i].ssid, ap_records[i].rssi, 
-                        ap_records[i].authmode, match);
-            }
-            
-            if (target_ssid && !found_target) {
-                ESP_LOGW(TAG, "Target SSID '%s' not found!", target_ssid);
-                ESP_LOGW(TAG, "Check: router power, SSID spelling, 2.4GHz band, MAC filter");
-            }
-        } else {
-            ESP_LOGW(TAG, "No WiFi networks found.");
+        if (!found_target) {
+            ESP_LOGW(TAG, "No stored network found!");
+            ESP_LOGW(TAG, "Check: router power, SSID spelling, 2.4GHz band, MAC filter");
         }
     } else {
-        ESP_LOGW(TAG, "WiFi scan failed: %s", esp_err_to_name(ret));
+        ESP_LOGW(TAG, "No WiFi networks found.");
     }
 }
 
 // Initialize WiFi Station mode
 static esp_err_t wifi_init_sta(void)
 {
-    // Read WiFi configuration from NVS
-    wifi_config_data_t wifi_config_data;
-    esp_err_t ret = wifi_provisioning_load_config(&wifi_config_data);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to load WiFi config from NVS: %s", esp_err_to_name(ret));
-        return ret;
-    }
-    
     ESP_LOGI(TAG, "Initializing WiFi Station mode...");
-    ESP_LOGI(TAG, "Connecting to SSID: %s", wifi_config_data.ssid);
     
-    // Start WiFi Station
-    ret = wifi_provisioning_start_sta(&wifi_config_data, wifi_status_callback);
+    // Start WiFi Station: the module picks the best stored network (one channel-hinted scan)
+    esp_err_t ret = wifi_provisioning_connect(wifi_status_callback);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start WiFi Station: %s", esp_err_to_name(ret));
         return ret;
@@ -499,87 +726,669 @@ static void wifi_deinit_sta(void)
     wifi_provisioning_stop_softap();
 }
 
-// Check and sync NTP time to DS3231
-static void sync_ntp_to_ds3231(void)
+// Log how long the sync kept the radio on (boot -> IP, IP -> first NTP reply, total radio-on time)
+static void log_sync_timing(bool success, int64_t radio_on_us)
+{
+    long long boot_to_ip_ms = s_got_ip_us ? s_got_ip_us / 1000 : -1;
+    long long ip_to_reply_ms = (s_got_ip_us && s_first_reply_us) ? (s_first_reply_us - s_got_ip_us) / 1000 : -1;
+    ESP_LOGI(TAG, "Sync timing (%s): boot->IP %lld ms, IP->first reply %lld ms, radio on %lld ms",
+             success ? "synced" : "failed", boot_to_ip_ms, ip_to_reply_ms, (long long)(radio_on_us / 1000));
+}
+
+// Measure RTC offset against NTP time and feed it to the drift calibration
+// ntp_offset_us: UTC minus esp_timer
+static void measure_rtc_drift(int64_t ntp_offset_us)
+{
+    time_t last_sync = get_last_sync_time();
+    int64_t ntp_s = (esp_timer_get_time() + ntp_offset_us) / 1000000;
+    if (last_sync <= 0 || ntp_s <= last_sync) {
+        return;  // No previous sync to measure the interval from
+    }
+    
+    // Sub-second RTC time from the time service when locked, otherwise the whole-second register
+    int64_t rtc_us;
+    int64_t ntp_us;
+    uint32_t resolution_ms;
+    uint32_t uncertainty_us;
+    int64_t ts_us = time_service_now_us(&uncertainty_us);
+    if (ts_us != 0 && uncertainty_us < 20000) {
+        ntp_us = esp_timer_get_time() + ntp_offset_us;
+        rtc_us = ts_us;
+        resolution_ms = (uncertainty_us + 999) / 1000 + 1;  // Plus the NTP offset, well below 1 ms on a LAN
+    } else {
+        ds3231_time_t rtc_time;
+        if (!ds3231_read_time(&ds3231, &rtc_time)) {
+            ESP_LOGW(TAG, "Cannot read DS3231 time, skipping drift measurement");
+            return;
+        }
+        ntp_us = esp_timer_get_time() + ntp_offset_us;
+        time_t rtc_epoch = ds3231_time_to_epoch(&rtc_time);
+        if (rtc_epoch <= 0) {
+            return;
+        }
+        // RTC only reports whole seconds: on average it is half a second into the current one
+        rtc_us = (int64_t)rtc_epoch * 1000000 + 500000;
+        resolution_ms = 500;
+    }
+    
+    int64_t offset_ms = (rtc_us - ntp_us) / 1000;
+    if (offset_ms > INT32_MAX || offset_ms < INT32_MIN) {
+        ESP_LOGW(TAG, "RTC offset out of range, skipping drift measurement");
+        return;
+    }
+    
+    ESP_LOGI(TAG, "RTC offset before sync: %lld ±%" PRIu32 " ms", (long long)offset_ms, resolution_ms);
+    s_rtc_offset_ms = (int32_t)offset_ms;
+    drift_cal_record(&ds3231, (uint32_t)(ntp_s - last_sync), (int32_t)offset_ms, resolution_ms);
+}
+
+// DS3231 writes on a second boundary
+// Writing the seconds register resets the DS3231 countdown chain, so the next increment
+// comes one second after the write: writing second N at UTC N.000 leaves the RTC in phase.
+// The rtc task waits for the boundary, only the last RTC_WRITE_SPIN_US are busy-waited.
+
+// Next second boundary that leaves at least RTC_WRITE_LEAD_US to prepare the write (epoch seconds)
+static int64_t rtc_write_next_second(int64_t ntp_offset_us)
+{
+    int64_t utc_us = esp_timer_get_time() + ntp_offset_us;
+    int64_t second = utc_us / 1000000 + 1;
+    if (second * 1000000 - utc_us < RTC_WRITE_LEAD_US) {
+        second++;
+    }
+    return second;
+}
+
+// esp_timer time to start the write so the seconds byte lands on the boundary
+static int64_t rtc_write_start_us(int64_t ntp_offset_us, int64_t second)
+{
+    return second * 1000000 - ntp_offset_us - RTC_WRITE_LATENCY_US;
+}
+
+// Busy-wait to the boundary and write UTC to the DS3231
+// Returns how late the write started (microseconds) or -1
+static int64_t rtc_write_at_second(int64_t ntp_offset_us, int64_t second, ds3231_time_t *written)
+{
+    if (!cal_ds3231_from_epoch(second, written)) {
+        return -1;
+    }
+    int64_t target_us = rtc_write_start_us(ntp_offset_us, second);
+    while (esp_timer_get_time() < target_us) {
+    }
+    int64_t late_us = esp_timer_get_time() - target_us;
+    if (!ds3231_write_time(&ds3231, written)) {
+        return -1;
+    }
+    return late_us;
+}
+
+// NTP exchange in its own task, so DNS and socket timeouts never hold up the net task
+static void ntp_sync_task(void *arg)
+{
+    // Race all servers, then a short burst to the fastest (microsecond offset against esp_timer)
+    TRACE_BEGIN(TRACE_EV_NTP_SYNC);
+    s_ntp_status = ntp_client_sync(NTP_SAMPLES, &s_ntp_result);
+    TRACE_END(TRACE_EV_NTP_SYNC, s_ntp_status);
+    s_ntp_busy = false;
+    xTaskNotifyGive(s_net_task);
+    vTaskDelete(NULL);
+}
+
+// Start one NTP exchange (result picked up by net_service)
+static void ntp_sync_launch(void)
+{
+    s_ntp_busy = true;
+    s_ntp_launched = true;
+    if (xTaskCreate(ntp_sync_task, "ntp_sync", NTP_SYNC_STACK_SIZE, NULL,
+                    tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+        s_ntp_status = ESP_ERR_NO_MEM;
+        s_ntp_busy = false;
+    }
+}
+
+// Check the NTP result (the rtc task measures the drift and writes the DS3231 if it is usable)
+static bool ntp_sync_accept(void)
+{
+    if (s_ntp_status != ESP_OK) {
+        ESP_LOGW(TAG, "NTP sync attempt failed (%s), retrying in %d seconds",
+                 esp_err_to_name(s_ntp_status), NTP_RETRY_INTERVAL_MS / 1000);
+        return false;
+    }
+    if (!s_first_reply_us) {
+        s_first_reply_us = s_ntp_result.first_reply_us;
+    }
+    int64_t ntp_offset_us = s_ntp_result.offset_us;
+    time_t now = (time_t)((esp_timer_get_time() + ntp_offset_us) / 1000000);
+    
+    // Check if time is reasonable (year should be 2020 or later)
+    ds3231_time_t ds3231_time;
+    if (now <= 0 || !cal_ds3231_from_epoch((int64_t)now, &ds3231_time) || ds3231_time.year < 20) {
+        ESP_LOGW(TAG, "NTP time out of range, retrying in %d seconds", NTP_RETRY_INTERVAL_MS / 1000);
+        return false;
+    }
+    ESP_LOGI(TAG, "NTP time synchronized!");
+    
+    // If force sync, clear flag
+    if (s_force_ntp_sync) {
+        ESP_LOGI(TAG, "Force NTP sync completed successfully");
+        s_force_ntp_sync = false;
+        // Note: force_sync_logged will be automatically reset on next should_sync_ntp() call
+    }
+    return true;
+}
+
+// Sync NTP time to DS3231 once the write is due (called every rtc task pass while a write is pending)
+// Returns ESP_ERR_NOT_FINISHED until the boundary is close, then ESP_OK or ESP_FAIL
+static esp_err_t ntp_sync_write_rtc(void)
 {
-    if (sntp_synced) {
-        return;  // Already synced
+    int64_t ntp_offset_us = s_rtc_sync.offset_us;
+    if (rtc_write_start_us(ntp_offset_us, s_rtc_write_second) - esp_timer_get_time() > RTC_WRITE_SPIN_US) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    
+    ds3231_time_t ds3231_time;
+    int64_t late_us = rtc_write_at_second(ntp_offset_us, s_rtc_write_second, &ds3231_time);
+    if (late_us < 0) {
+        ESP_LOGE(TAG, "Failed to write time to DS3231");
+        return ESP_FAIL;
+    }
+    if (late_us > RTC_WRITE_MAX_LATE_US) {
+        if (s_rtc_write_attempt < RTC_WRITE_ATTEMPTS) {
+            ESP_LOGW(TAG, "DS3231 write started %lld us late (preempted), rewriting on the next second", (long long)late_us);
+            s_rtc_write_attempt++;
+            s_rtc_write_second = rtc_write_next_second(ntp_offset_us);
+            return ESP_ERR_NOT_FINISHED;
+        }
+        ESP_LOGW(TAG, "DS3231 written %lld us late", (long long)late_us);
     }
     
-    // Check if SNTP is synchronized
-    time_t now = 0;
-    struct tm timeinfo = {0};
-    time(&now);
+    time_t now = (time_t)s_rtc_write_second;
+    ESP_LOGI(TAG, "Time synchronized to DS3231: %04d-%02d-%02d %02d:%02d:%02d UTC (%s, offset %+" PRId32 " min)",
+             2000 + ds3231_time.year, ds3231_time.month, ds3231_time.date,
+             ds3231_time.hours, ds3231_time.minutes, ds3231_time.seconds,
+             tz_get_zone(), tz_offset_at(now) / 60);
+    ESP_LOGI(TAG, "DS3231 phase error bound: %" PRIu32 " us", s_rtc_sync.delay_us / 2);
+    
+    // Keep system time consistent (used by should_sync_ntp)
+    int64_t utc_us = ntp_client_utc_us(&s_rtc_sync, esp_timer_get_time());
+    struct timeval tv_now = {
+        .tv_sec = (time_t)(utc_us / 1000000),
+        .tv_usec = (suseconds_t)(utc_us % 1000000),
+    };
+    settimeofday(&tv_now, NULL);
+    
+    // Record sync timestamp (written back to NVS by app_config_service)
+    save_last_sync_time(now);
     
-    if (now > 0) {
-        localtime_r(&now, &timeinfo);
+    // RTC time jumped: recompute alarm fire times and re-measure the second edge
+    alarm_sched_time_changed();
+    time_service_time_changed();
+    return ESP_OK;
+}
+
+// Take an NTP result from the net task and write it to the DS3231 on a second boundary;
+// the outcome goes back to the net task (rtc task)
+static void rtc_sync_service(void)
+{
+    if (s_rtc_write_attempt == 0) {
+        rtc_sync_request_t request;
+        if (xQueueReceive(s_rtc_queue, &request, 0) != pdTRUE) {
+            return;
+        }
+        s_rtc_sync = request.ntp;
         
-        // Check if time is reasonable (year should be between 2020-2099)
-        if (timeinfo.tm_year >= 120 && timeinfo.tm_year < 200) {
-            ESP_LOGI(TAG, "SNTP time synchronized!");
-            sntp_synced = true;
-            
-            // If force sync, clear flag
-            if (s_force_ntp_sync) {
-                ESP_LOGI(TAG, "Force NTP sync completed successfully");
-                s_force_ntp_sync = false;
-                // Note: force_sync_logged will be automatically reset on next should_sync_ntp() call
+        // Measure RTC offset before correcting it, to track oscillator drift
+        measure_rtc_drift(s_rtc_sync.offset_us);
+        
+        s_rtc_write_second = rtc_write_next_second(s_rtc_sync.offset_us);
+        s_rtc_write_attempt = 1;
+    }
+    
+    esp_err_t ret = ntp_sync_write_rtc();
+    if (ret == ESP_ERR_NOT_FINISHED) {
+        return;
+    }
+    s_rtc_write_attempt = 0;
+    xQueueSend(s_net_queue, &ret, 0);  // One write at a time: never full
+    xTaskNotifyGive(s_net_task);
+}
+
+#if STATUS_SERVER_ENABLED
+// Status server callback (HTTP server task): a snapshot of the tasks' state, fields may be
+// from different passes
+static void status_fill(status_report_t *report)
+{
+    report->net_state = s_net_state_names[s_net_state];
+    report->last_sync = get_last_sync_time();
+    report->sync_interval_s = drift_cal_get_sync_interval_s(SYNC_INTERVAL_HOURS * 3600);
+    report->has_outcome = s_net_has_outcome;
+    report->last_ok = s_net_last_ok;
+    report->last_delay_us = s_net_last_delay_us;
+    report->rtc_offset_ms = s_rtc_offset_ms;
+    
+    drift_cal_estimate_t estimate;
+    report->has_drift = drift_cal_get_estimate(&estimate);
+    if (report->has_drift) {
+        report->drift_ppm = estimate.ppm;
+        report->residual_ppm = estimate.residual_ppm;
+        report->uncertainty_ppm = estimate.uncertainty_ppm;
+        report->aging = estimate.aging;
+        report->drift_samples = estimate.samples;
+    }
+    
+    report->i2c_errors_rtc = ds3231.i2c_errors;
+    report->i2c_errors_display = ssd1306.i2c_errors;
+    report->frames = s_frame_count;
+    report->frame_error_max_us = (uint32_t)s_frame_jitter_max_us;
+}
+#endif
+
+// Radio-on time of the current bring-up, in microseconds
+static int64_t net_radio_used_us(void)
+{
+    int64_t used_us = s_net_radio_used_us;
+    if (s_net_radio_start_us) {
+        used_us += esp_timer_get_time() - s_net_radio_start_us;
+    }
+    return used_us;
+}
+
+// Stop the station and charge its on-time to the radio budget
+static void net_radio_off(void)
+{
+    if (s_net_radio_start_us) {
+        s_net_radio_used_us += esp_timer_get_time() - s_net_radio_start_us;
+        s_net_radio_start_us = 0;
+#if STATUS_SERVER_ENABLED
+        status_server_stop();
+#endif
+        wifi_deinit_sta();
+    }
+}
+
+// End the bring-up: close WiFi to save power, log sync timing and display jitter
+static void net_finish(bool success)
+{
+    if (ota_update_busy() && s_net_state != NET_UPDATING) {
+        // Closing WiFi would abort the upload; net_service() finishes once it has ended
+        ESP_LOGI(TAG, "Firmware upload running, keeping WiFi on until it ends");
+        s_net_update_success = success;
+        s_net_state = NET_UPDATING;
+        return;
+    }
+    net_radio_off();
+    s_net_has_outcome = true;
+    s_net_last_ok = success;
+    if (success) {
+        s_net_last_delay_us = s_ntp_result.delay_us;
+    }
+    log_sync_timing(success, s_net_radio_used_us);
+    ESP_LOGI(TAG, "Display during bring-up: %" PRIu32 " updates, max interval error %lld ms",
+             s_frame_count, (long long)(s_frame_jitter_max_us / 1000));
+    s_net_state = NET_IDLE;
+}
+
+// Start one connection attempt (restarts the station if the radio was turned off)
+static void net_connect(void)
+{
+    s_net_got_ip = false;
+    s_net_disconnected = false;
+    s_ntp_launched = false;  // A result from before the reconnect is not waited for
+    
+    esp_err_t ret;
+    if (s_net_radio_start_us) {
+        ret = esp_wifi_connect();
+    } else {
+        ret = wifi_init_sta();
+        if (ret == ESP_OK) {
+            s_net_radio_start_us = esp_timer_get_time();
+        }
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "WiFi connect failed: %s", esp_err_to_name(ret));
+        s_net_disconnected = true;  // Counted as a failed attempt on the next pass
+    }
+    
+    s_net_state = NET_CONNECTING;
+    s_net_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS);
+}
+
+// Start WiFi, IP and NTP bring-up (no-op if one is running)
+static void net_start(void)
+{
+    if (s_net_state != NET_IDLE) {
+        return;
+    }
+    ESP_LOGI(TAG, "Starting network bring-up (radio budget %d s)", NET_RADIO_BUDGET_MS / 1000);
+    s_retry_num = 0;
+    s_net_radio_used_us = 0;
+    s_got_ip_us = 0;
+    s_first_reply_us = 0;
+    s_frame_count = 0;
+    s_frame_jitter_max_us = 0;
+    net_connect();
+}
+
+// Connection attempt failed: retry after an exponential backoff with the radio off, or give up
+static void net_attempt_failed(void)
+{
+    if (s_retry_num >= WIFI_MAX_RETRY || net_radio_used_us() >= NET_RADIO_BUDGET_MS * 1000LL) {
+        ESP_LOGE(TAG, "Failed to connect after %d retries", s_retry_num);
+        ESP_LOGI(TAG, "All connection attempts failed. Will enter provisioning mode.");
+        net_finish(false);
+        // Mark need to enter provisioning mode (handled in the net task)
+        s_need_enter_provisioning = true;
+        wifi_status_callback(false, NULL);
+        return;
+    }
+    
+    uint32_t backoff_ms = (uint32_t)WIFI_BACKOFF_MIN_MS << s_retry_num;
+    if (backoff_ms > WIFI_BACKOFF_MAX_MS) {
+        backoff_ms = WIFI_BACKOFF_MAX_MS;
+    }
+    s_retry_num++;
+    ESP_LOGI(TAG, "Retry %d/%d in %" PRIu32 " ms", s_retry_num, WIFI_MAX_RETRY, backoff_ms);
+    
+    // Diagnostic scan after "No AP found" runs during the backoff, the radio stops when it is done
+    if (s_need_wifi_scan) {
+        s_need_wifi_scan = false;
+        wifi_scan_start();
+    }
+    if (!wifi_scan_running()) {
+        net_radio_off();
+    }
+    s_net_state = NET_BACKOFF;
+    s_net_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(backoff_ms);
+}
+
+// Advance the network bring-up (called every net task pass; waits are deadlines, never delays)
+static void net_service(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    bool due = (int32_t)(now - s_net_deadline) >= 0;
+    
+    switch (s_net_state) {
+        case NET_IDLE:
+            return;
+        case NET_CONNECTING:
+            if (s_net_got_ip) {
+                ESP_LOGI(TAG, "WiFi connected, starting NTP sync...");
+                // Connected through the station: the running image is good (updates can reach it)
+                ota_update_confirm();
+#if STATUS_SERVER_ENABLED
+                status_server_start(status_fill);
+#endif
+                s_net_state = NET_SYNCING;
+                s_net_deadline = now;  // First attempt on this pass
+                due = true;
+            } else if (s_net_disconnected || due) {
+                if (!s_net_disconnected) {
+                    ESP_LOGW(TAG, "No IP address after %d seconds", WIFI_CONNECT_TIMEOUT_MS / 1000);
+                }
+                net_attempt_failed();
+                return;
             }
-            
-            // Sync NTP time to DS3231
-            ds3231_time_t ds3231_time;
-            ds3231_time.seconds = timeinfo.tm_sec;
-            ds3231_time.minutes = timeinfo.tm_min;
-            ds3231_time.hours = timeinfo.tm_hour;
-            ds3231_time.day = timeinfo.tm_wday == 0 ? 7 : timeinfo.tm_wday;  // Convert to 1-7 (Sunday=7)
-            ds3231_time.date = timeinfo.tm_mday;
-            ds3231_time.month = timeinfo.tm_mon + 1;  // tm_mon is 0-11
-            ds3231_time.year = timeinfo.tm_year - 100;  // tm_year is years since 1900, convert to 0-99
-            
-            if (ds3231_write_time(&ds3231, &ds3231_time)) {
-                ESP_LOGI(TAG, "Time synchronized to DS3231: %04d-%02d-%02d %02d:%02d:%02d",
-                         2000 + ds3231_time.year, ds3231_time.month, ds3231_time.date,
-                         ds3231_time.hours, ds3231_time.minutes, ds3231_time.seconds);
-                
-                // Save sync timestamp to NVS
-                save_last_sync_time(now);
-                
-                // Close WiFi after sync completes to save power
-                wifi_deinit_sta();
-                ntp_initialized = false;  // Mark no longer need to check NTP sync
+            break;
+        case NET_BACKOFF:
+            if (s_net_radio_start_us && !wifi_scan_running()) {
+                log_wifi_scan();
+                net_radio_off();
+            }
+            if (due && !wifi_scan_running()) {
+                net_connect();
+            }
+            return;
+        case NET_UPDATING:
+            if (!ota_update_busy()) {
+                net_finish(s_net_update_success);
+            }
+            return;
+        default:
+            break;
+    }
+    
+    if (s_net_state == NET_SYNCING) {
+        if (s_net_disconnected) {
+            ESP_LOGW(TAG, "WiFi lost during NTP sync");
+            net_attempt_failed();
+            return;
+        }
+        if (s_ntp_launched && !s_ntp_busy) {
+            s_ntp_launched = false;
+            rtc_sync_request_t request = {.ntp = s_ntp_result};
+            if (ntp_sync_accept() && xQueueSend(s_rtc_queue, &request, 0) == pdTRUE) {
+                xTaskNotifyGive(s_rtc_task);
+                s_net_state = NET_RTC_WRITE;
             } else {
-                ESP_LOGE(TAG, "Failed to write time to DS3231");
+                s_net_deadline = now + pdMS_TO_TICKS(NTP_RETRY_INTERVAL_MS);
             }
+        } else if (!s_ntp_launched && !s_ntp_busy && due) {
+            ntp_sync_launch();
+        }
+    }
+    
+    // The rtc task reports the outcome of the DS3231 write
+    esp_err_t ret;
+    if (s_net_state == NET_RTC_WRITE && xQueueReceive(s_net_queue, &ret, 0) == pdTRUE) {
+        if (ret == ESP_OK) {
+            net_finish(true);
+            return;
         }
+        s_net_state = NET_SYNCING;
+        s_net_deadline = now + pdMS_TO_TICKS(NTP_RETRY_INTERVAL_MS);
+    }
+    
+    // The radio budget also bounds NTP: unreachable servers must not keep WiFi on
+    if (s_net_state == NET_SYNCING && net_radio_used_us() >= NET_RADIO_BUDGET_MS * 1000LL) {
+        ESP_LOGW(TAG, "NTP sync not done within the %d second radio budget. Closing WiFi to save power.",
+                 NET_RADIO_BUDGET_MS / 1000);
+        net_finish(false);
     }
 }
 
-// Initialize SNTP
-static void sntp_init_func(void)
+// Track display update interval error while the network is being brought up
+static void note_display_update(void)
 {
-    ESP_LOGI(TAG, "Initializing SNTP...");
-    sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    
-    // Set NTP servers (Beijing time)
-    sntp_setservername(0, NTP_SERVER1);
-    sntp_setservername(1, NTP_SERVER2);
-    sntp_setservername(2, NTP_SERVER3);
-    
-    // Set timezone (Beijing time UTC+8)
-    // Note: Timezone has been set at the beginning of app_main(), set again here to ensure correctness
-    setenv("TZ", "CST-8", 1);
-    tzset();
+    int64_t now_us = esp_timer_get_time();
+    if (s_net_state != NET_IDLE && s_last_frame_us) {
+        int64_t error_us = now_us - s_last_frame_us - 1000000;
+        if (error_us < 0) {
+            error_us = -error_us;
+        }
+        if (error_us > s_frame_jitter_max_us) {
+            s_frame_jitter_max_us = error_us;
+        }
+        s_frame_count++;
+    }
+    s_last_frame_us = now_us;
+}
+
+// Render task: draws each frame the rtc task sends (the only user of the SSD1306 after boot)
+static void render_task(void *arg)
+{
+    render_frame_t frame;
+    while (1) {
+        xQueueReceive(s_render_queue, &frame, portMAX_DELAY);
+#if LATENCY_ENABLED
+        int64_t renderUs = esp_timer_get_time();
+#endif
+        displayTime(&frame);
+        note_display_update();
+#if LATENCY_ENABLED
+        latency_stamps_t stamps = {
+            .rollover_us = frame.rollover_us,
+            .tick_us = frame.tick_us,
+            .render_us = renderUs,
+            .transfer_start_us = ssd1306.refresh_start_us,
+            .transfer_end_us = ssd1306.refresh_end_us,
+        };
+        latency_frame_done(&stamps);
+#endif
+    }
+}
+
+// RTC task: second edges, DS3231 reads and aligned writes, alarms; one frame per second
+static void rtc_task(void *arg)
+{
+    TickType_t lastUpdate = xTaskGetTickCount();
+    int64_t lastSecond = -1;  // Last displayed second (time service wall time)
+    const TickType_t updateIntervalMs = pdMS_TO_TICKS(1000);  // 1 second
     
-    // Start SNTP
-    sntp_init();
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        
+        // Write NTP time to the DS3231 on the second boundary (queued by the net task)
+        rtc_sync_service();
+        
+        // Timezone changed on the provisioning page: local alarm times move with it
+        if (s_zone_changed) {
+            s_zone_changed = false;
+            apply_zone_change();
+        }
+        
+        // Measure RTC second edges when due (busy-polls a few ms around the predicted edge)
+        time_service_service();
+        
+        // Check if the second changed: on the RTC edge once the time service is locked,
+        // otherwise every updateIntervalMs. Wait out the uncertainty so the RTC read sees the new second.
+        bool secondTick;
+        uint32_t uncertaintyUs;
+        int64_t wallUs = time_service_now_us(&uncertaintyUs);
+        int64_t tickUs = esp_timer_get_time();
+        int64_t rolloverUs = 0;  // Start of the current RTC second in esp_timer time
+        if (wallUs > 0 && uncertaintyUs < 100000) {
+            rolloverUs = tickUs - wallUs % 1000000;
+            int64_t second = (wallUs - uncertaintyUs) / 1000000;
+            secondTick = second != lastSecond;
+            if (secondTick) {
+                lastSecond = second;
+            }
+        } else {
+            secondTick = (now - lastUpdate) >= updateIntervalMs;
+        }
+        
+        if (secondTick) {
+            // Read latest time from DS3231
+            if (!readTimeFromDS3231(&s_rtc_time)) {
+                // If read fails, use software timing (backward compatibility)
+                s_rtc_time.second++;
+                if (s_rtc_time.second >= 60) {
+                    s_rtc_time.second = 0;
+                    s_rtc_time.minute++;
+                    if (s_rtc_time.minute >= 60) {
+                        s_rtc_time.minute = 0;
+                        s_rtc_time.hour++;
+                        if (s_rtc_time.hour >= 24) {
+                            s_rtc_time.hour = 0;
+                        }
+                    }
+                }
+            }
+            // Fire due alarms (checks DS3231 alarm flags, no time comparison here)
+            alarm_sched_service();
+            
+            // Alarm indication: inverted on odd counts, back to normal once the count reaches zero
+            if (s_alarm_flash_remaining > 0) {
+                s_alarm_flash_remaining--;
+            }
+            
+            // Hand the frame to the render task (an undrawn older frame is replaced)
+            render_frame_t frame;
+            rtc_fill_frame(&s_rtc_time, &frame);
+            frame.rollover_us = rolloverUs;
+            frame.tick_us = tickUs;
+            xQueueOverwrite(s_render_queue, &frame);
+            lastUpdate = now;
+        }
+        
+        // Wait for the next edge check (a queued NTP result ends it early)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RTC_TASK_POLL_MS));
+    }
+}
+
+// Net task: WiFi bring-up, NTP, provisioning, settings write-back and memory checks
+static void net_task(void *arg)
+{
+    bool memLogged = false;
     
-    ESP_LOGI(TAG, "SNTP initialized. Waiting for time sync...");
+    while (1) {
+#if TRACE_ENABLED
+        int64_t passStartUs = esp_timer_get_time();
+#endif
+        
+        // WiFi connect with backoff, NTP sync and the hand-off of the DS3231 write
+        net_service();
+        
+        // If all 5 retries fail, enter provisioning mode
+        if (s_need_enter_provisioning) {
+            s_need_enter_provisioning = false;
+            ESP_LOGI(TAG, "Entering provisioning mode due to connection failure...");
+            
+            // Stop current WiFi (whether Station or SoftAP mode)
+            esp_err_t ret = esp_wifi_stop();
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to stop WiFi: %s", esp_err_to_name(ret));
+            }
+            
+            // Stored networks are kept (the device may be back in range later); adding one leaves provisioning
+            // Reset retry count
+            s_retry_num = 0;
+            
+            // Start SoftAP provisioning mode
+            s_in_provisioning_mode = true;
+            s_wifi_config_changed = false;
+            ret = wifi_provisioning_start_softap(wifi_status_callback);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to start provisioning mode: %s", esp_err_to_name(ret));
+            } else {
+                ESP_LOGI(TAG, "Provisioning mode started. Connect to 'PIX_Clock_Setup' and visit http://192.168.4.1");
+            }
+        }
+        
+        // In provisioning mode, leave as soon as a network was added (config_changed_cb wakes the task)
+        if (s_in_provisioning_mode && s_wifi_config_changed) {
+            s_wifi_config_changed = false;
+            // New config detected, stop provisioning mode and connect WiFi
+            ESP_LOGI(TAG, "WiFi config detected, stopping provisioning and connecting...");
+            wifi_provisioning_stop_softap();
+            s_in_provisioning_mode = false;
+            
+            // Start Station mode, NTP sync follows once connected (net_service)
+            net_start();
+        }
+        
+        // Heaps and task stack high-water marks once the first bring-up has ended (sync done and WiFi
+        // closed, no sync due, or a network added in provisioning mode and synced), so the WiFi, lwIP
+        // and httpd peaks are in the minimum values
+        if (!memLogged && s_net_state == NET_IDLE && !s_in_provisioning_mode) {
+            mem_report_log();
+            memLogged = true;
+        }
+        
+        // Write changed settings back to NVS once they have been quiet for a while
+        app_config_service();
+        
+        // Warn about low heap or task stacks (checked every MEM_REPORT_INTERVAL_S)
+        mem_report_service();
+        
+#if TRACE_ENABLED
+        // Only passes that did work (NVS write, WiFi and provisioning calls) are traced
+        if (esp_timer_get_time() - passStartUs >= TRACE_LOOP_MIN_US) {
+            TRACE_COMPLETE(TRACE_EV_LOOP, passStartUs, s_net_state);
+        }
+#endif
+        
+        // Wait for the next deadline check (WiFi/IP events, ntp_sync_task and the rtc task end it early)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NET_TASK_POLL_MS));
+    }
 }
 
 void app_main(void)
 {
     ESP_LOGI(TAG, "=== NTP Timer with DS3231 and SSD1306 ===");
     
+    // DLOGx messages are formatted and printed by an idle-priority task from here on
+    ESP_ERROR_CHECK(dlog_init());
+    
     // Initialize NVS (for storing sync timestamp)
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -589,11 +1398,26 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
     
-    // Set timezone (Beijing time UTC+8) - must be set before calling should_sync_ntp()
-    // This way mktime() can correctly convert DS3231 local time to UTC timestamp
-    setenv("TZ", "CST-8", 1);
-    tzset();
-    ESP_LOGI(TAG, "Timezone set to CST-8 (UTC+8)");
+    // Load settings into the RAM cache (written back to NVS from the net task)
+    ESP_ERROR_CHECK(app_config_init());
+    
+    // Log the running image (a fresh update stays pending until the first WiFi connection)
+    ota_update_init();
+    
+    // Load RTC drift history (adapts NTP sync interval)
+    drift_cal_init();
+    
+    // Select the stored timezone (DS3231 keeps UTC, conversion to local time is done by the tz module only)
+    app_config_t config;
+    app_config_get(&config);
+    tz_init(config.zone);
+    
+    // Select the stored clock face
+    face_init(config.face);
+    
+    // Load cached NTP server addresses and response times
+    static const char *const ntp_servers[] = {NTP_SERVER1, NTP_SERVER2, NTP_SERVER3};
+    ntp_client_init(ntp_servers, sizeof(ntp_servers) / sizeof(ntp_servers[0]));
     
     // Initialize I2C bus (DS3231 and SSD1306 share)
     ESP_LOGI(TAG, "Initializing I2C bus...");
@@ -614,6 +1438,9 @@ void app_main(void)
         return;
     }
     
+    // Size-based timeouts, stuck bus detection and recovery for both devices
+    ESP_ERROR_CHECK(i2c_fault_init(i2c_bus, DS3231_SDA_PIN, DS3231_SCL_PIN));
+    
     // Initialize DS3231
     ESP_LOGI(TAG, "Initializing DS3231 RTC...");
     if (!ds3231_init(&ds3231, i2c_bus, DS3231_SDA_PIN, DS3231_SCL_PIN)) {
@@ -629,6 +1456,17 @@ void app_main(void)
                 ESP_LOGW(TAG, "Warning: DS3231 oscillator was stopped. Time may be inaccurate.");
             }
         }
+        
+        // Convert RTC left at UTC+8 by older firmware
+        migrate_rtc_to_utc();
+        
+        // Start alarm scheduler (user alarms, chimes, scheduled dimming)
+        if (alarm_sched_init(&ds3231, DS3231_INT_PIN, alarm_fired_callback, NULL) == ESP_OK) {
+            seed_default_alarms();
+        }
+        
+        // Track RTC second edges for sub-second time (locks within ~2 s of the rtc task running)
+        time_service_init(&ds3231);
     }
     
     // Initialize SSD1306 display module (shares I2C bus with DS3231)
@@ -655,21 +1493,24 @@ void app_main(void)
     }
     
     // Read time from DS3231 and display
-    Time_t currentTime = {15, 29, 15};  // Default time
-    if (readTimeFromDS3231(&currentTime)) {
+    if (readTimeFromDS3231(&s_rtc_time)) {
         ESP_LOGI(TAG, "Time read from DS3231: %02d:%02d:%02d", 
-               currentTime.hour, currentTime.minute, currentTime.second);
+               s_rtc_time.hour, s_rtc_time.minute, s_rtc_time.second);
     } else {
         ESP_LOGW(TAG, "Failed to read time from DS3231, using default time: %02d:%02d:%02d",
-                currentTime.hour, currentTime.minute, currentTime.second);
+                s_rtc_time.hour, s_rtc_time.minute, s_rtc_time.second);
     }
     
-    // Display initial time
-    displayTime(&currentTime);
+    // Display initial time (the render task takes over once it runs)
+    s_target_brightness = brightness_for_hour(s_rtc_time.hour);
+    render_frame_t frame;
+    rtc_fill_frame(&s_rtc_time, &frame);
+    displayTime(&frame);
     
     // Initialize WiFi provisioning module (event handlers registered internally)
     ESP_LOGI(TAG, "Initializing WiFi provisioning module...");
     ESP_ERROR_CHECK(wifi_provisioning_init());
+    app_config_subscribe(config_changed_cb, NULL);
     
     // Register additional WiFi event handlers (for Station mode connection status and retry logic)
     esp_event_handler_instance_t instance_any_id;
@@ -695,6 +1536,7 @@ void app_main(void)
         ESP_LOGI(TAG, "No WiFi config found in NVS. Automatically entering provisioning mode...");
         ESP_LOGI(TAG, "Please connect to WiFi hotspot 'PIX_Clock_Setup' and open http://192.168.4.1");
         s_in_provisioning_mode = true;
+        s_wifi_config_changed = false;
         ESP_ERROR_CHECK(wifi_provisioning_start_softap(wifi_status_callback));
     } else {
         // WiFi config exists, check if NTP sync is needed (determines if WiFi needs to be started)
@@ -702,195 +1544,37 @@ void app_main(void)
         ESP_LOGI(TAG, "WiFi config found. NTP sync check: %s", s_need_ntp_sync ? "needed" : "not needed");
         
         if (s_need_ntp_sync) {
-        // Config exists and NTP sync needed, start WiFi connection
-        ESP_LOGI(TAG, "WiFi config found. NTP sync needed. Connecting to WiFi...");
-        esp_err_t ret = wifi_init_sta();
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to start WiFi Station, entering provisioning mode");
-                s_in_provisioning_mode = true;
-                ESP_ERROR_CHECK(wifi_provisioning_start_softap(wifi_status_callback));
-            } else {
-                // WiFi started successfully, wait for connection then initialize SNTP
-                ESP_LOGI(TAG, "NTP sync needed. Waiting for WiFi connection...");
-                esp_netif_t *sta_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-                esp_netif_ip_info_t ip_info;
-                int retry_count = 0;
-                bool wifi_connected = false;
-                
-                while (retry_count < 30) {  // Wait at most 30 seconds
-                    vTaskDelay(pdMS_TO_TICKS(1000));
-                    retry_count++;
-                    if (sta_netif && esp_netif_get_ip_info(sta_netif, &ip_info) == ESP_OK) {
-                        if (ip_info.ip.addr != 0) {
-                            wifi_connected = true;
-                            ESP_LOGI(TAG, "WiFi connected, initializing SNTP...");
-                            break;
-                        }
-                    }
-                }
-                
-                if (!wifi_connected) {
-                    ESP_LOGW(TAG, "WiFi connection failed after 30 seconds. Entering provisioning mode.");
-                    // WiFi connection failed, enter provisioning mode
-                    wifi_provisioning_stop_softap();  // First stop Station mode
-                    vTaskDelay(pdMS_TO_TICKS(500));  // Wait for WiFi to completely stop
-                    s_retry_num = 0;  // Reset retry count
-                    s_need_enter_provisioning = true;  // Mark need to enter provisioning mode
-                    ntp_initialized = false;
-                } else {
-                    // WiFi connection successful, initialize SNTP
-                    sntp_init_func();
-                    ntp_initialized = true;
-                }
-            }
+            // Config exists and NTP sync needed: connect and sync in the background,
+            // the tasks (and display) start right away
+            ESP_LOGI(TAG, "WiFi config found. NTP sync needed. Connecting to WiFi...");
+            net_start();
         } else {
             // Config exists but NTP sync not needed, don't start WiFi to save power
-            ESP_LOGI(TAG, "WiFi config found but NTP sync not needed (last sync was within %d hours).", SYNC_INTERVAL_HOURS);
+            ESP_LOGI(TAG, "WiFi config found but NTP sync not needed (last sync was within %lu hours).",
+                     (unsigned long)(drift_cal_get_sync_interval_s(SYNC_INTERVAL_HOURS * 3600) / 3600));
             ESP_LOGI(TAG, "Skipping WiFi initialization to save power. Using DS3231 time directly.");
-            ntp_initialized = false;
             // Don't start WiFi, use DS3231 time directly
         }
     }
     
     if (s_in_provisioning_mode) {
         ESP_LOGI(TAG, "In provisioning mode, NTP sync will be performed after WiFi is configured.");
-        ntp_initialized = false;
     }
     
-    ESP_LOGI(TAG, "System ready. Time will update every second.");
-    
-    // Main loop: read time from DS3231 every second
-    TickType_t lastUpdate = xTaskGetTickCount();
-    TickType_t lastNtpCheck = xTaskGetTickCount();
-    TickType_t lastProvCheck = xTaskGetTickCount();  // Provisioning mode check
-    TickType_t ntpSyncStartTime = xTaskGetTickCount();  // Record NTP sync start time
-    const TickType_t updateIntervalMs = pdMS_TO_TICKS(1000);  // 1 second
-    const TickType_t ntpCheckIntervalMs = pdMS_TO_TICKS(5000);  // Check NTP sync every 5 seconds
-    const TickType_t provCheckIntervalMs = pdMS_TO_TICKS(2000);  // Check provisioning status every 2 seconds
-    const TickType_t ntpSyncTimeoutMs = pdMS_TO_TICKS(60000);  // NTP sync timeout: 60 seconds
-    
-    while (1) {
-        TickType_t now = xTaskGetTickCount();
-        
-        // If WiFi scan is needed (execute in main loop to avoid stack overflow in event handler)
-        if (s_need_wifi_scan) {
-            s_need_wifi_scan = false;
-            // Move scan operation to independent function to avoid using large arrays in main loop
-            perform_wifi_scan();
-        }
-        
-        // If all 5 retries fail, enter provisioning mode
-        if (s_need_enter_provisioning) {
-            s_need_enter_provisioning = false;
-            ESP_LOGI(TAG, "Entering provisioning mode due to connection failure...");
-            
-            // Stop current WiFi (whether Station or SoftAP mode)
-            esp_err_t ret = esp_wifi_stop();
-            if (ret != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to stop WiFi: %s", esp_err_to_name(ret));
-            }
-            vTaskDelay(pdMS_TO_TICKS(500));  // Wait for WiFi to completely stop
-            
-            // Clear old invalid config to avoid detecting old config immediately after provisioning mode starts
-            ESP_LOGI(TAG, "Clearing invalid WiFi config...");
-            wifi_provisioning_clear_config();
-            
-            // Reset retry count
-            s_retry_num = 0;
-            
-            // Start SoftAP provisioning mode
-            s_in_provisioning_mode = true;
-            ret = wifi_provisioning_start_softap(wifi_status_callback);
-            if (ret != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to start provisioning mode: %s", esp_err_to_name(ret));
-            } else {
-                ESP_LOGI(TAG, "Provisioning mode started. Connect to 'PIX_Clock_Setup' and visit http://192.168.4.1");
-            }
-        }
-        
-        // In provisioning mode, periodically check if new config is saved
-        if (s_in_provisioning_mode && (now - lastProvCheck) >= provCheckIntervalMs) {
-            lastProvCheck = now;
-            if (wifi_provisioning_has_config()) {
-                // New config detected, stop provisioning mode and connect WiFi
-                ESP_LOGI(TAG, "WiFi config detected, stopping provisioning and connecting...");
-                wifi_provisioning_stop_softap();
-                s_in_provisioning_mode = false;
-                
-                // Start Station mode
-                esp_err_t ret = wifi_init_sta();
-                if (ret == ESP_OK) {
-                    // Note: Don't initialize NTP here because WiFi may not have connected successfully yet
-                    // Main loop will detect WiFi connection and initialize SNTP (see logic at lines 710-722)
-                }
-            }
-        }
-        
-        // Periodically check NTP sync status (every 5 seconds, only when NTP is initialized)
-        if (ntp_initialized && (now - lastNtpCheck) >= ntpCheckIntervalMs) {
-            sync_ntp_to_ds3231();
-            lastNtpCheck = now;
-            
-            // Check if timeout (not synced successfully within 60 seconds)
-            if (!sntp_synced && (now - ntpSyncStartTime) >= ntpSyncTimeoutMs) {
-                ESP_LOGW(TAG, "NTP sync timeout after 60 seconds. Closing WiFi to save power.");
-                wifi_provisioning_stop_softap();
-                ntp_initialized = false;
-            }
-        }
-        
-        // If WiFi is connected and NTP sync is needed but NTP is not initialized, initialize NTP
-        // Note: If s_force_ntp_sync is true, need to recheck should_sync_ntp() to update s_need_ntp_sync
-        // But only check when WiFi is connected to avoid repeated calls to should_sync_ntp()
-        if (s_force_ntp_sync && !ntp_initialized) {
-            esp_netif_t *sta_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-            esp_netif_ip_info_t ip_info;
-            // Only update s_need_ntp_sync when WiFi is connected to avoid duplicate logs
-            if (sta_netif && esp_netif_get_ip_info(sta_netif, &ip_info) == ESP_OK && ip_info.ip.addr != 0) {
-                s_need_ntp_sync = should_sync_ntp();  // Recheck, should_sync_ntp will return true at this time (only output log once)
-            }
-        }
-        
-        if (!s_in_provisioning_mode && !ntp_initialized && s_need_ntp_sync) {
-            esp_netif_t *sta_netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-            esp_netif_ip_info_t ip_info;
-            if (sta_netif && esp_netif_get_ip_info(sta_netif, &ip_info) == ESP_OK) {
-                if (ip_info.ip.addr != 0) {
-                    ESP_LOGI(TAG, "WiFi connected, initializing SNTP...");
-                    if (s_force_ntp_sync) {
-                        ESP_LOGI(TAG, "Force NTP sync mode");
-                    }
-                    sntp_init_func();
-                    ntp_initialized = true;
-                    ntpSyncStartTime = now;
-                    ESP_LOGI(TAG, "SNTP initialization started. Waiting for time sync...");
-                }
-            }
-        }
-        
-        // Check if 1 second has passed
-        if ((now - lastUpdate) >= updateIntervalMs) {
-            // Read latest time from DS3231
-            if (!readTimeFromDS3231(&currentTime)) {
-                // If read fails, use software timing (backward compatibility)
-                currentTime.second++;
-                if (currentTime.second >= 60) {
-                    currentTime.second = 0;
-                    currentTime.minute++;
-                    if (currentTime.minute >= 60) {
-                        currentTime.minute = 0;
-                        currentTime.hour++;
-                        if (currentTime.hour >= 24) {
-                            currentTime.hour = 0;
-                        }
-                    }
-                }
-            }
-            displayTime(&currentTime);
-            lastUpdate = now;
-        }
-        
-        // Small delay to prevent CPU spinning
-        vTaskDelay(pdMS_TO_TICKS(10));
+    // Queues between the tasks, then the tasks themselves (app_main returns once they run)
+    s_render_queue = xQueueCreate(1, sizeof(render_frame_t));
+    s_rtc_queue = xQueueCreate(RTC_QUEUE_LEN, sizeof(rtc_sync_request_t));
+    s_net_queue = xQueueCreate(NET_QUEUE_LEN, sizeof(esp_err_t));
+    if (s_render_queue == NULL || s_rtc_queue == NULL || s_net_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create task queues");
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
     }
+    if (xTaskCreate(render_task, "render", RENDER_TASK_STACK, NULL, RENDER_TASK_PRIORITY, NULL) != pdPASS ||
+        xTaskCreate(rtc_task, "rtc", RTC_TASK_STACK, NULL, RTC_TASK_PRIORITY, &s_rtc_task) != pdPASS ||
+        xTaskCreate(net_task, "net", NET_TASK_STACK, NULL, NET_TASK_PRIORITY, &s_net_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create tasks");
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+    
+    ESP_LOGI(TAG, "System ready. Time will update every second.");
 }
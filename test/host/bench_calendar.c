@@ -0,0 +1,114 @@
+// Host benchmark of main/lib/calendar/calendar.h against the C library
+//
+// Converts the same pseudo-random times of the DS3231 range (2000-2199) both ways and
+// reports ns per conversion. mktime() runs with TZ=UTC so it does the same work as on the
+// device before tz.c (it still normalises the struct and consults the zone). On the
+// ESP32-C3 the ratio is larger: newlib's mktime() takes the environment lock and
+// re-reads TZ on every call.
+
+#define _DEFAULT_SOURCE     // timegm()
+#include "calendar.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SAMPLES     4096
+#define ROUNDS      256
+
+static volatile int64_t s_sink;     // Keeps the conversions from being optimised away
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void report(const char *name, double start, double end)
+{
+    printf("  %-28s %7.1f ns/op\n", name, (end - start) / ((double)SAMPLES * ROUNDS));
+}
+
+int main(void)
+{
+    static struct tm tms[SAMPLES];
+    static int64_t epochs[SAMPLES];
+
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    // xorshift32, fixed seed so runs are comparable
+    uint32_t x = 2463534242u;
+    int64_t span = cal_epoch_from_civil(CAL_DS3231_YEAR_MAX + 1, 1, 1, 0, 0, 0) - CAL_EPOCH_2000;
+    for (int i = 0; i < SAMPLES; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        epochs[i] = CAL_EPOCH_2000 + (int64_t)((uint64_t)x * (uint64_t)span >> 32);
+        time_t t = (time_t)epochs[i];
+        gmtime_r(&t, &tms[i]);
+    }
+
+    printf("civil -> epoch (%d samples x %d rounds)\n", SAMPLES, ROUNDS);
+    double start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            const struct tm *tm = &tms[i];
+            s_sink = cal_epoch_from_civil(tm->tm_year + 1900, (uint32_t)tm->tm_mon + 1, (uint32_t)tm->tm_mday,
+                                          (uint32_t)tm->tm_hour, (uint32_t)tm->tm_min, (uint32_t)tm->tm_sec);
+        }
+    }
+    report("cal_epoch_from_civil", start, now_ns());
+
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            struct tm tm = tms[i];
+            s_sink = mktime(&tm);
+        }
+    }
+    report("mktime (TZ=UTC)", start, now_ns());
+
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            struct tm tm = tms[i];
+            s_sink = timegm(&tm);
+        }
+    }
+    report("timegm", start, now_ns());
+
+    printf("epoch -> civil\n");
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            ds3231_time_t rtc = {0};
+            cal_ds3231_from_epoch(epochs[i], &rtc);
+            s_sink = rtc.date + rtc.seconds;
+        }
+    }
+    report("cal_ds3231_from_epoch", start, now_ns());
+
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            time_t t = (time_t)epochs[i];
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            s_sink = tm.tm_mday + tm.tm_sec;
+        }
+    }
+    report("gmtime_r", start, now_ns());
+
+    start = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (int i = 0; i < SAMPLES; i++) {
+            time_t t = (time_t)epochs[i];
+            struct tm tm;
+            localtime_r(&t, &tm);
+            s_sink = tm.tm_mday + tm.tm_sec;
+        }
+    }
+    report("localtime_r (TZ=UTC)", start, now_ns());
+    return 0;
+}
@@ -0,0 +1,337 @@
+// Host benchmark of the NTP sync procedure against real UDP servers
+//
+// Runs the sync of ntp_client_sync() (main/lib/ntp_client) over POSIX sockets with the
+// firmware's own packet, sample and filter code (ntp_proto.c): one request races to every
+// server, smallest smoothed delay first, the first valid reply wins and the rest of the
+// burst goes to the winner, keeping the lowest-delay sample. Smoothed delays persist
+// across syncs as in the NVS cache; DNS and the cache itself are left out (servers are
+// given as addresses). CLOCK_REALTIME stands in for esp_timer, so the filtered offset is
+// the server clock's offset from the host clock.
+//
+// Meant to run against tools/ntp_bench.py serve, which adds delay, jitter, loss, offset
+// and Kiss-o'-Death to a local server:
+//   tools/ntp_bench.py serve --bind 127.0.0.1 --port 0 --delay-ms 20,35,60 --offset-ms 250
+//       --run build_host/bench_ntp --expect-offset-ms 250 {servers}
+//
+// Usage: bench_ntp [--syncs N] [--samples N] [--spacing-ms N] [--expect-offset-ms N]
+//                  [--max-residual-us N] host:port[,host:port...]
+// Exits non-zero if a sync fails or a residual (filtered offset minus the expected
+// offset) exceeds --max-residual-us.
+
+#define _DEFAULT_SOURCE     // nanosleep(), getaddrinfo()
+#include "ntp_proto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_SERVERS     4       // NTP_CLIENT_MAX_SERVERS
+#define MAX_SYNCS       10000
+#define US_PER_S        1000000LL
+
+typedef struct {
+    struct sockaddr_in addr;
+    char name[32];
+    uint32_t rtt_us;        // Smoothed round-trip delay, kept across syncs
+    uint8_t nonce[NTP_NONCE_SIZE];
+    int64_t t1_us;
+    bool outstanding;
+    bool excluded;
+} peer_t;
+
+static peer_t s_peers[MAX_SERVERS];
+static size_t s_count = 0;
+static uint32_t s_rand = 0x2545F491;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * US_PER_S + ts.tv_nsec / 1000;
+}
+
+static void sleep_ms(unsigned ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// xorshift32 (the device uses esp_fill_random(); the nonce only has to differ per request)
+static void fill_nonce(uint8_t *nonce)
+{
+    for (size_t i = 0; i < NTP_NONCE_SIZE; i++) {
+        s_rand ^= s_rand << 13;
+        s_rand ^= s_rand >> 17;
+        s_rand ^= s_rand << 5;
+        nonce[i] = (uint8_t)s_rand;
+    }
+}
+
+static bool peer_send(int sock, peer_t *peer)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    fill_nonce(peer->nonce);
+    ntp_request(pkt, peer->nonce);
+    peer->t1_us = now_us();
+    if (sendto(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&peer->addr, sizeof(peer->addr)) != sizeof(pkt)) {
+        perror("sendto");
+        return false;
+    }
+    peer->outstanding = true;
+    return true;
+}
+
+// As ntp_receive(): next valid reply to an outstanding request, -1 on timeout
+static int peer_receive(int sock, int64_t deadline_us, ntp_sample_t *sample)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    while (1) {
+        bool waiting = false;
+        for (size_t i = 0; i < s_count; i++) {
+            waiting |= s_peers[i].outstanding;
+        }
+        int64_t remaining_us = deadline_us - now_us();
+        if (!waiting || remaining_us <= 0) {
+            return -1;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+        struct timeval timeout = {
+            .tv_sec = remaining_us / US_PER_S,
+            .tv_usec = remaining_us % US_PER_S,
+        };
+        if (select(sock + 1, &fds, NULL, NULL, &timeout) <= 0) {
+            return -1;
+        }
+
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&from, &from_len);
+        int64_t t4 = now_us();
+        if (len < NTP_PACKET_SIZE) {
+            continue;
+        }
+
+        int idx = -1;
+        for (size_t i = 0; i < s_count; i++) {
+            peer_t *peer = &s_peers[i];
+            if (peer->outstanding && peer->addr.sin_addr.s_addr == from.sin_addr.s_addr &&
+                peer->addr.sin_port == from.sin_port && ntp_reply_matches(pkt, peer->nonce)) {
+                idx = (int)i;
+                break;
+            }
+        }
+        if (idx < 0) {
+            continue;
+        }
+        s_peers[idx].outstanding = false;
+
+        ntp_reply_t reply = ntp_parse(pkt, s_peers[idx].t1_us, t4, sample);
+        if (reply == NTP_REPLY_KOD) {
+            s_peers[idx].excluded = true;
+            continue;
+        }
+        if (reply != NTP_REPLY_OK) {
+            continue;
+        }
+        s_peers[idx].rtt_us = ntp_smooth_rtt(s_peers[idx].rtt_us, sample->delay_us);
+        return idx;
+    }
+}
+
+// As ntp_race()
+static int race(int sock, ntp_sample_t *sample)
+{
+    uint32_t rtt_us[MAX_SERVERS];
+    uint8_t order[MAX_SERVERS];
+    for (size_t i = 0; i < s_count; i++) {
+        rtt_us[i] = s_peers[i].rtt_us;
+    }
+    ntp_race_order(rtt_us, s_count, order);
+
+    bool sent = false;
+    for (size_t k = 0; k < s_count; k++) {
+        peer_t *peer = &s_peers[order[k]];
+        if (!peer->excluded && peer_send(sock, peer)) {
+            sent = true;
+        }
+    }
+    if (!sent) {
+        return -1;
+    }
+    return peer_receive(sock, now_us() + NTP_RECV_TIMEOUT_MS * 1000LL, sample);
+}
+
+typedef struct {
+    int winner;
+    int64_t first_reply_us;
+    int64_t duration_us;
+    ntp_filter_t filter;
+} sync_result_t;
+
+// As ntp_client_sync()
+static bool sync_once(unsigned samples, unsigned spacing_ms, sync_result_t *result)
+{
+    for (size_t i = 0; i < s_count; i++) {
+        s_peers[i].outstanding = false;
+        s_peers[i].excluded = false;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        perror("socket");
+        return false;
+    }
+
+    int64_t start = now_us();
+    ntp_sample_t sample;
+    int winner = race(sock, &sample);
+    if (winner < 0) {
+        close(sock);
+        return false;
+    }
+    result->winner = winner;
+    result->first_reply_us = sample.t4_us - start;
+    ntp_filter_reset(&result->filter);
+    ntp_filter_add(&result->filter, &sample);
+
+    for (unsigned i = 1; i < samples && !s_peers[winner].excluded; i++) {
+        sleep_ms(spacing_ms);
+        if (!peer_send(sock, &s_peers[winner])) {
+            break;
+        }
+        int64_t deadline_us = now_us() + NTP_RECV_TIMEOUT_MS * 1000LL;
+        int idx;
+        do {
+            idx = peer_receive(sock, deadline_us, &sample);
+        } while (idx >= 0 && idx != winner);
+        if (idx == winner) {
+            ntp_filter_add(&result->filter, &sample);
+        }
+    }
+    close(sock);
+    result->duration_us = now_us() - start;
+    return true;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, int64_t *values, size_t count, double scale, const char *unit)
+{
+    if (count == 0) {
+        printf("%-16s(none)\n", name);
+        return;
+    }
+    qsort(values, count, sizeof(values[0]), cmp_i64);
+#define PICK(q) ((double)values[(size_t)((q) * count) < count ? (size_t)((q) * count) : count - 1] * scale)
+    printf("%-16smin %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f %s\n", name,
+           (double)values[0] * scale, PICK(0.5), PICK(0.9), PICK(0.99), (double)values[count - 1] * scale, unit);
+#undef PICK
+}
+
+static bool parse_servers(char *list)
+{
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        char *colon = strrchr(tok, ':');
+        if (s_count == MAX_SERVERS || !colon) {
+            return false;
+        }
+        *colon = '\0';
+        peer_t *peer = &s_peers[s_count];
+        peer->addr.sin_family = AF_INET;
+        peer->addr.sin_port = htons((uint16_t)atoi(colon + 1));
+        if (inet_pton(AF_INET, tok, &peer->addr.sin_addr) != 1) {
+            return false;
+        }
+        snprintf(peer->name, sizeof(peer->name), "%s:%s", tok, colon + 1);
+        s_count++;
+    }
+    return s_count > 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned syncs = 5;
+    unsigned samples = 4;                   // NTP_SAMPLES in main.c
+    unsigned spacing_ms = NTP_SAMPLE_SPACING_MS;
+    double expect_offset_ms = 0.0;
+    long max_residual_us = -1;
+    char *servers = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (more && strcmp(argv[i], "--syncs") == 0) {
+            syncs = (unsigned)atoi(argv[++i]);
+        } else if (more && strcmp(argv[i], "--samples") == 0) {
+            samples = (unsigned)atoi(argv[++i]);
+        } else if (more && strcmp(argv[i], "--spacing-ms") == 0) {
+            spacing_ms = (unsigned)atoi(argv[++i]);
+        } else if (more && strcmp(argv[i], "--expect-offset-ms") == 0) {
+            expect_offset_ms = atof(argv[++i]);
+        } else if (more && strcmp(argv[i], "--max-residual-us") == 0) {
+            max_residual_us = atol(argv[++i]);
+        } else if (argv[i][0] != '-' && !servers) {
+            servers = argv[i];
+        } else {
+            servers = NULL;
+            break;
+        }
+    }
+    if (!servers || !parse_servers(servers) || syncs == 0 || syncs > MAX_SYNCS || samples == 0) {
+        fprintf(stderr, "usage: %s [--syncs N] [--samples N] [--spacing-ms N] [--expect-offset-ms N]\n"
+                        "       [--max-residual-us N] host:port[,host:port...] (at most %d servers)\n",
+                argv[0], MAX_SERVERS);
+        return 2;
+    }
+
+    static int64_t first_replies[MAX_SYNCS], durations[MAX_SYNCS], delays[MAX_SYNCS], residuals[MAX_SYNCS];
+    unsigned wins[MAX_SERVERS] = {0};
+    size_t ok = 0;
+    int64_t expect_us = (int64_t)(expect_offset_ms * 1000.0);
+    for (unsigned n = 0; n < syncs; n++) {
+        sync_result_t result;
+        if (!sync_once(samples, spacing_ms, &result)) {
+            continue;
+        }
+        int64_t residual = result.filter.best.offset_us - expect_us;
+        first_replies[ok] = result.first_reply_us;
+        durations[ok] = result.duration_us;
+        delays[ok] = result.filter.best.delay_us;
+        residuals[ok] = residual < 0 ? -residual : residual;
+        wins[result.winner]++;
+        ok++;
+    }
+
+    printf("%u syncs, %u failed (%zu servers, %u samples, %u ms spacing)\n",
+           syncs, syncs - (unsigned)ok, s_count, samples, spacing_ms);
+    report("first reply:", first_replies, ok, 1e-3, "ms");
+    report("time to sync:", durations, ok, 1e-3, "ms");
+    report("best delay:", delays, ok, 1e-3, "ms");
+    report("|residual|:", residuals, ok, 1.0, "us");
+    printf("winner:        ");
+    for (size_t i = 0; i < s_count; i++) {
+        printf(" %s: %u", s_peers[i].name, wins[i]);
+    }
+    printf("\n");
+
+    if (ok < syncs) {
+        printf("FAIL: %u syncs without a valid reply\n", syncs - (unsigned)ok);
+        return 1;
+    }
+    // report() sorted the residuals: the last one is the largest
+    if (max_residual_us >= 0 && residuals[ok - 1] > max_residual_us) {
+        printf("FAIL: residual %lld us above %ld us\n", (long long)residuals[ok - 1], max_residual_us);
+        return 1;
+    }
+    return 0;
+}
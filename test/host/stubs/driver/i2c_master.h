@@ -0,0 +1,10 @@
+#ifndef HOST_STUB_I2C_MASTER_H
+#define HOST_STUB_I2C_MASTER_H
+
+// Host build: just what ds3231.h declares its API with (no driver calls are made)
+#include <stddef.h>
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+typedef struct i2c_master_dev_t *i2c_master_dev_handle_t;
+
+#endif // HOST_STUB_I2C_MASTER_H
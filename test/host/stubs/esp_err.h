@@ -0,0 +1,12 @@
+#ifndef HOST_STUB_ESP_ERR_H
+#define HOST_STUB_ESP_ERR_H
+
+// Host build: the error type and the codes trace.c returns
+typedef int esp_err_t;
+
+#define ESP_OK      0
+#define ESP_FAIL    -1
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif // HOST_STUB_ESP_ERR_H
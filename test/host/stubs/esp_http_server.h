@@ -0,0 +1,14 @@
+#ifndef HOST_STUB_ESP_HTTP_SERVER_H
+#define HOST_STUB_ESP_HTTP_SERVER_H
+
+// Host build: the response calls trace.c makes; the test captures what is sent
+#include "esp_err.h"
+#include <sys/types.h>
+
+typedef struct httpd_req httpd_req_t;
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len);
+
+#endif // HOST_STUB_ESP_HTTP_SERVER_H
@@ -0,0 +1,9 @@
+#ifndef HOST_STUB_ESP_TIMER_H
+#define HOST_STUB_ESP_TIMER_H
+
+// Host build: the test provides the clock
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif // HOST_STUB_ESP_TIMER_H
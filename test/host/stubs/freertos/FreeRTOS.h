@@ -0,0 +1,13 @@
+#ifndef HOST_STUB_FREERTOS_H
+#define HOST_STUB_FREERTOS_H
+
+// Host build: the kernel types trace.c uses; the test plays the scheduler
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+BaseType_t xPortInIsrContext(void);
+
+#endif // HOST_STUB_FREERTOS_H
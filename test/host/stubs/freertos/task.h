@@ -0,0 +1,13 @@
+#ifndef HOST_STUB_FREERTOS_TASK_H
+#define HOST_STUB_FREERTOS_TASK_H
+
+// Host build: the task calls trace.c makes (current task, its name, delay)
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char *pcTaskGetName(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+
+#endif // HOST_STUB_FREERTOS_TASK_H
@@ -0,0 +1,176 @@
+// Exhaustive host test of main/lib/calendar/calendar.h against the C library (UTC)
+//
+// Every day from 2000-01-01 to 2199-12-31 (the DS3231 range): day numbers, civil dates,
+// weekdays and month lengths against timegm()/gmtime_r(), epoch <-> DS3231 fields, and
+// the DS3231 register block (BCD, 24- and 12-hour mode, century bit).
+
+#define _DEFAULT_SOURCE     // timegm()
+#include "calendar.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+static time_t utc_timegm(int y, int m, int d, int h, int min, int s)
+{
+    struct tm tm = {
+        .tm_year = y - 1900, .tm_mon = m - 1, .tm_mday = d,
+        .tm_hour = h, .tm_min = min, .tm_sec = s,
+    };
+    return timegm(&tm);
+}
+
+// Day numbers, civil dates, weekdays and month lengths for every day of the DS3231 range
+static void test_days(void)
+{
+    int32_t first = cal_days_from_civil(CAL_DS3231_YEAR_MIN, 1, 1);
+    int32_t last = cal_days_from_civil(CAL_DS3231_YEAR_MAX, 12, 31);
+    CHECK(first == CAL_DAYS_1970_TO_2000, "2000-01-01 is day %d", (int)first);
+    CHECK((int64_t)first * CAL_SECONDS_PER_DAY == CAL_EPOCH_2000, "CAL_EPOCH_2000");
+
+    for (int32_t days = first; days <= last; days++) {
+        time_t t = (time_t)days * CAL_SECONDS_PER_DAY;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        int32_t y = tm.tm_year + 1900;
+        uint32_t m = (uint32_t)tm.tm_mon + 1;
+        uint32_t d = (uint32_t)tm.tm_mday;
+
+        CHECK(cal_days_from_civil(y, m, d) == days, "days_from_civil(%d-%02u-%02u)", (int)y, m, d);
+        CHECK(utc_timegm(y, m, d, 0, 0, 0) == t, "timegm(%d-%02u-%02u)", (int)y, m, d);
+
+        int32_t cy;
+        uint32_t cm, cd;
+        cal_civil_from_days(days, &cy, &cm, &cd);
+        CHECK(cy == y && cm == m && cd == d, "civil_from_days(%d) = %d-%02u-%02u, gmtime %d-%02u-%02u",
+              (int)days, (int)cy, cm, cd, (int)y, m, d);
+        CHECK(cal_weekday(days) == (uint32_t)tm.tm_wday, "weekday(%d-%02u-%02u)", (int)y, m, d);
+
+        // The day after the last day of a month is the 1st
+        struct tm next;
+        time_t t_next = t + CAL_SECONDS_PER_DAY;
+        gmtime_r(&t_next, &next);
+        CHECK((next.tm_mday == 1) == (d == cal_days_in_month(y, m)),
+              "days_in_month(%d, %u) = %u", (int)y, m, cal_days_in_month(y, m));
+        if (m == 12 && d == 31) {
+            CHECK(cal_is_leap(y) == (tm.tm_yday == 365), "is_leap(%d)", (int)y);
+        }
+    }
+    // 2100 is not a leap year (the only century in the range that matters)
+    CHECK(!cal_is_leap(2100) && cal_is_leap(2000) && cal_days_in_month(2100, 2) == 28, "2100");
+}
+
+// Epoch <-> DS3231 fields, one time of day per day (spread over the whole day)
+static void test_epoch(void)
+{
+    int32_t first = cal_days_from_civil(CAL_DS3231_YEAR_MIN, 1, 1);
+    int32_t last = cal_days_from_civil(CAL_DS3231_YEAR_MAX, 12, 31);
+    for (int32_t days = first; days <= last; days++) {
+        uint32_t sod = (uint32_t)((days - first) * 7919u % CAL_SECONDS_PER_DAY);
+        int64_t epoch = (int64_t)days * CAL_SECONDS_PER_DAY + sod;
+        time_t t = (time_t)epoch;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+
+        ds3231_time_t rtc = {0};
+        CHECK(cal_ds3231_from_epoch(epoch, &rtc), "ds3231_from_epoch(%lld) out of range", (long long)epoch);
+        CHECK(rtc.year == tm.tm_year + 1900 - 2000 && rtc.month == tm.tm_mon + 1 && rtc.date == tm.tm_mday &&
+              rtc.hours == tm.tm_hour && rtc.minutes == tm.tm_min && rtc.seconds == tm.tm_sec &&
+              rtc.day == tm.tm_wday + 1,
+              "ds3231_from_epoch(%lld)", (long long)epoch);
+        CHECK(cal_ds3231_valid(&rtc), "valid(%lld)", (long long)epoch);
+        CHECK(cal_epoch_from_ds3231(&rtc) == epoch, "epoch_from_ds3231(%lld)", (long long)epoch);
+        CHECK(cal_epoch_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                                   tm.tm_sec) == utc_timegm(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                                                            tm.tm_hour, tm.tm_min, tm.tm_sec),
+              "epoch_from_civil(%lld)", (long long)epoch);
+
+        // Register block round trip, century bit from 2100
+        uint8_t regs[CAL_DS3231_REG_COUNT];
+        ds3231_time_t back;
+        cal_ds3231_pack(&rtc, regs);
+        CHECK(cal_ds3231_unpack(regs, &back) && memcmp(&back, &rtc, sizeof(rtc)) == 0,
+              "pack/unpack(%lld)", (long long)epoch);
+        CHECK(((regs[5] & CAL_DS3231_CENTURY_BIT) != 0) == (rtc.year >= 100), "century bit year %u", rtc.year);
+        CHECK((regs[2] & CAL_DS3231_12H_BIT) == 0, "pack writes 24-hour mode");
+    }
+
+    // Outside the DS3231 range
+    ds3231_time_t rtc;
+    CHECK(!cal_ds3231_from_epoch(CAL_EPOCH_2000 - 1, &rtc), "1999-12-31 23:59:59 rejected");
+    CHECK(!cal_ds3231_from_epoch(utc_timegm(2200, 1, 1, 0, 0, 0), &rtc), "2200-01-01 rejected");
+    CHECK(cal_split_epoch(-1, &(uint32_t){0}) == -1, "split_epoch floors negative times");
+}
+
+// BCD and the hours register in both modes
+static void test_bcd(void)
+{
+    for (int v = 0; v <= 99; v++) {
+        uint8_t bcd = cal_bin_to_bcd((uint8_t)v);
+        char text[3];
+        snprintf(text, sizeof(text), "%02x", bcd);
+        CHECK(atoi(text) == v && cal_bcd_to_bin(bcd) == v, "bcd(%d) = 0x%02x", v, bcd);
+    }
+
+    // Fixed registers: 2024-02-29 13:45:59 Thursday (weekday register 5)
+    const uint8_t regs24[CAL_DS3231_REG_COUNT] = {0x59, 0x45, 0x13, 0x05, 0x29, 0x02, 0x24};
+    ds3231_time_t t;
+    CHECK(cal_ds3231_unpack(regs24, &t) && t.year == 24 && t.month == 2 && t.date == 29 &&
+          t.hours == 13 && t.minutes == 45 && t.seconds == 59 && t.day == 5, "unpack 24-hour");
+
+    // 12-hour mode: 12 AM = 0, 1-11 AM, 12 PM = 12, 1-11 PM
+    for (int hour = 0; hour < 24; hour++) {
+        int h12 = hour % 12 == 0 ? 12 : hour % 12;
+        uint8_t regs[CAL_DS3231_REG_COUNT] = {0x00, 0x00, 0, 0x01, 0x01, 0x01, 0x00};
+        regs[2] = (uint8_t)(CAL_DS3231_12H_BIT | (hour >= 12 ? CAL_DS3231_PM_BIT : 0) | cal_bin_to_bcd((uint8_t)h12));
+        CHECK(cal_ds3231_unpack(regs, &t) && t.hours == hour, "12-hour register 0x%02x -> %u, expected %d",
+              regs[2], t.hours, hour);
+    }
+
+    // Century bit: 2199-12-31 and 2100-02-28 read back; 2100-02-29 does not exist
+    const uint8_t regs2199[CAL_DS3231_REG_COUNT] = {0x00, 0x00, 0x00, 0x03, 0x31, 0x92, 0x99};
+    CHECK(cal_ds3231_unpack(regs2199, &t) && t.year == 199 && t.month == 12 && t.date == 31, "2199-12-31");
+    const uint8_t regs2100[CAL_DS3231_REG_COUNT] = {0x00, 0x00, 0x00, 0x01, 0x28, 0x82, 0x00};
+    CHECK(cal_ds3231_unpack(regs2100, &t) && t.year == 100 && t.month == 2 && t.date == 28, "2100-02-28");
+    const uint8_t regs2100_29[CAL_DS3231_REG_COUNT] = {0x00, 0x00, 0x00, 0x01, 0x29, 0x82, 0x00};
+    CHECK(!cal_ds3231_unpack(regs2100_29, &t), "2100-02-29 rejected");
+    const uint8_t regs2000_29[CAL_DS3231_REG_COUNT] = {0x00, 0x00, 0x00, 0x03, 0x29, 0x02, 0x00};
+    CHECK(cal_ds3231_unpack(regs2000_29, &t), "2000-02-29 accepted");
+
+    // Invalid fields
+    const uint8_t bad[][CAL_DS3231_REG_COUNT] = {
+        {0x60, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00},     // second 60
+        {0x00, 0x60, 0x00, 0x01, 0x01, 0x01, 0x00},     // minute 60
+        {0x00, 0x00, 0x24, 0x01, 0x01, 0x01, 0x00},     // hour 24
+        {0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00},     // date 0
+        {0x00, 0x00, 0x00, 0x01, 0x31, 0x04, 0x00},     // April 31
+        {0x00, 0x00, 0x00, 0x01, 0x01, 0x13, 0x00},     // month 13
+        {0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00},     // month 0
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK(!cal_ds3231_unpack(bad[i], &t), "invalid register block %zu accepted", i);
+    }
+}
+
+int main(void)
+{
+    test_days();
+    test_epoch();
+    test_bcd();
+    printf("calendar: %u checks, %u failures\n", s_checks, s_failures);
+    return s_failures == 0 ? 0 : 1;
+}
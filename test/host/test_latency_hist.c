@@ -0,0 +1,145 @@
+// Host test of main/lib/latency/latency_hist.h
+//
+// Bucket layout for every value up to 2^22 (exact below 32 us, upper ends at most 1/16
+// above the value, contiguous and increasing, clamping above the range), and percentiles of
+// pseudo-random samples against the rank rule applied to the sorted values (which is what
+// tools/latency_report.py computes from a trace dump).
+
+#include "latency_hist.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+#define MAX_VALUE   ((1u << LATENCY_MAX_BITS) - 1)
+#define SAMPLES     5000
+
+static uint32_t s_rand = 0x9E3779B9;
+
+static uint32_t xorshift32(void)
+{
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_buckets(void)
+{
+    uint32_t prev = 0;
+    for (uint32_t v = 0; v <= MAX_VALUE; v++) {
+        uint32_t b = latency_hist_bucket(v);
+        uint32_t upper = latency_hist_bucket_upper(b);
+        if (v < LATENCY_LINEAR) {
+            CHECK(b == v && upper == v, "value %u: bucket %u, upper %u", v, b, upper);
+        }
+        CHECK(b < LATENCY_BUCKETS, "value %u: bucket %u", v, b);
+        CHECK(upper >= v && upper - v <= v / LATENCY_SUB_BUCKETS, "value %u: upper %u", v, upper);
+        // Buckets are contiguous: a new bucket starts right after the previous upper end
+        if (v > 0) {
+            CHECK(b == prev || (b == prev + 1 && latency_hist_bucket_upper(prev) == v - 1),
+                  "value %u: bucket %u after %u", v, b, prev);
+        }
+        prev = b;
+    }
+    CHECK(prev == LATENCY_BUCKETS - 1, "last bucket %u", prev);
+    CHECK(latency_hist_bucket_upper(LATENCY_BUCKETS - 1) == MAX_VALUE, "range end");
+    CHECK(latency_hist_bucket(MAX_VALUE + 1) == LATENCY_BUCKETS - 1, "clamped above the range");
+    CHECK(latency_hist_bucket(UINT32_MAX) == LATENCY_BUCKETS - 1, "clamped UINT32_MAX");
+}
+
+// Percentiles against the sorted samples, for values drawn below `range`
+static void test_percentiles(uint32_t range, uint32_t count)
+{
+    static uint32_t values[SAMPLES];
+    static latency_hist_t hist;
+    memset(&hist, 0, sizeof(hist));
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = xorshift32() % range;
+        latency_hist_add(&hist, values[i]);
+    }
+    qsort(values, count, sizeof(values[0]), cmp_u32);
+    CHECK(hist.count == count && hist.max_us == values[count - 1], "count %u, max %u", hist.count, hist.max_us);
+
+    static const uint32_t percents[] = { 0, 1, 10, 50, 90, 99, 100 };
+    for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++) {
+        uint32_t rank = (count * percents[i] + 99) / 100;
+        uint32_t value = values[rank ? rank - 1 : 0];
+        uint32_t expect = latency_hist_bucket_upper(latency_hist_bucket(value));
+        if (expect > values[count - 1]) {
+            expect = values[count - 1];
+        }
+        uint32_t got = latency_hist_percentile(&hist, percents[i]);
+        CHECK(got == expect, "range %u, %u samples, p%u: %u, expected %u (sample %u)",
+              range, count, percents[i], got, expect, value);
+        CHECK(got >= value && got - value <= value / LATENCY_SUB_BUCKETS,
+              "p%u: %u for sample %u", percents[i], got, value);
+    }
+}
+
+static void test_edge_cases(void)
+{
+    static latency_hist_t hist;
+    memset(&hist, 0, sizeof(hist));
+    CHECK(latency_hist_percentile(&hist, 50) == 0, "empty histogram");
+
+    latency_hist_add(&hist, 1234);
+    CHECK(latency_hist_percentile(&hist, 0) == 1234 && latency_hist_percentile(&hist, 100) == 1234,
+          "single sample capped at the maximum");
+
+    // 99 fast frames and one slow one: p99 is still fast, p100 is the slow one
+    memset(&hist, 0, sizeof(hist));
+    for (int i = 0; i < 99; i++) {
+        latency_hist_add(&hist, 10);
+    }
+    latency_hist_add(&hist, 500000);
+    CHECK(latency_hist_percentile(&hist, 99) == 10, "p99 %u", latency_hist_percentile(&hist, 99));
+    CHECK(latency_hist_percentile(&hist, 100) == 500000, "p100");
+
+    // Values beyond the range land in the last bucket and read back as its upper end;
+    // the maximum stays exact
+    latency_hist_add(&hist, 10000000);
+    CHECK(hist.max_us == 10000000 && hist.counts[LATENCY_BUCKETS - 1] == 1, "above the range");
+    CHECK(latency_hist_percentile(&hist, 100) == MAX_VALUE, "p100 above the range");
+
+    // Bucket counts saturate, the total keeps counting
+    memset(&hist, 0, sizeof(hist));
+    for (uint32_t i = 0; i < UINT16_MAX + 10u; i++) {
+        latency_hist_add(&hist, 7);
+    }
+    CHECK(hist.counts[7] == UINT16_MAX && hist.count == UINT16_MAX + 10u, "saturated bucket");
+    CHECK(latency_hist_percentile(&hist, 50) == 7, "saturated p50");
+}
+
+int main(void)
+{
+    test_buckets();
+    test_percentiles(LATENCY_LINEAR, 100);          // Exact buckets only
+    test_percentiles(2000, SAMPLES);                // Jitter-like
+    test_percentiles(80000, SAMPLES);               // Latency-like
+    test_percentiles(MAX_VALUE + 1, SAMPLES);
+    test_percentiles(1000000, 7);                   // Few samples: ranks round up
+    test_edge_cases();
+
+    printf("%u checks, %u failures\n", s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
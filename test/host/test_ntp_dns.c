@@ -0,0 +1,219 @@
+// Host test of main/lib/ntp_client/ntp_dns.h
+//
+// Query encoding (labels, length limits, rejected names), and replies: address and TTL of
+// the first A record, CNAME chains shortening the TTL, compressed and uncompressed owner
+// names, records that are skipped, error codes, replies to other queries, and every
+// truncation of a valid reply.
+
+#include "ntp_dns.h"
+#include <stdio.h>
+#include <string.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+#define TYPE_A          1
+#define TYPE_CNAME      5
+#define TYPE_AAAA       28
+#define CLASS_IN        1
+#define CLASS_CH        3
+#define ID              0xBEEF
+#define NAME            "pool.ntp.org"
+
+static const uint8_t s_to_question[] = { 0xC0, NTP_DNS_HEADER_SIZE };  // Pointer to the question name
+static const uint8_t s_addr1[] = { 192, 0, 2, 1 };
+static const uint8_t s_addr2[] = { 198, 51, 100, 7 };
+
+// Turn a query into the header of its reply (no error, recursion available)
+static size_t reply_begin(uint8_t *pkt, uint16_t id, const char *name)
+{
+    size_t len = ntp_dns_query(pkt, id, name);
+    pkt[2] |= 0x80;
+    pkt[3] = 0x80;
+    return len;
+}
+
+static size_t add_record(uint8_t *pkt, size_t len, const uint8_t *owner, size_t owner_len,
+                         uint16_t type, uint16_t class, uint32_t ttl, const uint8_t *data, uint16_t data_len)
+{
+    memcpy(&pkt[len], owner, owner_len);
+    len += owner_len;
+    uint8_t fixed[10] = {
+        type >> 8, type & 0xFF, class >> 8, class & 0xFF,
+        ttl >> 24, (ttl >> 16) & 0xFF, (ttl >> 8) & 0xFF, ttl & 0xFF,
+        data_len >> 8, data_len & 0xFF,
+    };
+    memcpy(&pkt[len], fixed, sizeof(fixed));
+    len += sizeof(fixed);
+    memcpy(&pkt[len], data, data_len);
+    len += data_len;
+    uint16_t answers = (uint16_t)(pkt[6] << 8 | pkt[7]) + 1;
+    pkt[6] = answers >> 8;
+    pkt[7] = answers & 0xFF;
+    return len;
+}
+
+static ntp_dns_reply_t parse(const uint8_t *pkt, size_t len, uint32_t *addr, uint32_t *ttl_s)
+{
+    return ntp_dns_parse(pkt, len, ID, NAME, addr, ttl_s);
+}
+
+static void test_query(void)
+{
+    uint8_t pkt[NTP_DNS_PACKET_MAX];
+    static const uint8_t expect[] = {
+        0xBE, 0xEF, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        4, 'p', 'o', 'o', 'l', 3, 'n', 't', 'p', 3, 'o', 'r', 'g', 0,
+        0x00, 0x01, 0x00, 0x01,
+    };
+    size_t len = ntp_dns_query(pkt, ID, NAME);
+    CHECK(len == sizeof(expect) && memcmp(pkt, expect, len) == 0, "query for " NAME " (%zu bytes)", len);
+    CHECK(ntp_dns_query(pkt, 1, "localhost") == NTP_DNS_HEADER_SIZE + 11 + 4, "single label");
+
+    static const char *const invalid[] = { "", ".", "a..b", ".ntp.org", "ntp.org.", "a.", };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CHECK(ntp_dns_query(pkt, ID, invalid[i]) == 0, "\"%s\" accepted", invalid[i]);
+    }
+
+    // Labels up to 63 characters, names up to 253
+    char name[300];
+    memset(name, 'a', 63);
+    strcpy(&name[63], ".org");
+    CHECK(ntp_dns_query(pkt, ID, name) == NTP_DNS_HEADER_SIZE + 1 + 63 + 4 + 1 + 4, "63-character label");
+    memset(name, 'a', 64);
+    strcpy(&name[64], ".org");
+    CHECK(ntp_dns_query(pkt, ID, name) == 0, "64-character label");
+    for (size_t i = 0; i < 253; i++) {
+        name[i] = i % 2 ? '.' : 'b';
+    }
+    name[253] = '\0';
+    CHECK(ntp_dns_query(pkt, ID, name) == NTP_DNS_HEADER_SIZE + 255 + 4, "253-character name");
+    CHECK(ntp_dns_query(pkt, ID, name) <= NTP_DNS_PACKET_MAX, "query size");
+    name[253] = 'b';
+    name[254] = '\0';
+    CHECK(ntp_dns_query(pkt, ID, name) == 0, "254-character name");
+}
+
+static void test_answers(void)
+{
+    uint8_t pkt[NTP_DNS_PACKET_MAX];
+    uint32_t addr, ttl;
+
+    // Plain A record
+    size_t len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 130, s_addr1, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && memcmp(&addr, s_addr1, 4) == 0 && ttl == 130,
+          "A record: ttl %u", ttl);
+
+    // Several A records: the first one
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 10, s_addr2, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && memcmp(&addr, s_addr1, 4) == 0 && ttl == 130,
+          "first A record: ttl %u", ttl);
+
+    // CNAME chain: the shortest TTL up to the A record, owner names uncompressed
+    static const uint8_t target[] = { 3, 'n', 't', 'p', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0 };
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_CNAME, CLASS_IN, 300, target, sizeof(target));
+    len = add_record(pkt, len, target, sizeof(target), TYPE_A, CLASS_IN, 3600, s_addr2, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && memcmp(&addr, s_addr2, 4) == 0 && ttl == 300,
+          "CNAME shorter: ttl %u", ttl);
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_CNAME, CLASS_IN, 300, target, sizeof(target));
+    len = add_record(pkt, len, target, sizeof(target), TYPE_A, CLASS_IN, 45, s_addr2, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && ttl == 45, "A shorter: ttl %u", ttl);
+
+    // Records that are not an IN A address are skipped
+    static const uint8_t aaaa[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_AAAA, CLASS_IN, 5, aaaa, sizeof(aaaa));
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_CH, 5, s_addr2, 4);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 5, aaaa, sizeof(aaaa));
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_NO_ADDRESS, "no IPv4 address yet");
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 900, s_addr1, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && memcmp(&addr, s_addr1, 4) == 0 && ttl == 900,
+          "A after skipped records: ttl %u", ttl);
+
+    // TTLs with the top bit set count as 0
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 0x80000001u, s_addr1, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && ttl == 0, "negative TTL: %u", ttl);
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 0x7FFFFFFFu, s_addr1, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK && ttl == 0x7FFFFFFFu, "largest TTL: %u", ttl);
+}
+
+static void test_rejected(void)
+{
+    uint8_t pkt[NTP_DNS_PACKET_MAX];
+    uint32_t addr, ttl;
+    size_t len;
+
+    // No answer, error codes
+    len = reply_begin(pkt, ID, NAME);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_NO_ADDRESS, "empty answer");
+    pkt[3] = 0x83;
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_NO_ADDRESS, "NXDOMAIN");
+    pkt[3] = 0x82;
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_NO_ADDRESS, "SERVFAIL");
+
+    // Replies to other queries
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_A, CLASS_IN, 60, s_addr1, 4);
+    CHECK(ntp_dns_parse(pkt, len, ID + 1, NAME, &addr, &ttl) == NTP_DNS_INVALID, "other ID");
+    CHECK(ntp_dns_parse(pkt, len, ID, "pool.ntp.org.uk", &addr, &ttl) == NTP_DNS_INVALID, "longer name");
+    CHECK(ntp_dns_parse(pkt, len, ID, "pool.ntp", &addr, &ttl) == NTP_DNS_INVALID, "shorter name");
+    CHECK(ntp_dns_parse(pkt, len, ID, "time.ntp.org", &addr, &ttl) == NTP_DNS_INVALID, "other name");
+    CHECK(ntp_dns_parse(pkt, len, ID, "POOL.Ntp.org", &addr, &ttl) == NTP_DNS_OK, "names ignore case");
+    pkt[2] &= 0x7F;
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_INVALID, "query instead of reply");
+    pkt[2] |= 0x80 | 0x10;
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_INVALID, "other opcode");
+
+    uint8_t other[NTP_DNS_PACKET_MAX];
+    len = ntp_dns_query(other, ID, NAME);
+    other[len - 3] = TYPE_AAAA;
+    other[2] |= 0x80;
+    CHECK(parse(other, len, &addr, &ttl) == NTP_DNS_INVALID, "AAAA question");
+
+    // Malformed owner names
+    static const uint8_t reserved_label[] = { 0x40, 0 };
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, reserved_label, sizeof(reserved_label), TYPE_A, CLASS_IN, 60, s_addr1, 4);
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_INVALID, "reserved label type");
+    static const uint8_t long_label[] = { 63, 'a' };
+    len = reply_begin(pkt, ID, NAME);
+    memcpy(&pkt[len], long_label, sizeof(long_label));
+    pkt[7] = 1;
+    CHECK(parse(pkt, len + sizeof(long_label), &addr, &ttl) == NTP_DNS_INVALID, "label past the end");
+
+    // Every truncation of a valid reply: no address until the A record is complete
+    static const uint8_t target[] = { 3, 'n', 't', 'p', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0 };
+    len = reply_begin(pkt, ID, NAME);
+    len = add_record(pkt, len, s_to_question, 2, TYPE_CNAME, CLASS_IN, 300, target, sizeof(target));
+    len = add_record(pkt, len, target, sizeof(target), TYPE_A, CLASS_IN, 60, s_addr2, 4);
+    for (size_t cut = 0; cut < len; cut++) {
+        CHECK(parse(pkt, cut, &addr, &ttl) == NTP_DNS_INVALID, "reply cut at %zu of %zu", cut, len);
+    }
+    CHECK(parse(pkt, len, &addr, &ttl) == NTP_DNS_OK, "full reply");
+}
+
+int main(void)
+{
+    test_query();
+    test_answers();
+    test_rejected();
+
+    printf("%u checks, %u failures\n", s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
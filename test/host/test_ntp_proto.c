@@ -0,0 +1,190 @@
+// Host test of main/lib/ntp_client/ntp_proto.h
+//
+// Timestamp conversion both ways (including the 2036 era rollover), requests and nonce
+// matching, reply checks (mode, Kiss-o'-Death, unsynchronized, implausible timestamps),
+// offset and delay of known exchanges, smoothed delays, race order and the clock filter.
+
+#include "ntp_proto.h"
+#include <stdio.h>
+#include <string.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+#define US_PER_S    1000000LL
+#define T_2024      1704067200LL    // 2024-01-01T00:00:00Z
+
+static const uint8_t s_nonce[NTP_NONCE_SIZE] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+
+// Server reply to a request carrying s_nonce
+static void make_reply(uint8_t *pkt, uint8_t li, uint8_t stratum, int64_t t2_us, int64_t t3_us)
+{
+    memset(pkt, 0, NTP_PACKET_SIZE);
+    pkt[NTP_LI_VN_MODE] = (uint8_t)((li << 6) | (NTP_VERSION << 3) | NTP_MODE_SERVER);
+    pkt[NTP_STRATUM] = stratum;
+    memcpy(&pkt[NTP_ORIGINATE_TS], s_nonce, NTP_NONCE_SIZE);
+    ntp_from_unix_us(t2_us, &pkt[NTP_RECEIVE_TS]);
+    ntp_from_unix_us(t3_us, &pkt[NTP_TRANSMIT_TS]);
+}
+
+static void test_timestamps(void)
+{
+    static const int64_t times_s[] = {
+        0, T_2024, 2085978495LL /* last second of era 0 */, 2085978496LL /* era 1 */, 4102444800LL /* 2100 */,
+    };
+    uint8_t ts[8];
+    for (size_t i = 0; i < sizeof(times_s) / sizeof(times_s[0]); i++) {
+        if (times_s[i] == 0) {
+            continue;  // 1970 is before 1968 + 2^31 s, i.e. read back as era 1
+        }
+        for (int64_t us = 0; us < US_PER_S; us += 999983) {
+            int64_t t = times_s[i] * US_PER_S + us;
+            ntp_from_unix_us(t, ts);
+            CHECK(ntp_to_unix_us(ts) == t, "round trip %lld us", (long long)t);
+        }
+    }
+
+    // Era 1 starts at 2036-02-07T06:28:16Z with seconds 0
+    static const uint8_t era1[8] = { 0 };
+    CHECK(ntp_to_unix_us(era1) == 2085978496LL * US_PER_S, "era 1 start %lld", (long long)ntp_to_unix_us(era1));
+    // Half a second
+    static const uint8_t half[8] = { 0xe9, 0x3c, 0x7c, 0x00 /* 2023-12-31 */, 0x80, 0, 0, 0 };
+    CHECK(ntp_to_unix_us(half) % US_PER_S == 500000, "fraction 0x80000000");
+}
+
+static void test_request(void)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    memset(pkt, 0xff, sizeof(pkt));
+    ntp_request(pkt, s_nonce);
+    CHECK(pkt[NTP_LI_VN_MODE] == ((NTP_VERSION << 3) | NTP_MODE_CLIENT), "li/vn/mode 0x%02x", pkt[0]);
+    CHECK(memcmp(&pkt[NTP_TRANSMIT_TS], s_nonce, NTP_NONCE_SIZE) == 0, "nonce as transmit timestamp");
+    bool zero = true;
+    for (size_t i = 1; i < NTP_TRANSMIT_TS; i++) {
+        zero &= pkt[i] == 0;
+    }
+    CHECK(zero, "rest of the request is zero");
+
+    make_reply(pkt, 0, 2, T_2024 * US_PER_S, T_2024 * US_PER_S);
+    CHECK(ntp_reply_matches(pkt, s_nonce), "matching nonce");
+    pkt[NTP_ORIGINATE_TS + 7] ^= 1;
+    CHECK(!ntp_reply_matches(pkt, s_nonce), "changed nonce");
+}
+
+static void test_parse(void)
+{
+    uint8_t pkt[NTP_PACKET_SIZE];
+    ntp_sample_t sample;
+    int64_t server = T_2024 * US_PER_S;
+
+    // Local clock 1.5 s behind, 10 ms out, 30 ms back, 2 ms in the server
+    int64_t t1 = server - 1500000;
+    int64_t t2 = server + 10000;
+    int64_t t3 = t2 + 2000;
+    int64_t t4 = t1 + 10000 + 2000 + 30000;
+    make_reply(pkt, 0, 2, t2, t3);
+    CHECK(ntp_parse(pkt, t1, t4, &sample) == NTP_REPLY_OK, "valid reply");
+    // Asymmetry of 20 ms shows up as half of it in the offset
+    CHECK(sample.offset_us == 1500000 - 10000, "offset %lld", (long long)sample.offset_us);
+    CHECK(sample.delay_us == 40000, "delay %lld", (long long)sample.delay_us);
+    CHECK(sample.t4_us == t4 && sample.stratum == 2, "t4 and stratum");
+
+    // Server time rounded above the measured round trip: delay clamps to 0
+    make_reply(pkt, 0, 1, server, server + 500);
+    CHECK(ntp_parse(pkt, server, server + 100, &sample) == NTP_REPLY_OK && sample.delay_us == 0,
+          "negative delay %lld", (long long)sample.delay_us);
+
+    make_reply(pkt, 0, 2, server, server);
+    pkt[NTP_LI_VN_MODE] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_INVALID, "client mode");
+
+    make_reply(pkt, 0, 0, server, server);
+    memcpy(&pkt[NTP_REF_ID], "RATE", 4);
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_KOD, "Kiss-o'-Death");
+
+    make_reply(pkt, NTP_LI_UNSYNCHRONIZED, 2, server, server);
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_UNSYNCHRONIZED, "leap indicator 3");
+    make_reply(pkt, 0, NTP_MAX_STRATUM + 1, server, server);
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_UNSYNCHRONIZED, "stratum 16");
+
+    make_reply(pkt, 0, 2, server, server - 1);
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_INVALID, "transmit before receive");
+    int64_t early = (NTP_MIN_UNIX_S - 1) * US_PER_S;
+    make_reply(pkt, 0, 2, early, early);
+    CHECK(ntp_parse(pkt, server, server, &sample) == NTP_REPLY_INVALID, "before 2020");
+}
+
+static void test_rtt(void)
+{
+    CHECK(ntp_smooth_rtt(0, 20000) == 20000, "first sample taken as is");
+    CHECK(ntp_smooth_rtt(20000, 60000) == 30000, "gain 1/4 up");
+    CHECK(ntp_smooth_rtt(20000, 0) == 15000, "gain 1/4 down");
+    CHECK(ntp_smooth_rtt(0, 0) == 1, "never 0");
+    CHECK(ntp_smooth_rtt(2, 0) == 2 && ntp_smooth_rtt(1, 0) == 1, "small values");
+    CHECK(ntp_smooth_rtt(0, 1LL << 40) == UINT32_MAX, "clamped");
+
+    uint32_t rtt = 0;
+    for (int i = 0; i < 100; i++) {
+        rtt = ntp_smooth_rtt(rtt, 35000);
+    }
+    CHECK(rtt == 35000, "converges %u", (unsigned)rtt);
+}
+
+static void test_race_order(void)
+{
+    uint8_t order[4];
+    static const uint32_t rtt[4] = { 0, 30000, 0, 10000 };
+    ntp_race_order(rtt, 4, order);
+    CHECK(order[0] == 3 && order[1] == 1 && order[2] == 0 && order[3] == 2,
+          "order %u %u %u %u", order[0], order[1], order[2], order[3]);
+
+    static const uint32_t equal[3] = { 5, 5, 5 };
+    ntp_race_order(equal, 3, order);
+    CHECK(order[0] == 0 && order[1] == 1 && order[2] == 2, "stable for equal delays");
+
+    ntp_race_order(rtt, 1, order);
+    CHECK(order[0] == 0, "single server");
+}
+
+static void test_filter(void)
+{
+    ntp_filter_t filter;
+    ntp_filter_reset(&filter);
+    ntp_sample_t s = { .offset_us = 100, .delay_us = 40000, .t4_us = 1, .stratum = 2 };
+    CHECK(ntp_filter_add(&filter, &s) && filter.count == 1, "first sample is best");
+    s = (ntp_sample_t){ .offset_us = 200, .delay_us = 50000, .t4_us = 2, .stratum = 2 };
+    CHECK(!ntp_filter_add(&filter, &s), "higher delay");
+    s = (ntp_sample_t){ .offset_us = 300, .delay_us = 20000, .t4_us = 3, .stratum = 1 };
+    CHECK(ntp_filter_add(&filter, &s), "lower delay");
+    s = (ntp_sample_t){ .offset_us = 400, .delay_us = 20000, .t4_us = 4, .stratum = 3 };
+    CHECK(!ntp_filter_add(&filter, &s), "equal delay keeps the earlier sample");
+    CHECK(filter.count == 4 && filter.best.offset_us == 300 && filter.best.stratum == 1,
+          "best %lld of %u", (long long)filter.best.offset_us, filter.count);
+
+    ntp_filter_reset(&filter);
+    CHECK(filter.count == 0, "reset");
+}
+
+int main(void)
+{
+    test_timestamps();
+    test_request();
+    test_parse();
+    test_rtt();
+    test_race_order();
+    test_filter();
+
+    printf("%u checks, %u failures\n", s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+// Host test of main/lib/ota_update/ota_package.h
+//
+// The streaming heatshrink decoder against a reference encoder (greedy LZSS in the same
+// format as tools/ota_pack.py): generated images with literals, long runs and far
+// back-references, fed in random chunk sizes (fixed seeds, so failures reproduce) and one
+// byte at a time. Checks the output, the sink segments (never empty, at most half a
+// window), the overflow and truncation paths and a failing sink. Then the version parser
+// and the application description lookup behind the anti-downgrade check.
+
+#include "ota_package.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+#define MAX_IMAGE       65536
+#define MAX_MATCH       (1 << OTA_LOOKAHEAD_BITS)
+#define MIN_MATCH       2
+#define RECV_CHUNK      1024    // OTA_RECV_CHUNK
+#define SEEDS           16
+
+static uint32_t s_rand;
+
+static uint32_t xorshift32(void)
+{
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+// Reference encoder
+
+typedef struct {
+    uint8_t *out;
+    size_t len;
+    uint32_t acc;
+    int count;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t value, int bits)
+{
+    for (int i = bits - 1; i >= 0; i--) {
+        w->acc = (w->acc << 1) | ((value >> i) & 1);
+        if (++w->count == 8) {
+            w->out[w->len++] = (uint8_t)w->acc;
+            w->acc = 0;
+            w->count = 0;
+        }
+    }
+}
+
+static size_t compress(const uint8_t *data, size_t n, uint8_t *out)
+{
+    bit_writer_t w = { .out = out };
+    size_t i = 0;
+    while (i < n) {
+        size_t best_len = 0, best_off = 0;
+        size_t limit = n - i < MAX_MATCH ? n - i : MAX_MATCH;
+        for (size_t off = 1; off <= OTA_WINDOW_SIZE && off <= i; off++) {
+            size_t len = 0;
+            while (len < limit && data[i - off + len] == data[i + len]) {
+                len++;  // Overlapping matches (off < len) repeat the last off bytes
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_off = off;
+                if (len == limit) {
+                    break;
+                }
+            }
+        }
+        if (best_len >= MIN_MATCH) {
+            put_bits(&w, 0, 1);
+            put_bits(&w, (uint32_t)(best_off - 1), OTA_WINDOW_BITS);
+            put_bits(&w, (uint32_t)(best_len - 1), OTA_LOOKAHEAD_BITS);
+            i += best_len;
+        } else {
+            put_bits(&w, 0x100 | data[i], 9);
+            i++;
+        }
+    }
+    if (w.count) {
+        put_bits(&w, 0, 8 - w.count);  // Padding, ignored by the decoder
+    }
+    return w.len;
+}
+
+// Image with random literals, runs (overlapping references) and copies from up to a window back
+static void make_image(uint8_t *data, size_t n)
+{
+    size_t i = 0;
+    while (i < n) {
+        size_t len = 1 + xorshift32() % 40;
+        if (len > n - i) {
+            len = n - i;
+        }
+        switch (xorshift32() % 4) {
+        case 0:
+            for (size_t k = 0; k < len; k++) {
+                data[i + k] = (uint8_t)xorshift32();
+            }
+            break;
+        case 1:
+            memset(data + i, (int)(xorshift32() % 3 ? 0xff : xorshift32()), len);
+            break;
+        default: {
+            size_t back = 1 + xorshift32() % (OTA_WINDOW_SIZE + 64);  // Sometimes beyond the window
+            for (size_t k = 0; k < len; k++) {
+                data[i + k] = i + k >= back ? data[i + k - back] : (uint8_t)k;
+            }
+            break;
+        }
+        }
+        i += len;
+    }
+}
+
+// Sink: collects the output
+
+typedef struct {
+    uint8_t *out;
+    size_t len;
+    unsigned calls;
+    unsigned fail_at;           // Call that returns an error (0 = never)
+    size_t max_segment;
+    bool empty_segment;
+} sink_t;
+
+static int collect(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *sink = ctx;
+    sink->calls++;
+    if (sink->fail_at && sink->calls == sink->fail_at) {
+        return 0x105;  // ESP_ERR_NOT_FOUND, any non-zero value
+    }
+    if (len == 0) {
+        sink->empty_segment = true;
+    }
+    if (len > sink->max_segment) {
+        sink->max_segment = len;
+    }
+    memcpy(sink->out + sink->len, data, len);
+    sink->len += len;
+    return 0;
+}
+
+static uint8_t s_image[MAX_IMAGE];
+static uint8_t s_packed[MAX_IMAGE * 9 / 8 + 16];
+static uint8_t s_output[MAX_IMAGE];
+static ota_decoder_t s_dec;
+
+// Feed the stream in chunks of 1..max_chunk bytes (max_chunk 1: byte by byte)
+static void decode(const uint8_t *packed, size_t packed_len, uint32_t limit, size_t max_chunk, sink_t *sink)
+{
+    memset(sink, 0, sizeof(*sink));
+    sink->out = s_output;
+    ota_decoder_init(&s_dec, limit, collect, sink);
+    size_t pos = 0;
+    while (pos < packed_len && !ota_decoder_failed(&s_dec)) {
+        size_t chunk = 1 + xorshift32() % max_chunk;
+        if (chunk > packed_len - pos) {
+            chunk = packed_len - pos;
+        }
+        ota_decoder_feed(&s_dec, packed + pos, chunk);
+        pos += chunk;
+    }
+    ota_decoder_finish(&s_dec);
+}
+
+static void test_round_trip(void)
+{
+    static const size_t sizes[] = { 1, 2, 100, 1023, 1024, 1025, 2047, 2048, 2049, 5000, 20000, MAX_IMAGE };
+    for (uint32_t seed = 1; seed <= SEEDS; seed++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            s_rand = seed * 2654435761u;
+            size_t n = sizes[s];
+            make_image(s_image, n);
+            size_t packed_len = compress(s_image, n, s_packed);
+
+            static const size_t max_chunks[] = { 1, 7, RECV_CHUNK };
+            for (size_t c = 0; c < sizeof(max_chunks) / sizeof(max_chunks[0]); c++) {
+                sink_t sink;
+                decode(s_packed, packed_len, (uint32_t)n, max_chunks[c], &sink);
+                CHECK(!ota_decoder_failed(&s_dec) && s_dec.written == n && sink.len == n,
+                      "seed %u, %zu bytes, chunks <= %zu: wrote %u, sink %zu", seed, n, max_chunks[c],
+                      s_dec.written, sink.len);
+                CHECK(memcmp(s_output, s_image, n) == 0, "seed %u, %zu bytes, chunks <= %zu: output differs",
+                      seed, n, max_chunks[c]);
+                CHECK(!sink.empty_segment && sink.max_segment <= OTA_FLUSH_SIZE,
+                      "seed %u: segment of %zu bytes", seed, sink.max_segment);
+            }
+        }
+    }
+}
+
+static void test_errors(void)
+{
+    s_rand = 12345;
+    size_t n = 20000;
+    make_image(s_image, n);
+    size_t packed_len = compress(s_image, n, s_packed);
+    sink_t sink;
+
+    // More output than announced: stops at the limit; the segment in progress is dropped
+    // (the upload is aborted anyway)
+    decode(s_packed, packed_len, (uint32_t)n - 1, RECV_CHUNK, &sink);
+    CHECK(s_dec.overflow && s_dec.written == n - 1 && sink.len <= n - 1 && sink.len + OTA_FLUSH_SIZE > n - 1,
+          "overflow: wrote %u, sink %zu", s_dec.written, sink.len);
+    CHECK(memcmp(s_output, s_image, sink.len) == 0, "overflow: output differs");
+
+    // Truncated stream: no failure, but short
+    decode(s_packed, packed_len / 2, (uint32_t)n, RECV_CHUNK, &sink);
+    CHECK(!ota_decoder_failed(&s_dec) && s_dec.written < n && sink.len == s_dec.written,
+          "truncated: wrote %u, sink %zu", s_dec.written, sink.len);
+    CHECK(memcmp(s_output, s_image, sink.len) == 0, "truncated: output differs");
+
+    // Failing sink (flash write): decoding stops, the error is kept
+    memset(&sink, 0, sizeof(sink));
+    sink.out = s_output;
+    sink.fail_at = 3;
+    ota_decoder_init(&s_dec, (uint32_t)n, collect, &sink);
+    ota_decoder_feed(&s_dec, s_packed, packed_len);
+    ota_decoder_finish(&s_dec);
+    CHECK(s_dec.sink_error == 0x105 && ota_decoder_failed(&s_dec), "sink error %d", s_dec.sink_error);
+    CHECK(sink.calls == 3 && sink.len == 2 * OTA_FLUSH_SIZE, "sink calls %u after the error, %zu bytes",
+          sink.calls, sink.len);
+    unsigned calls = sink.calls;
+    ota_decoder_feed(&s_dec, s_packed, packed_len);
+    CHECK(sink.calls == calls, "fed after the error");
+
+    // Back-reference before the start of the image reads the zeroed window
+    static const uint8_t zero_ref[] = { 0x00, 0x00, 0x00 };  // Offset 1, count 1, then padding
+    decode(zero_ref, sizeof(zero_ref), 1, RECV_CHUNK, &sink);
+    CHECK(s_dec.written == 1 && sink.len == 1 && s_output[0] == 0, "reference before the start");
+}
+
+static void test_versions(void)
+{
+    static const struct {
+        const char *text;
+        bool ok;
+        uint32_t version;
+    } cases[] = {
+        { "1.0.0", true, 1u << 20 },
+        { "v1.2.3", true, 1u << 20 | 2u << 10 | 3 },
+        { "2", true, 2u << 20 },
+        { "2.1", true, 2u << 20 | 1u << 10 },
+        { "1.0.0-rc1", true, 1u << 20 },
+        { "1.10.0+build5", true, 1u << 20 | 10u << 10 },
+        { "1023.1023.1023", true, 0x3fffffffu },
+        { "1024.0.0", false, 0 },
+        { "4de1ac9", false, 0 },
+        { "v", false, 0 },
+        { "", false, 0 },
+        { "1.", false, 0 },
+        { "1..2", false, 0 },
+        { "1.2.3.4", false, 0 },
+        { "1.0.0-3-g4de1ac9-dirty", true, 1u << 20 },
+        { "x1.0", false, 0 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint32_t v = 0;
+        bool ok = ota_version_parse(cases[i].text, 32, &v);
+        CHECK(ok == cases[i].ok && (!ok || v == cases[i].version), "\"%s\": %d 0x%08x", cases[i].text, ok, v);
+    }
+
+    uint32_t a, b;
+    CHECK(ota_version_parse("1.9.9", 32, &a) && ota_version_parse("1.10.0", 32, &b) && a < b, "1.9.9 < 1.10.0");
+    CHECK(ota_version_parse("1.2.3", 3, &a) && a == (1u << 20 | 2u << 10), "not NUL-terminated: \"1.2\"");
+
+    // Application description in an image
+    uint8_t image[OTA_APP_DESC_MIN_SIZE + 16];
+    memset(image, 0, sizeof(image));
+    image[0] = 0xE9;
+    image[OTA_APP_DESC_OFFSET + 0] = 0x32;
+    image[OTA_APP_DESC_OFFSET + 1] = 0x54;
+    image[OTA_APP_DESC_OFFSET + 2] = 0xCD;
+    image[OTA_APP_DESC_OFFSET + 3] = 0xAB;
+    memset(image + OTA_APP_VERSION_OFFSET, 'x', OTA_APP_VERSION_LEN);  // Not NUL-terminated
+    memcpy(image + OTA_APP_VERSION_OFFSET, "1.2.0", 6);
+    CHECK(ota_image_version(image, sizeof(image), &a) && a == (1u << 20 | 2u << 10), "image version");
+    CHECK(!ota_image_version(image, OTA_APP_DESC_MIN_SIZE - 1, &a), "image too short");
+    memcpy(image + OTA_APP_VERSION_OFFSET, "1.2.0-", 6);
+    CHECK(ota_image_version(image, sizeof(image), &a), "full-length version field with suffix");
+    image[OTA_APP_DESC_OFFSET] = 0;
+    CHECK(!ota_image_version(image, sizeof(image), &a), "no application description");
+}
+
+int main(void)
+{
+    test_round_trip();
+    test_errors();
+    test_versions();
+
+    printf("%u checks, %u failures\n", s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
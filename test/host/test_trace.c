@@ -0,0 +1,397 @@
+// Host test of main/lib/trace/trace.c (built unmodified against the stubs in stubs/)
+//
+// The test plays the scheduler and the clock: it picks the current task and the esp_timer
+// time, and captures what trace_http_handler sends. Dumps are decoded the way
+// tools/trace_decode.py does it. Covered: task slots (a task recreated under the same name
+// keeps its slot, long names, slots running out, interrupts), ring overwrite with the dump
+// sent oldest first in two segments, no records while a dump is sent, a failed send, the
+// 32-bit timestamp wrap, and a torn record (a dump taken while a record is half-written).
+//
+// With a file argument, the dump holding the torn record is written there; the
+// trace_decode test decodes it with tools/trace_decode.py.
+
+#include "trace.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static unsigned s_checks = 0;
+static unsigned s_failures = 0;
+
+#define CHECK(cond, ...) do {                                   \
+        s_checks++;                                             \
+        if (!(cond)) {                                          \
+            if (s_failures++ < 20) {                            \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+                printf(__VA_ARGS__);                            \
+                printf("\n");                                   \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+#define HEADER_SIZE     24
+#define NAMES_SIZE      (TRACE_TASKS * TRACE_TASK_NAME)
+#define DUMP_MAX        (HEADER_SIZE + NAMES_SIZE + TRACE_RECORDS * sizeof(trace_record_t))
+#define WRAP_BASE_US    ((1LL << 32) - 30020)   // Record 300 of test_wrap spans the wrap
+#define WRAP_RECORDS    600
+#define WRAP_STEP_US    100
+
+typedef struct {
+    uint8_t data[DUMP_MAX];
+    size_t len;
+    unsigned chunks;
+    bool ended;             // Terminating empty chunk seen
+    // Decoded
+    uint32_t written;
+    uint32_t count;
+    int64_t now_us;
+    const trace_record_t *records;
+} dump_t;
+
+// Scheduler and clock
+struct tskTaskControlBlock {
+    char name[32];
+};
+
+static struct tskTaskControlBlock *s_current;
+static bool s_isr = false;
+static int64_t s_now_us = 1000000;
+
+// Capture
+static dump_t *s_capture;
+static unsigned s_fail_chunk = 0;       // Chunk number to fail (1-based), 0: none
+static bool s_tear = false;             // Dump while the next record is half-written
+static dump_t s_torn;
+
+static esp_err_t take_dump(dump_t *dump);
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+// trace_write asks for the task index between stamping a record and setting its phase:
+// a dump taken here sees the record torn
+BaseType_t xPortInIsrContext(void)
+{
+    if (s_tear) {
+        s_tear = false;
+        dump_t *outer = s_capture;
+        take_dump(&s_torn);
+        s_capture = outer;
+    }
+    return s_isr;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    return task->name;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)ticks;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type)
+{
+    (void)req;
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value)
+{
+    (void)req;
+    (void)field;
+    (void)value;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len)
+{
+    (void)req;
+    dump_t *dump = s_capture;
+    dump->chunks++;
+    // Another task recording while the dump is sent: dropped
+    TRACE_INSTANT(TRACE_EV_IP_EVENT, 0xDEAD, 0);
+    if (dump->chunks == s_fail_chunk) {
+        return ESP_FAIL;
+    }
+    CHECK(!dump->ended, "chunk after the end");
+    if (buf == NULL || buf_len == 0) {
+        dump->ended = true;
+        return ESP_OK;
+    }
+    CHECK(dump->len + (size_t)buf_len <= DUMP_MAX, "dump longer than %zu bytes", (size_t)DUMP_MAX);
+    if (dump->len + (size_t)buf_len <= DUMP_MAX) {
+        memcpy(dump->data + dump->len, buf, (size_t)buf_len);
+        dump->len += (size_t)buf_len;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t take_dump(dump_t *dump)
+{
+    memset(dump, 0, sizeof(*dump));
+    s_capture = dump;
+    esp_err_t ret = trace_http_handler(NULL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Header and layout as read by tools/trace_decode.py (the host is little-endian)
+    CHECK(dump->ended, "no terminating chunk");
+    CHECK(dump->len >= HEADER_SIZE + NAMES_SIZE, "dump of %zu bytes", dump->len);
+    CHECK(memcmp(dump->data, "PXTR", 4) == 0 && dump->data[4] == 1, "magic or version");
+    CHECK(dump->data[5] == sizeof(trace_record_t) && dump->data[6] == TRACE_TASKS, "record size or tasks");
+    memcpy(&dump->written, dump->data + 8, sizeof(dump->written));
+    memcpy(&dump->count, dump->data + 12, sizeof(dump->count));
+    memcpy(&dump->now_us, dump->data + 16, sizeof(dump->now_us));
+    CHECK(dump->count == (dump->written < TRACE_RECORDS ? dump->written : TRACE_RECORDS),
+          "%u records of %u written", dump->count, dump->written);
+    CHECK(dump->len == HEADER_SIZE + NAMES_SIZE + dump->count * sizeof(trace_record_t),
+          "dump of %zu bytes for %u records", dump->len, dump->count);
+    CHECK(dump->now_us == s_now_us, "dump time");
+    dump->records = (const trace_record_t *)(dump->data + HEADER_SIZE + NAMES_SIZE);
+    return ESP_OK;
+}
+
+static const char *task_name(const dump_t *dump, unsigned slot)
+{
+    return (const char *)dump->data + HEADER_SIZE + slot * TRACE_TASK_NAME;
+}
+
+static const trace_record_t *last_record(const dump_t *dump)
+{
+    return &dump->records[dump->count - 1];
+}
+
+// Full esp_timer time of a record, as tools/trace_decode.py reconstructs it
+static int64_t record_time(const dump_t *dump, const trace_record_t *record)
+{
+    uint32_t age = (uint32_t)dump->now_us - record->ts_us;
+    return dump->now_us - age;
+}
+
+static struct tskTaskControlBlock *task(const char *name)
+{
+    static struct tskTaskControlBlock tasks[16];
+    static unsigned created = 0;
+    struct tskTaskControlBlock *t = &tasks[created++];
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    return t;
+}
+
+// Slot of a record written by the current task
+static uint8_t record_slot(void)
+{
+    static dump_t dump;
+    TRACE_INSTANT(TRACE_EV_WIFI_EVENT, 0, 0);
+    take_dump(&dump);
+    // The dump's own record comes after the dump
+    return last_record(&dump)->task;
+}
+
+static void test_tasks(void)
+{
+    static dump_t dump;
+    struct tskTaskControlBlock *main_task = task("main");
+    struct tskTaskControlBlock *net = task("net");
+    struct tskTaskControlBlock *ntp_sync = task("ntp_sync");
+
+    s_current = main_task;
+    TRACE_BEGIN(TRACE_EV_DISPLAY);
+    s_current = net;
+    TRACE_INSTANT(TRACE_EV_WIFI_EVENT, 4, 0);
+    s_current = ntp_sync;
+    TRACE_BEGIN(TRACE_EV_NTP_SYNC);
+    TRACE_END(TRACE_EV_NTP_SYNC, -1);
+    s_current = main_task;
+    TRACE_END(TRACE_EV_DISPLAY, 0);
+    take_dump(&dump);
+
+    CHECK(dump.written == 5 && dump.count == 5, "written %u, count %u", dump.written, dump.count);
+    CHECK(dump.chunks == 4, "%u chunks for a ring that did not wrap", dump.chunks);
+    CHECK(strcmp(task_name(&dump, 0), "main") == 0 && strcmp(task_name(&dump, 1), "net") == 0 &&
+          strcmp(task_name(&dump, 2), "ntp_sync") == 0 && task_name(&dump, 3)[0] == '\0' &&
+          strcmp(task_name(&dump, TRACE_TASKS - 1), "other") == 0, "task names");
+    static const struct {
+        uint8_t event, phase, task;
+        uint32_t arg0;
+    } expect[] = {
+        { TRACE_EV_DISPLAY, TRACE_PH_BEGIN, 0, 0 },
+        { TRACE_EV_WIFI_EVENT, TRACE_PH_INSTANT, 1, 4 },
+        { TRACE_EV_NTP_SYNC, TRACE_PH_BEGIN, 2, 0 },
+        { TRACE_EV_NTP_SYNC, TRACE_PH_END, 2, UINT32_MAX },
+        { TRACE_EV_DISPLAY, TRACE_PH_END, 0, 0 },
+    };
+    for (unsigned i = 0; i < 5; i++) {
+        const trace_record_t *r = &dump.records[i];
+        CHECK(r->event == expect[i].event && r->phase == expect[i].phase && r->task == expect[i].task &&
+              r->arg0 == expect[i].arg0, "record %u: event %u, phase %c, task %u, arg0 %u",
+              i, r->event, r->phase, r->task, r->arg0);
+    }
+
+    // ntp_sync is deleted and created again on every sync: same slot, no new one
+    s_current = task("ntp_sync");
+    CHECK(record_slot() == 2, "recreated task");
+
+    s_isr = true;
+    CHECK(record_slot() == TRACE_TASK_ISR, "interrupt");
+    s_isr = false;
+
+    // Long names are cut to TRACE_TASK_NAME - 1 characters and still match when recreated
+    s_current = task("tz");
+    CHECK(record_slot() == 3, "fourth task");
+    s_current = task("display");
+    CHECK(record_slot() == 4, "fifth task");
+    s_current = task("httpd");
+    CHECK(record_slot() == 5, "sixth task");
+    s_current = task("a_very_long_task_name");
+    CHECK(record_slot() == 6, "seventh task");
+    s_current = task("a_very_long_task_name");
+    CHECK(record_slot() == 6, "recreated long name");
+
+    // Slots ran out
+    s_current = task("late");
+    CHECK(record_slot() == TRACE_TASKS - 1, "first task without a slot");
+    s_current = task("later");
+    CHECK(record_slot() == TRACE_TASKS - 1, "second task without a slot");
+    s_current = main_task;
+    CHECK(record_slot() == 0, "first task again");
+
+    take_dump(&dump);
+    CHECK(strcmp(task_name(&dump, 6), "a_very_long_tas") == 0, "long name \"%s\"", task_name(&dump, 6));
+    CHECK(strcmp(task_name(&dump, TRACE_TASKS - 1), "other") == 0, "other slot renamed");
+}
+
+static void test_overwrite(void)
+{
+    static dump_t before, after, again;
+    take_dump(&before);
+    for (uint32_t i = 0; i < 1000; i++) {
+        s_now_us += 10;
+        TRACE_INSTANT(TRACE_EV_FRAME, i, 0);
+    }
+    take_dump(&after);
+
+    // 1000 records and the previous dump's own one since the first dump
+    CHECK(after.written == before.written + 1001, "written %u after %u", after.written, before.written);
+    CHECK(after.count == TRACE_RECORDS, "count %u", after.count);
+    uint32_t first = (after.written - TRACE_RECORDS) & (TRACE_RECORDS - 1);
+    CHECK(first != 0 && after.chunks == 5, "%u chunks, oldest record in slot %u", after.chunks, first);
+    bool ordered = true;
+    for (uint32_t i = 0; i < TRACE_RECORDS; i++) {
+        const trace_record_t *r = &after.records[i];
+        ordered &= r->event == TRACE_EV_FRAME && r->arg0 == 1000 - TRACE_RECORDS + i;
+    }
+    CHECK(ordered, "records not the last %u, oldest first", TRACE_RECORDS);
+
+    // Nothing is recorded while a dump is sent (send_chunk tries): only the dump's own record
+    take_dump(&again);
+    CHECK(again.written == after.written + 1, "written %u after %u", again.written, after.written);
+    const trace_record_t *r = last_record(&again);
+    CHECK(r->event == TRACE_EV_DUMP && r->phase == TRACE_PH_INSTANT && r->arg0 == TRACE_RECORDS,
+          "dump record: event %u, arg0 %u", r->event, r->arg0);
+}
+
+static void test_send_error(void)
+{
+    static dump_t before, failed, after;
+    take_dump(&before);
+    s_fail_chunk = 3;
+    CHECK(take_dump(&failed) == ESP_FAIL, "failed send not reported");
+    s_fail_chunk = 0;
+
+    // No dump record for the failed dump, and tracing resumed
+    TRACE_INSTANT(TRACE_EV_FRAME, 1, 0);
+    take_dump(&after);
+    CHECK(after.written == before.written + 2, "written %u after %u", after.written, before.written);
+    CHECK(last_record(&after)->event == TRACE_EV_FRAME, "tracing not resumed");
+}
+
+static void test_wrap(void)
+{
+    static dump_t dump;
+    for (uint32_t k = 0; k < WRAP_RECORDS; k++) {
+        int64_t start = WRAP_BASE_US + (int64_t)k * WRAP_STEP_US;
+        s_now_us = start + WRAP_STEP_US / 2;
+        TRACE_COMPLETE(TRACE_EV_LOOP, start, k);
+    }
+    s_now_us = WRAP_BASE_US + WRAP_RECORDS * WRAP_STEP_US;
+    take_dump(&dump);
+
+    CHECK(dump.records[0].ts_us > last_record(&dump)->ts_us, "ring does not span the wrap");
+    bool exact = true;
+    for (uint32_t i = 0; i < dump.count; i++) {
+        const trace_record_t *r = &dump.records[i];
+        uint32_t k = WRAP_RECORDS - TRACE_RECORDS + i;
+        int64_t t = record_time(&dump, r);
+        if (r->arg0 != k || t != WRAP_BASE_US + (int64_t)k * WRAP_STEP_US || r->arg1 != WRAP_STEP_US / 2) {
+            if (exact) {
+                printf("record %u: arg0 %u, time %lld, duration %u\n", i, r->arg0, (long long)t, r->arg1);
+            }
+            exact = false;
+        }
+    }
+    CHECK(exact, "times or durations across the wrap");
+}
+
+static void test_torn(void)
+{
+    static dump_t after;
+    s_current = task("torn");
+    s_now_us += 1000;
+    s_tear = true;
+    TRACE_BEGIN(TRACE_EV_DISPLAY);
+    CHECK(!s_tear && s_torn.ended, "no dump while the record was written");
+
+    // The half-written record is the newest one in the dump, with phase 0
+    const trace_record_t *r = last_record(&s_torn);
+    CHECK(r->phase == 0 && r->event == TRACE_EV_DISPLAY && r->ts_us == (uint32_t)s_now_us,
+          "torn record: phase %u, event %u", r->phase, r->event);
+    unsigned incomplete = 0;
+    for (uint32_t i = 0; i < s_torn.count; i++) {
+        incomplete += s_torn.records[i].phase == 0;
+    }
+    CHECK(incomplete == 1, "%u incomplete records", incomplete);
+
+    // The writer finished it after the dump, whose own record was claimed next
+    take_dump(&after);
+    r = &after.records[after.count - 2];
+    CHECK(r->phase == TRACE_PH_BEGIN && r->event == TRACE_EV_DISPLAY && r->task == TRACE_TASKS - 1,
+          "finished record: phase %u, event %u, task %u", r->phase, r->event, r->task);
+    CHECK(last_record(&after)->event == TRACE_EV_DUMP, "dump record");
+}
+
+int main(int argc, char **argv)
+{
+    test_tasks();
+    test_overwrite();
+    test_send_error();
+    test_wrap();
+    test_torn();
+
+    if (argc > 1) {
+        FILE *f = fopen(argv[1], "wb");
+        CHECK(f != NULL && fwrite(s_torn.data, 1, s_torn.len, f) == s_torn.len, "writing %s", argv[1]);
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+
+    printf("%u checks, %u failures\n", s_checks, s_failures);
+    return s_failures ? 1 : 0;
+}
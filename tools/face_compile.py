@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Compile clock face layouts into the constant tables used by main/lib/face.
+
+Input is a JSON file with a list of faces:
+
+  {"faces": [{"name": "classic", "shift": [1, 1], "elements": [
+      {"field": "time", "x": 12, "y": 34, "size": 4, "chars": 5, "align": "left"}, ...]}]}
+
+- field: time, date, weekday or temp (each at most once per face)
+- x, y: anchor and top edge in pixels; with "align" right x is one past the right
+  edge, with center it is the centre (default left: x is the left edge)
+- size: font scale of ssd1306_draw_string() (5x7 glyphs)
+- chars: longest text shown, the layout is checked for it
+- shift: burn-in pixel shift range [x, y], the face moves by up to +-shift
+
+Every element's box is computed here with the firmware's font metrics. A face is
+rejected if an element leaves the screen anywhere in its shift range or two
+elements overlap, so the firmware never clamps coordinates. The first face is
+the fallback when the selected one is not compiled in.
+
+Usage: face_compile.py <faces.json> <output.c>
+"""
+
+import json
+import sys
+
+# Keep in sync with main/lib/ssd1306 (screen size, 5x7 font, ssd1306_draw_string() spacing)
+WIDTH = 128
+HEIGHT = 64
+GLYPH_WIDTH = 5
+GLYPH_HEIGHT = 7
+SIZE_MAX = 8
+
+# Keep in sync with main/lib/face/face.h
+NAME_MAX_LEN = 16
+FIELDS = {'time': 'FACE_FIELD_TIME', 'date': 'FACE_FIELD_DATE',
+          'weekday': 'FACE_FIELD_WEEKDAY', 'temp': 'FACE_FIELD_TEMP'}
+ALIGNS = {'left': 'FACE_ALIGN_LEFT', 'right': 'FACE_ALIGN_RIGHT', 'center': 'FACE_ALIGN_CENTER'}
+
+
+class LayoutError(Exception):
+    pass
+
+
+def spacing(size):
+    """Pixels between characters: large fonts are drawn compact."""
+    return 1 if size >= 4 else size
+
+
+def integer(element, key, low, high, default=None):
+    value = element.get(key, default)
+    if not isinstance(value, int) or isinstance(value, bool) or not low <= value <= high:
+        raise LayoutError('%s must be an integer from %d to %d' % (key, low, high))
+    return value
+
+
+def compile_element(element):
+    field = element.get('field')
+    if field not in FIELDS:
+        raise LayoutError('unknown field %r (expected %s)' % (field, ', '.join(FIELDS)))
+    align = element.get('align', 'left')
+    if align not in ALIGNS:
+        raise LayoutError('%s: unknown align %r' % (field, align))
+    try:
+        x = integer(element, 'x', 0, WIDTH)
+        y = integer(element, 'y', 0, HEIGHT - 1)
+        size = integer(element, 'size', 1, SIZE_MAX)
+        chars = integer(element, 'chars', 1, 32)
+    except LayoutError as e:
+        raise LayoutError('%s: %s' % (field, e))
+
+    advance = GLYPH_WIDTH * size + spacing(size)
+    width = chars * advance - spacing(size)
+    if align == 'left':
+        left = x
+    elif align == 'right':
+        left = x - width
+    else:
+        left = x - width // 2
+    box = (left, y, left + width, y + GLYPH_HEIGHT * size)
+    return {'field': field, 'align': align, 'x': x, 'y': y, 'size': size,
+            'advance': advance, 'spacing': spacing(size), 'chars': chars, 'box': box}
+
+
+def compile_face(face):
+    name = face.get('name')
+    if not isinstance(name, str) or not name or len(name) >= NAME_MAX_LEN:
+        raise LayoutError('face name must be 1 to %d characters' % (NAME_MAX_LEN - 1))
+    shift = face.get('shift', [0, 0])
+    if (not isinstance(shift, list) or len(shift) != 2 or
+            not all(isinstance(s, int) and 0 <= s <= 8 for s in shift)):
+        raise LayoutError('%s: shift must be [x, y] with 0 to 8 pixels each' % name)
+    if not face.get('elements'):
+        raise LayoutError('%s: no elements' % name)
+
+    elements = []
+    for element in face['elements']:
+        try:
+            compiled = compile_element(element)
+        except LayoutError as e:
+            raise LayoutError('%s: %s' % (name, e))
+        if any(e['field'] == compiled['field'] for e in elements):
+            raise LayoutError('%s: %s appears twice' % (name, compiled['field']))
+        left, top, right, bottom = compiled['box']
+        if left - shift[0] < 0 or right + shift[0] > WIDTH or top - shift[1] < 0 or bottom + shift[1] > HEIGHT:
+            raise LayoutError('%s: %s (x %d-%d, y %d-%d) leaves the %dx%d screen when shifted by %d, %d' % (
+                name, compiled['field'], left, right - 1, top, bottom - 1, WIDTH, HEIGHT, shift[0], shift[1]))
+        for other in elements:
+            o_left, o_top, o_right, o_bottom = other['box']
+            if left < o_right and o_left < right and top < o_bottom and o_top < bottom:
+                raise LayoutError('%s: %s overlaps %s' % (name, compiled['field'], other['field']))
+        elements.append(compiled)
+    return name, shift, elements
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+
+    with open(sys.argv[1]) as f:
+        try:
+            faces = json.load(f).get('faces', [])
+        except ValueError as e:
+            sys.exit('%s: %s' % (sys.argv[1], e))
+    if not faces:
+        sys.exit('%s: no faces' % sys.argv[1])
+
+    compiled = []
+    for face in faces:
+        try:
+            compiled.append(compile_face(face))
+        except LayoutError as e:
+            sys.exit('%s: %s' % (sys.argv[1], e))
+        if [c[0] for c in compiled].count(compiled[-1][0]) > 1:
+            sys.exit('%s: face %s defined twice' % (sys.argv[1], compiled[-1][0]))
+
+    out = []
+    out.append('// Generated by tools/face_compile.py from %s, do not edit' % sys.argv[1].replace('\\', '/').split('/')[-1])
+    out.append('')
+    out.append('#include "face.h"')
+    out.append('')
+    for name, shift, elements in compiled:
+        out.append('static const face_element_t face_%s[%d] = {' % (
+            ''.join(c if c.isalnum() else '_' for c in name), len(elements)))
+        for e in elements:
+            left, top, right, bottom = e['box']
+            out.append('    {%s, %s, %d, %d, %d, %d, %d, %d},  // x %d-%d, y %d-%d' % (
+                FIELDS[e['field']], ALIGNS[e['align']], e['x'], e['y'], e['size'],
+                e['advance'], e['spacing'], e['chars'], left, right - 1, top, bottom - 1))
+        out.append('};')
+        out.append('')
+    out.append('const face_t face_faces[] = {')
+    for name, shift, elements in compiled:
+        out.append('    {"%s", face_%s, %d, %d, %d},' % (
+            name, ''.join(c if c.isalnum() else '_' for c in name), len(elements), shift[0], shift[1]))
+    out.append('};')
+    out.append('')
+    out.append('const size_t face_count = sizeof(face_faces) / sizeof(face_faces[0]);')
+    out.append('')
+
+    with open(sys.argv[2], 'w', newline='\n') as f:
+        f.write('\n'.join(out))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
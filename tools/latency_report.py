@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Display latency and jitter from an event trace dump (main/lib/trace, main/lib/latency).
+
+Every displayed frame is traced as a "frame" span from the DS3231 second rollover to the end
+of the SSD1306 transfer, with the interval since the previous frame. This prints p50/p99/max
+of the rollover-to-pixels latency and of the frame interval error (jitter), using the same
+histogram buckets as the device (so the numbers match the on-device report), plus the
+render and transfer spans that make up the latency.
+
+Usage:
+  latency_report.py http://<device IP>/trace --token <device token>
+  latency_report.py trace.bin --exact       (exact percentiles instead of the device buckets)
+"""
+
+import argparse
+import math
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import trace_decode  # noqa: E402
+
+# Keep in sync with main/lib/latency/latency_hist.h
+LINEAR = 32
+SUB_BUCKETS = 16
+MAX_BITS = 22
+
+EVENT_FRAME = 9
+EVENT_DISPLAY = 2
+EVENT_REFRESH = 3
+
+
+def bucket(value):
+    value = min(value, (1 << MAX_BITS) - 1)
+    if value < LINEAR:
+        return value
+    bits = value.bit_length() - 1
+    return LINEAR + (bits - 5) * SUB_BUCKETS + ((value >> (bits - 4)) & (SUB_BUCKETS - 1))
+
+
+def bucket_upper(index):
+    if index < LINEAR:
+        return index
+    bits = 5 + (index - LINEAR) // SUB_BUCKETS
+    sub = (index - LINEAR) % SUB_BUCKETS
+    return ((SUB_BUCKETS + sub + 1) << (bits - 4)) - 1
+
+
+def percentile(values, percent, exact):
+    """Same rank rule as latency_hist_percentile(): 1-based, rounded up."""
+    if not values:
+        return 0
+    ordered = sorted(values)
+    rank = max(1, math.ceil(len(ordered) * percent / 100.0))
+    value = ordered[rank - 1]
+    if exact:
+        return value
+    return min(bucket_upper(bucket(value)), ordered[-1])
+
+
+def spans(records, event):
+    """Durations of B/E spans of one event (per task)."""
+    starts = {}
+    durations = []
+    for t_us, ev, phase, task, _, _ in records:
+        if ev != event:
+            continue
+        if phase == 'B':
+            starts[task] = t_us
+        elif phase == 'E' and task in starts:
+            durations.append(t_us - starts.pop(task))
+    return durations
+
+
+def line(name, values, exact):
+    if not values:
+        return '  %-20s no samples' % name
+    return '  %-20s %5d  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms' % (
+        name, len(values), percentile(values, 50, exact) / 1000.0,
+        percentile(values, 99, exact) / 1000.0, max(values) / 1000.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('source', help='dump file or http://<device IP>/trace')
+    parser.add_argument('--exact', action='store_true', help='exact percentiles instead of the device buckets')
+    parser.add_argument('--token', help='device token (printed on the serial console after boot)')
+    args = parser.parse_args()
+
+    _, records, _ = trace_decode.parse(trace_decode.load(args.source, args.token))
+    frames = [r for r in records if r[1] == EVENT_FRAME and r[2] == 'X']
+    latency = [r[5] for r in frames]
+    # arg0 is the interval since the previous displayed frame (0 for the first one)
+    jitter = [abs(r[4] - 1000000) for r in frames if r[4]]
+
+    span_us = frames[-1][0] - frames[0][0] if len(frames) > 1 else 0
+    print('%d frames over %.1f s%s' % (len(frames), span_us / 1e6, ' (exact)' if args.exact else ''))
+    print(line('rollover to pixels', latency, args.exact))
+    print(line('jitter', jitter, args.exact))
+    print(line('displayTime', spans(records, EVENT_DISPLAY), args.exact))
+    print(line('ssd1306_refresh', spans(records, EVENT_REFRESH), args.exact))
+
+
+if __name__ == '__main__':
+    main()
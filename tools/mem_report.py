@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""Static memory footprint per component from the linker map, with budget warnings.
+
+Runs after each build (CMakeLists.txt) on build/<project>.map. Every input section placed
+in an output section is attributed to its archive (component) and, for the main component,
+to its object file, so each module of main/lib shows up on its own line.
+
+Columns: initialized data and BSS in DRAM, code in IRAM, code and read-only data in flash,
+RTC memory. RAM is data + BSS + IRAM (static, before the heap is set up).
+
+With --partitions the image (data + IRAM + flash code + rodata, the segments stored in the
+app binary) is checked against the smallest app partition: an image that leaves less than
+APP_SLOT_HEADROOM of its OTA slot free is an error, so a build that could not be updated
+over WiFi (or not flashed at all) fails here rather than on the device.
+
+Usage:
+  mem_report.py build/esp32_c3_ds3231_ssd1306.map --partitions partitions.csv
+  mem_report.py build/esp32_c3_ds3231_ssd1306.map --top 40 --strict
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# Budgets (bytes of static RAM); exceeding one prints a warning (--strict: exit status 1)
+RAM_BUDGET = 160 * 1024         # Whole image
+MAIN_RAM_BUDGET = 24 * 1024     # main component (main.c and main/lib)
+OBJECT_RAM_BUDGET = 4 * 1024    # One object file of main
+OBJECT_RAM_BUDGETS = {          # Objects with a deliberate larger footprint
+    'trace.c': 9 * 1024,        # 8 KB event ring
+}
+APP_SLOT_HEADROOM = 64 * 1024   # Free bytes required in each app (OTA) partition
+
+COLUMNS = ['data', 'bss', 'iram', 'code', 'rodata', 'rtc']
+MAIN_ARCHIVE = 'libmain.a'
+
+OUTPUT_SECTION = re.compile(r'^([./]\S*)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+).*)?$')
+OUTPUT_CONT = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s*$')
+INPUT_SECTION = re.compile(r'^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+INPUT_NAME = re.compile(r'^ ([^\s*]\S*)$')
+FILL = re.compile(r'^ \*fill\*\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)')
+INPUT_CONT = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+ARCHIVE_MEMBER = re.compile(r'([^/\\]+\.a)\((.+)\)$')
+
+
+def category(output_section):
+    """Column of an output section, None for sections not loaded (debug info, discarded)."""
+    if output_section.startswith('.iram'):
+        return 'iram'
+    if output_section.startswith('.dram0.bss') or output_section in ('.noinit', '.dram0.noinit'):
+        return 'bss'
+    if output_section.startswith('.dram0'):
+        return 'data'
+    if output_section.startswith('.flash.text'):
+        return 'code'
+    if output_section.startswith(('.flash.', '.eh_frame')):
+        if output_section.endswith(('_noload', '.tbss')):
+            return None
+        return 'rodata'
+    if output_section.startswith('.rtc'):
+        return 'rtc'
+    return None
+
+
+def owner(path):
+    """(component, object) of an input file; object is only kept for the main component."""
+    path = path.strip()
+    match = ARCHIVE_MEMBER.search(path)
+    if match is None:
+        return os.path.basename(path), None
+    archive, member = match.groups()
+    if archive == MAIN_ARCHIVE:
+        return archive, re.sub(r'\.obj$', '', member)
+    return archive, None
+
+
+def parse(lines):
+    """Return {(component, object): {column: bytes}}."""
+    usage = {}
+    in_map = False
+    column = None
+    pending = None
+    end = None      # End address of the current output section
+    entries = []    # (address, size, path) of the current output section, fill included
+
+    def flush():
+        # Merged sections (strings, constants) are listed with their size before merging,
+        # all at the address where they were merged: a section only counts up to the next one
+        for i, (address, size, path) in enumerate(entries):
+            if path is None or column is None:
+                continue
+            limit = entries[i + 1][0] if i + 1 < len(entries) else end
+            if limit is not None:
+                size = min(size, max(0, limit - address))
+            if size:
+                sizes = usage.setdefault(owner(path), dict.fromkeys(COLUMNS, 0))
+                sizes[column] += size
+        del entries[:]
+
+    for line in lines:
+        line = line.rstrip('\n')
+        if not in_map:
+            in_map = line.startswith('Linker script and memory map')
+            continue
+        if line and not line[0].isspace():
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                flush()
+                column = category(match.group(1))
+                end = int(match.group(2), 16) + int(match.group(3), 16) if match.group(2) else None
+                pending = None if match.group(2) else line
+            continue
+        if pending is not None and pending[0] != ' ':
+            # Long output section name: address and size follow on the next line
+            match = OUTPUT_CONT.match(line)
+            pending = None
+            if match:
+                end = int(match.group(1), 16) + int(match.group(2), 16)
+                continue
+        match = INPUT_SECTION.match(line)
+        if match:
+            entries.append((int(match.group(2), 16), int(match.group(3), 16), match.group(4)))
+            pending = None
+            continue
+        if line.startswith(' *fill*'):
+            match = FILL.match(line)
+            if match:
+                entries.append((int(match.group(1), 16), int(match.group(2), 16), None))
+            pending = None
+            continue
+        if pending is not None:
+            match = INPUT_CONT.match(line)
+            if match:
+                entries.append((int(match.group(1), 16), int(match.group(2), 16), match.group(3)))
+        pending = line if INPUT_NAME.match(line) else None
+    flush()
+    if not in_map:
+        sys.exit('no memory map found (not a GNU ld map file?)')
+    return usage
+
+
+def ram(sizes):
+    return sizes['data'] + sizes['bss'] + sizes['iram']
+
+
+def row(name, sizes):
+    return '%-34s %7d %7d %7d %8d %8d %6d %8d' % (
+        name[:34], sizes['data'], sizes['bss'], sizes['iram'], sizes['code'], sizes['rodata'],
+        sizes['rtc'], ram(sizes))
+
+
+def app_slot_size(path):
+    """Size of the smallest app partition in a partition table CSV."""
+    sizes = []
+    with open(path) as f:
+        for line in f:
+            fields = [field.strip() for field in line.split('#')[0].split(',')]
+            if len(fields) < 5 or fields[1] != 'app':
+                continue
+            size = fields[4].upper()
+            scale = {'K': 1024, 'M': 1024 * 1024}.get(size[-1:], 1)
+            sizes.append(int(size.rstrip('KM'), 0) * scale)
+    if not sizes:
+        sys.exit('%s: no app partition' % path)
+    return min(sizes)
+
+
+def total(entries):
+    sums = dict.fromkeys(COLUMNS, 0)
+    for sizes in entries:
+        for key in COLUMNS:
+            sums[key] += sizes[key]
+    return sums
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('--top', type=int, default=20, help='components listed (by RAM, default 20)')
+    parser.add_argument('--strict', action='store_true', help='exit with status 1 when a budget is exceeded')
+    parser.add_argument('--partitions', help='partition table CSV: check the image against the app slot')
+    args = parser.parse_args()
+
+    with open(args.map, 'r', errors='replace') as f:
+        usage = parse(f)
+
+    components = {}
+    main_objects = {}
+    for (component, obj), sizes in usage.items():
+        components.setdefault(component, []).append(sizes)
+        if component == MAIN_ARCHIVE:
+            main_objects[obj] = sizes
+    components = {name: total(entries) for name, entries in components.items()}
+    image = total(components.values())
+
+    header = '%-34s %7s %7s %7s %8s %8s %6s %8s' % ('', 'data', 'bss', 'iram', 'code', 'rodata', 'rtc', 'RAM')
+    print('Static memory by component (bytes), %s' % os.path.basename(args.map))
+    print(header)
+    ranked = sorted(components.items(), key=lambda item: (-ram(item[1]), -item[1]['code']))
+    for name, sizes in ranked[:args.top]:
+        print(row(name, sizes))
+    if len(ranked) > args.top:
+        print(row('(%d more)' % (len(ranked) - args.top), total(sizes for _, sizes in ranked[args.top:])))
+    print(row('total', image))
+
+    if main_objects:
+        print()
+        print('main component by object')
+        print(header)
+        for name, sizes in sorted(main_objects.items(), key=lambda item: -ram(item[1])):
+            print(row(name, sizes))
+
+    warnings = []
+    if ram(image) > RAM_BUDGET:
+        warnings.append('static RAM %d bytes exceeds the image budget of %d' % (ram(image), RAM_BUDGET))
+    main_sizes = components.get(MAIN_ARCHIVE)
+    if main_sizes and ram(main_sizes) > MAIN_RAM_BUDGET:
+        warnings.append('main component uses %d bytes of static RAM, budget %d' % (ram(main_sizes), MAIN_RAM_BUDGET))
+    for name, sizes in sorted(main_objects.items()):
+        budget = OBJECT_RAM_BUDGETS.get(name, OBJECT_RAM_BUDGET)
+        if ram(sizes) > budget:
+            warnings.append('%s uses %d bytes of static RAM, budget %d' % (name, ram(sizes), budget))
+    for warning in warnings:
+        print('warning: %s' % warning, file=sys.stderr)
+
+    if args.partitions:
+        slot = app_slot_size(args.partitions)
+        flash = image['data'] + image['iram'] + image['code'] + image['rodata']
+        print()
+        print('App image about %d bytes, %d of the %d byte app slot free (%.1f%%, headroom %d)' % (
+            flash, slot - flash, slot, 100.0 * (slot - flash) / slot, APP_SLOT_HEADROOM))
+        if slot - flash < APP_SLOT_HEADROOM:
+            print('error: app image leaves %d bytes of the app slot free, %d required (%s)' % (
+                slot - flash, APP_SLOT_HEADROOM, args.partitions), file=sys.stderr)
+            sys.exit(1)
+    if warnings and args.strict:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
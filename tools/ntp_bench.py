@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Stand-in SNTP servers for the firmware NTP client.
+
+Answers NTP client requests with an impaired clock and path, so the clock can
+be synced without internet servers (point NTP_SERVER1 in main/main.c at the
+host running this), and so the sync procedure can be measured on the host.
+
+Impairments: one-way delay (split by --asymmetry), uniform jitter per leg,
+packet loss per leg, a fixed server clock offset, the stratum and a
+Kiss-o'-Death (RATE) every N requests. --delay-ms takes one round-trip delay
+per server (--delay-ms 20,35,60): each server gets its own socket, on
+consecutive ports from --port (--port 0: ephemeral ports).
+
+--run starts a command once the servers are listening, with {servers}
+replaced by their host:port list, and exits with its status. The host build
+(test/host) runs bench_ntp, the firmware's sync procedure and packet code over
+POSIX sockets, this way:
+
+  ntp_bench.py serve --bind 127.0.0.1 --port 0 --delay-ms 20,35,60 --offset-ms 250 \
+      --run build_host/bench_ntp --expect-offset-ms 250 {servers}
+
+Usage:
+  ntp_bench.py serve [--port 123] [--delay-ms 20[,35...]] [impairments] [--run CMD ARGS...]
+"""
+
+import argparse
+import heapq
+import random
+import select
+import socket
+import struct
+import subprocess
+import threading
+import time
+
+NTP_UNIX_EPOCH_OFFSET = 2208988800
+NTP_PACKET_SIZE = 48
+
+
+def ntp_timestamp(t):
+    t += NTP_UNIX_EPOCH_OFFSET
+    sec = int(t)
+    return struct.pack('!II', sec & 0xFFFFFFFF, int((t - sec) * 2 ** 32) & 0xFFFFFFFF)
+
+
+class Impairment:
+    def __init__(self, args, delay_ms):
+        self.delay = delay_ms / 1000.0
+        self.jitter = args.jitter_ms / 1000.0
+        self.loss = args.loss
+        self.offset = args.offset_ms / 1000.0
+        self.asymmetry = args.asymmetry
+        self.stratum = args.stratum
+        self.kod_every = args.kod_every
+
+    def leg(self, outbound):
+        share = (1.0 + self.asymmetry) / 2 if outbound else (1.0 - self.asymmetry) / 2
+        return max(0.0, self.delay * share + random.uniform(0.0, self.jitter))
+
+    def lost(self):
+        return random.random() < self.loss
+
+
+class Server:
+    """Single-threaded NTP server; impairments are applied with a timer heap."""
+
+    def __init__(self, imp, bind, port, verbose=False):
+        self.imp = imp
+        self.verbose = verbose
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind((bind, port))
+        self.port = self.sock.getsockname()[1]
+        self.events = []
+        self.seq = 0
+        self.requests = 0
+
+    def schedule(self, when, action, *args):
+        self.seq += 1
+        heapq.heappush(self.events, (when, self.seq, action, args))
+
+    def receive(self, data, addr):
+        self.requests += 1
+        if len(data) < NTP_PACKET_SIZE or (data[0] & 0x07) != 3:
+            return
+        if self.imp.lost():
+            return
+        # Outbound leg: the server stamps the request when it "arrives"
+        self.schedule(time.monotonic() + self.imp.leg(True), self.stamp, data, addr)
+
+    def stamp(self, data, addr):
+        now = time.time() + self.imp.offset
+        if self.imp.kod_every and self.requests % self.imp.kod_every == 0:
+            reply = bytes([0xE4, 0, 0, 0]) + b'\0' * 8 + b'RATE' + b'\0' * 8 + data[40:48] + b'\0' * 16
+        else:
+            version = (data[0] >> 3) & 0x07
+            header = bytes([(version << 3) | 4, self.imp.stratum, 6, 0xEC])
+            reply = (header + b'\0' * 8 + b'LOCL' + ntp_timestamp(now) + data[40:48] +
+                     ntp_timestamp(now) + ntp_timestamp(time.time() + self.imp.offset))
+        if self.imp.lost():
+            return
+        # Return leg
+        self.schedule(time.monotonic() + self.imp.leg(False), self.send, reply, addr)
+
+    def send(self, reply, addr):
+        self.sock.sendto(reply, addr)
+        if self.verbose:
+            print('reply to %s:%d' % addr)
+
+    def fire(self, now):
+        while self.events and self.events[0][0] <= now:
+            _, _, action, args = heapq.heappop(self.events)
+            action(*args)
+
+
+def run(servers, stop):
+    """Serve until stop() returns true (single thread, all sockets)."""
+    socks = {s.sock: s for s in servers}
+    while not stop():
+        timeout = 0.1
+        for s in servers:
+            if s.events:
+                timeout = min(timeout, max(0.0, s.events[0][0] - time.monotonic()))
+        readable, _, _ = select.select(list(socks), [], [], timeout)
+        for sock in readable:
+            data, addr = sock.recvfrom(512)
+            socks[sock].receive(data, addr)
+        now = time.monotonic()
+        for s in servers:
+            s.fire(now)
+    for s in servers:
+        s.sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='mode', required=True)
+    p = sub.add_parser('serve', help='run stand-in SNTP servers')
+    p.add_argument('--bind', default='0.0.0.0')
+    p.add_argument('--port', type=int, default=123, help='port of the first server (0: ephemeral)')
+    p.add_argument('--verbose', action='store_true')
+    p.add_argument('--delay-ms', default='20', help='round-trip path delay per server, comma separated')
+    p.add_argument('--jitter-ms', type=float, default=5.0, help='uniform extra delay per leg')
+    p.add_argument('--loss', type=float, default=0.0, help='loss probability per leg')
+    p.add_argument('--offset-ms', type=float, default=0.0, help='server clock offset')
+    p.add_argument('--asymmetry', type=float, default=0.0,
+                   help='-1..1, share of the delay moved to the outbound leg')
+    p.add_argument('--stratum', type=int, default=2)
+    p.add_argument('--kod-every', type=int, default=0, help='send Kiss-o\'-Death (RATE) every N requests')
+    p.add_argument('--seed', type=int, default=None)
+    p.add_argument('--run', nargs=argparse.REMAINDER, help='command to run against the servers ({servers})')
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+    delays = [float(d) for d in args.delay_ms.split(',')]
+    servers = [Server(Impairment(args, d), args.bind, args.port + i if args.port else 0, args.verbose)
+               for i, d in enumerate(delays)]
+    host = '127.0.0.1' if args.bind == '0.0.0.0' else args.bind
+    addrs = ','.join('%s:%d' % (host, s.port) for s in servers)
+    for s, d in zip(servers, delays):
+        print('Serving NTP on %s:%d (delay %.1f ms, jitter %.1f ms, loss %.2f, offset %.1f ms)' % (
+            args.bind, s.port, d, args.jitter_ms, args.loss, args.offset_ms), flush=True)
+
+    if not args.run:
+        try:
+            run(servers, lambda: False)
+        except KeyboardInterrupt:
+            pass
+        return
+
+    done = threading.Event()
+    thread = threading.Thread(target=run, args=(servers, done.is_set))
+    thread.start()
+    try:
+        status = subprocess.call([a.replace('{servers}', addrs) for a in args.run])
+    finally:
+        done.set()
+        thread.join()
+    raise SystemExit(status)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,492 @@
+#!/usr/bin/env python3
+"""Build, sign, upload and test compressed firmware updates (main/lib/ota_update).
+
+keygen: create the ECDSA P-256 signing key (ota_signing_key.pem at the project
+        root by default). Keep it private; firmware built with it only accepts
+        packages signed with it.
+pubkey: write the public key as C (ota_pubkey.c, run by the build).
+pack:   compress build/<project>.bin into an update package: a 44-byte header
+        (magic, parameters, image size, SHA-256) signed with the key, the
+        signature, and the image in heatshrink format (window 2^11, lookahead
+        2^4), checked by decompressing it again. The image must carry a
+        major.minor.patch version (PROJECT_VER): devices refuse images older
+        than the running one.
+push:   POST a package to /ota on the status server while the clock is online
+        and print the device's report. The device token is printed on the
+        clock's serial console after boot. --wait keeps retrying until the clock is
+        reachable, for the short network window after a sync.
+serve:  local stand-in for the device: accepts POST /ota, checks the token and
+        signature, decompresses the stream with the firmware's window and
+        receive chunk sizes, checks the image version against
+        --running-version, verifies the SHA-256, optionally writes the image
+        to a file, and answers with the same JSON report (RAM is the firmware's
+        buffer size; flash is not simulated unless --flash-kb-s is given).
+
+Usage:
+  ota_pack.py keygen [ota_signing_key.pem]
+  ota_pack.py pubkey ota_signing_key.pem ota_pubkey.c
+  ota_pack.py pack build/esp32_c3_ds3231_ssd1306.bin firmware.pxfw [--key ota_signing_key.pem]
+  ota_pack.py push firmware.pxfw --host <device IP> --token <device token> [--port 80] [--wait 600]
+  ota_pack.py serve [--port 8081] [--key ota_signing_key.pem] [--token <token>] [--out image.bin]
+                    [--running-version 1.0.0]
+
+Signing needs the Python "cryptography" package (part of the ESP-IDF Python environment).
+"""
+
+import argparse
+import hashlib
+import http.client
+import http.server
+import json
+import os
+import re
+import struct
+import sys
+import time
+
+# Keep in sync with main/lib/ota_update/ota_update.h and ota_package.h
+MAGIC = b'PXFW'
+VERSION = 2
+WINDOW_BITS = 11
+LOOKAHEAD_BITS = 4
+SIGNED = struct.Struct('<4sBBBBI32s')   # Header bytes covered by the signature
+SIGNATURE_SIZE = 64                     # r and s, big-endian
+HEADER_SIZE = SIGNED.size + SIGNATURE_SIZE
+RECV_CHUNK = 1024
+SHA256_CONTEXT = 108  # sizeof(mbedtls_sha256_context) on the ESP32-C3 (software SHA)
+STATE_OVERHEAD = 84   # Other ota_state_t fields
+
+# Keep in sync with main/lib/ota_update/ota_package.h
+APP_DESC_OFFSET = 32  # esp_app_desc_t after the image header and the first segment header
+APP_DESC_MAGIC = 0xABCD5432
+APP_VERSION_OFFSET = APP_DESC_OFFSET + 16
+APP_VERSION_LEN = 32
+
+MIN_MATCH = 2         # A 2-byte match (16 bits) is shorter than two literals (18 bits)
+MAX_MATCH = 1 << LOOKAHEAD_BITS
+WINDOW = 1 << WINDOW_BITS
+MAX_CHAIN = 48        # Candidates tried per position
+
+DEFAULT_KEY = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), 'ota_signing_key.pem')
+
+
+def parse_version(text):
+    """As ota_version_parse(): "[v]major[.minor[.patch]]" plus an optional -/+ suffix, or None."""
+    m = re.fullmatch(r'v?(\d+)(?:\.(\d+))?(?:\.(\d+))?([-+].*)?', text, re.S)
+    if not m:
+        return None
+    parts = [int(p or 0) for p in m.group(1, 2, 3)]
+    if any(p > 1023 for p in parts):
+        return None
+    return tuple(parts)
+
+
+def image_version(image):
+    """Version string and parsed version of an application image, as ota_image_version()."""
+    if len(image) < APP_VERSION_OFFSET + APP_VERSION_LEN:
+        return None, None
+    if struct.unpack_from('<I', image, APP_DESC_OFFSET)[0] != APP_DESC_MAGIC:
+        return None, None
+    text = image[APP_VERSION_OFFSET:APP_VERSION_OFFSET + APP_VERSION_LEN].split(b'\0')[0].decode('latin-1')
+    return text, parse_version(text)
+
+
+def crypto():
+    try:
+        from cryptography.hazmat.primitives import hashes, serialization
+        from cryptography.hazmat.primitives.asymmetric import ec, utils
+    except ImportError:
+        sys.exit('signing needs the "cryptography" package (pip install cryptography)')
+    return hashes, serialization, ec, utils
+
+
+def load_key(path, private=True):
+    """Signing key, or its public key (a public key file is accepted then)."""
+    _, serialization, ec, _ = crypto()
+    try:
+        with open(path, 'rb') as f:
+            pem = f.read()
+    except OSError as e:
+        sys.exit('%s: %s (create a key with: ota_pack.py keygen)' % (path, e.strerror))
+    if b'PRIVATE KEY' in pem:
+        key = serialization.load_pem_private_key(pem, password=None)
+    elif private:
+        sys.exit('%s: not a private key' % path)
+    else:
+        key = serialization.load_pem_public_key(pem)
+    if not isinstance(key.curve, ec.SECP256R1):
+        sys.exit('%s: not a P-256 key' % path)
+    if not private and hasattr(key, 'public_key'):
+        key = key.public_key()
+    return key
+
+
+def sign(key, signed):
+    hashes, _, ec, utils = crypto()
+    r, s = utils.decode_dss_signature(key.sign(signed, ec.ECDSA(hashes.SHA256())))
+    return r.to_bytes(32, 'big') + s.to_bytes(32, 'big')
+
+
+def verify(public_key, signed, signature):
+    hashes, _, ec, utils = crypto()
+    der = utils.encode_dss_signature(int.from_bytes(signature[:32], 'big'), int.from_bytes(signature[32:], 'big'))
+    try:
+        public_key.verify(der, signed, ec.ECDSA(hashes.SHA256()))
+        return True
+    except Exception:
+        return False
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count:
+            self.out.append((self.acc << (8 - self.count)) & 0xFF)
+            self.count = 0
+        return bytes(self.out)
+
+
+def compress(data):
+    """Greedy LZSS in heatshrink format; hash chains on 2-byte prefixes."""
+    bits = BitWriter()
+    heads = {}
+    prev = [0] * len(data)
+    n = len(data)
+    i = 0
+
+    def insert(pos):
+        if pos + 1 < n:
+            key = data[pos:pos + 2]
+            prev[pos] = heads.get(key, -1)
+            heads[key] = pos
+
+    while i < n:
+        best_len, best_off = 0, 0
+        if i + 1 < n:
+            cand = heads.get(data[i:i + 2], -1)
+            limit = min(MAX_MATCH, n - i)
+            tries = 0
+            while cand >= 0 and i - cand <= WINDOW and tries < MAX_CHAIN:
+                tries += 1
+                # Only candidates that beat the best match so far are extended
+                if data[cand:cand + best_len + 1] == data[i:i + best_len + 1] or best_len == 0:
+                    length = 0
+                    while length < limit and data[cand + length] == data[i + length]:
+                        length += 1
+                    if length > best_len:
+                        best_len, best_off = length, i - cand
+                        if length == limit:
+                            break
+                cand = prev[cand]
+        if best_len >= MIN_MATCH:
+            bits.write(0, 1)
+            bits.write(best_off - 1, WINDOW_BITS)
+            bits.write(best_len - 1, LOOKAHEAD_BITS)
+            for pos in range(i, i + best_len):
+                insert(pos)
+            i += best_len
+        else:
+            bits.write(0x100 | data[i], 9)
+            insert(i)
+            i += 1
+    return bits.finish()
+
+
+class Decoder:
+    """Streaming decoder with the firmware's window (ota_decoder_feed)."""
+
+    def __init__(self):
+        self.window = bytearray(WINDOW)
+        self.head = 0
+        self.acc = 0
+        self.count = 0
+        self.out = bytearray()
+
+    def feed(self, chunk):
+        for byte in chunk:
+            self.acc = (self.acc << 8) | byte
+            self.count += 8
+            while True:
+                if self.count == 0:
+                    break
+                if (self.acc >> (self.count - 1)) & 1:
+                    if self.count < 9:
+                        break
+                    self.count -= 9
+                    self.put((self.acc >> self.count) & 0xFF)
+                else:
+                    need = 1 + WINDOW_BITS + LOOKAHEAD_BITS
+                    if self.count < need:
+                        break
+                    self.count -= need
+                    token = (self.acc >> self.count) & ((1 << (need - 1)) - 1)
+                    offset = (token >> LOOKAHEAD_BITS) + 1
+                    length = (token & (MAX_MATCH - 1)) + 1
+                    for _ in range(length):
+                        self.put(self.window[(self.head - offset) & (WINDOW - 1)])
+                self.acc &= (1 << self.count) - 1
+
+    def put(self, byte):
+        self.window[self.head] = byte
+        self.head = (self.head + 1) & (WINDOW - 1)
+        self.out.append(byte)
+
+
+def keygen(args):
+    _, serialization, ec, _ = crypto()
+    if os.path.exists(args.key):
+        sys.exit('%s exists, not overwritten (devices only accept packages signed with their key)' % args.key)
+    key = ec.generate_private_key(ec.SECP256R1())
+    pem = key.private_bytes(serialization.Encoding.PEM, serialization.PrivateFormat.PKCS8,
+                            serialization.NoEncryption())
+    fd = os.open(args.key, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600)
+    with os.fdopen(fd, 'wb') as f:
+        f.write(pem)
+    print('%s: new P-256 signing key; keep it private and backed up' % args.key)
+
+
+def pubkey(args):
+    _, serialization, _, _ = crypto()
+    point = load_key(args.key, private=False).public_bytes(serialization.Encoding.X962,
+                                                           serialization.PublicFormat.UncompressedPoint)
+    out = []
+    out.append('// Generated by tools/ota_pack.py from %s, do not edit' % os.path.basename(args.key))
+    out.append('')
+    out.append('#include "ota_update.h"')
+    out.append('')
+    out.append('const uint8_t ota_public_key[OTA_PUBLIC_KEY_SIZE] = {')
+    for i in range(0, len(point), 12):
+        out.append('    ' + ' '.join('0x%02x,' % b for b in point[i:i + 12]))
+    out.append('};')
+    out.append('')
+    with open(args.output, 'w', newline='\n') as f:
+        f.write('\n'.join(out))
+
+
+def pack(args):
+    with open(args.image, 'rb') as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        sys.exit('%s: not an ESP application image' % args.image)
+    version_text, version = image_version(image)
+    if version is None:
+        sys.exit('%s: version %r is not major.minor.patch (set PROJECT_VER in CMakeLists.txt); '
+                 'devices refuse it' % (args.image, version_text))
+    key = load_key(args.key)
+    start = time.perf_counter()
+    body = compress(image)
+    elapsed = time.perf_counter() - start
+    digest = hashlib.sha256(image).digest()
+    decoder = Decoder()
+    decoder.feed(body)
+    if bytes(decoder.out) != image:
+        sys.exit('internal error: package does not decompress to the image')
+    signed = SIGNED.pack(MAGIC, VERSION, WINDOW_BITS, LOOKAHEAD_BITS, 0, len(image), digest)
+    with open(args.package, 'wb') as f:
+        f.write(signed)
+        f.write(sign(key, signed))
+        f.write(body)
+    print('%s: version %s, %d -> %d bytes (%.1f%%), %.1f s, sha256 %s, signed with %s' % (
+        args.package, version_text, len(image), len(body) + HEADER_SIZE, 100.0 * (len(body) + HEADER_SIZE) / len(image),
+        elapsed, digest.hex()[:16], os.path.basename(args.key)))
+
+
+def push(args):
+    with open(args.package, 'rb') as f:
+        package = f.read()
+    deadline = time.monotonic() + args.wait
+    while True:
+        try:
+            conn = http.client.HTTPConnection(args.host, args.port, timeout=30)
+            start = time.perf_counter()
+            conn.request('POST', '/ota', body=package, headers={'Content-Type': 'application/octet-stream',
+                                                                'Authorization': 'Bearer ' + args.token})
+            response = conn.getresponse()
+            text = response.read().decode('utf-8', 'replace')
+            elapsed = time.perf_counter() - start
+            break
+        except OSError as e:
+            if time.monotonic() >= deadline:
+                sys.exit('%s:%d: %s' % (args.host, args.port, e))
+            time.sleep(1.0)
+    print('HTTP %d after %.2f s (%.1f KB/s from this side)' % (
+        response.status, elapsed, len(package) / 1024.0 / max(elapsed, 1e-6)))
+    if response.status == 401:
+        sys.exit('device token rejected (printed on the serial console after boot)')
+    try:
+        report = json.loads(text)
+    except ValueError:
+        sys.exit(text)
+    if not report.get('ok'):
+        sys.exit('update failed: %s' % report.get('error'))
+    print('image %d bytes, received %d bytes in %d ms: %d KB/s in, %d KB/s out; '
+          'buffers %d bytes, heap peak %d bytes' % (
+              report['image'], report['received'], report['ms'], report['in_kb_s'],
+              report['out_kb_s'], report['ram'], report['heap_peak']))
+    print('The clock restarts into the new image; it is confirmed once it connects to WiFi.')
+
+
+class OtaHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    out_path = None
+    flash_kb_s = 0.0
+    public_key = None
+    token = None
+    running_version = (0, 0, 0)
+
+    def reply(self, status, doc):
+        body = json.dumps(doc, separators=(',', ':')).encode()
+        self.send_response(status)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        if self.path != '/ota':
+            self.reply(404, {'ok': False, 'error': 'Not found'})
+            return
+        if self.token and self.headers.get('Authorization') != 'Bearer ' + self.token:
+            self.close_connection = True
+            self.reply(401, {'ok': False, 'error': 'Device token required'})
+            return
+        length = int(self.headers.get('Content-Length', 0))
+        if length <= HEADER_SIZE:
+            self.reply(400, {'ok': False, 'error': 'Empty package'})
+            return
+        signed = self.rfile.read(SIGNED.size)
+        signature = self.rfile.read(SIGNATURE_SIZE)
+        magic, version, wbits, lbits, _, size, digest = SIGNED.unpack(signed)
+        received = HEADER_SIZE
+        if magic != MAGIC:
+            self.reply(400, {'ok': False, 'error': 'Not an update package'})
+            return
+        if version != VERSION:
+            self.reply(400, {'ok': False, 'error': 'Unsigned or old package format'})
+            return
+        if (wbits, lbits) != (WINDOW_BITS, LOOKAHEAD_BITS):
+            self.reply(400, {'ok': False, 'error': 'Unsupported compression parameters'})
+            return
+        if not verify(self.public_key, signed, signature):
+            self.close_connection = True
+            self.reply(403, {'ok': False, 'error': 'Bad signature'})
+            return
+        start = time.perf_counter()
+        decoder = Decoder()
+        version_checked = False
+        while received < length:
+            chunk = self.rfile.read(min(RECV_CHUNK, length - received))
+            if not chunk:
+                self.reply(400, {'ok': False, 'error': 'Upload interrupted'})
+                return
+            received += len(chunk)
+            before = len(decoder.out)
+            decoder.feed(chunk)
+            if self.flash_kb_s:
+                time.sleep((len(decoder.out) - before) / 1024.0 / self.flash_kb_s)
+            if len(decoder.out) > size:
+                self.reply(400, {'ok': False, 'error': 'Image larger than announced'})
+                return
+            # The device checks the version in the first flash write (half a window)
+            if not version_checked and len(decoder.out) >= min(size, WINDOW // 2):
+                version_checked = True
+                _, version = image_version(bytes(decoder.out))
+                if version is None:
+                    self.reply(400, {'ok': False, 'error': 'Image has no valid version'})
+                    return
+                if version < self.running_version:
+                    self.reply(409, {'ok': False, 'error': 'Older than the running firmware'})
+                    return
+        image = bytes(decoder.out)
+        if len(image) != size:
+            self.reply(400, {'ok': False, 'error': 'Image shorter than announced'})
+            return
+        if hashlib.sha256(image).digest() != digest:
+            self.reply(400, {'ok': False, 'error': 'SHA-256 mismatch'})
+            return
+        ms = max(int((time.perf_counter() - start) * 1000), 1)
+        if self.out_path:
+            with open(self.out_path, 'wb') as f:
+                f.write(image)
+        ram = WINDOW + RECV_CHUNK + SHA256_CONTEXT + STATE_OVERHEAD
+        self.reply(200, {'ok': True, 'image': size, 'received': received, 'ms': ms,
+                         'in_kb_s': received * 1000 // ms // 1024, 'out_kb_s': size * 1000 // ms // 1024,
+                         'ram': ram, 'heap_peak': ram})
+        print('update: %d -> %d bytes in %d ms, sha256 ok%s' % (
+            received, size, ms, ', written to %s' % self.out_path if self.out_path else ''))
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def serve(args):
+    OtaHandler.out_path = args.out
+    OtaHandler.flash_kb_s = args.flash_kb_s
+    OtaHandler.public_key = load_key(args.key, private=False)
+    OtaHandler.token = args.token
+    OtaHandler.running_version = parse_version(args.running_version)
+    if OtaHandler.running_version is None:
+        sys.exit('--running-version: not major.minor.patch')
+    server = http.server.ThreadingHTTPServer((args.bind, args.port), OtaHandler)
+    print('OTA stand-in on %s:%d (POST /ota)' % (args.bind, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='mode', required=True)
+    keygen_parser = sub.add_parser('keygen', help='create the update signing key')
+    keygen_parser.add_argument('key', nargs='?', default=DEFAULT_KEY)
+    pubkey_parser = sub.add_parser('pubkey', help='write the public key as C source (build step)')
+    pubkey_parser.add_argument('key')
+    pubkey_parser.add_argument('output')
+    pack_parser = sub.add_parser('pack', help='compress and sign an application image into an update package')
+    pack_parser.add_argument('image')
+    pack_parser.add_argument('package')
+    pack_parser.add_argument('--key', default=DEFAULT_KEY, help='signing key')
+    push_parser = sub.add_parser('push', help='upload a package to a clock')
+    push_parser.add_argument('package')
+    push_parser.add_argument('--host', required=True, help='clock address on the station network')
+    push_parser.add_argument('--token', required=True, help='device token (printed on the serial console after boot)')
+    push_parser.add_argument('--port', type=int, default=80)
+    push_parser.add_argument('--wait', type=float, default=0.0, help='seconds to keep retrying the connection')
+    serve_parser = sub.add_parser('serve', help='local stand-in for the device')
+    serve_parser.add_argument('--bind', default='127.0.0.1')
+    serve_parser.add_argument('--port', type=int, default=8081)
+    serve_parser.add_argument('--out', help='write the received image here')
+    serve_parser.add_argument('--flash-kb-s', type=float, default=0.0, help='simulated flash write speed')
+    serve_parser.add_argument('--key', default=DEFAULT_KEY, help='key the packages must be signed with')
+    serve_parser.add_argument('--token', help='require this device token')
+    serve_parser.add_argument('--running-version', default='0.0.0',
+                              help='refuse images older than this (the device compares with its own)')
+    args = parser.parse_args()
+
+    if args.mode == 'keygen':
+        keygen(args)
+    elif args.mode == 'pubkey':
+        pubkey(args)
+    elif args.mode == 'pack':
+        pack(args)
+    elif args.mode == 'push':
+        push(args)
+    else:
+        serve(args)
+
+
+if __name__ == '__main__':
+    main()
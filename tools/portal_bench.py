@@ -0,0 +1,278 @@
+#!/usr/bin/env python3
+"""Stand-in provisioning portal and time-to-first-paint benchmark.
+
+serve:   serve the compiled provisioning page the way the firmware does
+         (tools/web_compile.py output: gzip bodies, ETag, Cache-Control,
+         302 for unknown paths, a fixed /scan list) plus a captive DNS responder, with an
+         optional per-request delay to mimic the SoftAP. Useful to try page
+         changes without flashing.
+measure: load the portal like a browser with an empty cache (cold) and
+         again with everything cached (warm), and report the timing of each
+         step. Run it on a laptop joined to the PIX_Clock_Setup SoftAP, or
+         against `serve`.
+
+First paint is taken as the time the page and its render-blocking
+stylesheet are complete; the script is deferred and does not delay it. Paint
+itself (layout, raster) happens in the browser and is not included.
+
+Usage:
+  portal_bench.py serve [--port 8080] [--dns-port 5353] [--delay-ms 0]
+  portal_bench.py measure [--host 192.168.4.1] [--port 80] [--dns-port 53] [--runs 20]
+"""
+
+import argparse
+import gzip
+import http.client
+import http.server
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import web_compile  # noqa: E402
+
+WEB_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'main', 'lib', 'wifi_provisioning', 'web')
+WEB_FILES = ['index.html', 'style.css', 'app.js']  # Keep in sync with main/CMakeLists.txt
+
+# Keep in sync with main/lib/wifi_provisioning/wifi_provisioning.c
+WEB_CACHE_IMMUTABLE = 'public, max-age=31536000, immutable'
+WEB_CACHE_REVALIDATE = 'no-cache'
+
+PROBE_NAME = 'connectivitycheck.gstatic.com'
+
+# Network list served on /scan by the stand-in (format of main/lib/wifi_scan)
+SAMPLE_SCAN = b'{"scanning":false,"aps":[["HomeNet",-48,6,3],["Cafe \\"Guest\\"",-67,1,0],["Office-5",-81,11,4]]}'
+SAMPLE_SCAN_ETAG = '"s2"'
+
+
+def dns_query(name):
+    header = struct.pack('!HHHHHH', os.getpid() & 0xFFFF, 0x0100, 1, 0, 0, 0)
+    qname = b''.join(bytes([len(label)]) + label.encode() for label in name.split('.')) + b'\0'
+    return header + qname + struct.pack('!HH', 1, 1)
+
+
+def dns_answer(query, ip):
+    """Same answer as main/lib/captive_dns: every A query resolves to ip."""
+    if len(query) < 12 or query[2] & 0xF8 or query[4:6] != b'\0\1':
+        return None
+    pos = 12
+    while pos < len(query) and query[pos]:
+        pos += query[pos] + 1
+    if pos + 5 > len(query):
+        return None
+    qtype, qclass = struct.unpack('!HH', query[pos + 1:pos + 5])
+    reply = bytearray(query[:pos + 5])
+    reply[2] = 0x84 | (query[2] & 0x01)
+    reply[3] = 0
+    reply[6:12] = b'\0' * 6
+    if qtype in (1, 255) and qclass == 1:
+        reply += struct.pack('!HHHIH', 0xC00C, 1, 1, 60, 4) + socket.inet_aton(ip)
+        reply[7] = 1
+    return bytes(reply)
+
+
+class PortalHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    disable_nagle_algorithm = True  # As the firmware: headers and body are separate writes
+    assets = {}
+    delay = 0.0
+    portal_url = ''
+
+    def do_GET(self):
+        time.sleep(self.delay)
+        if self.path.split('?', 1)[0] == '/scan':
+            self.send_scan()
+            return
+        asset = self.assets.get(self.path.split('?', 1)[0])
+        if asset is None:
+            self.send_response(302)
+            self.send_header('Location', self.portal_url)
+            self.send_header('Cache-Control', 'no-store')
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        _, content_type, gz, etag, immutable = asset[:5]
+        if etag in self.headers.get('If-None-Match', ''):
+            self.send_response(304)
+            self.send_header('ETag', etag)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Content-Encoding', 'gzip')
+        self.send_header('ETag', etag)
+        self.send_header('Cache-Control', WEB_CACHE_IMMUTABLE if immutable else WEB_CACHE_REVALIDATE)
+        self.send_header('Content-Length', str(len(gz)))
+        self.end_headers()
+        self.wfile.write(gz)
+
+    def send_scan(self):
+        if SAMPLE_SCAN_ETAG in self.headers.get('If-None-Match', ''):
+            self.send_response(304)
+            self.send_header('ETag', SAMPLE_SCAN_ETAG)
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('ETag', SAMPLE_SCAN_ETAG)
+        self.send_header('Cache-Control', WEB_CACHE_REVALIDATE)
+        self.send_header('Content-Length', str(len(SAMPLE_SCAN)))
+        self.end_headers()
+        self.wfile.write(SAMPLE_SCAN)
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def serve(args):
+    assets = web_compile.compile_assets([os.path.join(WEB_DIR, f) for f in WEB_FILES])
+    PortalHandler.assets = {a[0]: a for a in assets}
+    PortalHandler.delay = args.delay_ms / 1000.0
+    PortalHandler.portal_url = 'http://%s:%d/' % (args.address, args.port)
+    for uri, _, gz, _, _, name, size in assets:
+        print('%-24s %5d bytes minified, %5d bytes gzip' % (uri, size, len(gz)))
+
+    dns = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    dns.bind((args.bind, args.dns_port))
+
+    def dns_loop():
+        while True:
+            query, addr = dns.recvfrom(512)
+            reply = dns_answer(query, args.address)
+            if reply:
+                time.sleep(PortalHandler.delay)
+                dns.sendto(reply, addr)
+
+    threading.Thread(target=dns_loop, daemon=True).start()
+    server = http.server.ThreadingHTTPServer((args.bind, args.port), PortalHandler)
+    print('Serving the portal on %s:%d, DNS on port %d (delay %.1f ms)' % (
+        args.bind, args.port, args.dns_port, args.delay_ms))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+def fetch(conn, path, cache):
+    """GET on a keep-alive connection; returns (status, seconds to first byte, seconds total, decoded body)."""
+    headers = {'Accept-Encoding': 'gzip'}
+    if path in cache:
+        headers['If-None-Match'] = cache[path]
+    start = time.perf_counter()
+    conn.request('GET', path, headers=headers)
+    response = conn.getresponse()
+    ttfb = time.perf_counter() - start
+    body = response.read()
+    total = time.perf_counter() - start
+    if response.status == 200:
+        cache[path] = response.getheader('ETag')
+        if response.getheader('Content-Encoding') == 'gzip':
+            body = gzip.decompress(body)
+    return response.status, ttfb, total, body
+
+
+def load(args, cache):
+    """One page load; returns a dict of step durations in seconds."""
+    steps = {}
+    start = time.perf_counter()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2.0)
+    try:
+        sock.sendto(dns_query(PROBE_NAME), (args.host, args.dns_port))
+        reply = sock.recv(512)
+        steps['dns'] = time.perf_counter() - start
+        if reply[7] != 1 or reply[-4:] != socket.inet_aton(args.host):
+            print('warning: DNS answer does not point at %s' % args.host)
+    except socket.timeout:
+        steps['dns'] = None
+    sock.close()
+
+    t = time.perf_counter()
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=5)
+    conn.connect()
+    steps['connect'] = time.perf_counter() - t
+
+    # OS probe: the portal answers with a redirect to the page
+    t = time.perf_counter()
+    conn.request('GET', '/generate_204')
+    probe = conn.getresponse()
+    probe.read()
+    steps['probe'] = time.perf_counter() - t
+    if probe.status != 302:
+        print('warning: probe returned %d, expected 302' % probe.status)
+
+    status, ttfb, total, body = fetch(conn, '/', cache)
+    steps['ttfb'] = ttfb
+    steps['page'] = total
+    steps['page_status'] = status
+
+    # Render-blocking stylesheets (from cache when warm: no request at all)
+    css_time = 0.0
+    if status == 200:
+        cache['/body'] = body
+    html = cache.get('/body', b'').decode('utf-8', 'replace')
+    for href in re.findall(r'<link[^>]+rel="?stylesheet"?[^>]+href="?([^" >]+)', html):
+        if href not in cache:
+            _, _, css_total, _ = fetch(conn, href, cache)
+            css_time += css_total
+    steps['css'] = css_time
+    steps['first_paint'] = time.perf_counter() - start
+    conn.close()
+    return steps
+
+
+def summary(values):
+    values = sorted(v for v in values if v is not None)
+    if not values:
+        return '(none)'
+    p50 = values[len(values) // 2]
+    p90 = values[min(len(values) - 1, int(0.9 * len(values)))]
+    return 'p50 %6.1f  p90 %6.1f  max %6.1f ms' % (p50 * 1e3, p90 * 1e3, values[-1] * 1e3)
+
+
+def measure(args):
+    results = {'cold': [], 'warm': []}
+    for _ in range(args.runs):
+        cache = {}
+        results['cold'].append(load(args, cache))
+        results['warm'].append(load(args, cache))
+
+    for kind in ('cold', 'warm'):
+        runs = results[kind]
+        print('%s cache (%d loads, page status %s):' % (
+            kind, len(runs), sorted(set(r['page_status'] for r in runs))))
+        for step in ('dns', 'connect', 'probe', 'ttfb', 'page', 'css', 'first_paint'):
+            print('  %-12s %s' % (step, summary([r[step] for r in runs])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='mode', required=True)
+    serve_parser = sub.add_parser('serve', help='serve the compiled page and a captive DNS responder')
+    serve_parser.add_argument('--bind', default='0.0.0.0')
+    serve_parser.add_argument('--address', default='127.0.0.1', help='address returned by DNS and redirects')
+    serve_parser.add_argument('--port', type=int, default=8080)
+    serve_parser.add_argument('--dns-port', type=int, default=5353)
+    serve_parser.add_argument('--delay-ms', type=float, default=0.0, help='delay before each response')
+    measure_parser = sub.add_parser('measure', help='measure cold and warm page loads')
+    measure_parser.add_argument('--host', default='192.168.4.1')
+    measure_parser.add_argument('--port', type=int, default=80)
+    measure_parser.add_argument('--dns-port', type=int, default=53)
+    measure_parser.add_argument('--runs', type=int, default=20)
+    args = parser.parse_args()
+
+    if args.mode == 'serve':
+        serve(args)
+    else:
+        measure(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Convert an event trace dump (main/lib/trace) into Chrome/Perfetto trace JSON.
+
+The dump comes from GET /trace on the status server while the clock is online for a
+sync; it needs the device token printed on the serial console after boot. Open the output in
+https://ui.perfetto.dev or chrome://tracing; one track per task. A summary of span
+durations (count, mean, max) is printed as well.
+
+Usage:
+  trace_decode.py http://<device IP>/trace --token <device token> -o trace.json
+  trace_decode.py trace.bin -o trace.json      (saved with --save or curl -o trace.bin ...)
+"""
+
+import argparse
+import json
+import struct
+import sys
+import urllib.error
+import urllib.request
+
+# Keep in sync with main/lib/trace/trace.h
+MAGIC = b'PXTR'
+VERSION = 1
+HEADER = struct.Struct('<4sBBBBIIq')
+RECORD = struct.Struct('<IBBBBII')
+TASK_NAME = 16
+TASK_ISR = 0xFF
+
+# main.c s_net_state_names
+NET_STATES = ['idle', 'connecting', 'backoff', 'syncing', 'rtc_write', 'updating']
+
+# esp_wifi_types.h wifi_event_t / esp_netif_types.h ip_event_t (ESP-IDF 5.x)
+WIFI_EVENTS = [
+    'WIFI_READY', 'SCAN_DONE', 'STA_START', 'STA_STOP', 'STA_CONNECTED', 'STA_DISCONNECTED',
+    'STA_AUTHMODE_CHANGE', 'STA_WPS_ER_SUCCESS', 'STA_WPS_ER_FAILED', 'STA_WPS_ER_TIMEOUT',
+    'STA_WPS_ER_PIN', 'STA_WPS_ER_PBC_OVERLAP', 'AP_START', 'AP_STOP', 'AP_STACONNECTED',
+    'AP_STADISCONNECTED', 'AP_PROBEREQRECVED', 'FTM_REPORT', 'STA_BSS_RSSI_LOW',
+    'ACTION_TX_STATUS', 'ROC_DONE', 'STA_BEACON_TIMEOUT',
+]
+IP_EVENTS = ['STA_GOT_IP', 'STA_LOST_IP', 'AP_STAIPASSIGNED', 'GOT_IP6', 'ETH_GOT_IP',
+             'ETH_LOST_IP', 'PPP_GOT_IP', 'PPP_LOST_IP']
+
+
+def enum_name(names, value):
+    return names[value] if value < len(names) else str(value)
+
+
+# event id -> (name, function formatting arg0/arg1 into Chrome args)
+EVENTS = {
+    1: ('loop', lambda a0, a1: {'net_state': enum_name(NET_STATES, a0)}),
+    2: ('displayTime', lambda a0, a1: {}),
+    3: ('ssd1306_refresh', lambda a0, a1: {'ok': bool(a0)}),
+    4: ('ds3231_read_time', lambda a0, a1: {'ok': bool(a0)}),
+    5: ('wifi', lambda a0, a1: {'event': enum_name(WIFI_EVENTS, a0), 'reason': a1} if a1
+        else {'event': enum_name(WIFI_EVENTS, a0)}),
+    6: ('ip', lambda a0, a1: {'event': enum_name(IP_EVENTS, a0)}),
+    7: ('ntp_sync', lambda a0, a1: {'err': a0 - (1 << 32) if a0 & 0x80000000 else a0}),
+    8: ('trace_dump', lambda a0, a1: {'records': a0}),
+    9: ('frame', lambda a0, a1: {'interval_us': a0}),
+}
+
+
+def load(source, token=None):
+    if source.startswith('http://'):
+        request = urllib.request.Request(source)
+        if token:
+            request.add_header('Authorization', 'Bearer ' + token)
+        try:
+            with urllib.request.urlopen(request, timeout=30) as response:
+                return response.read()
+        except urllib.error.HTTPError as e:
+            sys.exit('%s: HTTP %d%s' % (source, e.code, ' (device token needed, see --token)' if e.code == 401 else ''))
+    with open(source, 'rb') as f:
+        return f.read()
+
+
+def parse(data):
+    """Return (tasks, records, info); record = (t_us, event, phase, task, arg0, arg1)."""
+    if len(data) < HEADER.size:
+        sys.exit('dump too short')
+    magic, version, record_size, task_count, _, written, count, now_us = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit('not a trace dump (magic %r, version %d, record size %d)' % (magic, version, record_size))
+    offset = HEADER.size
+    tasks = []
+    for i in range(task_count):
+        raw = data[offset + i * TASK_NAME:offset + (i + 1) * TASK_NAME]
+        tasks.append(raw.split(b'\0', 1)[0].decode('ascii', 'replace'))
+    offset += task_count * TASK_NAME
+    if len(data) < offset + count * RECORD.size:
+        sys.exit('dump truncated: %d of %d records' % ((len(data) - offset) // RECORD.size, count))
+
+    records = []
+    incomplete = 0
+    now_low = now_us & 0xFFFFFFFF
+    for i in range(count):
+        ts, event, phase, task, _, arg0, arg1 = RECORD.unpack_from(data, offset + i * RECORD.size)
+        if phase == 0:
+            incomplete += 1
+            continue
+        # Timestamps are the low 32 bits of esp_timer: the age relative to the dump is exact
+        # for records younger than 71 minutes
+        age = (now_low - ts) & 0xFFFFFFFF
+        records.append((now_us - age, event, chr(phase), task, arg0, arg1))
+    # Records are claimed before they are stamped, so tasks preempting each other can
+    # leave them slightly out of order
+    records.sort(key=lambda r: r[0])
+    info = {'written': written, 'count': count, 'incomplete': incomplete, 'now_us': now_us}
+    return tasks, records, info
+
+
+def convert(tasks, records):
+    """Chrome trace events; ends whose begin was overwritten in the ring are dropped."""
+    events = [{'ph': 'M', 'name': 'process_name', 'pid': 1, 'args': {'name': 'PIX_Clock'}}]
+    for tid, name in enumerate(tasks):
+        if name:
+            events.append({'ph': 'M', 'name': 'thread_name', 'pid': 1, 'tid': tid, 'args': {'name': name}})
+    events.append({'ph': 'M', 'name': 'thread_name', 'pid': 1, 'tid': TASK_ISR, 'args': {'name': 'isr'}})
+
+    depth = {}
+    open_spans = {}
+    spans = {}
+    for t_us, event, phase, task, arg0, arg1 in records:
+        name, fmt = EVENTS.get(event, ('event_%d' % event, lambda a0, a1: {'arg0': a0, 'arg1': a1}))
+        doc = {'name': name, 'ph': phase, 'ts': t_us, 'pid': 1, 'tid': task}
+        key = (task, event)
+        if phase == 'B':
+            depth[key] = depth.get(key, 0) + 1
+            open_spans.setdefault(key, []).append(t_us)
+        elif phase == 'E':
+            if not depth.get(key):
+                continue
+            depth[key] -= 1
+            spans.setdefault(name, []).append(t_us - open_spans[key].pop())
+            doc['args'] = fmt(arg0, arg1)
+        elif phase == 'X':
+            doc['dur'] = arg1
+            doc['args'] = fmt(arg0, 0)
+            spans.setdefault(name, []).append(arg1)
+        else:
+            doc['s'] = 't'
+            doc['args'] = fmt(arg0, arg1)
+        events.append(doc)
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}, spans
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('source', help='dump file or http://<device IP>/trace')
+    parser.add_argument('-o', '--output', default='trace.json')
+    parser.add_argument('--save', help='also write the raw dump here')
+    parser.add_argument('--token', help='device token (printed on the serial console after boot)')
+    args = parser.parse_args()
+
+    data = load(args.source, args.token)
+    if args.save:
+        with open(args.save, 'wb') as f:
+            f.write(data)
+    tasks, records, info = parse(data)
+    trace, spans = convert(tasks, records)
+    with open(args.output, 'w') as f:
+        json.dump(trace, f, separators=(',', ':'))
+
+    span_us = records[-1][0] - records[0][0] if records else 0
+    print('%s: %d records over %.1f s (%d written since boot, %d overwritten, %d incomplete)' % (
+        args.output, len(records), span_us / 1e6, info['written'],
+        info['written'] - info['count'], info['incomplete']))
+    for name in sorted(spans):
+        durations = spans[name]
+        print('  %-18s %5d spans, mean %8.3f ms, max %8.3f ms' % (
+            name, len(durations), sum(durations) / len(durations) / 1000.0, max(durations) / 1000.0))
+
+
+if __name__ == '__main__':
+    main()
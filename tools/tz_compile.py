@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""Compile POSIX TZ rules into the transition table used by main/lib/tz.
+
+Input is a text file with one zone per line: "<IANA name> <POSIX TZ rule> <first year>".
+The rule is the footer line of the IANA zone file (what `tail -n1` of the
+compiled zoneinfo file prints), e.g. "CET-1CEST,M3.5.0,M10.5.0/3". The footer
+only describes the current rule, so <first year> records the first year it
+fully covers; the table is exact from then on and extrapolates before it.
+
+Every transition instant between TZ_FIRST_YEAR and TZ_LAST_YEAR is
+precomputed in UTC, so the firmware never parses rule strings. Zones that
+switch at the same UTC instants (e.g. all EU zones) share one transition list.
+
+Usage: tz_compile.py <zones.txt> <output.c>
+"""
+
+import datetime
+import re
+import sys
+
+TZ_FIRST_YEAR = 2000
+TZ_LAST_YEAR = 2099
+
+EPOCH = datetime.datetime(1970, 1, 1)
+
+
+class RuleError(Exception):
+    pass
+
+
+def parse_name(s, pos):
+    if s[pos:pos + 1] == '<':
+        end = s.index('>', pos)
+        return s[pos + 1:end], end + 1
+    m = re.compile(r'[A-Za-z]{3,}').match(s, pos)
+    if not m:
+        raise RuleError('expected zone abbreviation at %d' % pos)
+    return m.group(0), m.end()
+
+
+def parse_hms(s, pos):
+    """Parse [+-]hh[:mm[:ss]] and return seconds."""
+    m = re.compile(r'([+-]?)(\d{1,3})(?::(\d{2}))?(?::(\d{2}))?').match(s, pos)
+    if not m:
+        raise RuleError('expected time at %d' % pos)
+    sign = -1 if m.group(1) == '-' else 1
+    secs = int(m.group(2)) * 3600 + int(m.group(3) or 0) * 60 + int(m.group(4) or 0)
+    return sign * secs, m.end()
+
+
+def parse_date(s, pos):
+    """Parse Mm.w.d, Jn or n, optionally followed by /time (default 02:00)."""
+    m = re.compile(r'M(\d{1,2})\.(\d)\.(\d)|J(\d{1,3})|(\d{1,3})').match(s, pos)
+    if not m:
+        raise RuleError('expected transition date at %d' % pos)
+    if m.group(1):
+        date = ('M', int(m.group(1)), int(m.group(2)), int(m.group(3)))
+    elif m.group(4):
+        date = ('J', int(m.group(4)))
+    else:
+        date = ('n', int(m.group(5)))
+    pos = m.end()
+    secs = 2 * 3600
+    if s[pos:pos + 1] == '/':
+        secs, pos = parse_hms(s, pos + 1)
+    return date, secs, pos
+
+
+def parse_rule(rule):
+    """Return (std_offset, dst_offset, start, end); offsets are seconds east of UTC."""
+    _, pos = parse_name(rule, 0)
+    std, pos = parse_hms(rule, pos)
+    std = -std  # POSIX offsets are west of UTC
+    if pos == len(rule):
+        return std, None, None, None
+
+    _, pos = parse_name(rule, pos)
+    dst = std + 3600
+    if pos < len(rule) and rule[pos] != ',':
+        dst, pos = parse_hms(rule, pos)
+        dst = -dst
+    if rule[pos:pos + 1] != ',':
+        raise RuleError('DST rule without transition dates is not supported')
+    start_date, start_secs, pos = parse_date(rule, pos + 1)
+    if rule[pos:pos + 1] != ',':
+        raise RuleError('missing DST end date')
+    end_date, end_secs, pos = parse_date(rule, pos + 1)
+    if pos != len(rule):
+        raise RuleError('trailing characters: %r' % rule[pos:])
+    return std, dst, (start_date, start_secs), (end_date, end_secs)
+
+
+def local_date(year, date):
+    kind = date[0]
+    if kind == 'M':
+        _, month, week, wday = date
+        first = datetime.date(year, month, 1)
+        # POSIX weekday: 0 = Sunday; Python: 0 = Monday
+        day = 1 + (wday - (first.weekday() + 1) % 7) % 7 + (week - 1) * 7
+        if week == 5:
+            nxt = datetime.date(year + (month == 12), month % 12 + 1, 1)
+            last = (nxt - first).days
+            while day > last:
+                day -= 7
+        return datetime.date(year, month, day)
+    if kind == 'J':
+        # Julian day 1-365, February 29 is never counted
+        d = datetime.date(year, 1, 1) + datetime.timedelta(days=date[1] - 1)
+        if date[1] >= 60 and year % 4 == 0 and (year % 100 != 0 or year % 400 == 0):
+            d += datetime.timedelta(days=1)
+        return d
+    return datetime.date(year, 1, 1) + datetime.timedelta(days=date[1])
+
+
+def transition_utc(year, spec, offset_before):
+    date, secs = spec
+    local = datetime.datetime.combine(local_date(year, date), datetime.time()) + datetime.timedelta(seconds=secs)
+    return int((local - EPOCH).total_seconds()) - offset_before
+
+
+def compile_zone(rule):
+    std, dst, start, end = parse_rule(rule)
+    if dst is None:
+        return std, std, []
+    events = []
+    for year in range(TZ_FIRST_YEAR, TZ_LAST_YEAR + 1):
+        events.append((transition_utc(year, start, std), True))
+        events.append((transition_utc(year, end, dst), False))
+    events.sort()
+    for a, b in zip(events, events[1:]):
+        if a[1] == b[1]:
+            raise RuleError('transitions do not alternate')
+    return std, dst, events
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+
+    zones = []
+    with open(sys.argv[1]) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            try:
+                name, rule, first_year = line.split()
+                first_year = int(first_year)
+            except ValueError:
+                sys.exit('%s:%d: expected "<name> <rule> <first year>"' % (sys.argv[1], lineno))
+            if len(name) >= 32:
+                sys.exit('%s:%d: zone name too long: %s' % (sys.argv[1], lineno, name))
+            if not TZ_FIRST_YEAR <= first_year <= TZ_LAST_YEAR:
+                sys.exit('%s:%d: first year %d outside %d-%d' % (sys.argv[1], lineno, first_year,
+                                                                TZ_FIRST_YEAR, TZ_LAST_YEAR))
+            try:
+                zones.append((name, rule, first_year) + compile_zone(rule))
+            except (RuleError, ValueError) as e:
+                sys.exit('%s:%d: %s: %s' % (sys.argv[1], lineno, rule, e))
+
+    # Share identical transition lists
+    lists = {}
+    for z in zones:
+        instants = tuple(t for t, _ in z[5])
+        if instants and instants not in lists:
+            lists[instants] = 'tz_list_%d' % len(lists)
+
+    out = []
+    out.append('// Generated by tools/tz_compile.py from %s, do not edit' % sys.argv[1].replace('\\', '/').split('/')[-1])
+    out.append('// Transitions cover %d-%d' % (TZ_FIRST_YEAR, TZ_LAST_YEAR))
+    out.append('')
+    out.append('#include "tz.h"')
+    out.append('')
+    for instants, ident in lists.items():
+        out.append('static const uint32_t %s[%d] = {' % (ident, len(instants)))
+        for i in range(0, len(instants), 6):
+            out.append('    ' + ' '.join('%du,' % t for t in instants[i:i + 6]))
+        out.append('};')
+        out.append('')
+    out.append('const tz_zone_t tz_zones[] = {')
+    for name, rule, first_year, std, dst, events in zones:
+        instants = tuple(t for t, _ in events)
+        first_dst = 1 if events and events[0][1] else 0
+        out.append('    {"%s", %s, %d, %d, %d, %d, %d},  // %s' % (
+            name, lists.get(instants, 'NULL'), len(instants), std, dst, first_dst, first_year, rule))
+    out.append('};')
+    out.append('')
+    out.append('const size_t tz_zone_count = sizeof(tz_zones) / sizeof(tz_zones[0]);')
+    out.append('')
+
+    with open(sys.argv[2], 'w', newline='\n') as f:
+        f.write('\n'.join(out))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Compile the provisioning web page into the asset table used by main/lib/wifi_provisioning.
+
+The first input is the page served at "/". The other inputs are assets it
+references by file name (href="style.css", src="app.js"); they are served
+under content-hashed names (/style.<hash>.css), so they can be cached for a
+year and a firmware update still loads the new version. The page itself is
+revalidated with its ETag on every load (a 304 is ~100 bytes).
+
+Every file is minified (comments and redundant whitespace removed) and
+gzip-compressed with a fixed timestamp, so the output is reproducible.
+
+Usage: web_compile.py <output.c> <page.html> [asset...]
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+CONTENT_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+    '.png': 'image/png',
+}
+
+HASH_LEN = 8        # Hex digits of the content hash in asset names
+ETAG_LEN = 16       # Hex digits of the content hash in ETags
+
+
+def minify_html(text):
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    text = re.sub(r'>\s+<', '><', text)
+    return re.sub(r'\s+', ' ', text).strip()
+
+
+def minify_css(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'\s+', ' ', text)
+    text = re.sub(r'\s*([{};:,>])\s*', r'\1', text)
+    return text.replace(';}', '}').strip()
+
+
+def minify_js(text):
+    """Conservative: drop full-line comments and indentation, keep line breaks (no ASI surprises)."""
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith('//'):
+            lines.append(line)
+    return '\n'.join(lines)
+
+
+MINIFIERS = {'.html': minify_html, '.css': minify_css, '.js': minify_js}
+
+
+def c_bytes(data, indent='    ', per_line=16):
+    lines = []
+    for i in range(0, len(data), per_line):
+        lines.append(indent + ' '.join('0x%02x,' % b for b in data[i:i + per_line]))
+    return lines
+
+
+def compile_assets(paths):
+    """Minify and compress the page and its assets.
+
+    Returns [(uri, content type, gzip data, ETag, immutable, file name, minified size)],
+    the page first.
+    """
+    files = []
+    for path in paths:
+        ext = os.path.splitext(path)[1].lower()
+        if ext not in CONTENT_TYPES:
+            raise ValueError('%s: unsupported file type' % path)
+        with open(path, 'rb') as f:
+            data = f.read()
+        if ext in MINIFIERS:
+            data = MINIFIERS[ext](data.decode('utf-8')).encode('utf-8')
+        files.append((path, ext, data))
+
+    # Assets first: the page refers to their hashed names
+    assets = []
+    renames = {}
+    for path, ext, data in files[1:]:
+        name = os.path.basename(path)
+        stem = os.path.splitext(name)[0]
+        uri = '/%s.%s%s' % (stem, hashlib.sha256(data).hexdigest()[:HASH_LEN], ext)
+        renames[name] = uri
+        assets.append((uri, ext, data, True, name))
+
+    page, ext, data = files[0]
+    text = data.decode('utf-8')
+    for name, uri in renames.items():
+        pattern = r'''(\b(?:href|src)=["']?)%s(?=["'\s>])''' % re.escape(name)
+        text, n = re.subn(pattern, lambda m: m.group(1) + uri, text)
+        if n == 0:
+            raise ValueError('%s: %s is not referenced' % (page, name))
+    assets.insert(0, ('/', ext, text.encode('utf-8'), False, os.path.basename(page)))
+
+    result = []
+    for uri, ext, data, immutable, name in assets:
+        gz = gzip.compress(data, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha256(data).hexdigest()[:ETAG_LEN]
+        result.append((uri, CONTENT_TYPES[ext], gz, etag, immutable, name, len(data)))
+    return result
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write(__doc__)
+        return 2
+
+    try:
+        assets = compile_assets(sys.argv[2:])
+    except ValueError as e:
+        sys.exit(str(e))
+
+    out = []
+    out.append('// Generated by tools/web_compile.py from %s, do not edit' %
+               ', '.join(os.path.basename(p) for p in sys.argv[2:]))
+    out.append('')
+    out.append('#include "web_assets.h"')
+    out.append('')
+    table = []
+    for i, (uri, content_type, gz, etag, immutable, name, size) in enumerate(assets):
+        ident = 'web_asset_%d' % i
+        out.append('// %s: %d bytes minified, %d bytes gzip' % (name, size, len(gz)))
+        out.append('static const uint8_t %s[%d] = {' % (ident, len(gz)))
+        out.extend(c_bytes(gz))
+        out.append('};')
+        out.append('')
+        table.append('    {"%s", "%s", %s, sizeof(%s), "\\"%s\\"", %s},' % (
+            uri, content_type, ident, ident, etag.strip('"'), 'true' if immutable else 'false'))
+    out.append('const web_asset_t web_assets[] = {')
+    out.extend(table)
+    out.append('};')
+    out.append('')
+    out.append('const size_t web_asset_count = sizeof(web_assets) / sizeof(web_assets[0]);')
+    out.append('')
+
+    with open(sys.argv[1], 'w', newline='\n') as f:
+        f.write('\n'.join(out))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())